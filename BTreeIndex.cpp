@@ -0,0 +1,822 @@
+/**
+ * @file BTreeIndex.cpp - implementation of BTreeIndex and its nodes
+ * @see "Seattle University, CPSC5300"
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include "BTreeIndex.h"
+#include "HeapTable.h"
+
+using namespace std;
+typedef uint16_t u16;
+
+/*
+ * *********
+ * BTreeStat
+ * *********
+ */
+
+/**
+ * Bookkeeping for a brand new tree whose root is a leaf.
+ * @param file     the index file
+ * @param stat_id  which block to keep it in
+ * @param root_id  block of the root leaf
+ */
+BTreeStat::BTreeStat(HeapFile &file, BlockID stat_id, BlockID root_id) : file(file), stat_id(stat_id),
+                                                                         root_id(root_id), height(1) {
+}
+
+/**
+ * Read the bookkeeping of an existing tree.
+ * @param file     the index file
+ * @param stat_id  which block it is kept in
+ */
+BTreeStat::BTreeStat(HeapFile &file, BlockID stat_id) : file(file), stat_id(stat_id), root_id(0), height(0) {
+    SlottedPage *page = file.get(stat_id);
+    Dbt *data = page->get(1);
+    this->root_id = *(BlockID *) data->get_data();
+    delete data;
+    data = page->get(2);
+    this->height = *(uint32_t *) data->get_data();
+    delete data;
+    delete page;
+}
+
+/**
+ * Write the bookkeeping back to its block: record 1 is the root's block id, record 2 is the height.
+ */
+void BTreeStat::save() {
+    char block[DbBlock::BLOCK_SZ];
+    memset(block, 0, sizeof(block));
+    Dbt data(block, sizeof(block));
+    SlottedPage page(data, this->stat_id, true);
+    Dbt root(&this->root_id, sizeof(BlockID));
+    page.add(&root);
+    uint32_t height = this->height;
+    Dbt height_data(&height, sizeof(uint32_t));
+    page.add(&height_data);
+    this->file.put(&page);
+}
+
+
+/*
+ * *********
+ * BTreeNode
+ * *********
+ */
+
+/**
+ * Read this node's block.
+ * @param first     returned by reference: the block id in record 1
+ * @param keys      returned by reference: the entries
+ * @param pointers  if not nullptr, returned by reference: the block id following each entry
+ */
+void BTreeNode::read(BlockID &first, vector<BTreeKey> &keys, vector<BlockID> *pointers) {
+    SlottedPage *page = this->file.get(this->id);
+    RecordIDCursor *records = page->id_cursor();
+    RecordID record_id;
+    bool is_first = true;
+    while (records->next(record_id)) {
+        Dbt *data = page->get(record_id);
+        const char *bytes = (const char *) data->get_data();
+        if (is_first) {
+            first = *(BlockID *) bytes;
+            is_first = false;
+        } else {
+            keys.push_back(BTreeKey());
+            uint offset = unmarshal_index_entry(this->key_profile, bytes, keys.back());
+            if (pointers != nullptr)
+                pointers->push_back(*(BlockID *) (bytes + offset));
+        }
+        delete data;
+    }
+    delete records;
+    delete page;
+}
+
+/**
+ * Replace this node's block with the given contents.
+ * @param first     the block id for record 1
+ * @param keys      the entries
+ * @param pointers  if not nullptr, a block id to follow each entry
+ * @throws DbBlockNoRoomError if it doesn't all fit (in which case the block is left as it was)
+ */
+void BTreeNode::write(BlockID first, const vector<BTreeKey> &keys, const vector<BlockID> *pointers) {
+    char block[DbBlock::BLOCK_SZ];
+    memset(block, 0, sizeof(block));
+    Dbt data(block, sizeof(block));
+    SlottedPage page(data, this->id, true);
+    Dbt first_data(&first, sizeof(BlockID));
+    page.add(&first_data);
+    char bytes[MAX_INDEX_ENTRY_SZ + sizeof(BlockID)];
+    for (uint i = 0; i < keys.size(); i++) {
+        uint size = marshal_index_entry(this->key_profile, keys[i], bytes);
+        if (pointers != nullptr) {
+            *(BlockID *) (bytes + size) = (*pointers)[i];
+            size += sizeof(BlockID);
+        }
+        Dbt entry(bytes, size);
+        page.add(&entry);
+    }
+    this->file.put(&page);
+}
+
+
+/*
+ * *********
+ * BTreeLeaf
+ * *********
+ */
+
+/**
+ * Constructor
+ * @param file         the index file
+ * @param id           block of this leaf
+ * @param key_profile  data types of the search key
+ * @param create       true for a new, empty leaf (the block is only written by save())
+ */
+BTreeLeaf::BTreeLeaf(HeapFile &file, BlockID id, const KeyProfile &key_profile, bool create) : BTreeNode(file, id,
+                                                                                                         key_profile),
+                                                                                               next_leaf(0) {
+    if (!create)
+        read(this->next_leaf, this->entries, nullptr);
+}
+
+void BTreeLeaf::save() {
+    write(this->next_leaf, this->entries, nullptr);
+}
+
+uint BTreeLeaf::lower_bound(const BTreeKey &key) const {
+    return (uint) (std::lower_bound(this->entries.begin(), this->entries.end(), key) - this->entries.begin());
+}
+
+/**
+ * Add an entry, splitting this leaf in half if it no longer fits in its block.
+ * @param key       entry to add
+ * @param boundary  returned by reference if there was a split: smallest entry of the new sibling
+ * @return          the new right sibling if there was a split, else nullptr (freed by caller)
+ */
+BTreeLeaf *BTreeLeaf::insert(const BTreeKey &key, BTreeKey &boundary) {
+    this->entries.insert(this->entries.begin() + lower_bound(key), key);
+    try {
+        save();
+        return nullptr;
+    } catch (DbBlockNoRoomError &e) {
+        // split below
+    }
+    SlottedPage *page = this->file.get_new();
+    BTreeLeaf *sibling = new BTreeLeaf(this->file, page->get_block_id(), this->key_profile, true);
+    delete page;
+    uint half = (uint) this->entries.size() / 2;
+    sibling->entries.assign(this->entries.begin() + half, this->entries.end());
+    this->entries.resize(half);
+    sibling->next_leaf = this->next_leaf;
+    this->next_leaf = sibling->get_id();
+    sibling->save();
+    save();
+    boundary = sibling->entries.front();
+    return sibling;
+}
+
+bool BTreeLeaf::del(const BTreeKey &key) {
+    uint i = lower_bound(key);
+    if (i == this->entries.size() || this->entries[i] != key)
+        return false;
+    this->entries.erase(this->entries.begin() + i);
+    return true;
+}
+
+
+/*
+ * *************
+ * BTreeInterior
+ * *************
+ */
+
+/**
+ * Constructor
+ * @param file         the index file
+ * @param id           block of this node
+ * @param key_profile  data types of the search key
+ * @param create       true for a new, empty node (the block is only written by save())
+ */
+BTreeInterior::BTreeInterior(HeapFile &file, BlockID id, const KeyProfile &key_profile, bool create) : BTreeNode(
+        file, id, key_profile), first(0) {
+    if (!create)
+        read(this->first, this->boundaries, &this->pointers);
+}
+
+void BTreeInterior::save() {
+    write(this->first, this->boundaries, &this->pointers);
+}
+
+BlockID BTreeInterior::find(const BTreeKey &key) const {
+    uint i = (uint) (upper_bound(this->boundaries.begin(), this->boundaries.end(), key) - this->boundaries.begin());
+    return i == 0 ? this->first : this->pointers[i - 1];
+}
+
+/**
+ * Add a child, splitting this node in half if it no longer fits in its block. The middle boundary of a
+ * split moves up to the parent rather than staying in either half.
+ * @param boundary  smallest key under child
+ * @param child     the new child
+ * @param push_up   returned by reference if there was a split: the boundary for the parent
+ * @return          the new right sibling if there was a split, else nullptr (freed by caller)
+ */
+BTreeInterior *BTreeInterior::insert(const BTreeKey &boundary, BlockID child, BTreeKey &push_up) {
+    uint i = (uint) (upper_bound(this->boundaries.begin(), this->boundaries.end(), boundary) -
+                     this->boundaries.begin());
+    this->boundaries.insert(this->boundaries.begin() + i, boundary);
+    this->pointers.insert(this->pointers.begin() + i, child);
+    try {
+        save();
+        return nullptr;
+    } catch (DbBlockNoRoomError &e) {
+        // split below
+    }
+    SlottedPage *page = this->file.get_new();
+    BTreeInterior *sibling = new BTreeInterior(this->file, page->get_block_id(), this->key_profile, true);
+    delete page;
+    uint half = (uint) this->boundaries.size() / 2;
+    push_up = this->boundaries[half];
+    sibling->first = this->pointers[half];
+    sibling->boundaries.assign(this->boundaries.begin() + half + 1, this->boundaries.end());
+    sibling->pointers.assign(this->pointers.begin() + half + 1, this->pointers.end());
+    this->boundaries.resize(half);
+    this->pointers.resize(half);
+    sibling->save();
+    save();
+    return sibling;
+}
+
+
+/*
+ * **********
+ * BTreeIndex
+ * **********
+ */
+
+/**
+ * Constructor
+ * @param relation     table being indexed
+ * @param name         name of the index (unique for the table)
+ * @param key_columns  columns of the search key, in order
+ * @param unique       true if no two rows may have the same search key
+ */
+BTreeIndex::BTreeIndex(DbRelation &relation, Identifier name, ColumnNames key_columns, bool unique) : DbIndex(
+        relation, name, key_columns, unique), file(relation.get_table_name() + "-" + name), stat(nullptr),
+                                                                                                  closed(true),
+                                                                                                  fill_percent(
+                                                                                                          DEFAULT_FILL_PERCENT),
+                                                                                                  sort_memory(
+                                                                                                          IndexEntrySorter::DEFAULT_MEMORY) {
+    relation.get_column_numbers(&this->key_columns, this->key_column_numbers);
+    ColumnAttributes column_attributes = relation.get_column_attributes();
+    for (auto const &col_num: this->key_column_numbers)
+        this->key_profile.push_back(column_attributes[col_num].get_data_type());
+}
+
+BTreeIndex::~BTreeIndex() {
+    delete this->stat;
+}
+
+/**
+ * Create the index file and fill it with entries for every row already in the relation: scan the relation,
+ * sort its entries (spilling to temporary files if they exceed the sort memory) and build the tree bottom-up.
+ * @throws DbRelationError if the relation has duplicate keys for a unique index (the index is dropped)
+ */
+void BTreeIndex::create() {
+    this->file.create();  // makes block 1 for the stat
+    this->closed = false;
+
+    IndexEntrySorter sorter(this->key_profile, this->sort_memory);
+    HandleCursor *cursor = this->relation.select_cursor();
+    Handle handle;
+    while (cursor->next(handle)) {
+        KeyValue *key = this->relation.project_row(handle, &this->key_column_numbers);
+        sorter.add(BTreeKey(*key, handle));
+        delete key;
+    }
+    delete cursor;
+
+    IndexEntryCursor *entries = sorter.sorted();
+    try {
+        bulk_load(entries);
+    } catch (DbRelationError &e) {
+        delete entries;
+        drop();
+        throw;
+    }
+    delete entries;
+}
+
+void BTreeIndex::drop() {
+    this->file.drop();
+    delete this->stat;
+    this->stat = nullptr;
+    this->closed = true;
+}
+
+void BTreeIndex::open() {
+    if (!this->closed)
+        return;
+    this->file.open();
+    this->stat = new BTreeStat(this->file, STAT);
+    this->closed = false;
+}
+
+void BTreeIndex::close() {
+    this->file.close();
+    delete this->stat;
+    this->stat = nullptr;
+    this->closed = true;
+}
+
+void BTreeIndex::set_fill_percent(uint fill_percent) {
+    this->fill_percent = fill_percent < 50 ? 50 : fill_percent > 100 ? 100 : fill_percent;
+}
+
+/**
+ * Find the rows with the given search key.
+ * @param key_values  value for each of the key columns
+ * @return            handles of the matching rows (freed by caller)
+ */
+Handles *BTreeIndex::lookup(ValueDict *key_values) const {
+    KeyValue *key = make_index_key(this->key_columns, key_values);
+    Handles *handles = scan(key, key);
+    delete key;
+    return handles;
+}
+
+/**
+ * Find the rows with search keys between min_key and max_key (inclusive).
+ * @param min_key  lowest key (nullptr for no lower limit)
+ * @param max_key  highest key (nullptr for no upper limit)
+ * @return         handles of the matching rows, in key order (freed by caller)
+ */
+Handles *BTreeIndex::range(ValueDict *min_key, ValueDict *max_key) const {
+    KeyValue *min_tkey = min_key == nullptr ? nullptr : make_index_key(this->key_columns, min_key);
+    KeyValue *max_tkey = max_key == nullptr ? nullptr : make_index_key(this->key_columns, max_key);
+    Handles *handles = scan(min_tkey, max_tkey);
+    delete min_tkey;
+    delete max_tkey;
+    return handles;
+}
+
+/**
+ * Add the entry for a row just inserted into the relation.
+ * @param record  the new row
+ * @throws DbRelationError if this is a unique index and the key is already there
+ */
+void BTreeIndex::insert(Handle record) {
+    open();
+    KeyValue *key = this->relation.project_row(record, &this->key_column_numbers);
+    BTreeKey entry(*key, record);
+    delete key;
+    insert_entry(entry);
+}
+
+/**
+ * Remove the entry for a row about to be deleted from the relation.
+ * @param record  the row (must still be in the relation)
+ */
+void BTreeIndex::del(Handle record) {
+    open();
+    KeyValue *key = this->relation.project_row(record, &this->key_column_numbers);
+    BTreeKey entry(*key, record);
+    delete key;
+    BTreeLeaf *leaf = find_leaf(&entry);
+    if (leaf->del(entry))
+        leaf->save();
+    delete leaf;
+}
+
+/**
+ * The entries are sorted, so all of those in a leaf come together and each leaf is read and written once.
+ */
+void BTreeIndex::del_batch(const Handles &records) {
+    open();
+    vector<BTreeKey> entries;
+    entries.reserve(records.size());
+    for (auto const &record: records) {
+        KeyValue *key = this->relation.project_row(record, &this->key_column_numbers);
+        entries.push_back(BTreeKey(*key, record));
+        delete key;
+    }
+    sort(entries.begin(), entries.end());
+    BTreeLeaf *leaf = nullptr;
+    bool changed = false;
+    for (auto const &entry: entries) {
+        // a leaf holds everything between its first and last entries, so anything else is in some other leaf
+        if (leaf == nullptr || leaf->get_entries().empty() || entry < leaf->get_entries().front() ||
+            leaf->get_entries().back() < entry) {
+            if (leaf != nullptr && changed)
+                leaf->save();
+            delete leaf;
+            leaf = find_leaf(&entry);
+            changed = false;
+        }
+        if (leaf->del(entry))
+            changed = true;
+    }
+    if (leaf != nullptr && changed)
+        leaf->save();
+    delete leaf;
+}
+
+/**
+ * Build the tree from entries in sorted order, one level at a time from the leaves up.
+ * @param entries  all the entries, in order
+ * @throws DbRelationError if this is a unique index and two entries have the same key
+ */
+void BTreeIndex::bulk_load(IndexEntryCursor *entries) {
+    const uint limit = DbBlock::BLOCK_SZ * this->fill_percent / 100;
+    const uint empty = 4 + 4 + sizeof(BlockID);  // page header and record 1 with its slot
+    char bytes[MAX_INDEX_ENTRY_SZ];
+    vector<pair<BTreeKey, BlockID>> level;  // smallest key and block of each node of the level just built
+
+    SlottedPage *page = this->file.get_new();
+    BTreeLeaf *leaf = new BTreeLeaf(this->file, page->get_block_id(), this->key_profile, true);
+    delete page;
+    uint used = empty;
+    BTreeKey entry;
+    while (entries->next(entry)) {
+        const vector<BTreeKey> &so_far = leaf->get_entries();
+        if (this->unique && !so_far.empty() && so_far.back().first == entry.first) {
+            delete leaf;
+            throw DbRelationError("duplicate key for unique index " + this->name);
+        }
+        uint size = 4 + marshal_index_entry(this->key_profile, entry, bytes);
+        if (!so_far.empty() && used + size > limit) {
+            page = this->file.get_new();
+            BlockID next_id = page->get_block_id();
+            delete page;
+            leaf->set_next_leaf(next_id);
+            leaf->save();
+            level.push_back(make_pair(so_far.front(), leaf->get_id()));
+            delete leaf;
+            leaf = new BTreeLeaf(this->file, next_id, this->key_profile, true);
+            used = empty;
+        }
+        leaf->append(entry);
+        used += size;
+    }
+    leaf->save();
+    level.push_back(make_pair(leaf->get_entries().empty() ? BTreeKey() : leaf->get_entries().front(),
+                              leaf->get_id()));
+    delete leaf;
+
+    uint height = 1;
+    while (level.size() > 1) {
+        vector<pair<BTreeKey, BlockID>> parents;
+        BTreeInterior *node = nullptr;
+        uint children = 0;
+        for (auto const &child: level) {
+            uint size = 4 + marshal_index_entry(this->key_profile, child.first, bytes) + sizeof(BlockID);
+            if (node == nullptr || (children > 1 && used + size > limit)) {
+                if (node != nullptr) {
+                    node->save();
+                    delete node;
+                }
+                page = this->file.get_new();
+                node = new BTreeInterior(this->file, page->get_block_id(), this->key_profile, true);
+                delete page;
+                node->set_first(child.second);
+                parents.push_back(make_pair(child.first, node->get_id()));
+                used = empty;
+                children = 1;
+            } else {
+                node->append(child.first, child.second);
+                used += size;
+                children++;
+            }
+        }
+        node->save();
+        delete node;
+        level.swap(parents);
+        height++;
+    }
+
+    this->stat = new BTreeStat(this->file, STAT, level.front().second);
+    this->stat->set_height(height);
+    this->stat->save();
+}
+
+/**
+ * Descend to the leaf where the given entry is or would go.
+ * @param key  entry to look for (nullptr for the leftmost leaf)
+ * @return     the leaf (freed by caller)
+ */
+BTreeLeaf *BTreeIndex::find_leaf(const BTreeKey *key) const {
+    BlockID node_id = this->stat->get_root_id();
+    for (uint depth = 1; depth < this->stat->get_height(); depth++) {
+        BTreeInterior node(this->file, node_id, this->key_profile);
+        node_id = key == nullptr ? node.find(BTreeKey()) : node.find(*key);
+    }
+    return new BTreeLeaf(this->file, node_id, this->key_profile);
+}
+
+/**
+ * Walk the leaves from min_key to max_key.
+ * @param min_key  lowest key (nullptr for no lower limit)
+ * @param max_key  highest key (nullptr for no upper limit)
+ * @return         handles of the matching rows, in key order (freed by caller)
+ */
+Handles *BTreeIndex::scan(const KeyValue *min_key, const KeyValue *max_key) const {
+    if (this->closed)
+        throw DbRelationError("index " + this->name + " is not open");
+    Handles *handles = new Handles();
+    BTreeKey start(min_key == nullptr ? KeyValue() : *min_key, Handle(0, 0));  // sorts before any real entry
+    BTreeLeaf *leaf = find_leaf(min_key == nullptr ? nullptr : &start);
+    uint i = min_key == nullptr ? 0 : leaf->lower_bound(start);
+    while (true) {
+        const vector<BTreeKey> &entries = leaf->get_entries();
+        for (; i < entries.size(); i++) {
+            if (max_key != nullptr && *max_key < entries[i].first) {
+                delete leaf;
+                return handles;
+            }
+            handles->push_back(entries[i].second);
+        }
+        BlockID next_leaf = leaf->get_next_leaf();
+        delete leaf;
+        if (next_leaf == 0)
+            return handles;
+        leaf = new BTreeLeaf(this->file, next_leaf, this->key_profile);
+        i = 0;
+    }
+}
+
+/**
+ * Insert an entry, splitting nodes on the way back up as needed and growing a new root if the old one
+ * splits.
+ * @param key  the entry
+ * @throws DbRelationError if this is a unique index and the search key is already there
+ */
+void BTreeIndex::insert_entry(const BTreeKey &key) {
+    vector<BlockID> path;
+    BlockID node_id = this->stat->get_root_id();
+    for (uint depth = 1; depth < this->stat->get_height(); depth++) {
+        path.push_back(node_id);
+        BTreeInterior node(this->file, node_id, this->key_profile);
+        node_id = node.find(key);
+    }
+    BTreeLeaf leaf(this->file, node_id, this->key_profile);
+    if (this->unique) {
+        // any entry with the same search key would be right next to ours, usually in this same leaf
+        const vector<BTreeKey> &entries = leaf.get_entries();
+        uint i = leaf.lower_bound(key);
+        bool duplicate;
+        if (i > 0 && (i < entries.size() || leaf.get_next_leaf() == 0)) {
+            duplicate = entries[i - 1].first == key.first || (i < entries.size() && entries[i].first == key.first);
+        } else {
+            Handles *handles = scan(&key.first, &key.first);
+            duplicate = !handles->empty();
+            delete handles;
+        }
+        if (duplicate)
+            throw DbRelationError("duplicate key for unique index " + this->name);
+    }
+    BTreeKey boundary;
+    BTreeLeaf *split_leaf = leaf.insert(key, boundary);
+    if (split_leaf == nullptr)
+        return;
+    BlockID split_id = split_leaf->get_id();
+    delete split_leaf;
+
+    while (!path.empty()) {
+        BTreeInterior parent(this->file, path.back(), this->key_profile);
+        path.pop_back();
+        BTreeKey push_up;
+        BTreeInterior *split_parent = parent.insert(boundary, split_id, push_up);
+        if (split_parent == nullptr)
+            return;
+        split_id = split_parent->get_id();
+        delete split_parent;
+        boundary = push_up;
+    }
+
+    // the root split, so the tree gets taller
+    SlottedPage *page = this->file.get_new();
+    BTreeInterior root(this->file, page->get_block_id(), this->key_profile, true);
+    delete page;
+    root.set_first(this->stat->get_root_id());
+    BTreeKey unused;
+    root.insert(boundary, split_id, unused);
+    this->stat->set_root_id(root.get_id());
+    this->stat->set_height(this->stat->get_height() + 1);
+    this->stat->save();
+}
+
+
+/**
+ * Test BTreeIndex: lookups, ranges, duplicate keys, deletes and unique checking on a table big enough for
+ * the tree to need a few levels.
+ * @return true if the tests all succeeded
+ */
+bool test_btree() {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    HeapTable table("_test_btree_cpp", column_names, column_attributes);
+    table.create_if_not_exists();
+    ValueDict row;
+    const int N = 10000;
+    for (int i = 0; i < N; i++) {
+        row["a"] = Value(i);
+        row["b"] = Value(-i);
+        table.insert(&row);
+    }
+
+    // built from existing rows
+    ColumnNames key_columns;
+    key_columns.push_back("a");
+    BTreeIndex index(table, "fooindex", key_columns, true);
+    index.create();
+    table.attach_index(&index);
+
+    // maintained on insert
+    for (int i = N; i < 2 * N; i++) {
+        row["a"] = Value(i);
+        row["b"] = Value(-i);
+        table.insert(&row);
+    }
+
+    ValueDict lookup;
+    for (int i = 0; i < 2 * N; i += 97) {
+        lookup["a"] = Value(i);
+        Handles *handles = index.lookup(&lookup);
+        bool ok = handles->size() == 1;
+        if (ok) {
+            ValueDict *result = table.project((*handles)[0]);
+            ok = (*result)["b"].n == -i;
+            delete result;
+        }
+        delete handles;
+        if (!ok)
+            return assertion_failure("btree lookup", i);
+    }
+    lookup["a"] = Value(2 * N);
+    Handles *handles = index.lookup(&lookup);
+    if (!handles->empty())
+        return assertion_failure("btree lookup of missing key");
+    delete handles;
+
+    ValueDict max_key;
+    lookup["a"] = Value(100);
+    max_key["a"] = Value(199);
+    handles = index.range(&lookup, &max_key);
+    bool ok = handles->size() == 100;
+    for (uint i = 0; ok && i < handles->size(); i++) {
+        ValueDict *result = table.project((*handles)[i]);
+        ok = (*result)["a"].n == (int) (100 + i);
+        delete result;
+    }
+    delete handles;
+    if (!ok)
+        return assertion_failure("btree range");
+    handles = index.range(nullptr, nullptr);
+    if (handles->size() != 2 * N)
+        return assertion_failure("btree full range", handles->size());
+    delete handles;
+
+    // unique
+    row["a"] = Value(5);
+    try {
+        table.insert(&row);
+        return assertion_failure("btree unique");
+    } catch (DbRelationError &e) {
+        // expected
+    }
+    handles = table.select();
+    if (handles->size() != 2 * N)
+        return assertion_failure("row left behind by failed insert");
+    delete handles;
+
+    // maintained on delete (and select uses the index)
+    ValueDict where;
+    where["a"] = Value(12345);
+    handles = table.select(&where);
+    if (handles->size() != 1)
+        return assertion_failure("select via btree");
+    table.del((*handles)[0]);
+    delete handles;
+    lookup["a"] = Value(12345);
+    handles = index.lookup(&lookup);
+    if (!handles->empty())
+        return assertion_failure("btree del");
+    delete handles;
+
+    // non-unique, on a column with lots of duplicates
+    key_columns.clear();
+    key_columns.push_back("b");
+    table.detach_index(&index);
+    index.drop();
+    for (int i = 0; i < 1000; i++) {
+        row["a"] = Value(i);
+        row["b"] = Value(7);
+        table.insert(&row);
+    }
+    BTreeIndex not_unique(table, "bazindex", key_columns, true);
+    try {
+        not_unique.create();
+        return assertion_failure("btree unique create");
+    } catch (DbRelationError &e) {
+        // expected
+    }
+
+    // bulk built with sort runs spilled to temporary files and half-full nodes
+    BTreeIndex dups(table, "barindex", key_columns, false);
+    dups.set_sort_memory(20000);
+    dups.set_fill_percent(50);
+    dups.create();
+    lookup.clear();
+    lookup["b"] = Value(7);
+    handles = dups.lookup(&lookup);
+    ok = handles->size() == 1000;
+    delete handles;
+    handles = dups.range(nullptr, nullptr);
+    ok = ok && handles->size() == 2 * N - 1 + 1000;
+    int previous = -2 * N;
+    for (uint i = 0; ok && i < handles->size(); i++) {
+        ValueDict *result = table.project((*handles)[i]);
+        ok = (*result)["b"].n >= previous;
+        previous = (*result)["b"].n;
+        delete result;
+    }
+    delete handles;
+    dups.drop();
+    table.drop();
+    if (!ok)
+        return assertion_failure("btree duplicates");
+
+    // too big counting all the columns (and the handle), even without any text
+    KeyProfile wide_profile(MAX_INDEX_ENTRY_SZ / sizeof(int32_t), ColumnAttribute::DataType::INT);
+    IndexEntry wide_entry(KeyValue(wide_profile.size(), Value(1)), Handle(1, 1));
+    char bytes[MAX_INDEX_ENTRY_SZ];
+    try {
+        marshal_index_entry(wide_profile, wide_entry, bytes);
+        return assertion_failure("index entry over MAX_INDEX_ENTRY_SZ");
+    } catch (DbRelationError &e) {
+        // expected
+    }
+    return true;
+}
+
+/**
+ * Benchmark point lookups through a BTreeIndex against select() with a where clause, which has to scan.
+ * @param rows  how many rows to load
+ */
+void benchmark_btree(uint rows) {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    HeapTable table("_benchmark_btree_cpp", column_names, column_attributes);
+    table.create_if_not_exists();
+    ValueDict row;
+    for (uint i = 0; i < rows; i++) {
+        row["a"] = Value(i);
+        row["b"] = Value("row number " + to_string(i));
+        table.insert(&row);
+    }
+    ColumnNames key_columns;
+    key_columns.push_back("a");
+    BTreeIndex index(table, "benchmark", key_columns, true);
+    auto start = chrono::steady_clock::now();
+    index.create();
+    double create_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    const uint LOOKUPS = 1000;
+    ValueDict where;
+    start = chrono::steady_clock::now();
+    uint found = 0;
+    for (uint i = 0; i < LOOKUPS; i++) {
+        where["a"] = Value((i * 7919) % rows);
+        Handles *handles = index.lookup(&where);
+        found += handles->size();
+        delete handles;
+    }
+    double lookup_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    const uint SCANS = 10;
+    start = chrono::steady_clock::now();
+    for (uint i = 0; i < SCANS; i++) {
+        where["a"] = Value((i * 7919) % rows);
+        Handles *handles = table.select(&where);
+        found += handles->size();
+        delete handles;
+    }
+    double scan_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    cout << "btree on " << rows << " rows: create " << create_ms << " ms, lookup " << lookup_ms * 1000 / LOOKUPS
+         << " us each, scanning select " << scan_ms * 1000 / SCANS << " us each (" << found << " found)" << endl;
+    index.drop();
+    table.drop();
+}
@@ -0,0 +1,259 @@
+/**
+ * @file BTreeIndex.h - Implementation of DbIndex with a B+ tree.
+ * BTreeStat
+ * BTreeNode
+ * BTreeLeaf: BTreeNode
+ * BTreeInterior: BTreeNode
+ * BTreeIndex: DbIndex
+ *
+ * @see "Seattle University, CPSC5300, Spring 2021"
+ */
+#pragma once
+
+#include "storage_engine.h"
+#include "HeapFile.h"
+#include "IndexKey.h"
+#include "ExternalSort.h"
+
+/**
+ * The tree is ordered by search key and then handle. That makes every entry distinct, so duplicate search
+ * keys (in a non-unique index) need no special handling.
+ */
+typedef IndexEntry BTreeKey;
+
+/**
+ * @class BTreeStat - the tree's bookkeeping, kept in block 1 of the index file
+ */
+class BTreeStat {
+public:
+    BTreeStat(HeapFile &file, BlockID stat_id, BlockID root_id);
+
+    BTreeStat(HeapFile &file, BlockID stat_id);
+
+    virtual ~BTreeStat() {}
+
+    virtual void save();
+
+    BlockID get_root_id() const { return root_id; }
+
+    void set_root_id(BlockID root_id) { this->root_id = root_id; }
+
+    uint get_height() const { return height; }
+
+    void set_height(uint height) { this->height = height; }
+
+protected:
+    HeapFile &file;
+    BlockID stat_id;
+    BlockID root_id;
+    uint height;  // 1 if the root is a leaf
+};
+
+/**
+ * @class BTreeNode - base class for the nodes of the tree, one per block of the index file
+ *
+ *      A node is read into memory in its entirety when it is constructed and written out in its entirety
+ *      by save(). Its records are:
+ *          record 1: a block id (the next leaf for a leaf, the leftmost child for an interior node)
+ *          record 2, ...: the node's entries in key order
+ */
+class BTreeNode {
+public:
+    BTreeNode(HeapFile &file, BlockID id, const KeyProfile &key_profile) : file(file), id(id),
+                                                                             key_profile(key_profile) {}
+
+    virtual ~BTreeNode() {}
+
+    /**
+     * Write this node back to its block.
+     * @throws DbBlockNoRoomError if the node has too many entries for one block (caller should split it)
+     */
+    virtual void save() = 0;
+
+    BlockID get_id() const { return id; }
+
+protected:
+    HeapFile &file;
+    BlockID id;
+    const KeyProfile &key_profile;
+
+    virtual void read(BlockID &first, std::vector<BTreeKey> &keys, std::vector<BlockID> *pointers);
+
+    virtual void write(BlockID first, const std::vector<BTreeKey> &keys, const std::vector<BlockID> *pointers);
+};
+
+/**
+ * @class BTreeLeaf - holds (search key, handle) entries; leaves are chained left to right via next_leaf
+ */
+class BTreeLeaf : public BTreeNode {
+public:
+    BTreeLeaf(HeapFile &file, BlockID id, const KeyProfile &key_profile, bool create = false);
+
+    virtual ~BTreeLeaf() {}
+
+    virtual void save();
+
+    /**
+     * Position of the first entry not less than key (entries.size() if none).
+     */
+    virtual uint lower_bound(const BTreeKey &key) const;
+
+    /**
+     * Add an entry.
+     * @param key       entry to add (must not already be there)
+     * @param boundary  returned by reference if there was a split: smallest entry of the new sibling
+     * @returns         the new right sibling if this leaf had to be split, else nullptr (freed by caller)
+     */
+    virtual BTreeLeaf *insert(const BTreeKey &key, BTreeKey &boundary);
+
+    /**
+     * Remove an entry (in memory only until save(); leaves are never merged, so a leaf may end up empty).
+     * @param key  entry to remove
+     * @returns    false if it wasn't there
+     */
+    virtual bool del(const BTreeKey &key);
+
+    /**
+     * Add an entry after all the others (for bulk loading, where entries arrive in order).
+     * @param key  entry to add
+     */
+    virtual void append(const BTreeKey &key) { this->entries.push_back(key); }
+
+    const std::vector<BTreeKey> &get_entries() const { return entries; }
+
+    BlockID get_next_leaf() const { return next_leaf; }
+
+    void set_next_leaf(BlockID next_leaf) { this->next_leaf = next_leaf; }
+
+protected:
+    std::vector<BTreeKey> entries;
+    BlockID next_leaf;  // 0 for the rightmost leaf
+};
+
+/**
+ * @class BTreeInterior - holds boundaries and child pointers: keys less than boundaries[0] are under first,
+ *                        keys from boundaries[i] up to boundaries[i+1] are under pointers[i]
+ */
+class BTreeInterior : public BTreeNode {
+public:
+    BTreeInterior(HeapFile &file, BlockID id, const KeyProfile &key_profile, bool create = false);
+
+    virtual ~BTreeInterior() {}
+
+    virtual void save();
+
+    /**
+     * Which child could hold key.
+     */
+    virtual BlockID find(const BTreeKey &key) const;
+
+    /**
+     * Add a boundary for a new child (just split off from the child to its left).
+     * @param boundary  smallest key under child
+     * @param child     the new child
+     * @param push_up   returned by reference if there was a split: the boundary for the parent
+     * @returns         the new right sibling if this node had to be split, else nullptr (freed by caller)
+     */
+    virtual BTreeInterior *insert(const BTreeKey &boundary, BlockID child, BTreeKey &push_up);
+
+    /**
+     * Add a child to the right of all the others (for bulk loading).
+     * @param boundary  smallest key under child
+     * @param child     the new child
+     */
+    virtual void append(const BTreeKey &boundary, BlockID child) {
+        this->boundaries.push_back(boundary);
+        this->pointers.push_back(child);
+    }
+
+    void set_first(BlockID first) { this->first = first; }
+
+protected:
+    BlockID first;
+    std::vector<BTreeKey> boundaries;
+    std::vector<BlockID> pointers;
+};
+
+/**
+ * @class BTreeIndex - B+ tree implementation of DbIndex
+ *
+ *      The tree lives in its own HeapFile (<table>-<index>.db) with one node per block, so nodes are
+ *      read and written through the buffer pool like any other block. Lookups and range scans descend
+ *      from the root to the leftmost leaf that could hold the lower key and then walk right along the leaf
+ *      chain. Deletes just remove the entry from its leaf; nodes are not merged.
+ *
+ *      create() builds the tree bottom-up from the relation's entries in sorted order: leaves are filled left
+ *      to right to the fill factor, then each level of interior nodes is built over the one below it. So
+ *      every block is written once and leaves are left with room for later inserts.
+ */
+class BTreeIndex : public DbIndex {
+public:
+    /**
+     * How full create() packs each node unless told otherwise, as a percentage of the block
+     */
+    static const uint DEFAULT_FILL_PERCENT = 90;
+
+    BTreeIndex(DbRelation &relation, Identifier name, ColumnNames key_columns, bool unique);
+
+    virtual ~BTreeIndex();
+
+    BTreeIndex(const BTreeIndex &other) = delete;
+
+    BTreeIndex(BTreeIndex &&temp) = delete;
+
+    BTreeIndex &operator=(const BTreeIndex &other) = delete;
+
+    BTreeIndex &operator=(BTreeIndex &&temp) = delete;
+
+    virtual void create();
+
+    virtual void drop();
+
+    virtual void open();
+
+    virtual void close();
+
+    virtual Handles *lookup(ValueDict *key_values) const;
+
+    virtual Handles *range(ValueDict *min_key, ValueDict *max_key) const;
+
+    virtual void insert(Handle record);
+
+    virtual void del(Handle record);
+
+    virtual void del_batch(const Handles &records);
+
+    /**
+     * How full create() packs each node (clamped to 50..100).
+     * @param fill_percent  percentage of the block
+     */
+    virtual void set_fill_percent(uint fill_percent);
+
+    /**
+     * How much memory create() may use to sort the entries before it spills runs to temporary files.
+     * @param sort_memory  bytes
+     */
+    virtual void set_sort_memory(size_t sort_memory) { this->sort_memory = sort_memory; }
+
+protected:
+    static const BlockID STAT = 1;
+
+    mutable HeapFile file;  // lookups only read it, but reading goes through the (non-const) buffer pool
+    BTreeStat *stat;
+    bool closed;
+    KeyProfile key_profile;
+    ColumnNumbers key_column_numbers;
+    uint fill_percent;
+    size_t sort_memory;
+
+    virtual void bulk_load(IndexEntryCursor *entries);
+
+    virtual BTreeLeaf *find_leaf(const BTreeKey *key) const;
+
+    virtual Handles *scan(const KeyValue *min_key, const KeyValue *max_key) const;
+
+    virtual void insert_entry(const BTreeKey &key);
+};
+
+bool test_btree();
+void benchmark_btree(uint rows);
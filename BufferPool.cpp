@@ -0,0 +1,252 @@
+/**
+ * @file BufferPool.cpp
+ * @see Seattle University, CPSC5300
+ */
+#include <algorithm>
+#include <cstring>
+#include "BufferPool.h"
+
+using namespace std;
+
+/**
+ * Constructor
+ * @param n_frames  how many blocks the pool can hold at once
+ */
+BufferPool::BufferPool(uint n_frames) : frames(n_frames), data(new char[(size_t) n_frames * DbBlock::BLOCK_SZ]),
+                                        hand(0), hits(0), misses(0), evictions(0), writes(0) {
+    for (auto &frame: this->frames) {
+        frame.owner = nullptr;
+        frame.pin_count = 0;
+        frame.valid = frame.dirty = frame.referenced = false;
+    }
+}
+
+BufferPool::~BufferPool() {
+    delete[] this->data;
+}
+
+uint32_t BufferPool::register_file(const string &dbfilename) {
+    auto found = this->file_ids.find(dbfilename);
+    if (found != this->file_ids.end())
+        return found->second;
+    uint32_t file_id = (uint32_t) this->file_ids.size() + 1;
+    this->file_ids[dbfilename] = file_id;
+    return file_id;
+}
+
+/**
+ * Pin a block, reading it in on a miss.
+ * @param file_id
+ * @param db
+ * @param block_id
+ * @return frame number
+ */
+uint BufferPool::pin(uint32_t file_id, Db *db, BlockID block_id) {
+    uint frame_number;
+    auto found = this->page_table.find(key(file_id, block_id));
+    if (found != this->page_table.end()) {
+        this->hits++;
+        frame_number = found->second;
+    } else {
+        this->misses++;
+        frame_number = victim();
+        Dbt db_key(&block_id, sizeof(block_id));
+        Dbt db_data;
+        if (db->get(nullptr, &db_key, &db_data, 0) != 0)  // not written yet
+            memset(get_data(frame_number), 0, DbBlock::BLOCK_SZ);
+        else
+            memcpy(get_data(frame_number), db_data.get_data(), DbBlock::BLOCK_SZ);
+        Frame &frame = this->frames[frame_number];
+        frame.file_id = file_id;
+        frame.block_id = block_id;
+        frame.owner = nullptr;
+        frame.valid = true;
+        frame.dirty = false;
+        this->page_table[key(file_id, block_id)] = frame_number;
+    }
+    Frame &frame = this->frames[frame_number];
+    frame.pin_count++;
+    frame.referenced = true;
+    if (frame.owner == nullptr)
+        frame.owner = db;
+    return frame_number;
+}
+
+void BufferPool::unpin(uint frame) {
+    if (this->frames[frame].pin_count > 0)
+        this->frames[frame].pin_count--;
+}
+
+/**
+ * Mark a block dirty, copying in its new contents if they aren't already in the frame.
+ * @param file_id
+ * @param db
+ * @param block_id
+ * @param data
+ */
+void BufferPool::put(uint32_t file_id, Db *db, BlockID block_id, const void *data) {
+    uint frame_number = pin(file_id, db, block_id);
+    if (get_data(frame_number) != data)
+        memcpy(get_data(frame_number), data, DbBlock::BLOCK_SZ);
+    Frame &frame = this->frames[frame_number];
+    frame.dirty = true;
+    frame.owner = db;
+    unpin(frame_number);
+}
+
+/**
+ * Write all the dirty frames for a file and stop using db for any of its frames.
+ * @param file_id
+ * @param db
+ */
+void BufferPool::flush(uint32_t file_id, Db *db) {
+    for (uint i = 0; i < this->frames.size(); i++) {
+        Frame &frame = this->frames[i];
+        if (!frame.valid || frame.file_id != file_id)
+            continue;
+        if (frame.dirty) {
+            frame.owner = db;
+            write_back(i);
+        }
+        if (frame.owner == db)
+            frame.owner = nullptr;
+    }
+}
+
+/**
+ * Write every dirty frame and sync each file that got written, so what's on disk is as of now.
+ */
+void BufferPool::flush_all() {
+    vector<Db *> written;
+    for (uint i = 0; i < this->frames.size(); i++) {
+        Frame &frame = this->frames[i];
+        if (!frame.valid || !frame.dirty)
+            continue;
+        if (find(written.begin(), written.end(), frame.owner) == written.end())
+            written.push_back(frame.owner);
+        write_back(i);
+    }
+    for (Db *db: written)
+        db->sync(0);
+}
+
+/**
+ * Drop all the frames for a file on the floor.
+ * @param file_id
+ */
+void BufferPool::discard(uint32_t file_id) {
+    for (auto &frame: this->frames) {
+        if (!frame.valid || frame.file_id != file_id)
+            continue;
+        this->page_table.erase(key(frame.file_id, frame.block_id));
+        frame.valid = frame.dirty = frame.referenced = false;
+        frame.pin_count = 0;
+        frame.owner = nullptr;
+    }
+}
+
+/**
+ * Pick a frame to (re)use with the CLOCK algorithm, writing back and evicting its current block if need be.
+ * @return frame number, now free
+ * @throws BufferPoolError if everything is pinned
+ */
+uint BufferPool::victim() {
+    uint n = (uint) this->frames.size();
+    for (uint sweep = 0; sweep < 2 * n; sweep++) {
+        uint frame_number = this->hand;
+        this->hand = (this->hand + 1) % n;
+        Frame &frame = this->frames[frame_number];
+        if (!frame.valid)
+            return frame_number;
+        if (frame.pin_count > 0)
+            continue;
+        if (frame.referenced) {
+            frame.referenced = false;
+            continue;
+        }
+        if (frame.dirty)
+            write_back(frame_number);
+        this->page_table.erase(key(frame.file_id, frame.block_id));
+        frame.valid = false;
+        frame.owner = nullptr;
+        this->evictions++;
+        return frame_number;
+    }
+    throw BufferPoolError("all " + to_string(n) + " buffer pool frames are pinned");
+}
+
+/**
+ * Write a dirty frame to its file.
+ * @param frame_number
+ */
+void BufferPool::write_back(uint frame_number) {
+    Frame &frame = this->frames[frame_number];
+    BlockID block_id = frame.block_id;
+    Dbt db_key(&block_id, sizeof(block_id));
+    Dbt db_data(get_data(frame_number), DbBlock::BLOCK_SZ);
+    frame.owner->put(nullptr, &db_key, &db_data, 0);
+    frame.dirty = false;
+    this->writes++;
+}
+
+// make buffer pool counters printable
+ostream &operator<<(ostream &out, const BufferPool &pool) {
+    u_long requests = pool.hits + pool.misses;
+    out << "buffer pool: " << pool.frames.size() << " frames, " << pool.hits << " hits, " << pool.misses
+        << " misses (" << (requests == 0 ? 0.0 : 100.0 * pool.hits / requests) << "% hit rate), " << pool.evictions
+        << " evictions, " << pool.writes << " writes";
+    return out;
+}
+
+/**
+ * Testing function for the buffer pool. Uses its own little pool so it can force evictions.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_buffer_pool() {
+    const uint N = 4;
+    BufferPool pool(N);
+    Db db(_DB_ENV, 0);
+    string dbfilename = "_test_buffer_pool_cpp.db";
+    db.set_re_len(DbBlock::BLOCK_SZ);
+    db.open(nullptr, dbfilename.c_str(), nullptr, DB_RECNO, DB_CREATE | DB_TRUNCATE, 0644);
+    uint32_t file_id = pool.register_file(dbfilename);
+    if (pool.register_file(dbfilename) != file_id)
+        return false;
+
+    // write 2N blocks through the pool, so half of them get evicted (and written back)
+    char block[DbBlock::BLOCK_SZ];
+    for (BlockID block_id = 1; block_id <= 2 * N; block_id++) {
+        memset(block, (int) block_id, sizeof(block));
+        pool.put(file_id, &db, block_id, block);
+    }
+    if (pool.get_evictions() != N || pool.get_writes() != N)
+        return false;
+
+    // read them all back
+    for (BlockID block_id = 1; block_id <= 2 * N; block_id++) {
+        uint frame = pool.pin(file_id, &db, block_id);
+        bool ok = ((char *) pool.get_data(frame))[DbBlock::BLOCK_SZ - 1] == (char) block_id;
+        pool.unpin(frame);
+        if (!ok)
+            return false;
+    }
+
+    // pinned frames are never chosen as victims
+    uint pinned[N];
+    for (BlockID block_id = 1; block_id <= N; block_id++)
+        pinned[block_id - 1] = pool.pin(file_id, &db, block_id);
+    try {
+        pool.pin(file_id, &db, N + 1);
+        return false;
+    } catch (BufferPoolError &e) {
+        // expected
+    }
+    for (uint i = 0; i < N; i++)
+        pool.unpin(pinned[i]);
+
+    pool.flush(file_id, &db);
+    pool.discard(file_id);
+    db.close(0);
+    Db(_DB_ENV, 0).remove(dbfilename.c_str(), nullptr, 0);
+    return true;
+}
@@ -0,0 +1,152 @@
+/**
+ * @file BufferPool.h - Buffer pool for the blocks of our Berkeley DB backed files.
+ * BufferPool
+ *
+ * @see "Seattle University, CPSC5300, Spring 2021"
+ */
+#pragma once
+
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+#include "db_cxx.h"
+#include "storage_engine.h"
+
+/**
+ * @class BufferPoolError - thrown when every frame is pinned and we need another one
+ */
+class BufferPoolError : public std::runtime_error {
+public:
+    explicit BufferPoolError(std::string s) : runtime_error(s) {}
+};
+
+/**
+ * @class BufferPool - fixed number of block-sized frames shared by all the open files
+ *
+ * Blocks are pinned into a frame with pin() and released with unpin(). A pinned frame is never evicted.
+ * Changes are only written back to the Berkeley DB file when a dirty frame is evicted or the file is
+ * flushed (on close). Replacement is CLOCK: each frame has a reference bit that is set on every pin and
+ * cleared as the clock hand sweeps past; the first unpinned frame found with its bit clear is the victim.
+ *
+ * Frames are keyed by a file id from register_file(), not by the Db handle, so several handles open on the
+ * same file (which happens with the schema tables) share the same frames.
+ */
+class BufferPool {
+public:
+    /**
+     * 4 MB of frames unless told otherwise
+     */
+    static const uint DEFAULT_FRAMES = 1024;
+
+    explicit BufferPool(uint n_frames = DEFAULT_FRAMES);
+
+    virtual ~BufferPool();
+
+    BufferPool(const BufferPool &other) = delete;
+
+    BufferPool(BufferPool &&temp) = delete;
+
+    BufferPool &operator=(const BufferPool &other) = delete;
+
+    BufferPool &operator=(BufferPool &&temp) = delete;
+
+    /**
+     * Get the id used for all the frames of the given file.
+     * @param dbfilename  Berkeley DB file name
+     * @returns           the same id every time for the same file name
+     */
+    virtual uint32_t register_file(const std::string &dbfilename);
+
+    /**
+     * Pin a block into a frame, reading it from db if it isn't already in the pool.
+     * @param file_id   from register_file()
+     * @param db        open handle to read the block with (and write it back with later if need be)
+     * @param block_id  which block
+     * @returns         frame number (pass to get_data() and unpin())
+     * @throws          BufferPoolError if all frames are pinned
+     */
+    virtual uint pin(uint32_t file_id, Db *db, BlockID block_id);
+
+    /**
+     * Release one pin on a frame.
+     * @param frame  frame number from pin()
+     */
+    virtual void unpin(uint frame);
+
+    /**
+     * The block's bytes in the given frame.
+     * @param frame  frame number from pin()
+     * @returns      pointer to BLOCK_SZ bytes
+     */
+    virtual void *get_data(uint frame) { return this->data + (size_t) frame * DbBlock::BLOCK_SZ; }
+
+    /**
+     * Note that a block has changed. If data is not the block's frame, it is copied into the frame first.
+     * @param file_id   from register_file()
+     * @param db        open handle to write the block with later
+     * @param block_id  which block
+     * @param data      BLOCK_SZ bytes of new contents for the block
+     */
+    virtual void put(uint32_t file_id, Db *db, BlockID block_id, const void *data);
+
+    /**
+     * Write out all the dirty frames for the file. Call before closing db.
+     * @param file_id  from register_file()
+     * @param db       handle to write with (about to be closed)
+     */
+    virtual void flush(uint32_t file_id, Db *db);
+
+    /**
+     * Write out every dirty frame in the pool and sync the files they belong to.
+     */
+    virtual void flush_all();
+
+    /**
+     * Forget all the frames for a file without writing them (the file is being dropped).
+     * @param file_id  from register_file()
+     */
+    virtual void discard(uint32_t file_id);
+
+    u_long get_hits() const { return hits; }
+
+    u_long get_misses() const { return misses; }
+
+    u_long get_evictions() const { return evictions; }
+
+    u_long get_writes() const { return writes; }
+
+    uint get_frame_count() const { return (uint) frames.size(); }
+
+    friend std::ostream &operator<<(std::ostream &stream, const BufferPool &pool);
+
+protected:
+    struct Frame {
+        uint32_t file_id;
+        BlockID block_id;
+        Db *owner;        // handle to write this frame back with
+        uint pin_count;
+        bool valid;
+        bool dirty;
+        bool referenced;  // CLOCK reference bit
+    };
+
+    std::vector<Frame> frames;
+    char *data;
+    uint hand;
+    std::unordered_map<uint64_t, uint> page_table;
+    std::unordered_map<std::string, uint32_t> file_ids;
+    u_long hits, misses, evictions, writes;
+
+    static uint64_t key(uint32_t file_id, BlockID block_id) { return (uint64_t) file_id << 32 | block_id; }
+
+    virtual uint victim();
+
+    virtual void write_back(uint frame);
+};
+
+/**
+ * Global variable to hold the buffer pool (set up alongside _DB_ENV).
+ */
+extern BufferPool *_BUFFER_POOL;
+
+bool test_buffer_pool();
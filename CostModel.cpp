@@ -0,0 +1,370 @@
+/**
+ * @file CostModel.cpp - implementation of ColumnStatistics, TableStatistics and CostModel
+ * @see "Seattle University, CPSC5300"
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "CostModel.h"
+#include "HeapTable.h"
+
+using namespace std;
+using namespace hsql;
+
+/**
+ * Where value falls between two bounds (lo < value <= hi), as a fraction of the way from lo to hi. Strings are
+ * assumed to be halfway.
+ */
+static double interpolate(const Value &lo, const Value &hi, const Value &value) {
+    if (value.data_type == ColumnAttribute::TEXT)
+        return 0.5;
+    return ((double) value.n - lo.n) / ((double) hi.n - lo.n);
+}
+
+/**
+ * The value as it is kept in the statistics (long strings are cut short).
+ */
+static Value kept(const Value &value) {
+    if (value.data_type != ColumnAttribute::TEXT || value.s.length() <= CostModel::MAX_TEXT_STATISTIC)
+        return value;
+    return Value(value.s.substr(0, CostModel::MAX_TEXT_STATISTIC));
+}
+
+/**
+ * The value of an AST literal.
+ * @returns  false if it isn't a literal we can compare with a column
+ */
+static bool literal_value(const Expr *expr, Value &value) {
+    if (expr->type == kExprLiteralInt)
+        value = Value((int32_t) expr->ival);
+    else if (expr->type == kExprLiteralString)
+        value = Value(string(expr->name));
+    else
+        return false;
+    return true;
+}
+
+
+/**
+ * Anything outside [min, max] isn't there. Otherwise it's one of the distinct values, unless the histogram says
+ * it's more common than that (it is all of any bucket it is both bounds of).
+ */
+double ColumnStatistics::equal_fraction(const Value &value) const {
+    if (this->histogram.empty() || value < this->min || this->max < value)
+        return 0.0;
+    uint buckets = (uint) this->histogram.size() - 1, filled = 0;
+    for (uint i = 0; i < buckets; i++)
+        if (this->histogram[i] == value && this->histogram[i + 1] == value)
+            filled++;
+    double fraction = this->distinct_count == 0 ? 0.0 : 1.0 / this->distinct_count;
+    if (buckets > 0)
+        fraction = std::max(fraction, (double) filled / buckets);
+    return std::min(fraction, 1.0);
+}
+
+/**
+ * Buckets wholly below the value count in full, and the one it falls in counts in part.
+ */
+double ColumnStatistics::less_fraction(const Value &value, bool inclusive) const {
+    if (this->histogram.size() < 2)
+        return this->histogram.empty() || !(this->histogram[0] < value) ? (inclusive ? equal_fraction(value) : 0.0)
+                                                                         : 1.0;
+    uint buckets = (uint) this->histogram.size() - 1;
+    double below = 0.0;
+    for (uint i = 0; i < buckets; i++) {
+        const Value &lo = this->histogram[i], &hi = this->histogram[i + 1];
+        if (hi < value)
+            below += 1.0;
+        else if (lo < value)
+            below += interpolate(lo, hi, value);
+    }
+    double fraction = below / buckets;
+    if (inclusive)
+        fraction += equal_fraction(value);
+    return std::min(fraction, 1.0);
+}
+
+
+const ColumnStatistics *TableStatistics::get_column(const Identifier &column_name) const {
+    auto found = this->columns.find(column_name);
+    return found == this->columns.end() ? nullptr : &found->second;
+}
+
+
+/**
+ * Every column of every sampled row is kept in memory, so the sample is limited by blocks, not rows.
+ */
+void CostModel::analyze(DbRelation &table, TableStatistics &statistics, uint sample_blocks) {
+    const ColumnNames &column_names = table.get_column_names();
+    ColumnAttributes column_attributes = table.get_column_attributes();
+    uint n_columns = (uint) column_names.size();
+    ColumnNumbers all;
+    for (uint i = 0; i < n_columns; i++)
+        all.push_back(i);
+
+    BlockID block_count = 0;
+    vector<ValueRow> samples(n_columns);
+    RowBatchCursor *rows = table.sample_cursor(&all, sample_blocks, block_count);
+    RowBatch batch;
+    u_long n = 0;
+    try {
+        while (rows->next(batch)) {
+            for (uint r = 0; r < batch.size(); r++)
+                for (uint c = 0; c < n_columns; c++)
+                    samples[c].push_back(batch[r][c]);
+            n += batch.size();
+        }
+    } catch (...) {
+        delete rows;
+        throw;
+    }
+    delete rows;
+
+    BlockID sampled_blocks = min((BlockID) sample_blocks, block_count);
+    bool whole = sampled_blocks == block_count;
+    statistics = TableStatistics();
+    statistics.analyzed = true;
+    statistics.block_count = block_count;
+    statistics.row_count = whole ? n : (u_long) llround((double) n * block_count / sampled_blocks);
+    for (uint c = 0; c < n_columns; c++) {
+        ColumnStatistics &column = statistics.columns[column_names[c]];
+        column.data_type = column_attributes[c].get_data_type();
+        ValueRow &values = samples[c];
+        if (values.empty())
+            continue;
+        sort(values.begin(), values.end());
+        u_long distinct = 0, once = 0;
+        for (size_t i = 0; i < values.size();) {
+            size_t j = i + 1;
+            while (j < values.size() && values[j] == values[i])
+                j++;
+            distinct++;
+            if (j - i == 1)
+                once++;
+            i = j;
+        }
+        if (whole) {
+            column.distinct_count = distinct;
+        } else {
+            double N = (double) statistics.row_count;
+            double estimate = n * (double) distinct / (n - once + once * n / N);
+            column.distinct_count = (u_long) llround(max((double) distinct, min(estimate, N)));
+        }
+        column.min = kept(values.front());
+        column.max = kept(values.back());
+        for (uint b = 0; b <= HISTOGRAM_BUCKETS; b++)
+            column.histogram.push_back(kept(values[(values.size() - 1) * b / HISTOGRAM_BUCKETS]));
+    }
+}
+
+/**
+ * Comparisons of a column with a literal go by the column's histogram, and comparisons of two columns by their
+ * distinct counts. Anything else gets a default.
+ */
+double CostModel::selectivity(const Expr *predicate, const ColumnLookup &lookup) {
+    if (predicate == nullptr)
+        return 1.0;
+    if (predicate->type != kExprOperator)
+        return DEFAULT_RANGE_SELECTIVITY;
+    switch (predicate->opType) {
+        case Expr::AND:
+            return selectivity(predicate->expr, lookup) * selectivity(predicate->expr2, lookup);
+        case Expr::OR: {
+            double left = selectivity(predicate->expr, lookup), right = selectivity(predicate->expr2, lookup);
+            return left + right - left * right;
+        }
+        case Expr::NOT:
+            return 1.0 - selectivity(predicate->expr, lookup);
+        default:
+            break;
+    }
+
+    // the comparison as column <op> other
+    const Expr *column = predicate->expr, *other = predicate->expr2;
+    if (column == nullptr || other == nullptr)
+        return DEFAULT_RANGE_SELECTIVITY;
+    bool flipped = column->type != kExprColumnRef;
+    if (flipped)
+        swap(column, other);
+    if (column->type != kExprColumnRef)
+        return DEFAULT_RANGE_SELECTIVITY;
+    char op;
+    switch (predicate->opType) {
+        case Expr::SIMPLE_OP:
+            op = predicate->opChar;
+            break;
+        case Expr::NOT_EQUALS:
+            op = '!';
+            break;
+        case Expr::LESS_EQ:
+            op = 'l';
+            break;
+        case Expr::GREATER_EQ:
+            op = 'g';
+            break;
+        default:
+            return DEFAULT_RANGE_SELECTIVITY;
+    }
+    if (flipped) {
+        const char *from = "<>lg", *to = "><gl";
+        const char *at = strchr(from, op);
+        if (at != nullptr)
+            op = to[at - from];
+    }
+
+    const ColumnStatistics *statistics = lookup(column);
+    if (other->type == kExprColumnRef) {
+        double equal = join_selectivity(statistics, lookup(other));
+        return op == '=' ? equal : (op == '!' ? 1.0 - equal : DEFAULT_RANGE_SELECTIVITY);
+    }
+    Value value;
+    bool comparable = literal_value(other, value) && statistics != nullptr &&
+                      (value.data_type == ColumnAttribute::TEXT) == (statistics->data_type == ColumnAttribute::TEXT);
+    if (comparable)
+        value.data_type = statistics->data_type;
+    switch (op) {
+        case '=':
+            return comparable ? statistics->equal_fraction(value) : DEFAULT_EQUAL_SELECTIVITY;
+        case '!':
+            return 1.0 - (comparable ? statistics->equal_fraction(value) : DEFAULT_EQUAL_SELECTIVITY);
+        case '<':
+            return comparable ? statistics->less_fraction(value, false) : DEFAULT_RANGE_SELECTIVITY;
+        case 'l':
+            return comparable ? statistics->less_fraction(value, true) : DEFAULT_RANGE_SELECTIVITY;
+        case '>':
+            return comparable ? 1.0 - statistics->less_fraction(value, true) : DEFAULT_RANGE_SELECTIVITY;
+        case 'g':
+            return comparable ? 1.0 - statistics->less_fraction(value, false) : DEFAULT_RANGE_SELECTIVITY;
+        default:
+            return DEFAULT_RANGE_SELECTIVITY;
+    }
+}
+
+/**
+ * Each value on the side with fewer distinct values is assumed to match one on the other side.
+ */
+double CostModel::join_selectivity(const ColumnStatistics *left, const ColumnStatistics *right) {
+    u_long distinct = max(left == nullptr ? 0 : left->distinct_count, right == nullptr ? 0 : right->distinct_count);
+    return distinct == 0 ? DEFAULT_EQUAL_SELECTIVITY : 1.0 / distinct;
+}
+
+double CostModel::clamp_rows(double rows) {
+    return rows < 1.0 ? 1.0 : round(rows);
+}
+
+double CostModel::scan_cost(const TableStatistics &statistics) {
+    return statistics.block_count * SEQUENTIAL_BLOCK_COST + statistics.row_count * ROW_COST;
+}
+
+/**
+ * The rows found are read in block order, so the blocks read are the distinct blocks they're in (Cardenas'
+ * formula, assuming they're spread evenly over the table), each read out of sequence.
+ */
+double CostModel::index_cost(const TableStatistics &statistics, double rows, bool is_hash) {
+    double blocks = (double) max(statistics.block_count, (u_long) 1);
+    double height = is_hash ? 1.0 : max(1.0, ceil(log(max((double) statistics.row_count, 2.0)) / log(BTREE_FANOUT)));
+    double blocks_read = blocks * (1.0 - pow(1.0 - 1.0 / blocks, rows));
+    return height * RANDOM_BLOCK_COST + rows * INDEX_ENTRY_COST + blocks_read * RANDOM_BLOCK_COST + rows * ROW_COST;
+}
+
+double CostModel::filter_cost(double input_rows) {
+    return input_rows * OPERATOR_COST;
+}
+
+double CostModel::projection_cost(double input_rows) {
+    return input_rows * OPERATOR_COST;
+}
+
+/**
+ * With a limit, only the first limit rows are kept in order (in a heap), so each row costs log(limit) rather
+ * than log(rows) comparisons.
+ */
+double CostModel::sort_cost(double input_rows, double limit) {
+    double kept_rows = limit > 0 && limit < input_rows ? limit : input_rows;
+    return input_rows * (log2(max(kept_rows, 2.0)) * OPERATOR_COST + ROW_COST);
+}
+
+double CostModel::hash_join_cost(double left_rows, double right_rows, double rows) {
+    return (left_rows + right_rows) * (ROW_COST + OPERATOR_COST) + rows * ROW_COST;
+}
+
+double CostModel::hash_aggregate_cost(double input_rows, double groups) {
+    return input_rows * (ROW_COST + OPERATOR_COST) + groups * ROW_COST;
+}
+
+
+/**
+ * Test ANALYZE of a whole table and of a sample of it, and the selectivities estimated from what it finds.
+ * @return true if the tests all succeeded
+ */
+bool test_cost_model() {
+    const uint N = 5000;
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    column_names.push_back("c");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    HeapTable table("_test_cost_model_cpp", column_names, column_attributes);
+    table.create();
+    ValueDict row;
+    for (uint i = 0; i < N; i++) {
+        row["a"] = Value((int32_t) i);
+        row["b"] = Value((int32_t) (i % 10));
+        row["c"] = Value(i % 10 == 0 ? "rare " + to_string(i) : string("common"));
+        table.insert(&row);
+    }
+
+    TableStatistics statistics;
+    CostModel::analyze(table, statistics, 100000);
+    const ColumnStatistics *a = statistics.get_column("a"), *b = statistics.get_column("b");
+    const ColumnStatistics *c = statistics.get_column("c");
+    if (!statistics.analyzed || statistics.row_count != N || a == nullptr || b == nullptr || c == nullptr)
+        return assertion_failure("analyze whole table", statistics.row_count);
+    if (a->distinct_count != N || b->distinct_count != 10 || c->distinct_count != N / 10 + 1 || a->min.n != 0 ||
+        a->max.n != (int32_t) N - 1 || a->histogram.size() != CostModel::HISTOGRAM_BUCKETS + 1)
+        return assertion_failure("analyze distinct counts", a->distinct_count, b->distinct_count);
+
+    auto near = [](double x, double expected) { return fabs(x - expected) < 0.02; };
+    auto column_lookup = [&statistics](const Expr *column_ref) { return statistics.get_column(column_ref->name); };
+    Expr *where = Expr::makeOpBinary(Expr::makeColumnRef(strdup("b")), '=', Expr::makeLiteral((int64_t) 3));
+    double s = CostModel::selectivity(where, column_lookup);
+    delete where;
+    if (!near(s, 0.1))
+        return assertion_failure("selectivity b = 3", s);
+    where = Expr::makeOpBinary(Expr::makeLiteral((int64_t) 1000), '>', Expr::makeColumnRef(strdup("a")));
+    s = CostModel::selectivity(where, column_lookup);
+    delete where;
+    if (!near(s, 0.2))
+        return assertion_failure("selectivity 1000 > a", s);
+    where = Expr::makeOpBinary(
+            Expr::makeOpBinary(Expr::makeColumnRef(strdup("c")), '=', Expr::makeLiteral(strdup("common"))),
+            Expr::AND,
+            Expr::makeOpBinary(Expr::makeColumnRef(strdup("a")), Expr::GREATER_EQ, Expr::makeLiteral((int64_t) 4500)));
+    s = CostModel::selectivity(where, column_lookup);
+    delete where;
+    if (!near(s, 0.9 * 0.1))
+        return assertion_failure("selectivity c = 'common' AND a >= 4500", s);
+    where = Expr::makeOpBinary(Expr::makeColumnRef(strdup("a")), '=', Expr::makeLiteral((int64_t) -5));
+    s = CostModel::selectivity(where, column_lookup);
+    delete where;
+    if (s != 0.0)
+        return assertion_failure("selectivity out of range", s);
+
+    // a few blocks: every block has all ten values of b, and every value of a once
+    CostModel::analyze(table, statistics, 5);
+    a = statistics.get_column("a");
+    b = statistics.get_column("b");
+    if (statistics.row_count < N * 0.8 || statistics.row_count > N * 1.2 || b->distinct_count != 10 ||
+        a->distinct_count != statistics.row_count)
+        return assertion_failure("analyze sample", statistics.row_count, a->distinct_count);
+
+    // an index is worth it for a few rows but not for most of them
+    if (CostModel::index_cost(statistics, 5, false) >= CostModel::scan_cost(statistics) ||
+        CostModel::index_cost(statistics, N / 2.0, false) <= CostModel::scan_cost(statistics))
+        return assertion_failure("index cost", CostModel::index_cost(statistics, 5, false));
+    table.drop();
+    return true;
+}
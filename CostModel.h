@@ -0,0 +1,174 @@
+/**
+ * @file CostModel.h - Table statistics and the estimates the planner compares ways of running a query by.
+ * ColumnStatistics
+ * TableStatistics
+ * CostModel
+ *
+ * @see "Seattle University, CPSC5300, Spring 2021"
+ */
+#pragma once
+
+#include <functional>
+#include <unordered_map>
+#include "SQLParser.h"
+#include "storage_engine.h"
+
+/**
+ * @class ColumnStatistics - what ANALYZE found out about the values in one column
+ *
+ *      The histogram is equi-depth: its bounds split the column's values into buckets that each hold about the
+ *      same number of rows, so buckets are narrow where values are crowded together and wide where they are
+ *      spread out. The first bound is the smallest value and the last one the largest. A value common enough to
+ *      fill whole buckets by itself turns up as both bounds of each of them.
+ */
+class ColumnStatistics {
+public:
+    ColumnStatistics() : data_type(ColumnAttribute::INT), distinct_count(0), min(), max(), histogram() {}
+
+    ColumnAttribute::DataType data_type;
+    u_long distinct_count;
+    Value min;
+    Value max;
+    ValueRow histogram;  // bucket bounds, from min to max (empty if the table had no rows)
+
+    /**
+     * Estimate what fraction of the rows have the given value in this column.
+     * @param value  value of the column's type
+     * @returns      the fraction, from 0 to 1
+     */
+    virtual double equal_fraction(const Value &value) const;
+
+    /**
+     * Estimate what fraction of the rows have a value less than the given one in this column.
+     * @param value      value of the column's type
+     * @param inclusive  whether to count the rows equal to value, too
+     * @returns          the fraction, from 0 to 1
+     */
+    virtual double less_fraction(const Value &value, bool inclusive) const;
+};
+
+/**
+ * @class TableStatistics - what ANALYZE found out about a table (until it is analyzed, a default size is assumed
+ *                          and there are no column statistics)
+ */
+class TableStatistics {
+public:
+    static const u_long DEFAULT_ROWS = 1000;
+    static const u_long DEFAULT_BLOCKS = 10;
+
+    TableStatistics() : analyzed(false), row_count(DEFAULT_ROWS), block_count(DEFAULT_BLOCKS), columns() {}
+
+    bool analyzed;
+    u_long row_count;    // estimated from the sample, unless every block was read
+    u_long block_count;
+    std::unordered_map<Identifier, ColumnStatistics> columns;
+
+    /**
+     * A column's statistics.
+     * @param column_name  the column
+     * @returns            its statistics, or nullptr if there aren't any
+     */
+    virtual const ColumnStatistics *get_column(const Identifier &column_name) const;
+};
+
+/**
+ * @class CostModel - estimates of how many rows each step of a plan produces and what the step costs
+ *
+ *      Costs are in units of reading one block in sequence. Reading a block out of sequence costs several times
+ *      as much, and handling a row or evaluating a comparison costs a small fraction of a read. The functions
+ *      below give the cost of an operator's own work; the planner adds its inputs' costs to that, so the cost
+ *      of the top operator is the cost of the whole plan.
+ */
+class CostModel {
+public:
+    static constexpr double SEQUENTIAL_BLOCK_COST = 1.0;
+    static constexpr double RANDOM_BLOCK_COST = 4.0;
+    static constexpr double ROW_COST = 0.01;          // passing a row along
+    static constexpr double OPERATOR_COST = 0.0025;   // one comparison, or hashing one value
+    static constexpr double INDEX_ENTRY_COST = 0.005; // reading one index entry (index blocks are mostly cached)
+    static constexpr double BTREE_FANOUT = 100.0;     // for guessing the height of a B+ tree
+
+    /**
+     * How many blocks ANALYZE reads unless told otherwise
+     */
+    static const uint SAMPLE_BLOCKS = 300;
+
+    /**
+     * How many buckets ANALYZE divides each column's values into
+     */
+    static const uint HISTOGRAM_BUCKETS = 16;
+
+    /**
+     * Longest TEXT value kept as a histogram bound, min or max (longer ones are cut short, which is close enough
+     * for estimating and keeps the _statistics rows small)
+     */
+    static const uint MAX_TEXT_STATISTIC = 64;
+
+    /**
+     * Selectivities for conditions on columns that haven't been analyzed
+     */
+    static constexpr double DEFAULT_EQUAL_SELECTIVITY = 0.005;
+    static constexpr double DEFAULT_RANGE_SELECTIVITY = 1.0 / 3;
+
+    /**
+     * Finds the statistics of the column an AST column reference is to (nullptr if there aren't any).
+     */
+    typedef std::function<const ColumnStatistics *(const hsql::Expr *column_ref)> ColumnLookup;
+
+    /**
+     * Gather a table's statistics from a random sample of its blocks. The row count is scaled up from the sample;
+     * the distinct count is scaled up with the Haas-Stokes estimator, which goes by how many of the sampled
+     * values were seen only once. If the sample is the whole table, both are exact.
+     * @param table          the table
+     * @param statistics     returned by reference: the table's statistics
+     * @param sample_blocks  how many blocks to read
+     */
+    static void analyze(DbRelation &table, TableStatistics &statistics, uint sample_blocks = SAMPLE_BLOCKS);
+
+    /**
+     * Estimate what fraction of the rows satisfy a where-clause condition. AND, OR and NOT combine their sides'
+     * fractions as if they were independent.
+     * @param predicate  AST condition (nullptr for none)
+     * @param lookup     where to find the statistics of the columns it refers to
+     * @returns          the fraction, from 0 to 1
+     */
+    static double selectivity(const hsql::Expr *predicate, const ColumnLookup &lookup);
+
+    /**
+     * Estimate what fraction of the pairs of rows from two inputs have equal values in the given columns.
+     * @param left   statistics of the column from one input (nullptr if there aren't any)
+     * @param right  statistics of the column from the other
+     * @returns      the fraction, from 0 to 1
+     */
+    static double join_selectivity(const ColumnStatistics *left, const ColumnStatistics *right);
+
+    /**
+     * A row estimate, rounded and at least one (a plan for no rows at all is never any use).
+     */
+    static double clamp_rows(double rows);
+
+    /**
+     * Cost of reading every block of a table in order.
+     */
+    static double scan_cost(const TableStatistics &statistics);
+
+    /**
+     * Cost of finding rows with an index and then reading them from the table in block order.
+     * @param statistics  the table's statistics
+     * @param rows        how many rows the index finds
+     * @param is_hash     a hash index (one probe) rather than a B+ tree (a descent from the root)
+     */
+    static double index_cost(const TableStatistics &statistics, double rows, bool is_hash);
+
+    static double filter_cost(double input_rows);
+
+    static double projection_cost(double input_rows);
+
+    static double sort_cost(double input_rows, double limit);
+
+    static double hash_join_cost(double left_rows, double right_rows, double rows);
+
+    static double hash_aggregate_cost(double input_rows, double groups);
+};
+
+bool test_cost_model();
@@ -0,0 +1,193 @@
+/**
+ * @file CsvReader.cpp - implementation of CsvReader
+ * @see "Seattle University, CPSC5300"
+ */
+#include <cstring>
+#include "CsvReader.h"
+#include "SlottedPage.h"
+
+using namespace std;
+
+CsvReader::CsvReader(const string &path) : file(nullptr), owned(true), buffer(CHUNK_SZ), start(0), end(0),
+                                           at_eof(false), line_number(0), lines_seen(0), bytes_read(0) {
+    this->file = fopen(path.c_str(), "r");
+    if (this->file == nullptr)
+        throw DbRelationError("cannot open " + path + ": " + strerror(errno));
+}
+
+CsvReader::CsvReader(FILE *file) : file(file), owned(false), buffer(CHUNK_SZ), start(0), end(0), at_eof(false),
+                                   line_number(0), lines_seen(0), bytes_read(0) {
+}
+
+CsvReader::~CsvReader() {
+    if (this->owned)
+        fclose(this->file);
+}
+
+/**
+ * Find the end of the next line (skipping commas and newlines inside quotes), reading more of the file as
+ * needed, and split it into fields.
+ */
+bool CsvReader::next(RawFields &fields) {
+    while (true) {
+        bool quoted = false;
+        size_t i = this->start;
+        u_long newlines = 0;
+        while (true) {
+            if (i == this->end) {
+                size_t scanned = i - this->start;
+                bool more = fill();
+                i = this->start + scanned;
+                if (!more) {
+                    if (this->start == this->end)
+                        return false;
+                    break;  // last line has no newline
+                }
+                continue;
+            }
+            char c = this->buffer[i];
+            if (c == '"')
+                quoted = !quoted;
+            else if (c == '\n') {
+                newlines++;
+                if (!quoted)
+                    break;
+            }
+            i++;
+        }
+        size_t line_start = this->start, line_end = i;
+        this->start = i < this->end ? i + 1 : i;
+        this->line_number = this->lines_seen + 1;
+        this->lines_seen += newlines;
+        if (line_end > line_start && this->buffer[line_end - 1] == '\r')
+            line_end--;
+        if (line_end == line_start)
+            continue;  // blank line
+        split(line_start, line_end, fields);
+        return true;
+    }
+}
+
+/**
+ * Move what's left of the buffer to the front (growing the buffer if it's all one line) and read more after it.
+ * @return  false if there's nothing more to read
+ */
+bool CsvReader::fill() {
+    if (this->at_eof)
+        return false;
+    size_t left = this->end - this->start;
+    if (this->start > 0)
+        memmove(this->buffer.data(), this->buffer.data() + this->start, left);
+    this->start = 0;
+    this->end = left;
+    if (this->buffer.size() - this->end < CHUNK_SZ / 2)
+        this->buffer.resize(this->buffer.size() + CHUNK_SZ);
+    size_t n = fread(this->buffer.data() + this->end, 1, this->buffer.size() - this->end, this->file);
+    if (n == 0) {
+        if (ferror(this->file))
+            throw DbRelationError(string("cannot read CSV file: ") + strerror(errno));
+        this->at_eof = true;
+        return false;
+    }
+    this->end += n;
+    this->bytes_read += n;
+    return true;
+}
+
+/**
+ * Split a line into fields, taking the quotes off quoted fields (which is done in place, since a field only
+ * gets shorter).
+ * @param line_start  offset of the line in buffer
+ * @param line_end    offset just past the line
+ * @param fields      returned by reference: the fields
+ */
+void CsvReader::split(size_t line_start, size_t line_end, RawFields &fields) {
+    fields.clear();
+    char *line = this->buffer.data();
+    size_t i = line_start;
+    while (true) {
+        RawField field;
+        if (i < line_end && line[i] == '"') {
+            size_t out = i, in = i + 1;
+            field.text = line + out;
+            while (true) {
+                if (in == line_end)
+                    throw DbRelationError("line " + to_string(this->line_number) + ": unterminated quoted field");
+                if (line[in] == '"') {
+                    if (in + 1 < line_end && line[in + 1] == '"') {
+                        line[out++] = '"';
+                        in += 2;
+                        continue;
+                    }
+                    in++;
+                    break;
+                }
+                line[out++] = line[in++];
+            }
+            field.length = (uint) (out - i);
+            if (in < line_end && line[in] != ',')
+                throw DbRelationError("line " + to_string(this->line_number) + ": junk after quoted field");
+            i = in;
+        } else {
+            field.text = line + i;
+            const char *comma = (const char *) memchr(line + i, ',', line_end - i);
+            size_t field_end = comma == nullptr ? line_end : (size_t) (comma - line);
+            field.length = (uint) (field_end - i);
+            i = field_end;
+        }
+        fields.push_back(field);
+        if (i == line_end)
+            return;
+        i++;  // past the comma
+    }
+}
+
+
+/**
+ * Test CsvReader on a file with quoting, a blank line, a carriage return, and a line bigger than a chunk.
+ * @return true if the tests all succeeded
+ */
+bool test_csv_reader() {
+    FILE *file = tmpfile();
+    string big(CsvReader::CHUNK_SZ + 10, 'x');
+    fputs("1,plain,true\n", file);
+    fputs("2,\"with, comma\",f\r\n", file);
+    fputs("\n", file);
+    fputs("3,\"say \"\"hi\"\"\nthere\",\n", file);
+    fprintf(file, "4,%s,0\n", big.c_str());
+    fputs("5,,last", file);
+    rewind(file);
+
+    CsvReader reader(file);
+    RawFields fields;
+    auto is = [&fields](uint i, const string &text) {
+        return i < fields.size() && string(fields[i].text, fields[i].length) == text;
+    };
+    if (!reader.next(fields) || fields.size() != 3 || !is(0, "1") || !is(1, "plain") || !is(2, "true"))
+        return assertion_failure("csv plain line", fields.size());
+    if (!reader.next(fields) || fields.size() != 3 || !is(1, "with, comma") || !is(2, "f"))
+        return assertion_failure("csv quoted comma", fields.size());
+    if (!reader.next(fields) || reader.get_line_number() != 4 || fields.size() != 3 || !is(1, "say \"hi\"\nthere") ||
+        !is(2, ""))
+        return assertion_failure("csv quoted quotes", reader.get_line_number());
+    if (!reader.next(fields) || reader.get_line_number() != 6 || fields.size() != 3 || !is(1, big))
+        return assertion_failure("csv long line", reader.get_line_number());
+    if (!reader.next(fields) || fields.size() != 3 || !is(1, "") || !is(2, "last"))
+        return assertion_failure("csv last line", fields.size());
+    if (reader.next(fields))
+        return assertion_failure("csv end");
+    fclose(file);
+
+    file = tmpfile();
+    fputs("1,\"oops\n", file);
+    rewind(file);
+    CsvReader bad(file);
+    try {
+        bad.next(fields);
+        return assertion_failure("csv unterminated quote");
+    } catch (DbRelationError &e) {
+        // expected
+    }
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file CsvReader.h - Streaming reader of comma-separated values files.
+ * CsvReader
+ *
+ * @see "Seattle University, CPSC5300, Spring 2021"
+ */
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "RecordCodec.h"
+
+/**
+ * @class CsvReader - reads a CSV file a line at a time, handing back each line's fields where they lie in its buffer
+ *
+ *      The file is read in big chunks into one buffer and lines are split into fields in place, so nothing is
+ *      allocated or copied per line. Fields are separated by commas and lines by newlines (a carriage return
+ *      before the newline is dropped). A field may be quoted with double quotes, in which case it can hold
+ *      commas, newlines and doubled double quotes (which stand for one). Blank lines are skipped.
+ *
+ * Usage:
+ *      CsvReader reader(path);
+ *      RawFields fields;
+ *      while (reader.next(fields))
+ *          ... fields[i].text, fields[i].length ...
+ */
+class CsvReader {
+public:
+    /**
+     * How much of the file is read at a time (the buffer grows if a line is longer than this)
+     */
+    static const uint CHUNK_SZ = 1024 * 1024;
+
+    /**
+     * Open a file to read.
+     * @param path  the file
+     * @throws DbRelationError if it can't be opened
+     */
+    explicit CsvReader(const std::string &path);
+
+    /**
+     * Read from an already open file.
+     * @param file  the file, positioned where reading should start (still owned by the caller)
+     */
+    explicit CsvReader(FILE *file);
+
+    virtual ~CsvReader();
+
+    CsvReader(const CsvReader &other) = delete;
+
+    CsvReader(CsvReader &&temp) = delete;
+
+    CsvReader &operator=(const CsvReader &other) = delete;
+
+    CsvReader &operator=(CsvReader &&temp) = delete;
+
+    /**
+     * Read the next line.
+     * @param fields  returned by reference: the line's fields (only good until the next call)
+     * @returns       false at the end of the file
+     * @throws DbRelationError if the file can't be read or a quoted field is malformed
+     */
+    virtual bool next(RawFields &fields);
+
+    /**
+     * Line number (from 1) of the line next() last returned, for error messages.
+     */
+    u_long get_line_number() const { return line_number; }
+
+    /**
+     * How many bytes of the file have been read so far.
+     */
+    uint64_t get_bytes_read() const { return bytes_read; }
+
+protected:
+    FILE *file;
+    bool owned;         // whether we opened file (and so have to close it)
+    std::vector<char> buffer;
+    size_t start;       // first byte of buffer not yet handed out
+    size_t end;         // just past the last byte read into buffer
+    bool at_eof;
+    u_long line_number;
+    u_long lines_seen;  // newlines passed so far, including those inside quoted fields
+    uint64_t bytes_read;
+
+    virtual bool fill();
+
+    virtual void split(size_t line_start, size_t line_end, RawFields &fields);
+};
+
+bool test_csv_reader();
@@ -0,0 +1,502 @@
+/**
+ * @file ExternalSort.cpp - implementation of IndexEntrySorter and RowSorter
+ * @see "Seattle University, CPSC5300"
+ */
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include "ExternalSort.h"
+#include "SlottedPage.h"
+
+using namespace std;
+typedef uint16_t u16;
+
+/**
+ * Roughly how much memory an entry takes up while it's buffered.
+ */
+static size_t entry_footprint(const IndexEntry &entry) {
+    size_t size = sizeof(IndexEntry) + entry.first.size() * sizeof(Value);
+    for (auto const &value: entry.first)
+        size += value.s.length();
+    return size;
+}
+
+/**
+ * Read the next entry of a run (each is written as a 2-byte length followed by the marshaled entry).
+ * @returns false at the end of the run
+ */
+static bool read_entry(FILE *run, const KeyProfile &key_profile, IndexEntry &entry) {
+    u16 size;
+    if (fread(&size, sizeof(size), 1, run) != 1)
+        return false;
+    char bytes[MAX_INDEX_ENTRY_SZ];
+    if (fread(bytes, 1, size, run) != size)
+        throw DbRelationError("short read from sort run");
+    unmarshal_index_entry(key_profile, bytes, entry);
+    return true;
+}
+
+/**
+ * @class BufferCursor - streams the entries of an already sorted, in-memory buffer
+ */
+class BufferCursor : public IndexEntryCursor {
+public:
+    BufferCursor(const vector<IndexEntry> &buffer) : buffer(buffer), i(0) {}
+
+    virtual bool next(IndexEntry &entry) {
+        if (this->i >= this->buffer.size())
+            return false;
+        entry = this->buffer[this->i++];
+        return true;
+    }
+
+protected:
+    const vector<IndexEntry> &buffer;
+    size_t i;
+};
+
+/**
+ * @class RunMergeCursor - merges sorted runs by always taking the smallest of their current entries
+ */
+class RunMergeCursor : public IndexEntryCursor {
+public:
+    RunMergeCursor(const vector<FILE *> &runs, const KeyProfile &key_profile) : runs(runs),
+                                                                                 key_profile(key_profile) {
+        for (uint r = 0; r < runs.size(); r++) {
+            rewind(runs[r]);
+            Head head;
+            head.second = r;
+            if (read_entry(runs[r], key_profile, head.first))
+                this->heads.push(head);
+        }
+    }
+
+    virtual bool next(IndexEntry &entry) {
+        if (this->heads.empty())
+            return false;
+        Head head = this->heads.top();
+        this->heads.pop();
+        entry = head.first;
+        if (read_entry(this->runs[head.second], this->key_profile, head.first))
+            this->heads.push(head);
+        return true;
+    }
+
+protected:
+    typedef pair<IndexEntry, uint> Head;  // current entry of a run and which run
+
+    const vector<FILE *> &runs;
+    const KeyProfile &key_profile;
+    priority_queue<Head, vector<Head>, greater<Head>> heads;
+};
+
+
+/**
+ * Constructor
+ * @param key_profile  data types of the entries' keys
+ * @param memory       how many bytes of entries to hold before spilling a run
+ */
+IndexEntrySorter::IndexEntrySorter(const KeyProfile &key_profile, size_t memory) : key_profile(key_profile),
+                                                                                 memory(memory), used(0), buffer(),
+                                                                                 runs() {
+}
+
+/**
+ * Destructor - closing the temporary files removes them
+ */
+IndexEntrySorter::~IndexEntrySorter() {
+    for (auto const &run: this->runs)
+        fclose(run);
+}
+
+void IndexEntrySorter::add(const IndexEntry &entry) {
+    this->buffer.push_back(entry);
+    this->used += entry_footprint(entry);
+    if (this->used >= this->memory)
+        spill();
+}
+
+IndexEntryCursor *IndexEntrySorter::sorted() {
+    if (this->runs.empty()) {
+        sort(this->buffer.begin(), this->buffer.end());
+        return new BufferCursor(this->buffer);
+    }
+    if (!this->buffer.empty())
+        spill();
+    return new RunMergeCursor(this->runs, this->key_profile);
+}
+
+/**
+ * Sort the buffer and write it out as a new run.
+ */
+void IndexEntrySorter::spill() {
+    sort(this->buffer.begin(), this->buffer.end());
+    FILE *run = tmpfile();
+    if (run == nullptr)
+        throw DbRelationError("cannot make a temporary file for sorting");
+    this->runs.push_back(run);
+    char bytes[MAX_INDEX_ENTRY_SZ];
+    for (auto const &entry: this->buffer) {
+        u16 size = (u16) marshal_index_entry(this->key_profile, entry, bytes);
+        if (fwrite(&size, sizeof(size), 1, run) != 1 || fwrite(bytes, 1, size, run) != size)
+            throw DbRelationError("cannot write sort run");
+    }
+    this->buffer.clear();
+    this->used = 0;
+}
+
+
+/**
+ * INTs are big-endian with the sign bit flipped, BOOLEANs one byte, and TEXT has each zero byte followed by 0xff
+ * and two zero bytes after it (so a string sorts before any longer one it's a prefix of). For descending order,
+ * every byte is inverted.
+ */
+void normalize_value(const Value &value, ColumnAttribute::DataType data_type, bool descending, string &key) {
+    size_t start = key.length();
+    if (data_type == ColumnAttribute::TEXT) {
+        for (char c: value.s) {
+            key += c;
+            if (c == '\0')
+                key += '\xff';
+        }
+        key.append(2, '\0');
+    } else if (data_type == ColumnAttribute::BOOLEAN) {
+        key += (char) (value.n != 0);
+    } else {
+        uint32_t n = (uint32_t) value.n ^ 0x80000000U;
+        for (int shift = 24; shift >= 0; shift -= 8)
+            key += (char) (n >> shift);
+    }
+    if (descending)
+        for (size_t i = start; i < key.length(); i++)
+            key[i] = (char) ~key[i];
+}
+
+typedef RowSorter::KeyedRow KeyedRow;
+
+/**
+ * stdio buffer for each row run, so that merging reads each run in big sequential chunks
+ */
+static const size_t RUN_BUFFER_SZ = 64 * 1024;
+
+static bool key_less(const KeyedRow &a, const KeyedRow &b) {
+    return a.first < b.first;  // std::string compares as unsigned bytes
+}
+
+/**
+ * Roughly how much memory a keyed row takes up while it's buffered.
+ */
+static size_t keyed_row_footprint(const KeyedRow &item) {
+    size_t size = sizeof(KeyedRow) + item.first.capacity() + item.second.size() * sizeof(Value);
+    for (auto const &value: item.second)
+        size += value.s.length();
+    return size;
+}
+
+/**
+ * Write a keyed row to a run: the key's 4-byte length and bytes, then each value (INT and BOOLEAN: 4 bytes,
+ * TEXT: 4-byte length then the text).
+ */
+static void write_keyed_row(FILE *run, const vector<ColumnAttribute::DataType> &data_types, const KeyedRow &item,
+                            string &bytes) {
+    auto append = [&bytes](const void *data, size_t size) { bytes.append((const char *) data, size); };
+    bytes.clear();
+    uint32_t length = (uint32_t) item.first.length();
+    append(&length, sizeof(length));
+    bytes += item.first;
+    for (uint i = 0; i < data_types.size(); i++) {
+        const Value &value = item.second[i];
+        if (data_types[i] == ColumnAttribute::TEXT) {
+            length = (uint32_t) value.s.length();
+            append(&length, sizeof(length));
+            bytes += value.s;
+        } else {
+            append(&value.n, sizeof(value.n));
+        }
+    }
+    if (fwrite(bytes.data(), 1, bytes.size(), run) != bytes.size())
+        throw DbRelationError("cannot write sort run");
+}
+
+/**
+ * Read the next keyed row of a run (written by write_keyed_row()).
+ * @returns false at the end of the run
+ */
+static bool read_keyed_row(FILE *run, const vector<ColumnAttribute::DataType> &data_types, KeyedRow &item) {
+    uint32_t length;
+    if (fread(&length, sizeof(length), 1, run) != 1)
+        return false;
+    auto read_text = [run](string &text, uint32_t length) {
+        text.resize(length);
+        if (length > 0 && fread(&text[0], 1, length, run) != length)
+            throw DbRelationError("short read from sort run");
+    };
+    read_text(item.first, length);
+    item.second.resize(data_types.size());
+    for (uint i = 0; i < data_types.size(); i++) {
+        Value &value = item.second[i];
+        value.data_type = data_types[i];
+        if (data_types[i] == ColumnAttribute::TEXT) {
+            if (fread(&length, sizeof(length), 1, run) != 1)
+                throw DbRelationError("short read from sort run");
+            read_text(value.s, length);
+        } else {
+            if (fread(&value.n, sizeof(value.n), 1, run) != 1)
+                throw DbRelationError("short read from sort run");
+            value.s.clear();
+        }
+    }
+    return true;
+}
+
+/**
+ * @class RowBufferCursor - streams the rows of an already sorted, in-memory buffer (taking them out of it)
+ */
+class RowBufferCursor : public RowBatchCursor {
+public:
+    RowBufferCursor(vector<KeyedRow> &buffer) : buffer(buffer), i(0) {}
+
+    virtual bool next(RowBatch &batch) {
+        batch.clear();
+        while (!batch.full() && this->i < this->buffer.size())
+            batch.add().swap(this->buffer[this->i++].second);
+        return !batch.empty();
+    }
+
+protected:
+    vector<KeyedRow> &buffer;
+    size_t i;
+};
+
+/**
+ * @class RowRunMergeCursor - merges sorted runs of rows with a loser tree
+ *
+ *      The tree's internal nodes (1 to k-1, for k runs, with run r as leaf k+r) each hold the run that lost the
+ *      comparison there, and node 0 holds the overall winner. Taking the winner's row and reading the next one
+ *      from its run only needs the comparisons on the path from its leaf to the root to be replayed.
+ */
+class RowRunMergeCursor : public RowBatchCursor {
+public:
+    RowRunMergeCursor(const vector<FILE *> &runs, const vector<ColumnAttribute::DataType> &data_types,
+                      uint64_t limit) : runs(runs), data_types(data_types),
+                                        remaining(limit > 0 ? limit : UINT64_MAX), heads(runs.size()),
+                                        live(runs.size()), tree(runs.size()) {
+        uint k = (uint) runs.size();
+        for (uint r = 0; r < k; r++) {
+            rewind(runs[r]);
+            this->live[r] = read_keyed_row(runs[r], data_types, this->heads[r]);
+        }
+        vector<uint> winners(2 * k);
+        for (uint r = 0; r < k; r++)
+            winners[k + r] = r;
+        for (uint node = k - 1; node > 0; node--) {
+            uint winner = winners[2 * node], loser = winners[2 * node + 1];
+            if (less(loser, winner))
+                swap(winner, loser);
+            winners[node] = winner;
+            this->tree[node] = loser;
+        }
+        this->tree[0] = winners[1];
+    }
+
+    virtual bool next(RowBatch &batch) {
+        batch.clear();
+        while (!batch.full() && this->remaining > 0 && this->live[this->tree[0]]) {
+            uint r = this->tree[0];
+            batch.add().swap(this->heads[r].second);
+            this->remaining--;
+            this->live[r] = read_keyed_row(this->runs[r], this->data_types, this->heads[r]);
+            uint winner = r;
+            for (uint node = (r + (uint) this->runs.size()) / 2; node > 0; node /= 2)
+                if (less(this->tree[node], winner))
+                    swap(this->tree[node], winner);
+            this->tree[0] = winner;
+        }
+        return !batch.empty();
+    }
+
+protected:
+    const vector<FILE *> &runs;
+    const vector<ColumnAttribute::DataType> &data_types;
+    uint64_t remaining;      // rows still to produce
+    vector<KeyedRow> heads;  // current row of each run
+    vector<bool> live;       // whether each run still has a current row
+    vector<uint> tree;
+
+    // whether run a's current row comes before run b's (a finished run comes after everything)
+    bool less(uint a, uint b) const {
+        return this->live[a] && (!this->live[b] || this->heads[a].first < this->heads[b].first);
+    }
+};
+
+
+RowSorter::RowSorter(const ColumnAttributes &column_attributes, const ColumnNumbers &keys,
+                     const vector<bool> &descending, uint64_t limit, size_t memory)
+        : data_types(), keys(keys), descending(descending), limit(limit), top_n(limit > 0), memory(memory), used(0),
+          buffer(), runs() {
+    for (auto const &column_attribute: column_attributes)
+        this->data_types.push_back(column_attribute.get_data_type());
+}
+
+/**
+ * Destructor - closing the temporary files removes them
+ */
+RowSorter::~RowSorter() {
+    for (auto const &run: this->runs)
+        fclose(run);
+}
+
+void RowSorter::add(ValueRow &row) {
+    string key;
+    normalize(row, key);
+    if (this->top_n && this->buffer.size() == this->limit) {
+        if (!(key < this->buffer.front().first))
+            return;  // comes after every row we're keeping
+        pop_heap(this->buffer.begin(), this->buffer.end(), key_less);
+        this->used -= keyed_row_footprint(this->buffer.back());
+        this->buffer.pop_back();
+    }
+    this->buffer.emplace_back();
+    KeyedRow &item = this->buffer.back();
+    item.first.swap(key);
+    item.second.swap(row);
+    this->used += keyed_row_footprint(item);
+    if (this->top_n)
+        push_heap(this->buffer.begin(), this->buffer.end(), key_less);
+    if (this->used >= this->memory) {
+        this->top_n = false;
+        spill();
+    }
+}
+
+RowBatchCursor *RowSorter::sorted() {
+    if (this->runs.empty()) {
+        if (this->top_n)
+            sort_heap(this->buffer.begin(), this->buffer.end(), key_less);
+        else
+            sort(this->buffer.begin(), this->buffer.end(), key_less);
+        return new RowBufferCursor(this->buffer);
+    }
+    if (!this->buffer.empty())
+        spill();
+    return new RowRunMergeCursor(this->runs, this->data_types, this->limit);
+}
+
+/**
+ * Build a row's normalized sort key.
+ * @param row  the row
+ * @param key  returned by reference
+ */
+void RowSorter::normalize(const ValueRow &row, string &key) const {
+    key.clear();
+    for (uint i = 0; i < this->keys.size(); i++)
+        normalize_value(row[this->keys[i]], this->data_types[this->keys[i]], this->descending[i], key);
+}
+
+/**
+ * Sort the buffer and write it out as a new run (only as much of it as could be among the first limit rows).
+ */
+void RowSorter::spill() {
+    sort(this->buffer.begin(), this->buffer.end(), key_less);
+    FILE *run = tmpfile();
+    if (run == nullptr)
+        throw DbRelationError("cannot make a temporary file for sorting");
+    setvbuf(run, nullptr, _IOFBF, RUN_BUFFER_SZ);
+    this->runs.push_back(run);
+    size_t n = this->buffer.size();
+    if (this->limit > 0 && this->limit < n)
+        n = (size_t) this->limit;
+    string bytes;
+    for (size_t i = 0; i < n; i++)
+        write_keyed_row(run, this->data_types, this->buffer[i], bytes);
+    this->buffer.clear();
+    this->used = 0;
+}
+
+
+/**
+ * Test IndexEntrySorter both in memory and with a budget small enough to need many runs.
+ * @return true if the tests all succeeded
+ */
+bool test_external_sort() {
+    KeyProfile key_profile;
+    key_profile.push_back(ColumnAttribute::INT);
+    key_profile.push_back(ColumnAttribute::TEXT);
+    const uint N = 5000;
+    for (size_t memory: {IndexEntrySorter::DEFAULT_MEMORY, (size_t) 10000}) {
+        IndexEntrySorter sorter(key_profile, memory);
+        for (uint i = 0; i < N; i++) {
+            IndexEntry entry;
+            entry.first.push_back(Value((int) ((i * 7919) % 1000)));  // lots of duplicate keys
+            entry.first.push_back(Value("x" + to_string(i % 3)));
+            entry.second = Handle(i + 1, (RecordID) (i % 100));
+            sorter.add(entry);
+        }
+        if ((memory == IndexEntrySorter::DEFAULT_MEMORY) != (sorter.get_run_count() == 0))
+            return assertion_failure("external sort runs", sorter.get_run_count());
+        IndexEntryCursor *cursor = sorter.sorted();
+        IndexEntry previous, entry;
+        uint count = 0;
+        while (cursor->next(entry)) {
+            if (count > 0 && !(previous < entry)) {
+                delete cursor;
+                return assertion_failure("external sort order", count);
+            }
+            previous = entry;
+            count++;
+        }
+        delete cursor;
+        if (count != N)
+            return assertion_failure("external sort count", count);
+    }
+
+    // rows (a INT, b TEXT) ordered by b, then a descending: in memory, in runs, and the first 10 of them
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    ColumnNumbers keys;
+    keys.push_back(1);
+    keys.push_back(0);
+    vector<bool> descending;
+    descending.push_back(false);
+    descending.push_back(true);
+    auto in_order = [](const ValueRow &previous, const ValueRow &row) {
+        return previous[1].s < row[1].s || (previous[1].s == row[1].s && previous[0].n >= row[0].n);
+    };
+    ValueRows expected;
+    for (size_t memory: {RowSorter::DEFAULT_MEMORY, (size_t) 20000, (size_t) 0}) {
+        uint64_t limit = memory == 0 ? 10 : 0;
+        RowSorter sorter(column_attributes, keys, descending, limit,
+                         memory == 0 ? RowSorter::DEFAULT_MEMORY : memory);
+        for (uint i = 0; i < N; i++) {
+            ValueRow row;
+            row.push_back(Value((int32_t) ((i * 7919) % 1000) - 500));
+            row.push_back(Value(i % 3 == 0 ? string() : "x" + to_string(i % 11)));
+            sorter.add(row);
+        }
+        if ((memory == 20000) != (sorter.get_run_count() > 0))
+            return assertion_failure("row sort runs", memory, sorter.get_run_count());
+        RowBatchCursor *cursor = sorter.sorted();
+        RowBatch batch;
+        ValueRows rows;
+        while (cursor->next(batch))
+            for (uint i = 0; i < batch.size(); i++)
+                rows.push_back(new ValueRow(batch[i]));
+        delete cursor;
+        bool ok = rows.size() == (limit > 0 ? limit : N);
+        for (uint i = 0; ok && i < rows.size(); i++) {
+            ok = (i == 0 || in_order(*rows[i - 1], *rows[i])) && (expected.empty() || *rows[i] == *expected[i]);
+            ok = ok && rows[i]->size() == 2 && (*rows[i])[1].data_type == ColumnAttribute::TEXT;
+        }
+        if (expected.empty())
+            expected.swap(rows);
+        for (auto const &row: rows)
+            delete row;
+        if (!ok)
+            return assertion_failure("row sort", memory, rows.size());
+    }
+    for (auto const &row: expected)
+        delete row;
+    return true;
+}
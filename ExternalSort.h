@@ -0,0 +1,173 @@
+/**
+ * @file ExternalSort.h - Sorting more index entries or rows than fit in memory.
+ * IndexEntrySorter
+ * RowSorter
+ *
+ * @see "Seattle University, CPSC5300, Spring 2021"
+ */
+#pragma once
+
+#include <cstdio>
+#include <vector>
+#include "IndexKey.h"
+
+typedef DbCursor<IndexEntry> IndexEntryCursor;
+
+/**
+ * @class IndexEntrySorter - sorts index entries into (key, handle) order within a memory budget
+ *
+ *      Entries are collected in memory until the budget is used up, then that batch is sorted and spilled
+ *      as a run to a temporary file. sorted() merges the runs (along with whatever is still in memory) in
+ *      one pass, reading each run sequentially. Nothing is written at all if everything fits in the budget.
+ *
+ * Usage:
+ *      IndexEntrySorter sorter(key_profile);
+ *      for each entry: sorter.add(entry);
+ *      IndexEntryCursor *cursor = sorter.sorted();
+ *      while (cursor->next(entry)) ...
+ *      delete cursor;
+ */
+class IndexEntrySorter {
+public:
+    /**
+     * 16 MB of entries in memory unless told otherwise
+     */
+    static const size_t DEFAULT_MEMORY = 16 * 1024 * 1024;
+
+    IndexEntrySorter(const KeyProfile &key_profile, size_t memory = DEFAULT_MEMORY);
+
+    virtual ~IndexEntrySorter();
+
+    IndexEntrySorter(const IndexEntrySorter &other) = delete;
+
+    IndexEntrySorter(IndexEntrySorter &&temp) = delete;
+
+    IndexEntrySorter &operator=(const IndexEntrySorter &other) = delete;
+
+    IndexEntrySorter &operator=(IndexEntrySorter &&temp) = delete;
+
+    /**
+     * Add an entry to be sorted, spilling a run if the memory budget is used up.
+     * @param entry  the entry
+     */
+    virtual void add(const IndexEntry &entry);
+
+    /**
+     * Stream all the entries added so far in order. Call it once, after the last add().
+     * @returns  cursor over the entries; only good while this sorter lives (freed by caller)
+     */
+    virtual IndexEntryCursor *sorted();
+
+    /**
+     * How many runs have been spilled to temporary files.
+     */
+    uint get_run_count() const { return (uint) this->runs.size(); }
+
+protected:
+    KeyProfile key_profile;
+    size_t memory;
+    size_t used;  // estimated bytes taken by buffer
+    std::vector<IndexEntry> buffer;
+    std::vector<FILE *> runs;
+
+    virtual void spill();
+};
+
+/**
+ * Append a value to a normalized key: bytes that compare (as unsigned bytes, as std::string's operator< does) in
+ * the same order as the values do, and that are the same only if the values are. Since no value's bytes are a
+ * prefix of another's, a key made of several values in a row compares like the values, column by column.
+ * @param value       the value
+ * @param data_type   its data type
+ * @param descending  whether to reverse the order
+ * @param key         returned by reference: with the value's bytes appended
+ */
+void normalize_value(const Value &value, ColumnAttribute::DataType data_type, bool descending, std::string &key);
+
+/**
+ * @class RowSorter - sorts rows on some of their columns within a memory budget
+ *
+ *      Each row's sort key is normalized into a byte string (see normalize_value()) that compares in the order
+ *      the rows should come out, so sorting and merging only ever compare strings, whatever the key's columns are.
+ *
+ *      Rows are collected in memory until the budget is used up, then sorted and spilled as a run to a temporary
+ *      file. sorted() merges the runs (after spilling whatever is still in memory) in one pass with a loser tree,
+ *      which takes one key comparison per level of the tree for each row.
+ *
+ *      If only the first so many rows are wanted (ORDER BY ... LIMIT), the rows are kept in a heap of at most that
+ *      many instead, throwing away any row that sorts after all of them, so nothing is written at all. (If that
+ *      many rows don't fit in the budget, it goes back to spilling runs.)
+ *
+ * Usage:
+ *      RowSorter sorter(column_attributes, keys, descending);
+ *      for each row: sorter.add(row);
+ *      RowBatchCursor *cursor = sorter.sorted();
+ *      while (cursor->next(batch)) ...
+ *      delete cursor;
+ */
+class RowSorter {
+public:
+    /**
+     * 16 MB of rows in memory unless told otherwise
+     */
+    static const size_t DEFAULT_MEMORY = 16 * 1024 * 1024;
+
+    /**
+     * @param column_attributes  types of the rows' columns
+     * @param keys               positions of the sort key's columns in the rows, most significant first
+     * @param descending         for each key column, whether it sorts from high to low
+     * @param limit              if not 0, only this many rows are wanted from sorted()
+     * @param memory             how many bytes of rows to hold before spilling a run
+     */
+    RowSorter(const ColumnAttributes &column_attributes, const ColumnNumbers &keys,
+              const std::vector<bool> &descending, uint64_t limit = 0, size_t memory = DEFAULT_MEMORY);
+
+    virtual ~RowSorter();
+
+    RowSorter(const RowSorter &other) = delete;
+
+    RowSorter(RowSorter &&temp) = delete;
+
+    RowSorter &operator=(const RowSorter &other) = delete;
+
+    RowSorter &operator=(RowSorter &&temp) = delete;
+
+    /**
+     * Add a row to be sorted, spilling a run if the memory budget is used up.
+     * @param row  the row (its values are taken, leaving it empty)
+     */
+    virtual void add(ValueRow &row);
+
+    /**
+     * Stream all the rows added so far in order (or the first limit of them). Call it once, after the last add().
+     * @returns  cursor over the rows, without handles; only good while this sorter lives (freed by caller)
+     */
+    virtual RowBatchCursor *sorted();
+
+    /**
+     * How many runs have been spilled to temporary files.
+     */
+    uint get_run_count() const { return (uint) this->runs.size(); }
+
+    /**
+     * A row and its normalized sort key
+     */
+    typedef std::pair<std::string, ValueRow> KeyedRow;
+
+protected:
+    std::vector<ColumnAttribute::DataType> data_types;
+    ColumnNumbers keys;
+    std::vector<bool> descending;
+    uint64_t limit;
+    bool top_n;   // whether buffer is a max-heap of the first limit rows
+    size_t memory;
+    size_t used;  // estimated bytes taken by buffer
+    std::vector<KeyedRow> buffer;
+    std::vector<FILE *> runs;
+
+    virtual void normalize(const ValueRow &row, std::string &key) const;
+
+    virtual void spill();
+};
+
+bool test_external_sort();
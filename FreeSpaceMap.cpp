@@ -0,0 +1,144 @@
+/**
+ * @file FreeSpaceMap.cpp
+ * @see Seattle University, CPSC5300
+ */
+#include <cstring>
+#include "FreeSpaceMap.h"
+
+using namespace std;
+
+/**
+ * Constructor
+ * @param name  name of the heap file this map belongs to
+ */
+FreeSpaceMap::FreeSpaceMap(string name) : dbfilename(name + ".fsm.db"), closed(true), db(_DB_ENV, 0), hint(1) {
+}
+
+/**
+ * Create physical file (with no blocks tracked yet).
+ */
+void FreeSpaceMap::create(void) {
+    this->db.set_re_len(DbBlock::BLOCK_SZ);
+    this->db.open(nullptr, this->dbfilename.c_str(), nullptr, DB_RECNO, DB_CREATE | DB_EXCL, 0644);
+    this->categories.clear();
+    this->hint = 1;
+    this->closed = false;
+}
+
+/**
+ * Delete the physical file.
+ */
+void FreeSpaceMap::drop(void) {
+    close();
+    Db db(_DB_ENV, 0);
+    db.remove(this->dbfilename.c_str(), nullptr, 0);
+}
+
+/**
+ * Open physical file and read in all the map pages.
+ */
+bool FreeSpaceMap::open(void) {
+    if (!this->closed)
+        return true;
+    try {
+        this->db.set_re_len(DbBlock::BLOCK_SZ);
+        this->db.open(nullptr, this->dbfilename.c_str(), nullptr, DB_RECNO, 0, 0644);
+    } catch (DbException &e) {
+        // a heap file from before we kept free space maps
+        create();
+        return false;
+    }
+    this->categories.clear();
+    for (uint32_t page_number = 1;; page_number++) {
+        Dbt key(&page_number, sizeof(page_number));
+        Dbt data;
+        if (this->db.get(nullptr, &key, &data, 0) == DB_NOTFOUND)
+            break;
+        const uint8_t *bytes = (const uint8_t *) data.get_data();
+        this->categories.insert(this->categories.end(), bytes, bytes + DbBlock::BLOCK_SZ);
+    }
+    this->hint = 1;
+    this->closed = false;
+    return true;
+}
+
+/**
+ * Close the physical file.
+ */
+void FreeSpaceMap::close(void) {
+    if (this->closed)
+        return;
+    this->db.close(0);
+    this->closed = true;
+}
+
+/**
+ * Record the free space in the given block. Only touches the disk if the block's category changes.
+ * @param block_id
+ * @param free_bytes
+ */
+void FreeSpaceMap::set(BlockID block_id, uint free_bytes) {
+    uint category = min(free_bytes / CATEGORY_SZ, 15U);
+    uint index = block_id / 2;
+    if (index >= this->categories.size())
+        this->categories.resize((index / DbBlock::BLOCK_SZ + 1) * DbBlock::BLOCK_SZ, 0);
+    if (get_category(block_id) == category)
+        return;
+    uint8_t &byte = this->categories[index];
+    if (block_id % 2 == 0)
+        byte = (uint8_t) ((byte & 0xf0) | category);
+    else
+        byte = (uint8_t) ((byte & 0x0f) | (category << 4));
+    write_page(index / DbBlock::BLOCK_SZ + 1);
+}
+
+/**
+ * Look for a block whose category guarantees at least size bytes free. The search starts where the last one
+ * left off so that a run of inserts keeps filling the same block.
+ * @param size
+ * @return the block id or 0 if none found
+ */
+BlockID FreeSpaceMap::find(uint size) {
+    uint needed = (size + CATEGORY_SZ - 1) / CATEGORY_SZ;
+    if (needed > 15)
+        return 0;
+    BlockID n = (BlockID) this->categories.size() * 2;
+    if (n == 0)
+        return 0;
+    BlockID block_id = this->hint;
+    for (BlockID scanned = 0; scanned < n;) {
+        if (block_id >= n)
+            block_id = 0;
+        if (block_id % 2 == 0 && this->categories[block_id / 2] == 0) {
+            // both blocks in this byte are full
+            block_id += 2;
+            scanned += 2;
+            continue;
+        }
+        if (block_id != 0 && get_category(block_id) >= needed)
+            return this->hint = block_id;
+        block_id++;
+        scanned++;
+    }
+    return 0;
+}
+
+/**
+ * Get the category for a block.
+ * @param block_id
+ * @return 0..15
+ */
+uint FreeSpaceMap::get_category(BlockID block_id) const {
+    uint8_t byte = this->categories[block_id / 2];
+    return block_id % 2 == 0 ? byte & 0x0f : byte >> 4;
+}
+
+/**
+ * Write out one of the map pages.
+ * @param page_number  1-based page number within the map file
+ */
+void FreeSpaceMap::write_page(uint32_t page_number) {
+    Dbt key(&page_number, sizeof(page_number));
+    Dbt data(&this->categories[(page_number - 1) * DbBlock::BLOCK_SZ], DbBlock::BLOCK_SZ);
+    this->db.put(nullptr, &key, &data, 0);
+}
@@ -0,0 +1,81 @@
+/**
+ * @file FreeSpaceMap.h - Free space tracking for a HeapFile.
+ * FreeSpaceMap
+ *
+ * @see "Seattle University, CPSC5300, Spring 2021"
+ */
+#pragma once
+
+#include <vector>
+#include "db_cxx.h"
+#include "storage_engine.h"
+
+/**
+ * @class FreeSpaceMap - persistent record of roughly how much room is left in each block of a HeapFile
+ *
+ * Each block gets a 4-bit fill category: category c means the block has at least c * CATEGORY_SZ bytes
+ * free. Categories are packed two to a byte in 4 kB map pages which are kept in their own Berkeley DB
+ * RecNo file next to the heap file (<name>.fsm.db). The whole map is loaded into memory on open and a
+ * map page is written back only when one of its categories changes.
+ */
+class FreeSpaceMap {
+public:
+    /**
+     * 16 categories of 256 bytes each
+     */
+    static const uint CATEGORY_SZ = DbBlock::BLOCK_SZ / 16;
+
+    /**
+     * How many blocks one map page covers
+     */
+    static const uint BLOCKS_PER_PAGE = DbBlock::BLOCK_SZ * 2;
+
+    FreeSpaceMap(std::string name);
+
+    virtual ~FreeSpaceMap() {}
+
+    FreeSpaceMap(const FreeSpaceMap &other) = delete;
+
+    FreeSpaceMap(FreeSpaceMap &&temp) = delete;
+
+    FreeSpaceMap &operator=(const FreeSpaceMap &other) = delete;
+
+    FreeSpaceMap &operator=(FreeSpaceMap &&temp) = delete;
+
+    virtual void create(void);
+
+    virtual void drop(void);
+
+    /**
+     * Open the map, creating an empty one if the file doesn't exist yet.
+     * @returns  false if the map had to be created (so the caller should repopulate it)
+     */
+    virtual bool open(void);
+
+    virtual void close(void);
+
+    /**
+     * Record how much free space a block now has.
+     * @param block_id    which block
+     * @param free_bytes  how many bytes could still be handed out in the block
+     */
+    virtual void set(BlockID block_id, uint free_bytes);
+
+    /**
+     * Find a block that is known to have at least the given amount of free space.
+     * @param size  bytes needed
+     * @returns     a block id, or 0 if no block has enough room
+     */
+    virtual BlockID find(uint size);
+
+protected:
+    std::string dbfilename;
+    bool closed;
+    Db db;
+    std::vector<uint8_t> categories;  // all the map pages, back to back
+    BlockID hint;                     // where the last successful find() ended up
+
+    uint get_category(BlockID block_id) const;
+
+    void write_page(uint32_t page_number);
+};
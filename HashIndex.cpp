@@ -0,0 +1,641 @@
+/**
+ * @file HashIndex.cpp - implementation of HashIndex and its buckets
+ * @see "Seattle University, CPSC5300"
+ */
+#include <chrono>
+#include <cstring>
+#include <map>
+#include "HashIndex.h"
+#include "BTreeIndex.h"
+#include "HeapTable.h"
+
+using namespace std;
+
+/*
+ * **********
+ * HashBucket
+ * **********
+ */
+
+/**
+ * A brand new, empty bucket.
+ * @param file         the index file
+ * @param id           primary block of the bucket
+ * @param key_profile  data types of the search key
+ * @param local_depth  how many bits of hash all the bucket's keys agree on
+ */
+HashBucket::HashBucket(HeapFile &file, BlockID id, const KeyProfile &key_profile, uint local_depth) : file(file),
+        id(id), key_profile(key_profile), local_depth(local_depth), entries(), entry_sizes(), overflow() {
+}
+
+/**
+ * Read an existing bucket, following its overflow chain.
+ * @param file         the index file
+ * @param id           primary block of the bucket
+ * @param key_profile  data types of the search key
+ */
+HashBucket::HashBucket(HeapFile &file, BlockID id, const KeyProfile &key_profile) : file(file), id(id),
+        key_profile(key_profile), local_depth(0), entries(), entry_sizes(), overflow() {
+    BlockID block_id = id;
+    while (block_id != 0) {
+        if (block_id != id)
+            this->overflow.push_back(block_id);
+        SlottedPage *page = file.get(block_id);
+        RecordIDCursor *records = page->id_cursor();
+        RecordID record_id;
+        bool is_first = true;
+        while (records->next(record_id)) {
+            Dbt *data = page->get(record_id);
+            const char *bytes = (const char *) data->get_data();
+            if (is_first) {
+                this->local_depth = *(uint32_t *) bytes;
+                block_id = *(BlockID *) (bytes + sizeof(uint32_t));
+                is_first = false;
+            } else {
+                this->entries.push_back(IndexEntry());
+                unmarshal_index_entry(key_profile, bytes, this->entries.back());
+                this->entry_sizes.push_back(data->get_size());
+            }
+            delete data;
+        }
+        delete records;
+        delete page;
+    }
+}
+
+/**
+ * Write the entries out, filling the primary block and then each overflow block in turn. Each block takes
+ * every entry that still fits in it (first fit), so room freed in the primary block by a delete is used again
+ * before the overflow blocks. Overflow blocks left over after a delete are kept (empty) at the end of the
+ * chain so they can be refilled later.
+ */
+void HashBucket::save() {
+    char block[DbBlock::BLOCK_SZ];
+    char bytes[MAX_INDEX_ENTRY_SZ];
+    vector<bool> saved(this->entries.size(), false);
+    uint left = (uint) this->entries.size();
+    for (uint b = 0; b <= this->overflow.size(); b++) {
+        BlockID block_id = b == 0 ? this->id : this->overflow[b - 1];
+        memset(block, 0, sizeof(block));
+        Dbt data(block, sizeof(block));
+        SlottedPage page(data, block_id, true);
+        void *header = nullptr;
+        page.reserve(sizeof(uint32_t) + sizeof(BlockID), header);
+        uint room = BLOCK_ROOM;
+        uint before = left;
+        for (uint i = 0; i < this->entries.size() && left > 0; i++) {
+            if (saved[i] || 4 + this->entry_sizes[i] > room)
+                continue;
+            uint size = marshal_index_entry(this->key_profile, this->entries[i], bytes);
+            Dbt entry(bytes, size);
+            page.add(&entry);
+            room -= 4 + size;
+            saved[i] = true;
+            left--;
+        }
+        if (left > 0 && left == before)
+            throw DbRelationError("hash index entry too big for a block");
+        if (left > 0 && b == this->overflow.size()) {
+            SlottedPage *more = this->file.get_new();
+            this->overflow.push_back(more->get_block_id());
+            delete more;
+        }
+        *(uint32_t *) header = this->local_depth;
+        *(BlockID *) ((char *) header + sizeof(uint32_t)) = b < this->overflow.size() ? this->overflow[b] : 0;
+        this->file.put(&page);
+    }
+}
+
+/**
+ * Only the primary block counts: it gets whichever entries fit in it first (see save()), and the rest, which
+ * went to overflow blocks, don't change whether a new entry would fit there.
+ */
+bool HashBucket::has_room(uint entry_size) const {
+    uint room = BLOCK_ROOM;
+    for (auto const &size: this->entry_sizes)
+        if (4 + size <= room)
+            room -= 4 + size;
+    return 4 + entry_size <= room;
+}
+
+void HashBucket::add(const IndexEntry &entry, uint entry_size) {
+    this->entries.push_back(entry);
+    this->entry_sizes.push_back(entry_size);
+}
+
+bool HashBucket::del(const IndexEntry &entry) {
+    for (uint i = 0; i < this->entries.size(); i++) {
+        if (this->entries[i] == entry) {
+            this->entries.erase(this->entries.begin() + i);
+            this->entry_sizes.erase(this->entry_sizes.begin() + i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void HashBucket::split_into(HashBucket &sibling, uint bit) {
+    uint kept = 0;
+    for (uint i = 0; i < this->entries.size(); i++) {
+        if ((hash_index_key(this->key_profile, this->entries[i].first) >> bit) & 1) {
+            sibling.add(this->entries[i], this->entry_sizes[i]);
+        } else {
+            this->entries[kept] = this->entries[i];
+            this->entry_sizes[kept] = this->entry_sizes[i];
+            kept++;
+        }
+    }
+    this->entries.resize(kept);
+    this->entry_sizes.resize(kept);
+}
+
+
+/*
+ * *********
+ * HashIndex
+ * *********
+ */
+
+/**
+ * Constructor
+ * @param relation     table being indexed
+ * @param name         name of the index (unique for the table)
+ * @param key_columns  columns of the search key, in order
+ * @param unique       true if no two rows may have the same search key
+ */
+HashIndex::HashIndex(DbRelation &relation, Identifier name, ColumnNames key_columns, bool unique) : DbIndex(
+        relation, name, key_columns, unique), file(relation.get_table_name() + "-" + name), closed(true),
+                                                                                                global_depth(0) {
+    relation.get_column_numbers(&this->key_columns, this->key_column_numbers);
+    ColumnAttributes column_attributes = relation.get_column_attributes();
+    for (auto const &col_num: this->key_column_numbers)
+        this->key_profile.push_back(column_attributes[col_num].get_data_type());
+}
+
+/**
+ * Create the index file and fill it with entries for every row already in the relation.
+ * @throws DbRelationError if the relation has duplicate keys for a unique index (the index is dropped)
+ */
+void HashIndex::create() {
+    this->file.create();  // makes block 1 for the stat
+    SlottedPage *page = this->file.get_new();
+    BlockID bucket_id = page->get_block_id();
+    delete page;
+    HashBucket bucket(this->file, bucket_id, this->key_profile, 0);
+    bucket.save();
+    this->global_depth = 0;
+    this->directory.assign(1, bucket_id);
+    this->directory_blocks.clear();
+    save_directory(0, 0);
+    this->closed = false;
+
+    HandleCursor *cursor = this->relation.select_cursor();
+    Handle handle;
+    try {
+        while (cursor->next(handle))
+            insert(handle);
+    } catch (DbRelationError &e) {
+        delete cursor;
+        drop();
+        throw;
+    }
+    delete cursor;
+}
+
+void HashIndex::drop() {
+    this->file.drop();
+    this->directory.clear();
+    this->directory_blocks.clear();
+    this->closed = true;
+}
+
+/**
+ * Open the index file and read the directory into memory.
+ */
+void HashIndex::open() {
+    if (!this->closed)
+        return;
+    this->file.open();
+    SlottedPage *page = this->file.get(STAT);
+    RecordIDCursor *records = page->id_cursor();
+    RecordID record_id;
+    this->directory_blocks.clear();
+    while (records->next(record_id)) {
+        Dbt *data = page->get(record_id);
+        if (record_id == 1)
+            this->global_depth = *(uint32_t *) data->get_data();
+        else
+            this->directory_blocks.push_back(*(BlockID *) data->get_data());
+        delete data;
+    }
+    delete records;
+    delete page;
+
+    this->directory.clear();
+    this->directory.reserve(1U << this->global_depth);
+    for (auto const &block_id: this->directory_blocks) {
+        page = this->file.get(block_id);
+        Dbt *data = page->get(1);
+        const BlockID *slots = (const BlockID *) data->get_data();
+        this->directory.insert(this->directory.end(), slots, slots + data->get_size() / sizeof(BlockID));
+        delete data;
+        delete page;
+    }
+    this->closed = false;
+}
+
+void HashIndex::close() {
+    this->file.close();
+    this->directory.clear();
+    this->directory_blocks.clear();
+    this->closed = true;
+}
+
+/**
+ * Find the rows with the given search key.
+ * @param key_values  value for each of the key columns
+ * @return            handles of the matching rows (freed by caller)
+ */
+Handles *HashIndex::lookup(ValueDict *key_values) const {
+    if (this->closed)
+        throw DbRelationError("index " + this->name + " is not open");
+    KeyValue *key = make_index_key(this->key_columns, key_values);
+    HashBucket bucket(this->file, bucket_for(hash_index_key(this->key_profile, *key)), this->key_profile);
+    Handles *handles = new Handles();
+    for (auto const &entry: bucket.get_entries())
+        if (entry.first == *key)
+            handles->push_back(entry.second);
+    delete key;
+    return handles;
+}
+
+/**
+ * Add the entry for a row just inserted into the relation, splitting its bucket first if it is full.
+ * @param record  the new row
+ * @throws DbRelationError if this is a unique index and the key is already there
+ */
+void HashIndex::insert(Handle record) {
+    open();
+    KeyValue *key = this->relation.project_row(record, &this->key_column_numbers);
+    IndexEntry entry(*key, record);
+    delete key;
+    char bytes[MAX_INDEX_ENTRY_SZ];
+    uint size = marshal_index_entry(this->key_profile, entry, bytes);
+    uint32_t hash = hash_index_key(this->key_profile, entry.first);
+
+    HashBucket *bucket = new HashBucket(this->file, bucket_for(hash), this->key_profile);
+    if (this->unique) {
+        for (auto const &other: bucket->get_entries()) {
+            if (other.first == entry.first) {
+                delete bucket;
+                throw DbRelationError("duplicate key for unique index " + this->name);
+            }
+        }
+    }
+    while (!bucket->has_room(size) && bucket->get_local_depth() < MAX_GLOBAL_DEPTH) {
+        // splitting is no use if everything in the bucket hashes the same as the new entry
+        bool separable = false;
+        for (auto const &other: bucket->get_entries()) {
+            if (hash_index_key(this->key_profile, other.first) != hash) {
+                separable = true;
+                break;
+            }
+        }
+        if (!separable)
+            break;
+        split(*bucket, hash);
+        delete bucket;
+        bucket = new HashBucket(this->file, bucket_for(hash), this->key_profile);
+    }
+    bucket->add(entry, size);
+    bucket->save();
+    delete bucket;
+}
+
+/**
+ * Remove the entry for a row about to be deleted from the relation.
+ * @param record  the row (must still be in the relation)
+ */
+void HashIndex::del(Handle record) {
+    open();
+    KeyValue *key = this->relation.project_row(record, &this->key_column_numbers);
+    IndexEntry entry(*key, record);
+    delete key;
+    HashBucket bucket(this->file, bucket_for(hash_index_key(this->key_profile, entry.first)), this->key_profile);
+    if (bucket.del(entry))
+        bucket.save();
+}
+
+/**
+ * The entries are grouped by bucket, so each bucket is read and written once.
+ */
+void HashIndex::del_batch(const Handles &records) {
+    open();
+    map<BlockID, vector<IndexEntry>> by_bucket;
+    for (auto const &record: records) {
+        KeyValue *key = this->relation.project_row(record, &this->key_column_numbers);
+        IndexEntry entry(*key, record);
+        delete key;
+        by_bucket[bucket_for(hash_index_key(this->key_profile, entry.first))].push_back(entry);
+    }
+    for (auto const &group: by_bucket) {
+        HashBucket bucket(this->file, group.first, this->key_profile);
+        bool changed = false;
+        for (auto const &entry: group.second)
+            if (bucket.del(entry))
+                changed = true;
+        if (changed)
+            bucket.save();
+    }
+}
+
+/**
+ * Which bucket holds the keys with the given hash.
+ * @param hash  hash of a search key
+ * @return      primary block of the bucket
+ */
+BlockID HashIndex::bucket_for(uint32_t hash) const {
+    return this->directory[hash & ((1U << this->global_depth) - 1)];
+}
+
+/**
+ * Split a bucket in two by the next bit of hash, doubling the directory first if the bucket is already as
+ * deep as the directory.
+ * @param bucket  the bucket (its entries are moved, and both halves are saved)
+ * @param hash    the hash of any key that goes to this bucket
+ */
+void HashIndex::split(HashBucket &bucket, uint32_t hash) {
+    uint depth = bucket.get_local_depth();
+    bool doubled = false;
+    if (depth == this->global_depth) {
+        uint size = (uint) this->directory.size();
+        this->directory.resize(2 * size);
+        copy(this->directory.begin(), this->directory.begin() + size, this->directory.begin() + size);
+        this->global_depth++;
+        doubled = true;
+    }
+
+    SlottedPage *page = this->file.get_new();
+    HashBucket sibling(this->file, page->get_block_id(), this->key_profile, depth + 1);
+    delete page;
+    bucket.set_local_depth(depth + 1);
+    bucket.split_into(sibling, depth);
+    bucket.save();
+    sibling.save();
+
+    // the slots for this bucket are the ones whose low depth bits match; those with bit depth set move over
+    uint pattern = (hash & ((1U << depth) - 1)) | (1U << depth);
+    uint stride = 1U << (depth + 1);
+    uint last_block = UINT32_MAX;
+    for (uint slot = pattern; slot < this->directory.size(); slot += stride) {
+        this->directory[slot] = sibling.get_id();
+        if (!doubled && slot / SLOTS_PER_BLOCK != last_block) {
+            save_directory(slot, slot);
+            last_block = slot / SLOTS_PER_BLOCK;
+        }
+    }
+    if (doubled)
+        save_directory(0, (uint) this->directory.size() - 1);
+}
+
+/**
+ * Write out the directory blocks covering the given slots, adding directory blocks as needed.
+ * @param first_slot  first slot that changed
+ * @param last_slot   last slot that changed
+ */
+void HashIndex::save_directory(uint first_slot, uint last_slot) {
+    bool added = false;
+    char block[DbBlock::BLOCK_SZ];
+    for (uint b = first_slot / SLOTS_PER_BLOCK; b <= last_slot / SLOTS_PER_BLOCK; b++) {
+        if (b == this->directory_blocks.size()) {
+            SlottedPage *page = this->file.get_new();
+            this->directory_blocks.push_back(page->get_block_id());
+            delete page;
+            added = true;
+        }
+        uint first = b * SLOTS_PER_BLOCK;
+        uint count = (uint) this->directory.size() - first;
+        if (count > SLOTS_PER_BLOCK)
+            count = SLOTS_PER_BLOCK;
+        memset(block, 0, sizeof(block));
+        Dbt data(block, sizeof(block));
+        SlottedPage page(data, this->directory_blocks[b], true);
+        Dbt slots(&this->directory[first], count * sizeof(BlockID));
+        page.add(&slots);
+        this->file.put(&page);
+    }
+    if (added || first_slot == 0)
+        save_stat();
+}
+
+/**
+ * Write block 1: record 1 is the global depth, records 2, ... are the directory's block ids.
+ */
+void HashIndex::save_stat() {
+    char block[DbBlock::BLOCK_SZ];
+    memset(block, 0, sizeof(block));
+    Dbt data(block, sizeof(block));
+    SlottedPage page(data, STAT, true);
+    uint32_t depth = this->global_depth;
+    Dbt depth_data(&depth, sizeof(uint32_t));
+    page.add(&depth_data);
+    for (auto &block_id: this->directory_blocks) {
+        Dbt block_data(&block_id, sizeof(BlockID));
+        page.add(&block_data);
+    }
+    this->file.put(&page);
+}
+
+
+/**
+ * Test HashIndex: lookups, duplicate keys, deletes, unique checking and reopening on a table big enough for
+ * plenty of bucket splits and a few directory doublings.
+ * @return true if the tests all succeeded
+ */
+bool test_hash_index() {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    HeapTable table("_test_hash_index_cpp", column_names, column_attributes);
+    table.create_if_not_exists();
+    ValueDict row;
+    const int N = 10000;
+    for (int i = 0; i < N; i++) {
+        row["a"] = Value(i);
+        row["b"] = Value("b" + to_string(i));
+        table.insert(&row);
+    }
+
+    // built from existing rows
+    ColumnNames key_columns;
+    key_columns.push_back("a");
+    HashIndex index(table, "fooindex", key_columns, true);
+    index.create();
+    table.attach_index(&index);
+
+    // maintained on insert
+    for (int i = N; i < 2 * N; i++) {
+        row["a"] = Value(i);
+        row["b"] = Value("b" + to_string(i));
+        table.insert(&row);
+    }
+
+    // still all there after reading the directory back in
+    index.close();
+    index.open();
+    ValueDict lookup;
+    for (int i = 0; i < 2 * N; i += 89) {
+        lookup["a"] = Value(i);
+        Handles *handles = index.lookup(&lookup);
+        bool ok = handles->size() == 1;
+        if (ok) {
+            ValueDict *result = table.project((*handles)[0]);
+            ok = (*result)["b"].s == "b" + to_string(i);
+            delete result;
+        }
+        delete handles;
+        if (!ok)
+            return assertion_failure("hash lookup", i);
+    }
+    lookup["a"] = Value(2 * N);
+    Handles *handles = index.lookup(&lookup);
+    if (!handles->empty())
+        return assertion_failure("hash lookup of missing key");
+    delete handles;
+
+    // unique
+    row["a"] = Value(5);
+    try {
+        table.insert(&row);
+        return assertion_failure("hash unique");
+    } catch (DbRelationError &e) {
+        // expected
+    }
+    handles = table.select();
+    if (handles->size() != 2 * N)
+        return assertion_failure("row left behind by failed insert");
+    delete handles;
+
+    // maintained on delete (and select uses the index)
+    ValueDict where;
+    where["a"] = Value(12345);
+    handles = table.select(&where);
+    if (handles->size() != 1)
+        return assertion_failure("select via hash index");
+    table.del((*handles)[0]);
+    delete handles;
+    lookup["a"] = Value(12345);
+    handles = index.lookup(&lookup);
+    if (!handles->empty())
+        return assertion_failure("hash del");
+    delete handles;
+    table.detach_index(&index);
+    index.drop();
+
+    // non-unique on a text column, with more duplicates of one key than fit in a bucket
+    key_columns.clear();
+    key_columns.push_back("b");
+    HashIndex dups(table, "barindex", key_columns, false);
+    dups.create();
+    table.attach_index(&dups);
+    for (int i = 0; i < 1000; i++) {
+        row["a"] = Value(-i);
+        row["b"] = Value("same");
+        table.insert(&row);
+    }
+    lookup.clear();
+    lookup["b"] = Value("same");
+    handles = dups.lookup(&lookup);
+    bool ok = handles->size() == 1000;
+    delete handles;
+    lookup["b"] = Value("b777");
+    handles = dups.lookup(&lookup);
+    ok = ok && handles->size() == 1;
+    delete handles;
+
+    // deleting from the overflowing bucket and adding back, which refills the room freed in its blocks
+    lookup["b"] = Value("same");
+    handles = dups.lookup(&lookup);
+    for (uint i = 0; i < 100 && i < handles->size(); i++)
+        table.del((*handles)[i]);
+    delete handles;
+    for (int i = 0; i < 50; i++) {
+        row["a"] = Value(-1000 - i);
+        row["b"] = Value("same");
+        table.insert(&row);
+    }
+    handles = dups.lookup(&lookup);
+    ok = ok && handles->size() == 950;
+    delete handles;
+    table.detach_index(&dups);
+    dups.drop();
+    table.drop();
+    if (!ok)
+        return assertion_failure("hash duplicates");
+    return true;
+}
+
+/**
+ * Benchmark point lookups through a HashIndex against the same lookups through a BTreeIndex and against
+ * select() with a where clause, which has to scan.
+ * @param rows  how many rows to load
+ */
+void benchmark_hash_index(uint rows) {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    HeapTable table("_benchmark_hash_cpp", column_names, column_attributes);
+    table.create_if_not_exists();
+    ValueDict row;
+    for (uint i = 0; i < rows; i++) {
+        row["a"] = Value(i);
+        row["b"] = Value("row number " + to_string(i));
+        table.insert(&row);
+    }
+    ColumnNames key_columns;
+    key_columns.push_back("a");
+    HashIndex hash(table, "benchmark_hash", key_columns, true);
+    BTreeIndex btree(table, "benchmark_btree", key_columns, true);
+    DbIndex *indices[] = {&hash, &btree};
+    const char *labels[] = {"hash", "btree"};
+
+    const uint LOOKUPS = 1000;
+    ValueDict where;
+    uint found = 0;
+    for (uint n = 0; n < 2; n++) {
+        auto start = chrono::steady_clock::now();
+        indices[n]->create();
+        double create_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        start = chrono::steady_clock::now();
+        for (uint i = 0; i < LOOKUPS; i++) {
+            where["a"] = Value((i * 7919) % rows);
+            Handles *handles = indices[n]->lookup(&where);
+            found += handles->size();
+            delete handles;
+        }
+        double lookup_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << labels[n] << " index on " << rows << " rows: create " << create_ms << " ms, lookup "
+             << lookup_ms * 1000 / LOOKUPS << " us each" << endl;
+    }
+
+    const uint SCANS = 10;
+    auto start = chrono::steady_clock::now();
+    for (uint i = 0; i < SCANS; i++) {
+        where["a"] = Value((i * 7919) % rows);
+        Handles *handles = table.select(&where);
+        found += handles->size();
+        delete handles;
+    }
+    double scan_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "scanning select on " << rows << " rows: " << scan_ms * 1000 / SCANS << " us each (" << found
+         << " found)" << endl;
+    hash.drop();
+    btree.drop();
+    table.drop();
+}
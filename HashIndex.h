@@ -0,0 +1,159 @@
+/**
+ * @file HashIndex.h - Implementation of DbIndex with extendible hashing.
+ * HashBucket
+ * HashIndex: DbIndex
+ *
+ * @see "Seattle University, CPSC5300, Spring 2021"
+ */
+#pragma once
+
+#include "storage_engine.h"
+#include "HeapFile.h"
+#include "IndexKey.h"
+
+/**
+ * @class HashBucket - one bucket of a HashIndex: a primary block plus any overflow blocks chained from it
+ *
+ *      Each block's record 1 holds the bucket's local depth and the id of the next overflow block (0 if
+ *      none); the rest of its records are entries. Overflow blocks are only needed when a bucket fills up
+ *      with entries that all hash alike (e.g., lots of rows with the same key), since splitting can't
+ *      separate those. A bucket is read into memory in its entirety and written back by save().
+ */
+class HashBucket {
+public:
+    HashBucket(HeapFile &file, BlockID id, const KeyProfile &key_profile, uint local_depth);
+
+    HashBucket(HeapFile &file, BlockID id, const KeyProfile &key_profile);
+
+    virtual ~HashBucket() {}
+
+    /**
+     * Write the bucket back, adding overflow blocks if the entries don't fit in the blocks it already has.
+     * @throws DbRelationError if an entry doesn't fit even in an empty block
+     */
+    virtual void save();
+
+    /**
+     * Would one more entry of the given size still fit in the primary block?
+     * @param entry_size  marshaled size of the entry
+     * @returns           true if it fits without an overflow block
+     */
+    virtual bool has_room(uint entry_size) const;
+
+    /**
+     * Add an entry (in memory only until save()).
+     * @param entry       the entry
+     * @param entry_size  its marshaled size
+     */
+    virtual void add(const IndexEntry &entry, uint entry_size);
+
+    /**
+     * Remove an entry (in memory only until save()).
+     * @param entry  the entry
+     * @returns      false if it wasn't there
+     */
+    virtual bool del(const IndexEntry &entry);
+
+    /**
+     * Move the entries whose hash has the given bit set into another (empty) bucket.
+     * @param sibling  bucket to move them to
+     * @param bit      which bit of the hash decides
+     */
+    virtual void split_into(HashBucket &sibling, uint bit);
+
+    BlockID get_id() const { return id; }
+
+    uint get_local_depth() const { return local_depth; }
+
+    void set_local_depth(uint local_depth) { this->local_depth = local_depth; }
+
+    const std::vector<IndexEntry> &get_entries() const { return entries; }
+
+protected:
+    HeapFile &file;
+    BlockID id;
+    const KeyProfile &key_profile;
+    uint local_depth;
+    std::vector<IndexEntry> entries;
+    std::vector<uint> entry_sizes;     // marshaled size of each entry
+    std::vector<BlockID> overflow;     // overflow blocks, in chain order
+
+    // room for entries (with their 4-byte slots) in an empty block: after the slotted page header and record 1
+    static const uint BLOCK_ROOM = DbBlock::BLOCK_SZ - 4 - 4 - sizeof(uint32_t) - sizeof(BlockID);
+};
+
+/**
+ * @class HashIndex - extendible hashing implementation of DbIndex
+ *
+ *      The index lives in its own HeapFile (<table>-<index>.db). The directory has 2^global_depth slots,
+ *      each the block id of a bucket, and slot i covers the keys whose hash has i as its low global_depth
+ *      bits. Several slots share a bucket when the bucket's local depth is less than the global depth.
+ *      A full bucket is split in two by one more bit of hash, which touches only that bucket's entries
+ *      and slots; the directory doubles (by copying slots, not by rehashing) only when the bucket being
+ *      split is already at the global depth. So a lookup is one directory probe plus one bucket read.
+ *
+ *      Block 1 holds the global depth and the ids of the blocks the directory is stored in; the
+ *      directory itself is kept in memory while the index is open. Deletes never merge buckets.
+ */
+class HashIndex : public DbIndex {
+public:
+    /**
+     * Most directory slots stored in one block
+     */
+    static const uint SLOTS_PER_BLOCK = 1000;
+
+    /**
+     * We stop doubling the directory here and let buckets overflow instead
+     */
+    static const uint MAX_GLOBAL_DEPTH = 24;
+
+    HashIndex(DbRelation &relation, Identifier name, ColumnNames key_columns, bool unique);
+
+    virtual ~HashIndex() {}
+
+    HashIndex(const HashIndex &other) = delete;
+
+    HashIndex(HashIndex &&temp) = delete;
+
+    HashIndex &operator=(const HashIndex &other) = delete;
+
+    HashIndex &operator=(HashIndex &&temp) = delete;
+
+    virtual void create();
+
+    virtual void drop();
+
+    virtual void open();
+
+    virtual void close();
+
+    virtual Handles *lookup(ValueDict *key_values) const;
+
+    virtual void insert(Handle record);
+
+    virtual void del(Handle record);
+
+    virtual void del_batch(const Handles &records);
+
+protected:
+    static const BlockID STAT = 1;
+
+    mutable HeapFile file;  // lookups only read it, but reading goes through the (non-const) buffer pool
+    bool closed;
+    KeyProfile key_profile;
+    ColumnNumbers key_column_numbers;
+    uint global_depth;
+    std::vector<BlockID> directory;
+    std::vector<BlockID> directory_blocks;
+
+    virtual BlockID bucket_for(uint32_t hash) const;
+
+    virtual void split(HashBucket &bucket, uint32_t hash);
+
+    virtual void save_directory(uint first_slot, uint last_slot);
+
+    virtual void save_stat();
+};
+
+bool test_hash_index();
+void benchmark_hash_index(uint rows);
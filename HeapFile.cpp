@@ -10,12 +10,150 @@
 using namespace std;
 typedef uint16_t u16;
 
+/**
+ * @class PinnedSlottedPage - a SlottedPage whose bytes live in a buffer pool frame; the frame stays pinned
+ * for as long as the page object exists.
+ */
+class PinnedSlottedPage : public SlottedPage {
+public:
+    PinnedSlottedPage(Dbt &block, BlockID block_id, uint frame) : SlottedPage(block, block_id), frame(frame) {}
+
+    virtual ~PinnedSlottedPage() { _BUFFER_POOL->unpin(this->frame); }
+
+    PinnedSlottedPage(const PinnedSlottedPage &other) = delete;
+
+    PinnedSlottedPage &operator=(const PinnedSlottedPage &other) = delete;
+
+protected:
+    uint frame;
+};
+
+unordered_map<string, HeapFileState *> HeapFileState::registry;
+
+HeapFileState::HeapFileState(const string &name) : last(0), free_space_map(name), open_count(0), name(name),
+                                                   references(0) {
+}
+
+HeapFileState *HeapFileState::acquire(const string &name) {
+    HeapFileState *&state = HeapFileState::registry[name];
+    if (state == nullptr)
+        state = new HeapFileState(name);
+    state->references++;
+    return state;
+}
+
+void HeapFileState::release(HeapFileState *state) {
+    if (--state->references > 0)
+        return;
+    HeapFileState::registry.erase(state->name);
+    state->free_space_map.close();
+    delete state;
+}
+
+/**
+ * Constructor
+ * @param name
+ */
+SlottedPageFile::SlottedPageFile(string name) : DbFile(name), closed(true), state(HeapFileState::acquire(name)) {
+}
+
+/**
+ * Destructor - subclasses close the file in theirs (a base destructor can't call their close()).
+ */
+SlottedPageFile::~SlottedPageFile() {
+    HeapFileState::release(this->state);
+}
+
+/**
+ * Consult the free space map for a block that can take a record of the given size.
+ * @param size  record size
+ * @return      a block id or 0 if there is no such block
+ */
+BlockID SlottedPageFile::find_block_with_room(uint size) {
+    return this->state->free_space_map.find(size + 4);  // 4 more for the record's header
+}
+
+/**
+ * Sequence of all block ids.
+ * @return block ids
+ */
+BlockIDs *SlottedPageFile::block_ids() const {
+    BlockIDs *vec = new BlockIDs();
+    for (BlockID block_id = 1; block_id <= this->state->last; block_id++)
+        vec->push_back(block_id);
+    return vec;
+}
+
+/**
+ * @class SlottedPageFileCursor - counts through the block ids of a SlottedPageFile (as of when the cursor was made)
+ */
+class SlottedPageFileCursor : public BlockIDCursor {
+public:
+    SlottedPageFileCursor(uint32_t last) : block_id(0), last(last) {}
+
+    virtual bool next(BlockID &next_id) {
+        if (this->block_id >= this->last)
+            return false;
+        next_id = ++this->block_id;
+        return true;
+    }
+
+protected:
+    BlockID block_id;
+    BlockID last;
+};
+
+/**
+ * Stream of all block ids.
+ * @return cursor over the block ids (freed by caller)
+ */
+BlockIDCursor *SlottedPageFile::block_cursor() const {
+    return new SlottedPageFileCursor(this->state->last);
+}
+
+/**
+ * Open the free space map, unless another object on the same file already has.
+ */
+void SlottedPageFile::open_free_space_map() {
+    if (this->state->open_count++ == 0 && !this->state->free_space_map.open())
+        rebuild_free_space_map();
+}
+
+/**
+ * Close the free space map if no other object has the file open.
+ */
+void SlottedPageFile::close_free_space_map() {
+    if (this->state->open_count > 0 && --this->state->open_count == 0)
+        this->state->free_space_map.close();
+}
+
+/**
+ * Repopulate the free space map from the blocks themselves (for files made before we had one).
+ */
+void SlottedPageFile::rebuild_free_space_map() {
+    for (BlockID block_id = 1; block_id <= this->state->last; block_id++) {
+        SlottedPage *page = get(block_id);
+        this->state->free_space_map.set(block_id, page->free_space());
+        delete page;
+    }
+}
+
+
 /**
  * Constructor
  * @param name
  */
-HeapFile::HeapFile(string name) : DbFile(name), dbfilename(""), last(0), closed(true), db(_DB_ENV, 0) {
+HeapFile::HeapFile(string name) : SlottedPageFile(name), dbfilename(""), db(_DB_ENV, 0), file_id(0) {
     this->dbfilename = this->name + ".db";
+    this->file_id = _BUFFER_POOL->register_file(this->dbfilename);
+}
+
+/**
+ * Destructor - make sure nothing we changed is left only in the buffer pool.
+ */
+HeapFile::~HeapFile() {
+    if (!this->closed)
+        close();
 }
 
 /**
@@ -23,6 +161,8 @@ HeapFile::HeapFile(string name) : DbFile(name), dbfilename(""), last(0), closed(
  */
 void HeapFile::create(void) {
     db_open(DB_CREATE | DB_EXCL);
+    this->state->free_space_map.create();
+    this->state->open_count++;
     SlottedPage *page = get_new(); // force one page to exist
     delete page;
 }
@@ -31,22 +171,31 @@ void HeapFile::create(void) {
  * Delete the physical file.
  */
 void HeapFile::drop(void) {
+    _BUFFER_POOL->discard(this->file_id);
     close();
     Db db(_DB_ENV, 0);
     db.remove(this->dbfilename.c_str(), nullptr, 0);
+    this->state->free_space_map.drop();
 }
 
 /**
  * Open physical file.
  */
 void HeapFile::open(void) {
+    if (!this->closed)
+        return;
     db_open();
+    open_free_space_map();
 }
 
 /**
  * Close the physical file.
  */
 void HeapFile::close(void) {
+    if (!this->closed) {
+        _BUFFER_POOL->flush(this->file_id, &this->db);
+        close_free_space_map();
+    }
     this->db.close(0);
     this->closed = true;
 }
@@ -60,48 +209,42 @@ SlottedPage *HeapFile::get_new(void) {
     memset(block, 0, sizeof(block));
     Dbt data(block, sizeof(block));
 
-    int block_id = ++this->last;
+    BlockID block_id = ++this->state->last;
     Dbt key(&block_id, sizeof(block_id));
 
-    // write out an empty block and read it back in so Berkeley DB is managing the memory
-    SlottedPage *page = new SlottedPage(data, this->last, true);
+    // write out an empty block and read it back in so the buffer pool is managing the memory
+    SlottedPage *page = new SlottedPage(data, block_id, true);
     this->db.put(nullptr, &key, &data, 0); // write it out with initialization done to it
+    _STORAGE_COUNTERS.block_writes++;
     delete page;
-    this->db.get(nullptr, &key, &data, 0);
-    return new SlottedPage(data, this->last);
+    page = get(block_id);
+    this->state->free_space_map.set(block_id, page->free_space());
+    return page;
 }
 
 /**
- * Get a block from the database file.
+ * Get a block from the database file (via the buffer pool). The block stays pinned in the pool until the
+ * returned page is deleted.
  * @param block_id
  * @return          the given slotted page (freed by caller)
  */
 SlottedPage *HeapFile::get(BlockID block_id) {
-    Dbt key(&block_id, sizeof(block_id));
-    Dbt data;
-    this->db.get(nullptr, &key, &data, 0);
-    return new SlottedPage(data, block_id, false);
+    uint frame = _BUFFER_POOL->pin(this->file_id, &this->db, block_id);
+    _STORAGE_COUNTERS.block_reads++;
+    Dbt data(_BUFFER_POOL->get_data(frame), DbBlock::BLOCK_SZ);
+    return new PinnedSlottedPage(data, block_id, frame);
 }
 
 /**
- * Write a block back to the database file.
+ * Write a block back to the database file. It goes to the buffer pool and only reaches Berkeley DB when
+ * its frame is evicted or the file is closed.
  * @param block
  */
 void HeapFile::put(DbBlock *block) {
-    int block_id = block->get_block_id();
-    Dbt key(&block_id, sizeof(block_id));
-    this->db.put(nullptr, &key, block->get_block(), 0);
-}
-
-/**
- * Sequence of all block ids.
- * @return block ids
- */
-BlockIDs *HeapFile::block_ids() const {
-    BlockIDs *vec = new BlockIDs();
-    for (BlockID block_id = 1; block_id <= this->last; block_id++)
-        vec->push_back(block_id);
-    return vec;
+    BlockID block_id = block->get_block_id();
+    _BUFFER_POOL->put(this->file_id, &this->db, block_id, block->get_data());
+    _STORAGE_COUNTERS.block_writes++;
+    this->state->free_space_map.set(block_id, ((SlottedPage *) block)->free_space());
 }
 
 /**
@@ -126,6 +269,9 @@ void HeapFile::db_open(uint flags) {
     this->db.set_re_len(DbBlock::BLOCK_SZ); // record length - will be ignored if file already exists
     this->db.open(nullptr, this->dbfilename.c_str(), nullptr, DB_RECNO, flags, 0644);
 
-    this->last = flags ? 0 : get_block_count();
+    if (flags != 0)
+        this->state->last = 0;
+    else if (this->state->open_count == 0)
+        this->state->last = get_block_count();
     this->closed = false;
 }
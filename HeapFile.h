@@ -1,29 +1,135 @@
 /**
  * @file HeapFile.h - Implementation of storage_engine with a heap file structure.
- * HeapFile: DbFile
+ * HeapFileState
+ * SlottedPageFile: DbFile
+ * HeapFile: SlottedPageFile
  *
  * @author Kevin Lundeen
  * @see "Seattle University, CPSC5300, Spring 2021"
  */
 #pragma once
 
+#include <unordered_map>
 #include "db_cxx.h"
 #include "SlottedPage.h"
+#include "FreeSpaceMap.h"
+#include "BufferPool.h"
 
+/**
+ * @class HeapFileState - what every HeapFile object on the same file has to agree on: how many blocks the file
+ *                        has and how full they are
+ *
+ * More than one HeapFile can be open on a file at once (e.g., the schema tables are opened again by Tables
+ * objects made while SQLExec's are open), so this lives in a registry keyed by the file's name rather than in
+ * each HeapFile. The free space map is opened by the first of them to open the file and closed by the last.
+ */
+class HeapFileState {
+public:
+    /**
+     * The state for a file, made the first time any HeapFile asks for it.
+     * @param name  name of the heap file
+     * @returns     the state (give it back with release())
+     */
+    static HeapFileState *acquire(const std::string &name);
+
+    /**
+     * Give back a state from acquire(). It is freed when the last HeapFile using it gives it back.
+     * @param state  from acquire()
+     */
+    static void release(HeapFileState *state);
+
+    HeapFileState(const HeapFileState &other) = delete;
+
+    HeapFileState(HeapFileState &&temp) = delete;
+
+    HeapFileState &operator=(const HeapFileState &other) = delete;
+
+    HeapFileState &operator=(HeapFileState &&temp) = delete;
+
+    uint32_t last;                // id of the file's last block
+    FreeSpaceMap free_space_map;
+    uint open_count;              // how many HeapFiles have the file open
+
+protected:
+    std::string name;
+    uint references;              // how many HeapFiles have acquired this
+
+    static std::unordered_map<std::string, HeapFileState *> registry;
+
+    HeapFileState(const std::string &name);
+
+    virtual ~HeapFileState() {}
+};
+
+/**
+ * @class SlottedPageFile - what every file of SlottedPage blocks numbered 1..last has in common, however the
+ *                          blocks are stored
+ *
+ * Keeps the file's HeapFileState (block count and free space map) and answers everything that only needs it.
+ * Subclasses say where the blocks live: HeapFile in Berkeley DB through the buffer pool, MmapHeapFile in a
+ * memory-mapped plain file.
+ */
+class SlottedPageFile : public DbFile {
+public:
+    SlottedPageFile(std::string name);
+
+    virtual ~SlottedPageFile();
+
+    SlottedPageFile(const SlottedPageFile &other) = delete;
+
+    SlottedPageFile(SlottedPageFile &&temp) = delete;
+
+    SlottedPageFile &operator=(const SlottedPageFile &other) = delete;
+
+    SlottedPageFile &operator=(SlottedPageFile &&temp) = delete;
+
+    virtual SlottedPage *get_new(void) = 0;
+
+    virtual SlottedPage *get(BlockID block_id) = 0;
+
+    virtual BlockIDs *block_ids() const;
+
+    virtual BlockIDCursor *block_cursor() const;
+
+    /**
+     * Get the id of the current final block in the file.
+     * @return block id of last block
+     */
+    virtual uint32_t get_last_block_id() { return this->state->last; }
+
+    /**
+     * Find a block that has room for a record of the given size.
+     * @param size  size of the record to be added (not including its header)
+     * @return      block id of a block with room, or 0 if a new block is needed
+     */
+    virtual BlockID find_block_with_room(uint size);
+
+protected:
+    bool closed;
+    HeapFileState *state;
+
+    virtual void open_free_space_map();
+
+    virtual void close_free_space_map();
+
+    virtual void rebuild_free_space_map();
+};
 
 /**
  * @class HeapFile - heap file implementation of DbFile
  *
  * Heap file organization. Built on top of Berkeley DB RecNo file. There is one of our
-        database blocks for each Berkeley DB record in the RecNo file. In this way we are using Berkeley DB
-        for buffer management and file management.
+        database blocks for each Berkeley DB record in the RecNo file. Berkeley DB does the file management
+        and blocks are read and written through our own BufferPool (_BUFFER_POOL).
         Uses SlottedPage for storing records within blocks.
+        Keeps a FreeSpaceMap up to date on every put so inserts can reuse room freed by deletes (it and the
+        block count are shared with any other HeapFile on the same file; see HeapFileState).
  */
-class HeapFile : public DbFile {
+class HeapFile : public SlottedPageFile {
 public:
     HeapFile(std::string name);
 
-    virtual ~HeapFile() {}
+    virtual ~HeapFile();
 
     HeapFile(const HeapFile &other) = delete;
 
@@ -47,19 +153,10 @@ public:
 
     virtual void put(DbBlock *block);
 
-    virtual BlockIDs *block_ids() const;
-
-    /**
-     * Get the id of the current final block in the heap file.
-     * @return block id of last block
-     */
-    virtual uint32_t get_last_block_id() { return last; }
-
 protected:
     std::string dbfilename;
-    uint32_t last;
-    bool closed;
     Db db;
+    uint32_t file_id;  // for the buffer pool
 
     virtual void db_open(uint flags = 0);
 
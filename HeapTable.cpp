@@ -3,20 +3,46 @@
  * @author K Lundeen
  * @see Seattle University, CPSC5300
  */
-#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <random>
 #include "HeapTable.h"
+#include "CsvReader.h"
+#include "Predicate.h"
 
 using namespace std;
 typedef uint16_t u16;
 
+/**
+ * Where a forwarded row went.
+ * @param block      the row's home block
+ * @param record_id  the row's FORWARD stub
+ * @return           handle of the MOVED record with the row's bytes
+ */
+static Handle forwarded_to(const SlottedPage *block, RecordID record_id) {
+    u16 size;
+    const char *stub = block->get_bytes(record_id, size);
+    return Handle(*(BlockID *) stub, *(RecordID *) (stub + sizeof(BlockID)));
+}
+
 /**
  * Constructor
  * @param table_name
  * @param column_names
  * @param column_attributes
+ * @param memory_mapped      store the table in an MmapHeapFile instead of a Berkeley DB backed HeapFile
  */
-HeapTable::HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes) : DbRelation(
-        table_name, column_names, column_attributes), file(table_name) {
+HeapTable::HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+                     bool memory_mapped) : DbRelation(table_name, column_names, column_attributes), file(nullptr),
+                                           codec(column_attributes) {
+    if (memory_mapped)
+        this->file = new MmapHeapFile(table_name);
+    else
+        this->file = new HeapFile(table_name);
+}
+
+HeapTable::~HeapTable() {
+    delete this->file;
 }
 
 /**
@@ -24,7 +50,7 @@ HeapTable::HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttr
  * Is not responsible for metadata storage or validation.
  */
 void HeapTable::create() {
-    file.create();
+    file->create();
 }
 
 /**
@@ -43,21 +69,21 @@ void HeapTable::create_if_not_exists() {
  * Execute: DROP TABLE <table_name>
  */
 void HeapTable::drop() {
-    file.drop();
+    file->drop();
 }
 
 /**
  * Open existing table. Enables: insert, update, delete, select, project
  */
 void HeapTable::open() {
-    file.open();
+    file->open();
 }
 
 /**
  * Closes the table. Disables: insert, update, delete, select, project
  */
 void HeapTable::close() {
-    file.close();
+    file->close();
 }
 
 /**
@@ -67,21 +93,235 @@ void HeapTable::close() {
  */
 Handle HeapTable::insert(const ValueDict *row) {
     open();
-    ValueDict *full_row = validate(row);
-    Handle handle = append(full_row);
+    ValueRow *full_row = validate(row);
+    Handle handle;
+    try {
+        handle = append(full_row);
+    } catch (DbRelationError &e) {
+        delete full_row;  // e.g., too big
+        throw;
+    }
     delete full_row;
+    try {
+        for (auto const &index: this->indices)
+            index->insert(handle);
+    } catch (DbRelationError &e) {
+        del(handle);  // takes it back out of any indices it already got into, too
+        throw;
+    }
     return handle;
 }
 
+/**
+ * Execute: INSERT INTO <table_name> VALUES (<row_values>), (<row_values>), ...
+ * Rather than reading, changing and writing a block for each row, as insert() does, the rows are marshaled one
+ * after another into a block while it stays pinned, and the block is only written (and its free space noted)
+ * once it is full or the rows run out. Index entries are added after all the rows are in.
+ * @param rows     full rows in column order
+ * @param handles  if not nullptr, the new rows' handles are added to it, in order
+ */
+void HeapTable::insert_batch(const RowBatch &rows, Handles *handles) {
+    open();
+    // check everything first, so that once rows start going into blocks, they all do
+    vector<u16> sizes(rows.size());
+    for (uint i = 0; i < rows.size(); i++) {
+        if (rows[i].size() != this->column_names.size())
+            throw DbRelationError("don't know how to handle NULLs, defaults, etc. yet");
+        sizes[i] = (u16) this->codec.size(&rows[i]);
+    }
+
+    Handles added;
+    added.reserve(rows.size());
+    SlottedPage *block = nullptr;
+    for (uint i = 0; i < rows.size(); i++) {
+        void *bytes;
+        RecordID record_id = reserve(block, sizes[i], bytes);
+        this->codec.encode(&rows[i], (char *) bytes);
+        added.push_back(Handle(block->get_block_id(), record_id));
+    }
+    if (block != nullptr) {
+        this->file->put(block);
+        delete block;
+    }
+
+    try {
+        for (auto const &handle: added)
+            for (auto const &index: this->indices)
+                index->insert(handle);
+    } catch (DbRelationError &e) {
+        del_batch(added);  // takes them back out of any indices they already got into, too
+        throw;
+    }
+    if (handles != nullptr)
+        handles->insert(handles->end(), added.begin(), added.end());
+}
+
+/**
+ * Execute: COPY <table_name> FROM '<file>'
+ * Each line's fields are converted straight into a record in the block being filled, the same way insert_batch()
+ * fills blocks, without ever becoming Values. Index entries are added after all the rows are in.
+ * @param reader    the file
+ * @param progress  if not nullptr, a line is written to it every million rows
+ * @returns         how many rows were loaded
+ * @throws DbRelationError (naming the line) if a line doesn't fit the table, after taking out the rows already loaded
+ */
+u_long HeapTable::load_csv(CsvReader &reader, ostream *progress) {
+    const u_long PROGRESS_ROWS = 1000000;
+    open();
+    Handles added;
+    SlottedPage *block = nullptr;
+    RawFields fields;
+    try {
+        try {
+            while (reader.next(fields)) {
+                void *bytes;
+                RecordID record_id = reserve(block, (u16) this->codec.size(fields), bytes);
+                this->codec.encode(fields, (char *) bytes);
+                added.push_back(Handle(block->get_block_id(), record_id));
+                if (progress != nullptr && added.size() % PROGRESS_ROWS == 0)
+                    *progress << "  " << added.size() << " rows, " << reader.get_bytes_read() / (1024 * 1024)
+                              << " MB read" << endl;
+            }
+        } catch (DbRelationError &e) {
+            throw DbRelationError("line " + to_string(reader.get_line_number()) + ": " + e.what());
+        }
+        if (block != nullptr) {
+            this->file->put(block);
+            delete block;
+            block = nullptr;
+        }
+        for (auto const &handle: added)
+            for (auto const &index: this->indices)
+                index->insert(handle);
+    } catch (DbRelationError &e) {
+        if (block != nullptr) {
+            this->file->put(block);
+            delete block;
+        }
+        del_batch(added);  // takes them back out of any indices they already got into, too
+        throw;
+    }
+    return added.size();
+}
+
 /**
  * Conceptually, execute: UPDATE INTO <table_name> SET <new_values> WHERE <handle>
  * where handle is sufficient to identify one specific record (e.g., returned from an insert
  * or select).
+ * The row keeps its handle, even if it has to move (see rewrite()), so only the indices on changed columns have
+ * anything to do. If the change can't be made (e.g., it would duplicate a unique key), the row is left as it was.
  * @param handle the row to be updated
  * @param new_values a dictionary with column name keys
  */
 void HeapTable::update(const Handle handle, const ValueDict *new_values) {
-    throw DbRelationError("Not implemented");
+    open();
+    ValueDict *row = project(handle);
+    for (auto const &column: *new_values) {
+        if (row->find(column.first) == row->end()) {
+            delete row;
+            throw DbRelationError("unknown column " + column.first);
+        }
+        (*row)[column.first] = column.second;
+    }
+    ValueRow *new_row = validate(row);
+    delete row;
+    ValueRow *old_row = project_row(handle);
+
+    vector<DbIndex *> changed;
+    for (auto const &index: this->indices)
+        for (auto const &column_name: index->get_key_columns())
+            if (new_values->find(column_name) != new_values->end()) {
+                changed.push_back(index);
+                break;
+            }
+    for (auto const &index: changed)
+        index->del(handle);
+    try {
+        rewrite(handle, new_row);
+        uint done = 0;
+        try {
+            for (; done < changed.size(); done++)
+                changed[done]->insert(handle);
+        } catch (DbRelationError &e) {
+            // e.g., a duplicate key for a unique index: put the row back the way it was
+            for (uint i = 0; i < done; i++)
+                changed[i]->del(handle);
+            rewrite(handle, old_row);
+            throw;
+        }
+    } catch (DbRelationError &e) {
+        for (auto const &index: changed)
+            index->insert(handle);
+        delete new_row;
+        delete old_row;
+        throw;
+    }
+    delete new_row;
+    delete old_row;
+}
+
+/**
+ * Replace a row's record. It is rewritten in its block if it still fits there (even if it has grown), or else
+ * moved to a block with room and forwarded to from its home block.
+ * @param handle  the row (its home, where its stub is if it has been forwarded)
+ * @param row     the row's new values, in column order
+ * @throws DbRelationError if it had to move but its home block hasn't even room for the stub
+ */
+void HeapTable::rewrite(Handle handle, const ValueRow *row) {
+    char bytes[DbBlock::BLOCK_SZ];
+    u16 size = (u16) this->codec.size(row);
+    this->codec.encode(row, bytes);
+    Dbt data(bytes, size);
+
+    SlottedPage *home = this->file->get(handle.first);
+    Handle location = handle;
+    if (home->get_tag(handle.second) == SlottedPage::FORWARD)
+        location = forwarded_to(home, handle.second);
+    SlottedPage *block = location.first == handle.first ? home : this->file->get(location.first);
+    try {
+        block->put(location.second, data);
+        this->file->put(block);
+        if (block != home)
+            delete block;
+        delete home;
+        return;
+    } catch (DbBlockNoRoomError &e) {
+        // has to move
+    }
+    if (block != home) {
+        block->del(location.second);  // we'll forward to the new place instead
+        this->file->put(block);
+        delete block;
+    }
+    delete home;
+
+    SlottedPage *target = nullptr;
+    void *target_bytes;
+    RecordID target_id = reserve(target, size, target_bytes);
+    memcpy(target_bytes, bytes, size);
+    target->set_tag(target_id, SlottedPage::MOVED);
+    Handle moved(target->get_block_id(), target_id);
+    this->file->put(target);
+    delete target;
+
+    char stub[sizeof(BlockID) + sizeof(RecordID)];
+    *(BlockID *) stub = moved.first;
+    *(RecordID *) (stub + sizeof(BlockID)) = moved.second;
+    home = this->file->get(handle.first);
+    try {
+        home->put(handle.second, Dbt(stub, sizeof(stub)));
+    } catch (DbBlockNoRoomError &e) {
+        // only possible for a record that was smaller than a stub, and still in its home block
+        delete home;
+        target = this->file->get(moved.first);
+        target->del(moved.second);
+        this->file->put(target);
+        delete target;
+        throw DbRelationError("no room to forward the row");
+    }
+    home->set_tag(handle.second, SlottedPage::FORWARD);
+    this->file->put(home);
+    delete home;
 }
 
 /**
@@ -92,14 +332,62 @@ void HeapTable::update(const Handle handle, const ValueDict *new_values) {
  */
 void HeapTable::del(const Handle handle) {
     open();
+    for (auto const &index: this->indices)
+        index->del(handle);
     BlockID block_id = handle.first;
     RecordID record_id = handle.second;
-    SlottedPage *block = this->file.get(block_id);
+    SlottedPage *block = this->file->get(block_id);
+    if (block->get_tag(record_id) == SlottedPage::FORWARD) {
+        Handle moved = forwarded_to(block, record_id);
+        SlottedPage *target = moved.first == block_id ? block : this->file->get(moved.first);
+        target->del(moved.second);
+        if (target != block) {
+            this->file->put(target);
+            delete target;
+        }
+    }
     block->del(record_id);
-    this->file.put(block);
+    this->file->put(block);
     delete block;
 }
 
+/**
+ * Execute: DELETE FROM <table_name> WHERE <handle> OR <handle> OR ...
+ * Rather than reading and writing a block for each row, as del() does, the handles are grouped by block, so each
+ * block is read once, has all its victims tombstoned, and is written (and its free space noted) once. The index
+ * entries go first, each index taking all of them at once, since the indices need the rows to find their keys.
+ * @param handles  the rows to delete
+ */
+void HeapTable::del_batch(const Handles &handles) {
+    open();
+    Handles sorted(handles);
+    sort(sorted.begin(), sorted.end());
+    for (auto const &index: this->indices)
+        index->del_batch(sorted);
+    Handles moved;  // where the forwarded ones among them really are, deleted in a second pass
+    for (Handles *victims: {&sorted, &moved}) {
+        sort(victims->begin(), victims->end());
+        SlottedPage *block = nullptr;
+        for (auto const &handle: *victims) {
+            if (block == nullptr || block->get_block_id() != handle.first) {
+                if (block != nullptr) {
+                    this->file->put(block);
+                    delete block;
+                    block = nullptr;
+                }
+                block = this->file->get(handle.first);
+            }
+            if (block->get_tag(handle.second) == SlottedPage::FORWARD)
+                moved.push_back(forwarded_to(block, handle.second));
+            block->del(handle.second);
+        }
+        if (block != nullptr) {
+            this->file->put(block);
+            delete block;
+        }
+    }
+}
+
 /**
  * Conceptually, execute: SELECT <handle> FROM <table_name> WHERE 1
  * @return a list of handles for qualifying rows
@@ -114,22 +402,299 @@ Handles *HeapTable::select() {
  * @return list of handles of the selected rows
  */
 Handles *HeapTable::select(const ValueDict *where) {
-    open();
     Handles *handles = new Handles();
-    BlockIDs *block_ids = file.block_ids();
-    for (auto const &block_id: *block_ids) {
-        SlottedPage *block = file.get(block_id);
-        RecordIDs *record_ids = block->ids();
-        for (auto const &record_id: *record_ids) {
-            Handle handle(block_id, record_id);
-            if (selected(handle, where))
-                handles->push_back(Handle(block_id, record_id));
+    HandleCursor *cursor = select_cursor(where);
+    Handle handle;
+    while (cursor->next(handle))
+        handles->push_back(handle);
+    delete cursor;
+    return handles;
+}
+
+/**
+ * Stream the handles of the rows matching where. If one of our indices has its whole search key given by
+ * the where clause, the candidate rows come from an index lookup instead of a scan of the table.
+ * @param where predicates to match
+ * @return cursor over the selected rows (freed by caller)
+ */
+HandleCursor *HeapTable::select_cursor(const ValueDict *where) {
+    open();
+    DbIndex *index = index_for(where);
+    if (index != nullptr) {
+        ValueDict key;
+        for (auto const &column_name: index->get_key_columns())
+            key[column_name] = where->at(column_name);
+        return new HandleListCursor(*this, index->lookup(&key), where);
+    }
+    return new HeapTableCursor(*this, where);
+}
+
+/**
+ * Stream the given columns of the rows matching where, a batch at a time. The rows are picked out just as by
+ * select_cursor(where).
+ * @param column_numbers  positions of the columns to project
+ * @param where           predicates to match
+ * @return                cursor over the batches (freed by caller)
+ */
+RowBatchCursor *HeapTable::batch_cursor(const ColumnNumbers *column_numbers, const ValueDict *where) {
+    for (auto const &col_num: *column_numbers)
+        if (col_num >= this->column_names.size())
+            throw DbRelationError("column number " + to_string(col_num) + " out of range");
+    return new HeapTableBatchCursor(*this, select_cursor(where), column_numbers);
+}
+
+/**
+ * Stream the given columns of the rows matching where and the predicate, either from the given candidates or from
+ * a scan of every block, whatever indices there are.
+ * @param column_numbers  positions of the columns to project
+ * @param where           predicates to match
+ * @param handles         the candidates (freed by the cursor), or nullptr to scan
+ * @param predicate       condition checked on each marshaled row, or nullptr
+ * @return                cursor over the batches (freed by caller)
+ */
+RowBatchCursor *HeapTable::batch_cursor(const ColumnNumbers *column_numbers, const ValueDict *where,
+                                        Handles *handles, const Predicate *predicate) {
+    for (auto const &col_num: *column_numbers)
+        if (col_num >= this->column_names.size()) {
+            delete handles;
+            throw DbRelationError("column number " + to_string(col_num) + " out of range");
         }
-        delete record_ids;
-        delete block;
+    open();
+    HandleCursor *rows;
+    if (handles != nullptr)
+        rows = new HandleListCursor(*this, handles, where);
+    else
+        rows = new HeapTableCursor(*this, where);
+    return new HeapTableBatchCursor(*this, rows, column_numbers, predicate);
+}
+
+/**
+ * @class BlockListCursor - counts through a list of block ids
+ */
+class BlockListCursor : public BlockIDCursor {
+public:
+    BlockListCursor(const BlockIDs &block_ids) : block_ids(block_ids), position(0) {}
+
+    virtual bool next(BlockID &block_id) {
+        if (this->position == this->block_ids.size())
+            return false;
+        block_id = this->block_ids[this->position++];
+        return true;
     }
-    delete block_ids;
-    return handles;
+
+protected:
+    BlockIDs block_ids;
+    uint position;
+};
+
+/**
+ * The blocks are picked by selection sampling (Knuth's Algorithm S), which comes up with them in order, so the
+ * file is still read front to back, just skipping the blocks that weren't picked.
+ * @param column_numbers  positions of the columns to project
+ * @param n_blocks        how many blocks to read
+ * @param block_count     returned by reference: how many blocks there are
+ * @return                cursor over the batches (freed by caller)
+ */
+RowBatchCursor *HeapTable::sample_cursor(const ColumnNumbers *column_numbers, uint n_blocks, BlockID &block_count) {
+    for (auto const &col_num: *column_numbers)
+        if (col_num >= this->column_names.size())
+            throw DbRelationError("column number " + to_string(col_num) + " out of range");
+    open();
+    block_count = this->file->get_last_block_id();
+    BlockIDs block_ids;
+    mt19937 random(random_device{}());
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+    for (BlockID block_id = 1; block_id <= block_count && block_ids.size() < n_blocks; block_id++) {
+        uint needed = n_blocks - (uint) block_ids.size(), left = block_count - block_id + 1;
+        if (needed >= left || uniform(random) * left < needed)
+            block_ids.push_back(block_id);
+    }
+    HandleCursor *rows = new HeapTableCursor(*this, nullptr, new BlockListCursor(block_ids));
+    return new HeapTableBatchCursor(*this, rows, column_numbers);
+}
+
+/**
+ * Find an index whose search key columns all have values in the where clause.
+ * @param where  predicates to match (may be nullptr)
+ * @return       such an index or nullptr if there isn't one
+ */
+DbIndex *HeapTable::index_for(const ValueDict *where) const {
+    if (where == nullptr)
+        return nullptr;
+    for (auto const &index: this->indices) {
+        bool covered = true;
+        for (auto const &column_name: index->get_key_columns())
+            if (where->find(column_name) == where->end())
+                covered = false;
+        if (covered)
+            return index;
+    }
+    return nullptr;
+}
+
+/**
+ * Have insert and del keep the given index up to date, and let select use it.
+ * @param index  an index on this table
+ */
+void HeapTable::attach_index(DbIndex *index) {
+    if (find(this->indices.begin(), this->indices.end(), index) == this->indices.end())
+        this->indices.push_back(index);
+}
+
+/**
+ * Forget about an index given to attach_index().
+ * @param index  the index
+ */
+void HeapTable::detach_index(DbIndex *index) {
+    this->indices.erase(remove(this->indices.begin(), this->indices.end(), index), this->indices.end());
+}
+
+/**
+ * Set up a cursor over a list of candidate rows.
+ * @param table    table the rows are in (must be open)
+ * @param handles  the candidates (freed by this cursor)
+ * @param where    predicates the rows must match (nullptr for all of them)
+ */
+HandleListCursor::HandleListCursor(HeapTable &table, Handles *handles, const ValueDict *where) : table(table),
+                                                                                                 handles(handles),
+                                                                                                 position(0) {
+    if (where != nullptr)
+        table.compile_predicates(where, this->predicates);
+}
+
+HandleListCursor::~HandleListCursor() {
+    delete this->handles;
+}
+
+/**
+ * @param handle  set to the next candidate that matches the predicates
+ * @return        false when there are no more
+ */
+bool HandleListCursor::next(Handle &handle) {
+    while (this->position < this->handles->size()) {
+        Handle candidate = (*this->handles)[this->position++];
+        bool is_selected = true;
+        if (!this->predicates.empty()) {
+            SlottedPage *block = this->table.file->get(candidate.first);
+            SlottedPage *forwarded = nullptr;
+            u16 size;
+            const char *bytes = this->table.get_bytes(block, candidate.second, size, forwarded);
+            Dbt data((void *) bytes, size);
+            is_selected = bytes != nullptr && this->table.selected(&data, this->predicates);
+            delete forwarded;
+            delete block;
+        }
+        if (is_selected) {
+            handle = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Set up a scan of the given table.
+ * @param table   table to scan (must be open)
+ * @param where   predicates to match (nullptr for all rows)
+ * @param blocks  which blocks to scan (freed by this cursor), or nullptr for all of them
+ */
+HeapTableCursor::HeapTableCursor(HeapTable &table, const ValueDict *where, BlockIDCursor *blocks)
+        : table(table), blocks(blocks), block(nullptr), records(nullptr), forwarded(nullptr) {
+    if (where != nullptr)
+        table.compile_predicates(where, this->predicates);
+    if (this->blocks == nullptr)
+        this->blocks = table.file->block_cursor();
+}
+
+HeapTableCursor::~HeapTableCursor() {
+    delete this->forwarded;
+    delete this->records;
+    delete this->block;
+    delete this->blocks;
+}
+
+/**
+ * Each block is fetched once (and stays pinned while we're on it) and the where clause is checked against
+ * the marshaled bytes of each of its records, decoding only the columns being compared.
+ * @param handle  set to the next qualifying row
+ * @return        false when there are no more
+ */
+bool HeapTableCursor::next(Handle &handle) {
+    while (true) {
+        if (this->records == nullptr) {
+            BlockID block_id;
+            if (!this->blocks->next(block_id))
+                return false;
+            this->block = this->table.file->get(block_id);
+            this->records = this->block->id_cursor();
+        }
+        RecordID record_id;
+        while (this->records->next(record_id)) {
+            bool is_selected = true;
+            if (!this->predicates.empty()) {
+                u16 size;
+                const char *bytes = this->table.get_bytes(this->block, record_id, size, this->forwarded);
+                Dbt data((void *) bytes, size);
+                is_selected = this->table.selected(&data, this->predicates);
+            }
+            if (is_selected) {
+                handle = Handle(this->block->get_block_id(), record_id);
+                return true;
+            }
+        }
+        delete this->records;
+        this->records = nullptr;
+        delete this->block;
+        this->block = nullptr;
+    }
+}
+
+/**
+ * Set up to project the rows given by a cursor.
+ * @param table           table the rows are in (must be open)
+ * @param handles         the rows (freed by this cursor)
+ * @param column_numbers  positions of the columns to project
+ * @param predicate       condition the rows must pass (must outlive this cursor), or nullptr
+ */
+HeapTableBatchCursor::HeapTableBatchCursor(HeapTable &table, HandleCursor *handles,
+                                           const ColumnNumbers *column_numbers, const Predicate *predicate)
+        : table(table), handles(handles), column_numbers(*column_numbers), predicate(predicate), block(nullptr),
+          forwarded(nullptr) {
+}
+
+HeapTableBatchCursor::~HeapTableBatchCursor() {
+    delete this->forwarded;
+    delete this->block;
+    delete this->handles;
+}
+
+/**
+ * Each row's columns are decoded from the marshaled bytes in place into the batch's reused rows, and a block is
+ * only fetched again when the rows move on to another one. The predicate is run on the marshaled bytes, so a row
+ * that fails it costs nothing to unmarshal.
+ * @param batch  refilled with the next rows
+ * @return       false when there are no more
+ */
+bool HeapTableBatchCursor::next(RowBatch &batch) {
+    batch.clear();
+    uint n = (uint) this->column_numbers.size();
+    Handle handle;
+    while (!batch.full() && this->handles->next(handle)) {
+        if (this->block == nullptr || this->block->get_block_id() != handle.first) {
+            delete this->block;
+            this->block = nullptr;
+            this->block = this->table.file->get(handle.first);
+        }
+        u16 size;
+        const char *bytes = this->table.get_bytes(this->block, handle.second, size, this->forwarded);
+        if (bytes == nullptr || (this->predicate != nullptr && !this->predicate->test(this->table.codec, bytes)))
+            continue;
+        ValueRow &row = batch.add(handle);
+        row.resize(n);
+        for (uint i = 0; i < n; i++)
+            this->table.codec.decode(bytes, this->column_numbers[i], row[i]);
+    }
+    return !batch.empty();
 }
 
 /**
@@ -142,155 +707,175 @@ ValueDict *HeapTable::project(Handle handle) {
 }
 
 /**
- * Project given columns from a given row.
+ * Project given columns from a given row. This is just a dictionary-building wrapper around project_row().
  * @param handle row to be projected
- * @param column_names of columns to be included in the result
+ * @param column_names of columns to be included in the result (all of them if empty)
  * @return a sequence of values for handle given by column_names
  */
 ValueDict *HeapTable::project(Handle handle, const ColumnNames *column_names) {
-    BlockID block_id = handle.first;
-    RecordID record_id = handle.second;
-    SlottedPage *block = file.get(block_id);
-    Dbt *data = block->get(record_id);
-    ValueDict *row = unmarshal(data);
-    delete data;
-    delete block;
     if (column_names->empty())
-        return row;
+        column_names = &this->column_names;
+    ColumnNumbers column_numbers;
+    get_column_numbers(column_names, column_numbers);
+    ValueRow *row = project_row(handle, &column_numbers);
     ValueDict *result = new ValueDict();
-    for (auto const &column_name: *column_names) {
-        if (row->find(column_name) == row->end())
-            throw DbRelationError("table does not have column named '" + column_name + "'");
-        (*result)[column_name] = (*row)[column_name];
-    }
+    for (uint i = 0; i < column_names->size(); i++)
+        (*result)[(*column_names)[i]] = (*row)[i];
     delete row;
     return result;
 }
 
+/**
+ * Project all columns from a given row, in column order.
+ * @param handle row to be projected
+ * @return all the values for handle (freed by caller)
+ */
+ValueRow *HeapTable::project_row(Handle handle) {
+    SlottedPage *block = file->get(handle.first);
+    SlottedPage *forwarded = nullptr;
+    u16 size;
+    const char *bytes = get_bytes(block, handle.second, size, forwarded);
+    ValueRow *row = this->codec.decode(bytes);
+    delete forwarded;
+    delete block;
+    return row;
+}
+
+/**
+ * Project given columns from a given row. Only the asked-for columns are unmarshaled.
+ * @param handle row to be projected
+ * @param column_numbers positions of the columns to be included in the result
+ * @return the values for handle, in the order of column_numbers (freed by caller)
+ */
+ValueRow *HeapTable::project_row(Handle handle, const ColumnNumbers *column_numbers) {
+    for (auto const &col_num: *column_numbers)
+        if (col_num >= this->column_names.size())
+            throw DbRelationError("column number " + to_string(col_num) + " out of range");
+    SlottedPage *block = file->get(handle.first);
+    SlottedPage *forwarded = nullptr;
+    u16 size;
+    const char *bytes = get_bytes(block, handle.second, size, forwarded);
+    ValueRow *row = new ValueRow(column_numbers->size());
+    for (uint i = 0; i < column_numbers->size(); i++)
+        this->codec.decode(bytes, (*column_numbers)[i], (*row)[i]);
+    delete forwarded;
+    delete block;
+    return row;
+}
+
 /**
  * Check if the given row is acceptable to insert.
  * @param row to be validated
- * @return the full row dictionary
+ * @return the full row's values in column order
  * @throws DbRelationError if not valid
  */
-ValueDict *HeapTable::validate(const ValueDict *row) const {
-    ValueDict *full_row = new ValueDict();
+ValueRow *HeapTable::validate(const ValueDict *row) const {
+    ValueRow *full_row = new ValueRow();
+    full_row->reserve(this->column_names.size());
     for (auto const &column_name: this->column_names) {
-        Value value;
         ValueDict::const_iterator column = row->find(column_name);
-        if (column == row->end())
+        if (column == row->end()) {
+            delete full_row;
             throw DbRelationError("don't know how to handle NULLs, defaults, etc. yet");
-        else
-            value = column->second;
-        (*full_row)[column_name] = value;
+        }
+        full_row->push_back(column->second);
     }
     return full_row;
 }
 
 /**
- * Appends a record to the file.
+ * Appends a record to the file. Goes into whichever block the free space map says has room, or into a new
+ * block if none does. The record is marshaled directly into its slot in the block.
  * @param row to be appended
  * @return handle of newly inserted row
  */
-Handle HeapTable::append(const ValueDict *row) {
-    Dbt *data = marshal(row);
-    SlottedPage *block = this->file.get(this->file.get_last_block_id());
-    RecordID record_id;
+Handle HeapTable::append(const ValueRow *row) {
+    SlottedPage *block = nullptr;
+    void *bytes;
+    RecordID record_id = reserve(block, (u16) this->codec.size(row), bytes);
+    this->codec.encode(row, (char *) bytes);
+    BlockID block_id = block->get_block_id();
+    this->file->put(block);
+    delete block;
+    return Handle(block_id, record_id);
+}
+
+/**
+ * Reserves room for a record in the block being filled, if it has room, or else writes that block and moves on to
+ * one the free space map says has room (or a new one). The caller marshals the record into the returned space and
+ * eventually puts and frees the last block.
+ * @param block  returned by reference: the block being filled (nullptr to start)
+ * @param size   size of the record
+ * @param bytes  returned by reference: where to marshal the record
+ * @return       the record's id within block
+ */
+RecordID HeapTable::reserve(SlottedPage *&block, u16 size, void *&bytes) {
+    if (block != nullptr) {
+        try {
+            return block->reserve(size, bytes);
+        } catch (DbBlockNoRoomError &e) {
+            this->file->put(block);
+            delete block;
+            block = nullptr;
+        }
+    }
+    BlockID block_id = this->file->find_block_with_room(size);
+    block = block_id == 0 ? this->file->get_new() : this->file->get(block_id);
     try {
-        record_id = block->add(data);
+        return block->reserve(size, bytes);
     } catch (DbBlockNoRoomError &e) {
         // need a new block
         delete block;
-        block = this->file.get_new();
-        record_id = block->add(data);
+        block = this->file->get_new();
+        return block->reserve(size, bytes);
     }
-    this->file.put(block);
-    delete block;
-    delete[] (char *) data->get_data();
-    delete data;
-    return Handle(this->file.get_last_block_id(), record_id);
 }
 
 /**
- * Figure out the bits to go into the file.
+ * The bytes of a row, from wherever it really is if it has been forwarded.
+ * @param block      the row's home block
+ * @param record_id  the row's id in block
+ * @param size       returned by reference: size of the row
+ * @param forwarded  the block a forwarded row is in, kept across calls (fetched if it isn't already that block;
+ *                   freed by caller)
+ * @return           the row's bytes (only good until either block changes), or nullptr if it has been deleted
+ */
+const char *HeapTable::get_bytes(SlottedPage *block, RecordID record_id, u16 &size,
+                                 SlottedPage *&forwarded) const {
+    const char *bytes = block->get_bytes(record_id, size);
+    if (bytes == nullptr || block->get_tag(record_id) != SlottedPage::FORWARD)
+        return bytes;
+    Handle moved = forwarded_to(block, record_id);
+    if (moved.first == block->get_block_id())
+        return block->get_bytes(moved.second, size);
+    if (forwarded == nullptr || forwarded->get_block_id() != moved.first) {
+        delete forwarded;
+        forwarded = nullptr;
+        forwarded = this->file->get(moved.first);
+    }
+    return forwarded->get_bytes(moved.second, size);
+}
+
+/**
+ * Figure out the bits to go into the file (see RecordCodec for the layout).
  * The caller is responsible for freeing the returned Dbt and its enclosed ret->get_data().
- * @param row data for the tuple
+ * @param row data for the tuple, in column order
  * @return bits of the record as it should appear on disk
  */
-Dbt *HeapTable::marshal(const ValueDict *row) const {
-    char *bytes = new char[DbBlock::BLOCK_SZ]; // more than we need (we insist that one row fits into DbBlock::BLOCK_SZ)
-    uint offset = 0;
-    uint col_num = 0;
-    for (auto const &column_name: this->column_names) {
-        ColumnAttribute ca = this->column_attributes[col_num++];
-        ValueDict::const_iterator column = row->find(column_name);
-        Value value = column->second;
-
-        if (ca.get_data_type() == ColumnAttribute::DataType::INT) {
-            if (offset + 4 > DbBlock::BLOCK_SZ - 4)
-                throw DbRelationError("row too big to marshal");
-            *(int32_t *) (bytes + offset) = value.n;
-            offset += sizeof(int32_t);
-        } else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
-            u_long size = value.s.length();
-            if (size > UINT16_MAX)
-                throw DbRelationError("text field too long to marshal");
-            if (offset + 2 + size > DbBlock::BLOCK_SZ)
-                throw DbRelationError("row too big to marshal");
-            *(u16 *) (bytes + offset) = size;
-            offset += sizeof(u16);
-            memcpy(bytes + offset, value.s.c_str(), size); // assume ascii for now
-            offset += size;
-        } else if (ca.get_data_type() == ColumnAttribute::DataType::BOOLEAN) {
-            if (offset + 1 > DbBlock::BLOCK_SZ - 1)
-                throw DbRelationError("row too big to marshal");
-            *(uint8_t *) (bytes + offset) = (uint8_t) value.n;
-            offset += sizeof(uint8_t);
-        } else {
-            throw DbRelationError("Only know how to marshal INT, TEXT, and BOOLEAN");
-        }
-    }
-    char *right_size_bytes = new char[offset];
-    memcpy(right_size_bytes, bytes, offset);
-    delete[] bytes;
-    Dbt *data = new Dbt(right_size_bytes, offset);
-    return data;
+Dbt *HeapTable::marshal(const ValueRow *row) const {
+    uint size = this->codec.size(row);
+    char *bytes = new char[size];
+    this->codec.encode(row, bytes);
+    return new Dbt(bytes, size);
 }
 
 /**
  * Figure out the memory data structures from the given bits gotten from the file.
  * @param data file data for the tuple
- * @return row data for the tuple
- */
-ValueDict *HeapTable::unmarshal(Dbt *data) const {
-    ValueDict *row = new ValueDict();
-    Value value;
-    char *bytes = (char *) data->get_data();
-    uint offset = 0;
-    uint col_num = 0;
-    for (auto const &column_name: this->column_names) {
-        ColumnAttribute ca = this->column_attributes[col_num++];
-        value.data_type = ca.get_data_type();
-        if (ca.get_data_type() == ColumnAttribute::DataType::INT) {
-            value.n = *(int32_t *) (bytes + offset);
-            offset += sizeof(int32_t);
-        } else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
-            u16 size = *(u16 *) (bytes + offset);
-            offset += sizeof(u16);
-            char buffer[DbBlock::BLOCK_SZ];
-            memcpy(buffer, bytes + offset, size);
-            buffer[size] = '\0';
-            value.s = string(buffer);  // assume ascii for now
-            offset += size;
-        } else if (ca.get_data_type() == ColumnAttribute::DataType::BOOLEAN) {
-            value.n = *(uint8_t *) (bytes + offset);
-            offset += sizeof(uint8_t);
-        } else {
-            throw DbRelationError("Only know how to unmarshal INT, TEXT, and BOOLEAN");
-        }
-        (*row)[column_name] = value;
-    }
-    return row;
+ * @return row data for the tuple, in column order (freed by caller)
+ */
+ValueRow *HeapTable::unmarshal(const Dbt *data) const {
+    return this->codec.decode((const char *) data->get_data());
 }
 
 /**
@@ -308,6 +893,40 @@ bool HeapTable::selected(Handle handle, const ValueDict *where) {
     return is_selected;
 }
 
+/**
+ * Turn a where clause into (column number, value) pairs for selected(data, predicates).
+ * @param where       conditions to check
+ * @param predicates  returned by reference
+ * @throws DbRelationError if where refers to a column we don't have
+ */
+void HeapTable::compile_predicates(const ValueDict *where, ColumnPredicates &predicates) const {
+    for (uint col_num = 0; col_num < this->column_names.size(); col_num++) {
+        ValueDict::const_iterator column = where->find(this->column_names[col_num]);
+        if (column != where->end())
+            predicates.push_back(ColumnPredicate(col_num, column->second));
+    }
+    if (predicates.size() != where->size()) {
+        for (auto const &column: *where)
+            if (find(this->column_names.begin(), this->column_names.end(), column.first) == this->column_names.end())
+                throw DbRelationError("table does not have column named '" + column.first + "'");
+    }
+}
+
+/**
+ * See if the marshaled record satisfies the given predicates, comparing each column in place and never
+ * building a ValueDict.
+ * @param data        marshaled record (as from marshal())
+ * @param predicates  conditions to check (from compile_predicates())
+ * @return            true if conditions met, false otherwise
+ */
+bool HeapTable::selected(const Dbt *data, const ColumnPredicates &predicates) const {
+    const char *bytes = (const char *) data->get_data();
+    for (auto const &predicate: predicates)
+        if (!this->codec.equals(bytes, predicate.first, predicate.second))
+            return false;
+    return true;
+}
+
 /**
  * Test helper. Sets the row's a and b values.
  * @param row to set
@@ -356,6 +975,12 @@ bool test_heap_storage() {
     if (!test_slotted_page())
         return assertion_failure("slotted page tests failed");
     cout << endl << "slotted page tests ok" << endl;
+    if (!test_buffer_pool())
+        return assertion_failure("buffer pool tests failed");
+    cout << "buffer pool tests ok" << endl;
+    if (!test_record_codec())
+        return assertion_failure("record codec tests failed");
+    cout << "record codec tests ok" << endl;
 
     ColumnNames column_names;
     column_names.push_back("a");
@@ -406,6 +1031,35 @@ bool test_heap_storage() {
     cout << "many inserts/select/projects ok" << endl;
     delete handles;
 
+    ValueDict where;
+    where["a"] = Value(500);
+    where["b"] = Value(b);
+    handles = table.select(&where);
+    if (handles->size() != 1 || !test_compare(table, (*handles)[0], 500, b))
+        return false;
+    delete handles;
+    where["b"] = Value("nope");
+    handles = table.select(&where);
+    if (!handles->empty())
+        return false;
+    delete handles;
+    cout << "select where ok" << endl;
+
+    ColumnNames projected_names;
+    projected_names.push_back("c");
+    projected_names.push_back("a");
+    ColumnNumbers column_numbers;
+    table.get_column_numbers(&projected_names, column_numbers);
+    ValueRow *values = table.project_row(last_handle, &column_numbers);
+    if (values->size() != 2 || (*values)[0].n != 0 || (*values)[1].n != 999)
+        return false;
+    delete values;
+    values = table.project_row(last_handle);
+    if (values->size() != 3 || (*values)[1].s != b)
+        return false;
+    delete values;
+    cout << "project_row ok" << endl;
+
     table.del(last_handle);
     handles = table.select();
     if (handles->size() != 1000)
@@ -416,7 +1070,425 @@ bool test_heap_storage() {
             return false;
     }
     cout << "del ok" << endl;
+
+    // the free space map should steer this back into the room the delete left
+    test_set_row(row, 999, b);
+    Handle reused = table.insert(&row);
+    if (reused.first > last_handle.first || !test_compare(table, reused, 999, b))
+        return false;
+    if (reused == last_handle)
+        return assertion_failure("record id of deleted row handed out again");
+    cout << "reuse of deleted space ok" << endl;
+
+    RowBatch batch;
+    Handles batch_handles;
+    for (i = 0; i < 3000; i++) {
+        ValueRow &values = batch.add();
+        values.clear();
+        values.push_back(Value(2000 + i));
+        values.push_back(Value(b));
+        values.push_back(Value(i % 2 == 0));
+        if (batch.full() || i == 2999) {
+            table.insert_batch(batch, &batch_handles);
+            batch.clear();
+        }
+    }
+    if (batch_handles.size() != 3000)
+        return false;
+    for (i = 0; i < 3000; i++)
+        if (!test_compare(table, batch_handles[i], 2000 + i, b))
+            return false;
+    delete handles;
+    handles = table.select();
+    if (handles->size() != 4001)
+        return false;
+    cout << "insert_batch ok" << endl;
+
+    Handles victims;
+    for (i = 0; i < 3000; i += 2)
+        victims.push_back(batch_handles[i]);
+    table.del_batch(victims);
+    delete handles;
+    handles = table.select();
+    if (handles->size() != 2501)
+        return false;
+    for (i = 1; i < 3000; i += 2)
+        if (!test_compare(table, batch_handles[i], 2000 + i, b))
+            return false;
+    cout << "del_batch ok" << endl;
+
+    // the blocks are full, so growing a row much has to forward it; its handle and the row count stay the same
+    Handle updated = batch_handles[1];
+    ValueDict new_values;
+    for (string new_b: {string("x"), string(1000, 'y'), string(2000, 'z'), string("small again")}) {
+        new_values["b"] = Value(new_b);
+        table.update(updated, &new_values);
+        if (!test_compare(table, updated, 2001, new_b))
+            return assertion_failure("update to size", new_b.length());
+        delete handles;
+        handles = table.select();
+        if (handles->size() != 2501 || find(handles->begin(), handles->end(), updated) == handles->end())
+            return assertion_failure("select after update", handles->size());
+        for (auto const &handle: *handles) {
+            ValueRow *values = table.project_row(handle);
+            bool ok = (*values)[0].n != 2001 || handle == updated;
+            delete values;
+            if (!ok)
+                return assertion_failure("moved row selected twice");
+        }
+    }
+    SlottedPage *home = table.file->get(updated.first);
+    bool forwarded = home->get_tag(updated.second) == SlottedPage::FORWARD;
+    delete home;
+    if (!forwarded)
+        return assertion_failure("grown row not forwarded");
+    new_values.clear();
+    new_values["nope"] = Value(1);
+    try {
+        table.update(updated, &new_values);
+        return assertion_failure("update of unknown column");
+    } catch (DbRelationError &e) {
+        // expected
+    }
+    table.del(updated);
+    delete handles;
+    handles = table.select();
+    if (handles->size() != 2500)
+        return assertion_failure("del of forwarded row", handles->size());
+    cout << "update ok" << endl;
+
+    // a sample of two of the blocks, and a read of just the rows given
+    ColumnNumbers first_column(1, 0);
+    BlockID block_count = 0;
+    RowBatchCursor *rows = table.sample_cursor(&first_column, 2, block_count);
+    RowBatch sampled_rows;
+    BlockIDs sampled;
+    while (rows->next(sampled_rows))
+        for (uint r = 0; r < sampled_rows.size(); r++)
+            if (sampled.empty() || sampled.back() != sampled_rows.get_handle(r).first)
+                sampled.push_back(sampled_rows.get_handle(r).first);
+    delete rows;
+    if (block_count != table.file->get_last_block_id() || block_count < 3 || sampled.empty() || sampled.size() > 2)
+        return assertion_failure("sample_cursor", block_count, sampled.size());
+    rows = table.batch_cursor(&first_column, nullptr, new Handles{(*handles)[7], (*handles)[5]});
+    ValueRow *seventh = table.project_row((*handles)[7], &first_column);
+    bool given = rows->next(sampled_rows) && sampled_rows.size() == 2 && sampled_rows[0][0] == (*seventh)[0] &&
+                 sampled_rows.get_handle(1) == (*handles)[5] && !rows->next(sampled_rows);
+    delete seventh;
+    delete rows;
+    if (!given)
+        return assertion_failure("batch_cursor of given rows", sampled_rows.size());
+    cout << "sample_cursor ok" << endl;
+
+    // a second object on the same file sees the blocks the first has, and they both see the ones it adds
+    string wide(1000, 'w');
+    HeapTable *other = new HeapTable("_test_data_cpp", column_names, column_attributes);
+    other->open();
+    for (i = 0; i < 10; i++) {
+        test_set_row(row, 5000 + i, wide);
+        other->insert(&row);
+    }
+    bool agree = other->file->get_last_block_id() == table.file->get_last_block_id();
+    delete other;  // closes it, but table still has the file (and its free space map) open
+    test_set_row(row, 6000, wide);
+    table.insert(&row);
+    delete handles;
+    handles = table.select();
+    if (!agree || handles->size() != 2511)
+        return assertion_failure("two objects on one file", handles->size());
+    cout << "shared heap file state ok" << endl;
+
+    // a row too big for even an empty block is refused before any block is added for it
+    uint32_t last_block = table.file->get_last_block_id();
+    test_set_row(row, 7000, string(SlottedPage::MAX_RECORD_SZ, 'x'));  // (under BLOCK_SZ with the other columns)
+    try {
+        table.insert(&row);
+        return assertion_failure("row bigger than a block");
+    } catch (DbRelationError &e) {
+        // expected
+    }
+    if (table.file->get_last_block_id() != last_block)
+        return assertion_failure("blocks added for a row too big", table.file->get_last_block_id() - last_block);
     table.drop();
     delete handles;
+
+    HeapTable mapped("_test_mmap_cpp", column_names, column_attributes, true);
+    mapped.create_if_not_exists();
+    for (i = 0; i < 1000; i++) {
+        test_set_row(row, i, b);
+        mapped.insert(&row);
+    }
+    mapped.close();  // make sure it all made it to the file
+    mapped.open();
+    handles = mapped.select();
+    if (handles->size() != 1000)
+        return false;
+    i = 0;
+    for (auto const &handle: *handles) {
+        if (!test_compare(mapped, handle, i++, b))
+            return false;
+    }
+    cout << "memory-mapped table ok" << endl;
+    mapped.drop();
+    delete handles;
     return true;
 }
+
+/**
+ * Benchmark comparing a full scan (select() and then project() of every row) of the same rows stored in a
+ * Berkeley DB backed HeapFile and in an MmapHeapFile.
+ * @param rows  how many rows to load into each table
+ */
+void benchmark_heap_scan(uint rows) {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    column_names.push_back("c");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::BOOLEAN));
+    for (int memory_mapped = 0; memory_mapped <= 1; memory_mapped++) {
+        HeapTable table(memory_mapped ? "_benchmark_mmap_cpp" : "_benchmark_heap_cpp", column_names,
+                        column_attributes, memory_mapped);
+        table.create_if_not_exists();
+        ValueDict row;
+        for (uint i = 0; i < rows; i++) {
+            test_set_row(row, i, "row number " + to_string(i));
+            table.insert(&row);
+        }
+        auto start = chrono::steady_clock::now();
+        Handles *handles = table.select();
+        int64_t sum = 0;
+        for (auto const &handle: *handles) {
+            ValueDict *result = table.project(handle);
+            sum += (*result)["a"].n;
+            delete result;
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << (memory_mapped ? "MmapHeapFile" : "HeapFile") << " scan of " << handles->size() << " rows: " << ms
+             << " ms" << endl;
+        delete handles;
+        table.drop();
+    }
+}
+
+/**
+ * Benchmark of project() against project_row() for every row of a 10-column table (alternating INT and TEXT
+ * columns), i.e., building a ValueDict per row versus building positional ValueRows.
+ * @param rows  how many rows to load
+ */
+void benchmark_project(uint rows) {
+    ColumnNames column_names;
+    ColumnAttributes column_attributes;
+    for (uint i = 0; i < 10; i++) {
+        column_names.push_back("c" + to_string(i));
+        column_attributes.push_back(ColumnAttribute(i % 2 == 0 ? ColumnAttribute::INT : ColumnAttribute::TEXT));
+    }
+    HeapTable table("_benchmark_project_cpp", column_names, column_attributes);
+    table.create_if_not_exists();
+    ValueDict row;
+    for (uint r = 0; r < rows; r++) {
+        for (uint i = 0; i < 10; i++)
+            row[column_names[i]] = i % 2 == 0 ? Value(r) : Value("text value " + to_string(r));
+        table.insert(&row);
+    }
+    Handles *handles = table.select();
+
+    auto start = chrono::steady_clock::now();
+    int64_t sum = 0;
+    for (auto const &handle: *handles) {
+        ValueDict *result = table.project(handle);
+        sum += (*result)["c4"].n;
+        delete result;
+    }
+    double dict_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    start = chrono::steady_clock::now();
+    for (auto const &handle: *handles) {
+        ValueRow *result = table.project_row(handle);
+        sum -= (*result)[4].n;
+        delete result;
+    }
+    double row_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    cout << "project of " << handles->size() << " 10-column rows: ValueDict " << dict_ms << " ms, ValueRow "
+         << row_ms << " ms" << (sum == 0 ? "" : " (mismatch!)") << endl;
+    delete handles;
+    table.drop();
+}
+
+/**
+ * Benchmark of a bulk load done with insert() of one row at a time against insert_batch() of a RowBatch at a time.
+ * @param rows  how many rows to load
+ */
+void benchmark_insert(uint rows) {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    column_names.push_back("c");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::BOOLEAN));
+
+    HeapTable table("_benchmark_insert_cpp", column_names, column_attributes);
+    table.create();
+    ValueDict row;
+    auto start = chrono::steady_clock::now();
+    for (uint i = 0; i < rows; i++) {
+        test_set_row(row, i, "row number " + to_string(i));
+        table.insert(&row);
+    }
+    double row_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    table.drop();
+
+    table.create();
+    RowBatch batch;
+    start = chrono::steady_clock::now();
+    for (uint i = 0; i < rows; i++) {
+        ValueRow &values = batch.add();
+        values.resize(3);
+        values[0] = Value(i);
+        values[1].data_type = ColumnAttribute::TEXT;
+        values[1].s = "row number " + to_string(i);
+        values[2] = Value(i % 2 == 0);
+        if (batch.full() || i == rows - 1) {
+            table.insert_batch(batch);
+            batch.clear();
+        }
+    }
+    double batch_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    table.drop();
+
+    cout << "load of " << rows << " rows: insert " << (uint64_t) (rows / row_ms * 1000) << " rows/s, insert_batch "
+         << (uint64_t) (rows / batch_ms * 1000) << " rows/s" << endl;
+}
+
+/**
+ * Benchmark of deleting every other row of a table with del() of one row at a time against one del_batch().
+ * @param rows  how many rows the table has
+ */
+void benchmark_delete(uint rows) {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+
+    HeapTable table("_benchmark_delete_cpp", column_names, column_attributes);
+    double ms[2];
+    for (uint batched = 0; batched < 2; batched++) {
+        table.create();
+        RowBatch batch;
+        Handles handles;
+        for (uint i = 0; i < rows; i++) {
+            ValueRow &values = batch.add();
+            values.resize(2);
+            values[0] = Value(i);
+            values[1] = Value("row number " + to_string(i));
+            if (batch.full() || i == rows - 1) {
+                table.insert_batch(batch, &handles);
+                batch.clear();
+            }
+        }
+        Handles victims;
+        for (uint i = 0; i < rows; i += 2)
+            victims.push_back(handles[i]);
+        auto start = chrono::steady_clock::now();
+        if (batched) {
+            table.del_batch(victims);
+        } else {
+            for (auto const &handle: victims)
+                table.del(handle);
+        }
+        ms[batched] = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        table.drop();
+    }
+    cout << "delete of " << (rows + 1) / 2 << " of " << rows << " rows: del " << ms[0] << " ms, del_batch " << ms[1]
+         << " ms" << endl;
+}
+
+/**
+ * Benchmark of a bulk load of a CSV file with load_csv().
+ * @param rows  how many lines the file has
+ */
+void benchmark_load_csv(uint rows) {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    column_names.push_back("c");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::BOOLEAN));
+
+    FILE *file = tmpfile();
+    for (uint i = 0; i < rows; i++)
+        fprintf(file, "%u,row number %u,%s\n", i, i, i % 2 == 0 ? "true" : "false");
+    rewind(file);
+
+    HeapTable table("_benchmark_load_csv_cpp", column_names, column_attributes);
+    table.create();
+    CsvReader reader(file);
+    auto start = chrono::steady_clock::now();
+    u_long loaded = table.load_csv(reader);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    table.drop();
+    fclose(file);
+
+    cout << "load_csv of " << loaded << " rows: " << (uint64_t) (loaded / ms * 1000) << " rows/s, "
+         << (uint64_t) (reader.get_bytes_read() / ms * 1000 / (1024 * 1024)) << " MB/s" << endl;
+}
+
+/**
+ * Benchmark for heap storage under delete/insert churn. Loads a table, then repeatedly deletes a random
+ * row and inserts a new one, and reports how big the file got and how long a full select() takes.
+ * @param initial_rows  rows loaded before the churn starts
+ * @param churn         number of delete+insert pairs
+ */
+void benchmark_heap_storage(uint initial_rows, uint churn) {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    column_names.push_back("c");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::BOOLEAN));
+    HeapTable table("_benchmark_heap_cpp", column_names, column_attributes);
+    table.create_if_not_exists();
+
+    uint32_t seed = 5300;
+    auto next = [&seed](uint32_t n) {
+        seed = seed * 1103515245U + 12345U;
+        return ((seed >> 16) | ((seed & 0xffff) << 16)) % n;
+    };
+    ValueDict row;
+    Handles live;
+    auto start = chrono::steady_clock::now();
+    for (uint i = 0; i < initial_rows; i++) {
+        test_set_row(row, i, string(10 + next(40), 'x'));
+        live.push_back(table.insert(&row));
+    }
+    for (uint i = 0; i < churn; i++) {
+        uint victim = next((uint32_t) live.size());
+        table.del(live[victim]);
+        test_set_row(row, i, string(10 + next(40), 'x'));
+        live[victim] = table.insert(&row);
+    }
+    double churn_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    start = chrono::steady_clock::now();
+    Handles *handles = table.select();
+    double select_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    BlockIDs *block_ids = table.file->block_ids();
+    cout << *_BUFFER_POOL << endl;
+    cout << "heap churn: " << initial_rows << " rows + " << churn << " delete/insert pairs in " << churn_ms << " ms, "
+         << block_ids->size() << " blocks (" << block_ids->size() * DbBlock::BLOCK_SZ / 1024 << " KB), select() of "
+         << handles->size() << " rows in " << select_ms << " ms" << endl;
+    delete block_ids;
+    delete handles;
+    table.drop();
+}
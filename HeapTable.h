@@ -10,16 +10,28 @@
 #include "storage_engine.h"
 #include "SlottedPage.h"
 #include "HeapFile.h"
+#include "MmapHeapFile.h"
+#include "RecordCodec.h"
+
+// a where-clause value to compare against the column with the given column number
+typedef std::pair<uint, Value> ColumnPredicate;
+typedef std::vector<ColumnPredicate> ColumnPredicates;
 
 /**
  * @class HeapTable - Heap storage engine (implementation of DbRelation)
+ *
+ *      A row that grows too big for its block on update() moves to another block, leaving behind a FORWARD stub
+ *      that holds its new handle, so the handle it was given (and which indices have) stays good. The moved
+ *      record is tagged MOVED so that scans only find the row through its stub. A row is never forwarded more
+ *      than once: if it moves again, the stub is changed to point to the new place.
  */
 
 class HeapTable : public DbRelation {
 public:
-    HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes);
+    HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+              bool memory_mapped = false);
 
-    virtual ~HeapTable() {}
+    virtual ~HeapTable();
 
     HeapTable(const HeapTable &other) = delete;
 
@@ -41,32 +53,160 @@ public:
 
     virtual Handle insert(const ValueDict *row);
 
+    virtual void insert_batch(const RowBatch &rows, Handles *handles = nullptr);
+
+    virtual u_long load_csv(CsvReader &reader, std::ostream *progress = nullptr);
+
     virtual void update(const Handle handle, const ValueDict *new_values);
 
     virtual void del(const Handle handle);
 
+    virtual void del_batch(const Handles &handles);
+
     virtual Handles *select();
 
     virtual Handles *select(const ValueDict *where);
 
+    virtual HandleCursor *select_cursor(const ValueDict *where = nullptr);
+
+    virtual RowBatchCursor *batch_cursor(const ColumnNumbers *column_numbers, const ValueDict *where = nullptr);
+
+    virtual RowBatchCursor *batch_cursor(const ColumnNumbers *column_numbers, const ValueDict *where,
+                                         Handles *handles, const Predicate *predicate = nullptr);
+
+    virtual RowBatchCursor *sample_cursor(const ColumnNumbers *column_numbers, uint n_blocks, BlockID &block_count);
+
     virtual ValueDict *project(Handle handle);
 
     virtual ValueDict *project(Handle handle, const ColumnNames *column_names);
 
     using DbRelation::project;
 
+    virtual ValueRow *project_row(Handle handle);
+
+    virtual ValueRow *project_row(Handle handle, const ColumnNumbers *column_numbers);
+
+    virtual void attach_index(DbIndex *index);
+
+    virtual void detach_index(DbIndex *index);
+
 protected:
-    HeapFile file;
+    SlottedPageFile *file;  // either a HeapFile or an MmapHeapFile
+    RecordCodec codec;
+    std::vector<DbIndex *> indices;  // maintained by insert and del (not owned)
+
+    friend class HeapTableCursor;
+
+    friend class HandleListCursor;
 
-    virtual ValueDict *validate(const ValueDict *row) const;
+    friend class HeapTableBatchCursor;
 
-    virtual Handle append(const ValueDict *row);
+    friend bool test_heap_storage();
 
-    virtual Dbt *marshal(const ValueDict *row) const;
+    friend void benchmark_heap_storage(uint initial_rows, uint churn);
 
-    virtual ValueDict *unmarshal(Dbt *data) const;
+    virtual ValueRow *validate(const ValueDict *row) const;
+
+    virtual Handle append(const ValueRow *row);
+
+    virtual void rewrite(Handle handle, const ValueRow *row);
+
+    virtual const char *get_bytes(SlottedPage *block, RecordID record_id, uint16_t &size,
+                                  SlottedPage *&forwarded) const;
+
+    virtual RecordID reserve(SlottedPage *&block, uint16_t size, void *&bytes);
+
+    virtual Dbt *marshal(const ValueRow *row) const;
+
+    virtual ValueRow *unmarshal(const Dbt *data) const;
 
     virtual bool selected(Handle handle, const ValueDict *where);
+
+    virtual void compile_predicates(const ValueDict *where, ColumnPredicates &predicates) const;
+
+    virtual bool selected(const Dbt *data, const ColumnPredicates &predicates) const;
+
+    virtual DbIndex *index_for(const ValueDict *where) const;
+};
+
+/**
+ * @class HeapTableCursor - streams the handles of the rows of a HeapTable (or of some of its blocks) that match a
+ *                         where clause
+ */
+class HeapTableCursor : public HandleCursor {
+public:
+    HeapTableCursor(HeapTable &table, const ValueDict *where, BlockIDCursor *blocks = nullptr);
+
+    virtual ~HeapTableCursor();
+
+    HeapTableCursor(const HeapTableCursor &other) = delete;
+
+    HeapTableCursor &operator=(const HeapTableCursor &other) = delete;
+
+    virtual bool next(Handle &handle);
+
+protected:
+    HeapTable &table;
+    ColumnPredicates predicates;
+    BlockIDCursor *blocks;
+    SlottedPage *block;        // current block (pinned while we're on it)
+    RecordIDCursor *records;   // cursor over the current block's records
+    SlottedPage *forwarded;    // block of the last forwarded row whose bytes we needed
+};
+
+/**
+ * @class HandleListCursor - streams the handles from a list (as from an index lookup) that match a where clause
+ */
+class HandleListCursor : public HandleCursor {
+public:
+    HandleListCursor(HeapTable &table, Handles *handles, const ValueDict *where);
+
+    virtual ~HandleListCursor();
+
+    HandleListCursor(const HandleListCursor &other) = delete;
+
+    HandleListCursor &operator=(const HandleListCursor &other) = delete;
+
+    virtual bool next(Handle &handle);
+
+protected:
+    HeapTable &table;
+    ColumnPredicates predicates;
+    Handles *handles;  // owned
+    uint position;
+};
+
+/**
+ * @class HeapTableBatchCursor - streams some columns of the rows whose handles come from another cursor, a batch
+ *                               at a time, decoding them straight out of their blocks (and only the rows that
+ *                               pass its predicate, if it has one)
+ */
+class HeapTableBatchCursor : public RowBatchCursor {
+public:
+    HeapTableBatchCursor(HeapTable &table, HandleCursor *handles, const ColumnNumbers *column_numbers,
+                         const Predicate *predicate = nullptr);
+
+    virtual ~HeapTableBatchCursor();
+
+    HeapTableBatchCursor(const HeapTableBatchCursor &other) = delete;
+
+    HeapTableBatchCursor &operator=(const HeapTableBatchCursor &other) = delete;
+
+    virtual bool next(RowBatch &batch);
+
+protected:
+    HeapTable &table;
+    HandleCursor *handles;  // owned
+    ColumnNumbers column_numbers;
+    const Predicate *predicate;  // rows that fail it are skipped before they're decoded (nullptr for none)
+    SlottedPage *block;     // block of the last row (consecutive rows are usually in the same block)
+    SlottedPage *forwarded; // block of the last forwarded row
 };
 
 bool test_heap_storage();
+void benchmark_heap_storage(uint initial_rows, uint churn);
+void benchmark_heap_scan(uint rows);
+void benchmark_project(uint rows);
+void benchmark_insert(uint rows);
+void benchmark_delete(uint rows);
+void benchmark_load_csv(uint rows);
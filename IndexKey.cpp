@@ -0,0 +1,108 @@
+/**
+ * @file IndexKey.cpp - implementation of the index entry helpers
+ * @see "Seattle University, CPSC5300"
+ */
+#include <cstring>
+#include "IndexKey.h"
+
+using namespace std;
+typedef uint16_t u16;
+
+KeyValue *make_index_key(const ColumnNames &key_columns, const ValueDict *key) {
+    KeyValue *key_value = new KeyValue();
+    for (auto const &column_name: key_columns) {
+        ValueDict::const_iterator column = key->find(column_name);
+        if (column == key->end()) {
+            delete key_value;
+            throw DbRelationError("no value given for index column '" + column_name + "'");
+        }
+        key_value->push_back(column->second);
+    }
+    return key_value;
+}
+
+uint marshal_index_entry(const KeyProfile &key_profile, const IndexEntry &entry, char *bytes) {
+    // size it all up first: callers' buffers are only MAX_INDEX_ENTRY_SZ long, whatever the columns are
+    size_t size = sizeof(BlockID) + sizeof(RecordID);
+    for (uint i = 0; i < key_profile.size(); i++) {
+        if (key_profile[i] == ColumnAttribute::DataType::INT)
+            size += sizeof(int32_t);
+        else if (key_profile[i] == ColumnAttribute::DataType::BOOLEAN)
+            size += sizeof(uint8_t);
+        else
+            size += sizeof(u16) + entry.first[i].s.length();
+    }
+    if (size > MAX_INDEX_ENTRY_SZ)
+        throw DbRelationError("index entry too long (" + to_string(size) + " bytes, at most " +
+                              to_string(MAX_INDEX_ENTRY_SZ) + ")");
+
+    uint offset = 0;
+    for (uint i = 0; i < key_profile.size(); i++) {
+        const Value &value = entry.first[i];
+        if (key_profile[i] == ColumnAttribute::DataType::INT) {
+            *(int32_t *) (bytes + offset) = value.n;
+            offset += sizeof(int32_t);
+        } else if (key_profile[i] == ColumnAttribute::DataType::BOOLEAN) {
+            *(uint8_t *) (bytes + offset) = (uint8_t) value.n;
+            offset += sizeof(uint8_t);
+        } else {
+            *(u16 *) (bytes + offset) = (u16) value.s.length();
+            offset += sizeof(u16);
+            memcpy(bytes + offset, value.s.data(), value.s.length());
+            offset += value.s.length();
+        }
+    }
+    *(BlockID *) (bytes + offset) = entry.second.first;
+    offset += sizeof(BlockID);
+    *(RecordID *) (bytes + offset) = entry.second.second;
+    offset += sizeof(RecordID);
+    return offset;
+}
+
+uint unmarshal_index_entry(const KeyProfile &key_profile, const char *bytes, IndexEntry &entry) {
+    uint offset = 0;
+    entry.first.resize(key_profile.size());
+    for (uint i = 0; i < key_profile.size(); i++) {
+        Value &value = entry.first[i];
+        value.data_type = key_profile[i];
+        if (value.data_type == ColumnAttribute::DataType::INT) {
+            value.n = *(int32_t *) (bytes + offset);
+            offset += sizeof(int32_t);
+        } else if (value.data_type == ColumnAttribute::DataType::BOOLEAN) {
+            value.n = *(uint8_t *) (bytes + offset);
+            offset += sizeof(uint8_t);
+        } else {
+            u16 size = *(u16 *) (bytes + offset);
+            offset += sizeof(u16);
+            value.s.assign(bytes + offset, size);
+            offset += size;
+        }
+    }
+    entry.second.first = *(BlockID *) (bytes + offset);
+    offset += sizeof(BlockID);
+    entry.second.second = *(RecordID *) (bytes + offset);
+    offset += sizeof(RecordID);
+    return offset;
+}
+
+// 32-bit FNV-1a
+uint32_t hash_index_key(const KeyProfile &key_profile, const KeyValue &key) {
+    uint32_t hash = 2166136261U;
+    auto mix = [&hash](const void *data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            hash ^= ((const uint8_t *) data)[i];
+            hash *= 16777619U;
+        }
+    };
+    for (uint i = 0; i < key_profile.size(); i++) {
+        if (key_profile[i] == ColumnAttribute::DataType::TEXT) {
+            uint32_t length = (uint32_t) key[i].s.length();
+            mix(&length, sizeof(length));
+            mix(key[i].s.data(), length);
+        } else {
+            int32_t n = key[i].n;
+            mix(&n, sizeof(n));
+        }
+    }
+    return hash;
+}
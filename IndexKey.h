@@ -0,0 +1,58 @@
+/**
+ * @file IndexKey.h - Search keys and index entries shared by the index implementations.
+ *
+ * @see "Seattle University, CPSC5300, Spring 2021"
+ */
+#pragma once
+
+#include "storage_engine.h"
+
+typedef ValueRow KeyValue;
+typedef std::vector<ColumnAttribute::DataType> KeyProfile;
+
+/**
+ * An index entry: a search key together with the handle of its row.
+ */
+typedef std::pair<KeyValue, Handle> IndexEntry;
+
+/**
+ * Largest marshaled index entry we allow, so that an index page always holds several of them
+ */
+const uint MAX_INDEX_ENTRY_SZ = DbBlock::BLOCK_SZ / 8;
+
+/**
+ * Pull the search key out of a dictionary.
+ * @param key_columns  columns of the search key, in order
+ * @param key          value for each key column (may have others too)
+ * @returns            the key values in key column order (freed by caller)
+ * @throws DbRelationError if one of the key columns is missing
+ */
+KeyValue *make_index_key(const ColumnNames &key_columns, const ValueDict *key);
+
+/**
+ * Marshal an index entry: its search key (INT: 4 bytes, BOOLEAN: 1 byte, TEXT: 2-byte length then the
+ * text) followed by its handle.
+ * @param key_profile  data types of the search key
+ * @param entry        the entry
+ * @param bytes        where to put it (at least MAX_INDEX_ENTRY_SZ bytes)
+ * @returns            number of bytes used
+ * @throws DbRelationError if the whole entry would be bigger than MAX_INDEX_ENTRY_SZ (nothing is written)
+ */
+uint marshal_index_entry(const KeyProfile &key_profile, const IndexEntry &entry, char *bytes);
+
+/**
+ * Unmarshal an index entry written by marshal_index_entry().
+ * @param key_profile  data types of the search key
+ * @param bytes        the marshaled entry
+ * @param entry        returned by reference
+ * @returns            number of bytes used
+ */
+uint unmarshal_index_entry(const KeyProfile &key_profile, const char *bytes, IndexEntry &entry);
+
+/**
+ * Hash a search key (the same on every run, so it can be used for data on disk).
+ * @param key_profile  data types of the search key
+ * @param key          the search key
+ * @returns            32-bit hash of key
+ */
+uint32_t hash_index_key(const KeyProfile &key_profile, const KeyValue &key);
@@ -0,0 +1,186 @@
+/**
+ * @file MmapHeapFile.cpp
+ * @see Seattle University, CPSC5300
+ */
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "MmapHeapFile.h"
+
+using namespace std;
+
+/**
+ * Constructor
+ * @param name
+ */
+MmapHeapFile::MmapHeapFile(string name) : SlottedPageFile(name), path(""), fd(-1), base(nullptr), capacity(0),
+                                          reserved(0) {
+    const char *home = nullptr;
+    _DB_ENV->get_home(&home);
+    this->path = string(home == nullptr ? "." : home) + "/" + name + ".mmap";
+}
+
+/**
+ * Destructor - SlottedPageFile's destructor can't call our close() for us.
+ */
+MmapHeapFile::~MmapHeapFile() {
+    if (!this->closed)
+        close();
+}
+
+/**
+ * Create physical file.
+ */
+void MmapHeapFile::create(void) {
+    map_open(O_RDWR | O_CREAT | O_EXCL);
+    this->state->free_space_map.create();
+    this->state->open_count++;
+    SlottedPage *page = get_new(); // force one page to exist
+    delete page;
+}
+
+/**
+ * Delete the physical file.
+ */
+void MmapHeapFile::drop(void) {
+    close();
+    if (unlink(this->path.c_str()) != 0)
+        throw DbException(("cannot remove " + this->path).c_str(), errno);
+    this->state->free_space_map.drop();
+}
+
+/**
+ * Open physical file.
+ */
+void MmapHeapFile::open(void) {
+    if (!this->closed)
+        return;
+    map_open(O_RDWR);
+    open_free_space_map();
+}
+
+/**
+ * Flush and unmap the physical file.
+ */
+void MmapHeapFile::close(void) {
+    if (this->closed)
+        return;
+    flush();
+    munmap(this->base, (size_t) this->reserved * DbBlock::BLOCK_SZ);
+    ::close(this->fd);
+    this->base = nullptr;
+    this->fd = -1;
+    close_free_space_map();
+    this->closed = true;
+}
+
+/**
+ * Allocate a new block at the end of the file, growing the file if need be.
+ * @return the new empty block (freed by caller)
+ */
+SlottedPage *MmapHeapFile::get_new(void) {
+    ensure_capacity(this->state->last + 2);  // +1 for the new one, +1 for the header block
+    BlockID block_id = ++this->state->last;
+    *(uint32_t *) address(0) = block_id;
+    memset(address(block_id), 0, DbBlock::BLOCK_SZ);
+    Dbt data(address(block_id), DbBlock::BLOCK_SZ);
+    SlottedPage *page = new SlottedPage(data, block_id, true);
+    this->state->free_space_map.set(block_id, page->free_space());
+    _STORAGE_COUNTERS.block_writes++;
+    return page;
+}
+
+/**
+ * Get a block from the file. The page's bytes are the mapped file itself.
+ * @param block_id
+ * @return          the given slotted page (freed by caller)
+ */
+SlottedPage *MmapHeapFile::get(BlockID block_id) {
+    if (block_id == 0 || block_id > this->state->last)
+        throw DbRelationError("block " + to_string(block_id) + " is not in " + this->path);
+    Dbt data(address(block_id), DbBlock::BLOCK_SZ);
+    _STORAGE_COUNTERS.block_reads++;
+    return new SlottedPage(data, block_id);
+}
+
+/**
+ * Write a block back to the file. Pages from get()/get_new() were changed in place, so this only copies
+ * for blocks that came from somewhere else.
+ * @param block
+ */
+void MmapHeapFile::put(DbBlock *block) {
+    BlockID block_id = block->get_block_id();
+    if (block->get_data() != address(block_id))
+        memcpy(address(block_id), block->get_data(), DbBlock::BLOCK_SZ);
+    this->state->free_space_map.set(block_id, ((SlottedPage *) block)->free_space());
+    _STORAGE_COUNTERS.block_writes++;
+}
+
+/**
+ * Synchronously write the mapping back to the file.
+ */
+void MmapHeapFile::flush(void) {
+    if (this->closed)
+        return;
+    if (msync(this->base, (size_t) this->capacity * DbBlock::BLOCK_SZ, MS_SYNC) != 0)
+        throw DbException(("msync failed for " + this->path).c_str(), errno);
+}
+
+/**
+ * Open (and maybe create) the file and map it.
+ * @param flags  flags for open(2)
+ */
+void MmapHeapFile::map_open(int flags) {
+    if (!this->closed)
+        return;
+    this->fd = ::open(this->path.c_str(), flags, 0644);
+    if (this->fd < 0)
+        throw DbException(("cannot open " + this->path).c_str(), errno);
+    struct stat st;
+    fstat(this->fd, &st);
+    this->capacity = (uint32_t) (st.st_size / DbBlock::BLOCK_SZ);
+    if (this->capacity == 0) {
+        this->capacity = EXTENT_BLOCKS;
+        if (ftruncate(this->fd, (off_t) this->capacity * DbBlock::BLOCK_SZ) != 0)
+            throw DbException(("cannot size " + this->path).c_str(), errno);
+    }
+    map(max(this->capacity, (uint32_t) RESERVED_BLOCKS));
+    this->state->last = *(uint32_t *) address(0);  // the header block is shared with any other mapping
+    this->closed = false;
+}
+
+/**
+ * Make sure the file has at least the given number of blocks, growing it by whole extents. It only ever grows
+ * within the reservation: remapping would move the blocks out from under pages we've handed out.
+ * @param blocks  number of blocks needed (including the header block)
+ * @throws DbRelationError if the file would outgrow its reservation
+ */
+void MmapHeapFile::ensure_capacity(uint32_t blocks) {
+    if (blocks <= this->capacity)
+        return;
+    uint32_t new_capacity = (blocks + EXTENT_BLOCKS - 1) / EXTENT_BLOCKS * EXTENT_BLOCKS;
+    new_capacity = min(new_capacity, this->reserved);
+    if (blocks > new_capacity)
+        throw DbRelationError(this->path + " is full (" + to_string(this->reserved) + " blocks)");
+    if (ftruncate(this->fd, (off_t) new_capacity * DbBlock::BLOCK_SZ) != 0)
+        throw DbException(("cannot grow " + this->path).c_str(), errno);
+    this->capacity = new_capacity;
+}
+
+/**
+ * Map the given number of blocks worth of the file (some of which may be past its current end). Only done
+ * once per open. The part past the end of the file is just address space (MAP_NORESERVE), so it costs
+ * nothing until the file grows into it.
+ * @param blocks
+ */
+void MmapHeapFile::map(uint32_t blocks) {
+    void *addr = mmap(nullptr, (size_t) blocks * DbBlock::BLOCK_SZ, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE,
+                      this->fd, 0);
+    if (addr == MAP_FAILED)
+        throw DbException(("cannot map " + this->path).c_str(), errno);
+    this->base = (char *) addr;
+    this->reserved = blocks;
+}
@@ -0,0 +1,81 @@
+/**
+ * @file MmapHeapFile.h - Memory-mapped implementation of the heap file.
+ * MmapHeapFile: SlottedPageFile
+ *
+ * @see "Seattle University, CPSC5300, Spring 2021"
+ */
+#pragma once
+
+#include "HeapFile.h"
+
+/**
+ * @class MmapHeapFile - heap file kept in a plain file that is mapped into memory
+ *
+ * Instead of a Berkeley DB RecNo file, the blocks are stored back to back in <env home>/<name>.mmap and
+ * the whole file is mapped with mmap. get() hands SlottedPage a pointer straight into the mapping, so there
+ * is no copying on read and put() has nothing to copy either for pages that came from get()/get_new().
+ * Block 0 of the file is a header holding the number of blocks in use. The file grows by EXTENT_BLOCKS at
+ * a time inside an address space reservation made when it is opened. The mapping never moves, so pages
+ * already handed out stay valid; a file that would outgrow its reservation is full. Dirty pages are flushed
+ * with msync on close(). Free space is tracked with the same FreeSpaceMap that HeapFile uses. There is no
+ * Berkeley DB handle and nothing goes through the buffer pool.
+ */
+class MmapHeapFile : public SlottedPageFile {
+public:
+    /**
+     * Grow the file 64 blocks (256 kB) at a time.
+     */
+    static const uint EXTENT_BLOCKS = 64;
+
+    /**
+     * Reserve enough address space for 16M blocks (64 GB), or the file's size if it is already bigger. It is
+     * mapped with MAP_NORESERVE, so only the blocks the file actually has take any memory or swap.
+     */
+    static const uint RESERVED_BLOCKS = 1U << 24;
+
+    MmapHeapFile(std::string name);
+
+    virtual ~MmapHeapFile();
+
+    MmapHeapFile(const MmapHeapFile &other) = delete;
+
+    MmapHeapFile(MmapHeapFile &&temp) = delete;
+
+    MmapHeapFile &operator=(const MmapHeapFile &other) = delete;
+
+    MmapHeapFile &operator=(MmapHeapFile &&temp) = delete;
+
+    virtual void create(void);
+
+    virtual void drop(void);
+
+    virtual void open(void);
+
+    virtual void close(void);
+
+    virtual SlottedPage *get_new(void);
+
+    virtual SlottedPage *get(BlockID block_id);
+
+    virtual void put(DbBlock *block);
+
+    /**
+     * Write all changes out to the file (msync).
+     */
+    virtual void flush(void);
+
+protected:
+    std::string path;
+    int fd;
+    char *base;         // start of the mapping (block 0 is our header)
+    uint32_t capacity;  // blocks (including the header) the file currently has room for
+    uint32_t reserved;  // blocks of address space mapped (fixed while open)
+
+    virtual void map_open(int flags);
+
+    virtual void ensure_capacity(uint32_t blocks);
+
+    virtual void map(uint32_t blocks);
+
+    void *address(BlockID block_id) const { return this->base + (size_t) block_id * DbBlock::BLOCK_SZ; }
+};
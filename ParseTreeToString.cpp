@@ -74,6 +74,15 @@ string ParseTreeToString::operator_expression(const Expr *expr) {
         case Expr::SIMPLE_OP:
             ret += expr->opChar;
             break;
+        case Expr::NOT_EQUALS:
+            ret += "<>";
+            break;
+        case Expr::LESS_EQ:
+            ret += "<=";
+            break;
+        case Expr::GREATER_EQ:
+            ret += ">=";
+            break;
         case Expr::AND:
             ret += "AND";
             break;
@@ -108,7 +117,7 @@ string ParseTreeToString::expression(const Expr *expr) {
             ret += to_string(expr->ival);
             break;
         case kExprFunctionRef:
-            ret += string(expr->name) + "?" + expr->expr->name;
+            ret += string(expr->name) + "(" + (expr->distinct ? "DISTINCT " : "") + expression(expr->expr) + ")";
             break;
         case kExprOperator:
             ret += operator_expression(expr);
@@ -201,11 +210,64 @@ string ParseTreeToString::select(const SelectStatement *stmt) {
     ret += " FROM " + table_ref(stmt->fromTable);
     if (stmt->whereClause != NULL)
         ret += " WHERE " + expression(stmt->whereClause);
+    if (stmt->groupBy != NULL) {
+        ret += " GROUP BY ";
+        doComma = false;
+        for (Expr *expr : *stmt->groupBy->columns) {
+            if (doComma)
+                ret += ", ";
+            ret += expression(expr);
+            doComma = true;
+        }
+        if (stmt->groupBy->having != NULL)
+            ret += " HAVING " + expression(stmt->groupBy->having);
+    }
+    if (stmt->order != NULL) {
+        ret += " ORDER BY ";
+        doComma = false;
+        for (OrderDescription *order : *stmt->order) {
+            if (doComma)
+                ret += ", ";
+            ret += expression(order->expr);
+            if (order->type == kOrderDesc)
+                ret += " DESC";
+            doComma = true;
+        }
+    }
+    if (stmt->limit != NULL && stmt->limit->limit >= 0) {
+        ret += " LIMIT " + to_string(stmt->limit->limit);
+        if (stmt->limit->offset > 0)
+            ret += " OFFSET " + to_string(stmt->limit->offset);
+    }
     return ret;
 }
 
 string ParseTreeToString::insert(const InsertStatement *stmt) {
-    return "INSERT ...";
+    string ret("INSERT INTO ");
+    ret += stmt->tableName;
+    if (stmt->columns != NULL) {
+        ret += " (";
+        bool doComma = false;
+        for (char *col : *stmt->columns) {
+            if (doComma)
+                ret += ", ";
+            ret += col;
+            doComma = true;
+        }
+        ret += ")";
+    }
+    if (stmt->type == InsertStatement::kInsertSelect)
+        return ret + " " + select(stmt->select);
+    ret += " VALUES (";
+    bool doComma = false;
+    for (Expr *expr : *stmt->values) {
+        if (doComma)
+            ret += ", ";
+        ret += expression(expr);
+        doComma = true;
+    }
+    ret += ")";
+    return ret;
 }
 
 string ParseTreeToString::create(const CreateStatement *stmt) {
@@ -275,6 +337,45 @@ string ParseTreeToString::show(const ShowStatement *stmt) {
     return ret;
 }
 
+string ParseTreeToString::import(const ImportStatement *stmt) {
+    string ret("IMPORT FROM ");
+    switch (stmt->type) {
+        case ImportStatement::kImportCSV:
+            ret += "CSV";
+            break;
+        case ImportStatement::kImportTbl:
+            ret += "TBL";
+            break;
+        default:
+            ret += "?";
+    }
+    ret += string(" FILE '") + stmt->filePath + "' INTO " + stmt->tableName;
+    return ret;
+}
+
+string ParseTreeToString::del(const DeleteStatement *stmt) {
+    string ret("DELETE FROM ");
+    ret += stmt->tableName;
+    if (stmt->expr != nullptr)
+        ret += " WHERE " + expression(stmt->expr);
+    return ret;
+}
+
+string ParseTreeToString::update(const UpdateStatement *stmt) {
+    string ret("UPDATE ");
+    ret += table_ref(stmt->table) + " SET ";
+    bool doComma = false;
+    for (auto const &clause : *stmt->updates) {
+        if (doComma)
+            ret += ", ";
+        ret += string(clause->column) + " = " + expression(clause->value);
+        doComma = true;
+    }
+    if (stmt->where != nullptr)
+        ret += " WHERE " + expression(stmt->where);
+    return ret;
+}
+
 string ParseTreeToString::statement(const SQLStatement *stmt) {
     switch (stmt->type()) {
         case kStmtSelect:
@@ -287,11 +388,14 @@ string ParseTreeToString::statement(const SQLStatement *stmt) {
             return drop((const DropStatement *) stmt);
         case kStmtShow:
             return show((const ShowStatement *) stmt);
-
-        case kStmtError:
         case kStmtImport:
-        case kStmtUpdate:
+            return import((const ImportStatement *) stmt);
         case kStmtDelete:
+            return del((const DeleteStatement *) stmt);
+        case kStmtUpdate:
+            return update((const UpdateStatement *) stmt);
+
+        case kStmtError:
         case kStmtPrepare:
         case kStmtExecute:
         case kStmtExport:
@@ -0,0 +1,359 @@
+/**
+ * @file PlanCache.cpp - implementation of PreparedStatement and PlanCache
+ * @see "Seattle University, CPSC5300"
+ */
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include "PlanCache.h"
+#include "schema_tables.h"
+
+using namespace std;
+using namespace hsql;
+
+static void find_placeholders(Expr *expr, vector<Expr *> &placeholders);
+
+static void find_placeholders(SelectStatement *select, vector<Expr *> &placeholders);
+
+static void find_placeholders(TableRef *table, vector<Expr *> &placeholders) {
+    if (table == nullptr)
+        return;
+    if (table->select != nullptr)
+        find_placeholders(table->select, placeholders);
+    if (table->list != nullptr)
+        for (auto const &item: *table->list)
+            find_placeholders(item, placeholders);
+    if (table->join != nullptr) {
+        find_placeholders(table->join->left, placeholders);
+        find_placeholders(table->join->right, placeholders);
+        find_placeholders(table->join->condition, placeholders);
+    }
+}
+
+static void find_placeholders(SelectStatement *select, vector<Expr *> &placeholders) {
+    for (; select != nullptr; select = select->unionSelect) {
+        if (select->selectList != nullptr)
+            for (auto const &expr: *select->selectList)
+                find_placeholders(expr, placeholders);
+        find_placeholders(select->fromTable, placeholders);
+        find_placeholders(select->whereClause, placeholders);
+        if (select->groupBy != nullptr) {
+            if (select->groupBy->columns != nullptr)
+                for (auto const &expr: *select->groupBy->columns)
+                    find_placeholders(expr, placeholders);
+            find_placeholders(select->groupBy->having, placeholders);
+        }
+        if (select->order != nullptr)
+            for (auto const &order: *select->order)
+                find_placeholders(order->expr, placeholders);
+    }
+}
+
+/**
+ * Collect the placeholders in an expression (and in any subquery of it).
+ */
+static void find_placeholders(Expr *expr, vector<Expr *> &placeholders) {
+    if (expr == nullptr)
+        return;
+    if (expr->type == kExprPlaceholder)
+        placeholders.push_back(expr);
+    find_placeholders(expr->expr, placeholders);
+    find_placeholders(expr->expr2, placeholders);
+    if (expr->exprList != nullptr)
+        for (auto const &item: *expr->exprList)
+            find_placeholders(item, placeholders);
+    if (expr->select != nullptr)
+        find_placeholders(expr->select, placeholders);
+}
+
+/**
+ * The parser numbers each placeholder by where it is in the text, so sorting by that number puts them in order.
+ */
+PreparedStatement::PreparedStatement(SQLParserResult *parse) : parse(parse), placeholders() {
+    SQLStatement *statement = parse->getMutableStatement(0);
+    switch (statement->type()) {
+        case kStmtSelect:
+            find_placeholders((SelectStatement *) statement, this->placeholders);
+            break;
+        case kStmtInsert: {
+            InsertStatement *insert = (InsertStatement *) statement;
+            if (insert->values != nullptr)
+                for (auto const &expr: *insert->values)
+                    find_placeholders(expr, this->placeholders);
+            find_placeholders(insert->select, this->placeholders);
+            break;
+        }
+        case kStmtUpdate: {
+            UpdateStatement *update = (UpdateStatement *) statement;
+            if (update->updates != nullptr)
+                for (auto const &clause: *update->updates)
+                    find_placeholders(clause->value, this->placeholders);
+            find_placeholders(update->where, this->placeholders);
+            break;
+        }
+        case kStmtDelete:
+            find_placeholders(((DeleteStatement *) statement)->expr, this->placeholders);
+            break;
+        default:
+            break;
+    }
+    stable_sort(this->placeholders.begin(), this->placeholders.end(),
+                [](const Expr *a, const Expr *b) { return a->ival < b->ival; });
+}
+
+PreparedStatement::~PreparedStatement() {
+    delete this->parse;
+}
+
+bool PreparedStatement::preparable(const SQLParserResult *parse) {
+    if (!parse->isValid() || parse->size() != 1)
+        return false;
+    switch (parse->getStatement(0)->type()) {
+        case kStmtSelect:
+        case kStmtInsert:
+        case kStmtUpdate:
+        case kStmtDelete:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void PreparedStatement::bind(const ValueRow &parameters) {
+    for (size_t i = 0; i < this->placeholders.size(); i++) {
+        Expr *expr = this->placeholders[i];
+        const Value &value = parameters[i];
+        free(expr->name);
+        expr->name = nullptr;
+        if (value.data_type == ColumnAttribute::TEXT) {
+            expr->type = kExprLiteralString;
+            expr->name = strdup(value.s.c_str());
+        } else {
+            expr->type = kExprLiteralInt;
+            expr->ival = value.n;
+        }
+    }
+}
+
+PlanCache::PlanCache() : statements(), prepared(), version(Catalog::get_version()), hits(0), misses(0) {}
+
+PlanCache::~PlanCache() {
+    clear();
+    for (auto const &entry: this->prepared)
+        delete entry.second;
+}
+
+const SQLStatement *PlanCache::get(const string &sql) {
+    if (this->version != Catalog::get_version()) {
+        clear();
+        this->version = Catalog::get_version();
+    }
+    string normalized;
+    ValueRow literals;
+    if (!normalize(sql, normalized, literals))
+        return nullptr;
+
+    PreparedStatement *statement;
+    auto found = this->statements.find(normalized);
+    if (found != this->statements.end()) {
+        statement = found->second;
+        if (statement != nullptr)
+            this->hits++;
+    } else {
+        this->misses++;
+        statement = nullptr;
+        SQLParserResult *parse = SQLParser::parseSQLString(normalized);
+        if (PreparedStatement::preparable(parse))
+            statement = new PreparedStatement(parse);
+        else
+            delete parse;
+        if (this->statements.size() >= CAPACITY)
+            clear();
+        this->statements[normalized] = statement;
+    }
+    if (statement == nullptr || statement->get_parameter_count() != literals.size())
+        return nullptr;  // the text had placeholders of its own
+    statement->bind(literals);
+    return statement->get_statement();
+}
+
+void PlanCache::put(const Identifier &name, PreparedStatement *prepared) {
+    this->prepared[name] = prepared;
+}
+
+PreparedStatement *PlanCache::find(const Identifier &name) const {
+    auto found = this->prepared.find(name);
+    return found == this->prepared.end() ? nullptr : found->second;
+}
+
+bool PlanCache::remove(const Identifier &name) {
+    auto found = this->prepared.find(name);
+    if (found == this->prepared.end())
+        return false;
+    delete found->second;
+    this->prepared.erase(found);
+    return true;
+}
+
+void PlanCache::clear() {
+    for (auto const &entry: this->statements)
+        delete entry.second;
+    this->statements.clear();
+}
+
+/**
+ * Goes through the text a token at a time, copying everything but the literals. Quoted identifiers are copied
+ * whole, and the last word seen tells whether a number is a LIMIT or OFFSET.
+ */
+bool PlanCache::normalize(const string &sql, string &normalized, ValueRow &literals) {
+    normalized.clear();
+    literals.clear();
+    string word;  // the last keyword or identifier, in upper case
+    size_t pos = 0;
+    while (pos < sql.length()) {
+        char c = sql[pos];
+        if (isspace(c)) {
+            while (pos < sql.length() && isspace(sql[pos]))
+                pos++;
+            if (!normalized.empty() && pos < sql.length())
+                normalized += ' ';
+        } else if (c == '-' && pos + 1 < sql.length() && sql[pos + 1] == '-') {
+            return false;
+        } else if (c == '"') {
+            size_t end = sql.find('"', pos + 1);
+            if (end == string::npos)
+                return false;
+            normalized.append(sql, pos, end + 1 - pos);
+            pos = end + 1;
+            word.clear();
+        } else if (isalpha(c) || c == '_') {
+            size_t start = pos;
+            while (pos < sql.length() && (isalnum(sql[pos]) || sql[pos] == '_'))
+                pos++;
+            normalized.append(sql, start, pos - start);
+            word = sql.substr(start, pos - start);
+            transform(word.begin(), word.end(), word.begin(), ::toupper);
+        } else if (c == '\'' || isdigit(c)) {
+            size_t start = pos;
+            Value value;
+            bool after_dot = pos > 0 && sql[pos - 1] == '.';
+            if (!after_dot && word != "LIMIT" && word != "OFFSET" && scan_literal(sql, pos, value)) {
+                normalized += '?';
+                literals.push_back(value);
+            } else if (c == '\'') {
+                return false;
+            } else {
+                while (pos < sql.length() && (isalnum(sql[pos]) || sql[pos] == '_' || sql[pos] == '.'))
+                    pos++;
+                normalized.append(sql, start, pos - start);
+            }
+            word.clear();
+        } else {
+            normalized += c;
+            pos++;
+            word.clear();
+        }
+    }
+    return true;
+}
+
+bool PlanCache::scan_literal(const string &sql, size_t &pos, Value &value) {
+    size_t at = pos;
+    if (at < sql.length() && sql[at] == '\'') {
+        size_t end = sql.find('\'', at + 1);
+        if (end == string::npos || (end + 1 < sql.length() && sql[end + 1] == '\''))
+            return false;
+        value = Value(sql.substr(at + 1, end - at - 1));
+        pos = end + 1;
+        return true;
+    }
+    bool negative = at < sql.length() && sql[at] == '-';
+    if (negative)
+        at++;
+    int64_t n = 0;
+    size_t digits = at;
+    while (at < sql.length() && isdigit(sql[at]) && n <= INT_MAX)
+        n = n * 10 + (sql[at++] - '0');
+    if (at == digits || (negative ? -n < INT_MIN : n > INT_MAX))
+        return false;
+    if (at < sql.length() && (isalnum(sql[at]) || sql[at] == '_' || sql[at] == '.'))
+        return false;  // 1.5, 1e3, 12abc
+    value = Value((int32_t) (negative ? -n : n));
+    pos = at;
+    return true;
+}
+
+/**
+ * Test normalizing statements and reading literals (the cache itself needs the parser, so it is left to the
+ * benchmark).
+ * @return true if the tests all succeeded
+ */
+bool test_plan_cache() {
+    string normalized;
+    ValueRow literals;
+    if (!PlanCache::normalize("SELECT  a, b\tFROM t WHERE a = 12 AND b = 'x y' LIMIT 5 ", normalized, literals) ||
+        normalized != "SELECT a, b FROM t WHERE a = ? AND b = ? LIMIT 5" || literals.size() != 2 ||
+        literals[0] != Value(12) || literals[1] != Value("x y"))
+        return assertion_failure("normalize select");
+    if (!PlanCache::normalize("SELECT t1.c2 FROM t1 WHERE c2 > -3 OR c2 = 1.5 OR c2 = 3000000000 OR \"x 9\" = 0",
+                              normalized, literals) ||
+        normalized != "SELECT t1.c2 FROM t1 WHERE c2 > -? OR c2 = 1.5 OR c2 = 3000000000 OR \"x 9\" = ?" ||
+        literals.size() != 2 || literals[0] != Value(3) || literals[1] != Value(0))
+        return assertion_failure("normalize numbers");
+    if (!PlanCache::normalize("INSERT INTO t VALUES (1, '')", normalized, literals) ||
+        normalized != "INSERT INTO t VALUES (?, ?)" || literals[1] != Value(""))
+        return assertion_failure("normalize insert");
+    if (PlanCache::normalize("SELECT * FROM t WHERE b = 'it''s'", normalized, literals) ||
+        PlanCache::normalize("SELECT * FROM t -- all of it", normalized, literals))
+        return assertion_failure("normalize unhandled");
+
+    string sql = "-42, 'abc', 2147483648, 'abc";
+    size_t pos = 0;
+    Value value;
+    if (!PlanCache::scan_literal(sql, pos, value) || value != Value(-42) || pos != 3)
+        return assertion_failure("scan int", pos);
+    pos = 5;
+    if (!PlanCache::scan_literal(sql, pos, value) || value != Value("abc") || pos != 10)
+        return assertion_failure("scan text", pos);
+    pos = 12;
+    if (PlanCache::scan_literal(sql, pos, value) || pos != 12)
+        return assertion_failure("scan too big", pos);
+    pos = 24;
+    if (PlanCache::scan_literal(sql, pos, value))
+        return assertion_failure("scan unterminated");
+    return true;
+}
+
+/**
+ * Time parsing a statement afresh against getting it from the cache, with a different literal each time.
+ * @param n  how many statements
+ */
+void benchmark_plan_cache(uint n) {
+    vector<string> sqls;
+    for (uint i = 0; i < n; i++)
+        sqls.push_back("SELECT a, b FROM _benchmark_plan_cache WHERE a = " + to_string(i) + " AND b = 'row " +
+                       to_string(i % 100) + "'");
+
+    auto start = chrono::steady_clock::now();
+    uint parsed = 0;
+    for (auto const &sql: sqls) {
+        SQLParserResult *parse = SQLParser::parseSQLString(sql);
+        parsed += parse->isValid();
+        delete parse;
+    }
+    double parse_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    PlanCache cache;
+    start = chrono::steady_clock::now();
+    uint cached = 0;
+    for (auto const &sql: sqls)
+        cached += cache.get(sql) != nullptr;
+    double cache_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    cout << "plan cache with " << n << " statements: parse " << parse_ms * 1000 / n << " us each, cache "
+         << cache_ms * 1000 / n << " us each (" << parsed << " parsed, " << cached << " from the cache, "
+         << cache.get_hits() << " hits)" << endl;
+}
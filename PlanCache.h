@@ -0,0 +1,163 @@
+/**
+ * @file PlanCache.h - Statements parsed once and run many times.
+ * PreparedStatement
+ * PlanCache
+ *
+ * @see "Seattle University, CPSC5300, Spring 2021"
+ */
+#pragma once
+
+#include <unordered_map>
+#include "SQLParser.h"
+#include "storage_engine.h"
+
+/**
+ * @class PreparedStatement - a parsed statement with placeholders (?) that are given values each time it is run
+ *
+ *      Binding turns the placeholders in the parse tree into literals, so the statement can be handed to
+ *      SQLExec::execute like any other. A plan is still made each time it runs (operators are used up by
+ *      running them), but the SQL isn't parsed again.
+ */
+class PreparedStatement {
+public:
+    /**
+     * @param parse  a parse that passes preparable() (freed by this object)
+     */
+    PreparedStatement(hsql::SQLParserResult *parse);
+
+    virtual ~PreparedStatement();
+
+    PreparedStatement(const PreparedStatement &other) = delete;
+
+    PreparedStatement(PreparedStatement &&temp) = delete;
+
+    PreparedStatement &operator=(const PreparedStatement &other) = delete;
+
+    PreparedStatement &operator=(PreparedStatement &&temp) = delete;
+
+    /**
+     * Can the parse be prepared? It has to be a single SELECT, INSERT, UPDATE or DELETE.
+     * @param parse  what the parser made of the SQL
+     * @returns      true if it can
+     */
+    static bool preparable(const hsql::SQLParserResult *parse);
+
+    /**
+     * @returns  the statement, with whatever values were last bound in place of its placeholders
+     */
+    const hsql::SQLStatement *get_statement() const { return this->parse->getStatement(0); }
+
+    /**
+     * @returns  how many placeholders the statement has
+     */
+    size_t get_parameter_count() const { return this->placeholders.size(); }
+
+    /**
+     * Put values in place of the placeholders.
+     * @param parameters  one INT or TEXT value for each placeholder, in the order they appear in the SQL
+     */
+    void bind(const ValueRow &parameters);
+
+protected:
+    hsql::SQLParserResult *parse;
+    std::vector<hsql::Expr *> placeholders;  // in the order they appear in the SQL
+};
+
+/**
+ * @class PlanCache - the parsed form of each statement the shell has run lately, keyed on its text with the literals
+ *                    taken out, and the statements prepared by name
+ *
+ *      A statement that differs from an earlier one only in its literals (WHERE id = 7 after WHERE id = 3) is
+ *      found under the same normalized text, and its parse is reused with the new literals bound in. Text that
+ *      can't be cached (DDL, or literals where the grammar doesn't allow a placeholder, as in LIMIT) is
+ *      remembered as such, so it is only tried once.
+ *
+ *      Every entry is dropped when the catalog's version changes, i.e., after any DDL or ANALYZE. Prepared
+ *      statements are kept until they're deallocated; being planned each time they run, they follow the schema.
+ */
+class PlanCache {
+public:
+    /**
+     * Most statements kept (when it fills up, it is emptied and starts over)
+     */
+    static const size_t CAPACITY = 1024;
+
+    PlanCache();
+
+    virtual ~PlanCache();
+
+    PlanCache(const PlanCache &other) = delete;
+
+    PlanCache(PlanCache &&temp) = delete;
+
+    PlanCache &operator=(const PlanCache &other) = delete;
+
+    PlanCache &operator=(PlanCache &&temp) = delete;
+
+    /**
+     * The cached parse of a statement, with its literals bound (parsed and added if it isn't there yet).
+     * @param sql  text of the statement
+     * @returns    the statement (good until the next call), or nullptr if it can't be cached
+     */
+    const hsql::SQLStatement *get(const std::string &sql);
+
+    /**
+     * Keep a prepared statement under a name.
+     * @param name      the name (must not be in use)
+     * @param prepared  the statement (freed by this cache)
+     */
+    void put(const Identifier &name, PreparedStatement *prepared);
+
+    /**
+     * @param name  name of a prepared statement
+     * @returns     the statement, or nullptr if there's none by that name
+     */
+    PreparedStatement *find(const Identifier &name) const;
+
+    /**
+     * Forget a prepared statement.
+     * @param name  its name
+     * @returns     false if there was none by that name
+     */
+    bool remove(const Identifier &name);
+
+    /**
+     * Drop every cached statement (but not the prepared ones).
+     */
+    void clear();
+
+    u_long get_hits() const { return this->hits; }
+
+    u_long get_misses() const { return this->misses; }
+
+    /**
+     * Replace the INT and TEXT literals in a statement with placeholders, and squeeze its white space, so that
+     * statements differing only in their literals come out the same. Numbers after LIMIT or OFFSET and ones
+     * that aren't plain INTs (1.5, 1e3, or too big) are left in.
+     * @param sql         text of the statement
+     * @param normalized  returned by reference: the text with placeholders
+     * @param literals    returned by reference: the values taken out, in order
+     * @returns           false if the text has something normalizing doesn't handle (a comment, '' in a string)
+     */
+    static bool normalize(const std::string &sql, std::string &normalized, ValueRow &literals);
+
+    /**
+     * Read an INT ([-]digits) or TEXT ('characters') literal.
+     * @param sql    text
+     * @param pos    where the literal starts; returned by reference: just past it
+     * @param value  returned by reference: its value
+     * @returns      false if there isn't a literal we can handle at pos
+     */
+    static bool scan_literal(const std::string &sql, size_t &pos, Value &value);
+
+protected:
+    std::unordered_map<std::string, PreparedStatement *> statements;  // nullptr for text that can't be cached
+    std::unordered_map<Identifier, PreparedStatement *> prepared;
+    uint64_t version;  // catalog version the statements were parsed under
+    u_long hits;
+    u_long misses;
+};
+
+bool test_plan_cache();
+
+void benchmark_plan_cache(uint n);
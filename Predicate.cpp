@@ -0,0 +1,431 @@
+/**
+ * @file Predicate.cpp - implementation of Predicate
+ * @see "Seattle University, CPSC5300"
+ */
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include "Predicate.h"
+#include "SlottedPage.h"
+
+using namespace std;
+using namespace hsql;
+
+/**
+ * A column reference or literal on one side of a comparison.
+ */
+class Operand {
+public:
+    bool is_column;
+    uint column;
+    Value value;  // for a literal
+    ColumnAttribute::DataType data_type;
+};
+
+// an INT literal's value, which has to fit in 32 bits
+static int32_t int_literal(int64_t n) {
+    if (n < INT32_MIN || n > INT32_MAX)
+        throw DbRelationError("integer literal " + to_string(n) + " is out of range");
+    return (int32_t) n;
+}
+
+// whether an expression is a literal, counting a negated INT literal (the parser gives -5 as UMINUS applied to 5)
+static bool is_literal(const Expr *expr) {
+    if (expr->type == kExprOperator)
+        return expr->opType == Expr::UMINUS && expr->expr->type == kExprLiteralInt;
+    return expr->type == kExprLiteralInt || expr->type == kExprLiteralString;
+}
+
+static void operand(const Expr *expr, const ColumnAttributes &column_attributes,
+                    const Predicate::ColumnResolver &resolver, Operand &result) {
+    switch (expr->type) {
+        case kExprColumnRef: {
+            int i = resolver(expr);
+            if (i < 0)
+                throw DbRelationError(string("unknown column '") + expr->name + "'");
+            result.is_column = true;
+            result.column = (uint) i;
+            result.data_type = column_attributes[i].get_data_type();
+            break;
+        }
+        case kExprLiteralInt:
+            result.is_column = false;
+            result.value = Value(int_literal(expr->ival));
+            result.data_type = ColumnAttribute::INT;
+            break;
+        case kExprOperator:
+            if (!is_literal(expr))
+                throw DbRelationError("can only compare columns and literals");
+            result.is_column = false;
+            result.value = Value(int_literal(-expr->expr->ival));
+            result.data_type = ColumnAttribute::INT;
+            break;
+        case kExprLiteralString:
+            result.is_column = false;
+            result.value = Value(string(expr->name));
+            result.data_type = ColumnAttribute::TEXT;
+            break;
+        default:
+            throw DbRelationError("unsupported expression in where clause");
+    }
+}
+
+// compare the way std::string::compare does
+static int compare_text(const char *a, size_t a_length, const char *b, size_t b_length) {
+    int comparison = memcmp(a, b, min(a_length, b_length));
+    if (comparison != 0)
+        return comparison;
+    return a_length < b_length ? -1 : (a_length > b_length ? 1 : 0);
+}
+
+static int compare_int(int32_t a, int32_t b) {
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+/**
+ * The columns of a row of values, for run()
+ */
+class ValueRowAccess {
+public:
+    ValueRowAccess(const ValueRow &row) : row(row) {}
+
+    int32_t get_int(uint column) const { return this->row[column].n; }
+
+    int compare_text(uint column, const string &text) const { return this->row[column].s.compare(text); }
+
+    int compare_text(uint column, uint column2) const { return this->row[column].s.compare(this->row[column2].s); }
+
+protected:
+    const ValueRow &row;
+};
+
+/**
+ * The columns of a marshaled record, for run()
+ */
+class RecordAccess {
+public:
+    RecordAccess(const RecordCodec &codec, const char *bytes) : codec(codec), bytes(bytes) {}
+
+    int32_t get_int(uint column) const { return this->codec.get_int(this->bytes, column); }
+
+    int compare_text(uint column, const string &text) const {
+        const char *field;
+        uint16_t length;
+        this->codec.get_text(this->bytes, column, field, length);
+        return ::compare_text(field, length, text.data(), text.length());
+    }
+
+    int compare_text(uint column, uint column2) const {
+        const char *field, *field2;
+        uint16_t length, length2;
+        this->codec.get_text(this->bytes, column, field, length);
+        this->codec.get_text(this->bytes, column2, field2, length2);
+        return ::compare_text(field, length, field2, length2);
+    }
+
+protected:
+    const RecordCodec &codec;
+    const char *bytes;
+};
+
+Predicate::Predicate(const Expr *expr, const ColumnAttributes &column_attributes, const ColumnResolver &resolver)
+        : program() {
+    int constant = compile(expr, column_attributes, resolver, this->program, "where clause is not a condition");
+    if (constant >= 0) {
+        this->program.push_back(Instruction(CONSTANT));
+        this->program.back().n = constant;
+    }
+}
+
+bool Predicate::holds(Comparison comparison, int order) {
+    switch (comparison) {
+        case EQ:
+            return order == 0;
+        case NE:
+            return order != 0;
+        case LT:
+            return order < 0;
+        case LE:
+            return order <= 0;
+        case GT:
+            return order > 0;
+        default:
+            return order >= 0;
+    }
+}
+
+/**
+ * Both sides of an AND or OR are compiled separately, so that if one side turns out to be settled the other can be
+ * dropped (or kept alone) without fixing up any jumps; jumps are relative, so the sides can be copied as they are.
+ */
+int Predicate::compile(const Expr *expr, const ColumnAttributes &column_attributes, const ColumnResolver &resolver,
+                       Program &program, const char *not_condition) {
+    if (expr->type == kExprColumnRef) {
+        Operand column;
+        operand(expr, column_attributes, resolver, column);
+        if (column.data_type != ColumnAttribute::BOOLEAN)
+            throw DbRelationError(not_condition);
+        program.push_back(Instruction(BOOLEAN_COLUMN));
+        program.back().column = column.column;
+        return -1;
+    }
+    if (is_literal(expr))
+        throw DbRelationError(not_condition);
+    if (expr->type != kExprOperator)
+        throw DbRelationError("unsupported expression in where clause");
+
+    switch (expr->opType) {
+        case Expr::AND:
+        case Expr::OR: {
+            bool is_and = expr->opType == Expr::AND;
+            const char *message = "AND and OR need conditions on both sides";
+            Program left, right;
+            int left_constant = compile(expr->expr, column_attributes, resolver, left, message);
+            int right_constant = compile(expr->expr2, column_attributes, resolver, right, message);
+            if (left_constant >= 0 && (left_constant == 1) != is_and)
+                return left_constant;  // false AND ..., true OR ...
+            if (right_constant >= 0 && (right_constant == 1) != is_and)
+                return right_constant;
+            if (left_constant >= 0) {  // true AND right, false OR right
+                program.insert(program.end(), right.begin(), right.end());
+                return right_constant;
+            }
+            program.insert(program.end(), left.begin(), left.end());
+            if (right_constant >= 0)
+                return left_constant;
+            program.push_back(Instruction(is_and ? JUMP_IF_FALSE : JUMP_IF_TRUE));
+            program.back().skip = (uint) right.size();
+            program.insert(program.end(), right.begin(), right.end());
+            return -1;
+        }
+        case Expr::NOT: {
+            int constant = compile(expr->expr, column_attributes, resolver, program, "NOT needs a condition");
+            if (constant >= 0)
+                return !constant;
+            program.push_back(Instruction(NOT));
+            return -1;
+        }
+        case Expr::SIMPLE_OP:
+            if (expr->opChar != '=' && expr->opChar != '<' && expr->opChar != '>')
+                throw DbRelationError(string("unsupported operator ") + expr->opChar + " in where clause");
+            break;
+        case Expr::NOT_EQUALS:
+        case Expr::LESS_EQ:
+        case Expr::GREATER_EQ:
+            break;
+        default:
+            throw DbRelationError("unsupported operator in where clause");
+    }
+
+    Operand left, right;
+    operand(expr->expr, column_attributes, resolver, left);
+    operand(expr->expr2, column_attributes, resolver, right);
+    if (left.data_type != right.data_type)
+        throw DbRelationError("cannot compare values of different types");
+    Comparison comparison;
+    switch (expr->opType) {
+        case Expr::NOT_EQUALS:
+            comparison = NE;
+            break;
+        case Expr::LESS_EQ:
+            comparison = LE;
+            break;
+        case Expr::GREATER_EQ:
+            comparison = GE;
+            break;
+        default:
+            comparison = expr->opChar == '=' ? EQ : (expr->opChar == '<' ? LT : GT);
+    }
+
+    if (!left.is_column && !right.is_column)
+        return holds(comparison, left.data_type == ColumnAttribute::TEXT ? left.value.s.compare(right.value.s)
+                                                                         : compare_int(left.value.n, right.value.n));
+    if (!left.is_column) {  // 5 < a is a > 5
+        swap(left, right);
+        static const Comparison mirrored[] = {EQ, NE, GT, GE, LT, LE};
+        comparison = mirrored[comparison];
+    }
+    bool is_text = left.data_type == ColumnAttribute::TEXT;
+    if (right.is_column) {
+        program.push_back(Instruction(is_text ? TEXT_COLUMNS : INT_COLUMNS));
+        program.back().column2 = right.column;
+    } else {
+        program.push_back(Instruction(is_text ? TEXT_LITERAL : INT_LITERAL));
+        program.back().n = right.value.n;
+        program.back().s = right.value.s;
+    }
+    program.back().column = left.column;
+    program.back().comparison = comparison;
+    return -1;
+}
+
+template<class Row>
+bool Predicate::run(const Row &row) const {
+    bool result = true;
+    const Instruction *code = this->program.data();
+    size_t size = this->program.size();
+    for (size_t pc = 0; pc < size; pc++) {
+        const Instruction &instruction = code[pc];
+        switch (instruction.opcode) {
+            case CONSTANT:
+                result = instruction.n != 0;
+                break;
+            case BOOLEAN_COLUMN:
+                result = row.get_int(instruction.column) != 0;
+                break;
+            case INT_LITERAL:
+                result = holds(instruction.comparison, compare_int(row.get_int(instruction.column), instruction.n));
+                break;
+            case TEXT_LITERAL:
+                result = holds(instruction.comparison, row.compare_text(instruction.column, instruction.s));
+                break;
+            case INT_COLUMNS:
+                result = holds(instruction.comparison,
+                               compare_int(row.get_int(instruction.column), row.get_int(instruction.column2)));
+                break;
+            case TEXT_COLUMNS:
+                result = holds(instruction.comparison, row.compare_text(instruction.column, instruction.column2));
+                break;
+            case NOT:
+                result = !result;
+                break;
+            case JUMP_IF_FALSE:
+                if (!result)
+                    pc += instruction.skip;
+                break;
+            case JUMP_IF_TRUE:
+                if (result)
+                    pc += instruction.skip;
+                break;
+        }
+    }
+    return result;
+}
+
+bool Predicate::test(const ValueRow &row) const {
+    return run(ValueRowAccess(row));
+}
+
+bool Predicate::test(const RecordCodec &codec, const char *bytes) const {
+    return run(RecordAccess(codec, bytes));
+}
+
+bool Predicate::is_constant(bool &value) const {
+    if (this->program.size() != 1 || this->program[0].opcode != CONSTANT)
+        return false;
+    value = this->program[0].n != 0;
+    return true;
+}
+
+/**
+ * Test compiling and running predicates, on rows and on the same rows marshaled.
+ * @return true if the tests all succeeded
+ */
+bool test_predicate() {
+    ColumnNames column_names;
+    ColumnAttributes column_attributes;
+    column_names.push_back("a");
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_names.push_back("b");
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    column_names.push_back("c");
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_names.push_back("d");
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    column_names.push_back("e");
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::BOOLEAN));
+    Predicate::ColumnResolver resolver = [&column_names](const Expr *column_ref) {
+        auto found = find(column_names.begin(), column_names.end(), column_ref->name);
+        return found == column_names.end() ? -1 : (int) (found - column_names.begin());
+    };
+    RecordCodec codec(column_attributes);
+    ValueRows rows;
+    vector<char *> records;
+    for (int i = 0; i < 40; i++) {
+        ValueRow *row = new ValueRow();
+        row->push_back(Value(i - 20));
+        row->push_back(Value(string(1, (char) ('a' + i % 5)) + (i % 2 ? "x" : "")));
+        row->push_back(Value(i % 7));
+        row->push_back(Value(string(1, (char) ('a' + i % 3))));
+        row->push_back(Value(i % 4 == 0));
+        (*row)[4].data_type = ColumnAttribute::BOOLEAN;
+        rows.push_back(row);
+        records.push_back(new char[codec.size(row)]);
+        codec.encode(row, records.back());
+    }
+    auto count = [&](const Expr *expr, uint expected, size_t instructions, const char *message) -> bool {
+        Predicate predicate(expr, column_attributes, resolver);
+        delete expr;
+        uint n = 0;
+        for (uint i = 0; i < rows.size(); i++) {
+            bool passes = predicate.test(*rows[i]);
+            if (predicate.test(codec, records[i]) != passes)
+                return assertion_failure(string(message) + " (record)", i);
+            n += passes;
+        }
+        if (n != expected || predicate.size() != instructions)
+            return assertion_failure(message, n, predicate.size());
+        return true;
+    };
+    auto column = [](const char *name) { return Expr::makeColumnRef(strdup(name)); };
+    auto number = [](int64_t n) { return Expr::makeLiteral(n); };
+    auto text = [](const char *s) { return Expr::makeLiteral(strdup(s)); };
+
+    bool ok = true;
+    // a >= -5 AND a < 5: 10 rows
+    ok = ok && count(Expr::makeOpBinary(Expr::makeOpBinary(column("a"), Expr::GREATER_EQ, number(-5)), Expr::AND,
+                                        Expr::makeOpBinary(column("a"), '<', number(5))), 10, 3, "and");
+    // 3 > c OR b = 'ax': c in 0..2 (18 rows) plus b = 'ax' with c >= 3 (i = 5, 15, 25, 35: c = 5, 1, 4, 0 -> 2 more)
+    ok = ok && count(Expr::makeOpBinary(Expr::makeOpBinary(number(3), '>', column("c")), Expr::OR,
+                                        Expr::makeOpBinary(column("b"), '=', text("ax"))), 20, 3, "or");
+    // NOT b <= 'c' (b is "cx", "d", "dx", "e" or "ex"): 20 rows
+    ok = ok && count(Expr::makeOpUnary(Expr::NOT, Expr::makeOpBinary(column("b"), Expr::LESS_EQ, text("c"))), 20, 2,
+                     "not");
+    // d <> b, as columns: every row but those where b is a single letter equal to d (i = 0, 2, 16, 30, 32)
+    ok = ok && count(Expr::makeOpBinary(column("d"), Expr::NOT_EQUALS, column("b")), 35, 1, "text columns");
+    // e AND a > c: i = 24, 28, 32, 36
+    ok = ok && count(Expr::makeOpBinary(column("e"), Expr::AND, Expr::makeOpBinary(column("a"), '>', column("c"))),
+                     4, 3, "boolean column");
+    // 1 = 2 AND a = 0 folds to false; 'x' < 'y' OR a = 0 to true; a = 0 AND NOT 1 > 2 to a = 0
+    ok = ok && count(Expr::makeOpBinary(Expr::makeOpBinary(number(1), '=', number(2)), Expr::AND,
+                                        Expr::makeOpBinary(column("a"), '=', number(0))), 0, 1, "fold false");
+    ok = ok && count(Expr::makeOpBinary(Expr::makeOpBinary(text("x"), '<', text("y")), Expr::OR,
+                                        Expr::makeOpBinary(column("a"), '=', number(0))), 40, 1, "fold true");
+    ok = ok && count(Expr::makeOpBinary(Expr::makeOpBinary(column("a"), '=', number(0)), Expr::AND,
+                                        Expr::makeOpUnary(Expr::NOT, Expr::makeOpBinary(number(1), '>', number(2)))),
+                     1, 1, "fold away");
+    // a > -5 as the parser gives it, UMINUS on 5: a in -4..19; and the smallest INT there is
+    ok = ok && count(Expr::makeOpBinary(column("a"), '>', Expr::makeOpUnary(Expr::UMINUS, number(5))), 24, 1,
+                     "negative literal");
+    ok = ok && count(Expr::makeOpBinary(column("a"), '>', Expr::makeOpUnary(Expr::UMINUS, number(2147483648LL))),
+                     40, 1, "smallest literal");
+    for (int64_t n: {(int64_t) 2147483648LL, (int64_t) 10000000000LL}) {
+        Expr *too_big = Expr::makeOpBinary(column("a"), '=', number(n));
+        try {
+            Predicate predicate(too_big, column_attributes, resolver);
+            ok = ok && assertion_failure("out of range literal", n);
+        } catch (DbRelationError &e) {
+            // expected
+        }
+        delete too_big;
+    }
+
+    const char *rejected[] = {"not a condition", "different types", "unknown column"};
+    Expr *bad[] = {column("a"), Expr::makeOpBinary(column("a"), '=', text("x")),
+                   Expr::makeOpBinary(column("z"), '=', number(1))};
+    for (uint i = 0; i < 3; i++) {
+        try {
+            Predicate predicate(bad[i], column_attributes, resolver);
+            ok = ok && assertion_failure(rejected[i]);
+        } catch (DbRelationError &e) {
+            // expected
+        }
+        delete bad[i];
+    }
+
+    for (uint i = 0; i < rows.size(); i++) {
+        delete rows[i];
+        delete[] records[i];
+    }
+    return ok;
+}
@@ -0,0 +1,126 @@
+/**
+ * @file Predicate.h - Where-clause conditions compiled for evaluating against many rows.
+ * Predicate
+ *
+ * @see "Seattle University, CPSC5300, Spring 2021"
+ */
+#pragma once
+
+#include <functional>
+#include "SQLParser.h"
+#include "RecordCodec.h"
+#include "storage_engine.h"
+
+/**
+ * @class Predicate - a where-clause condition compiled into a flat program over column positions
+ *
+ *      Supports comparisons (=, <>, <, <=, >, >=) between columns and literals of the same type, BOOLEAN
+ *      columns on their own, and AND, OR and NOT. Each comparison becomes one instruction that already knows
+ *      its column positions, its data type and its literal, so running it is a switch on the opcode rather than
+ *      a walk of the AST with lookups along the way. AND and OR jump over their right side when the left side
+ *      decides, and NOT flips the result so far.
+ *
+ *      Comparisons between two literals are worked out while compiling, and then so are the AND, OR and NOT
+ *      above them where that settles them, so a condition can come out as simply true or false.
+ *
+ *      A program runs on a row of values or straight on a marshaled record, where INTs are read in place and
+ *      TEXT is compared without being copied out.
+ */
+class Predicate {
+public:
+    /**
+     * Finds the position of the column an AST column reference is to (-1 if there's no such column).
+     */
+    typedef std::function<int(const hsql::Expr *column_ref)> ColumnResolver;
+
+    /**
+     * @param expr               AST condition (needn't outlive this object)
+     * @param column_attributes  the type of the column at each position
+     * @param resolver           where to find the columns expr refers to
+     * @throws DbRelationError if the expression isn't supported or refers to a column there isn't
+     */
+    Predicate(const hsql::Expr *expr, const ColumnAttributes &column_attributes, const ColumnResolver &resolver);
+
+    virtual ~Predicate() {}
+
+    Predicate(const Predicate &other) = delete;
+
+    Predicate(Predicate &&temp) = delete;
+
+    Predicate &operator=(const Predicate &other) = delete;
+
+    Predicate &operator=(Predicate &&temp) = delete;
+
+    /**
+     * Evaluate the condition against a row.
+     * @param row  values at the positions the program was compiled for
+     * @returns    whether the row satisfies it
+     */
+    bool test(const ValueRow &row) const;
+
+    /**
+     * Evaluate the condition against a marshaled record.
+     * @param codec  the record's codec, whose column numbers are the positions the program was compiled for
+     * @param bytes  the record
+     * @returns      whether the row satisfies it
+     */
+    bool test(const RecordCodec &codec, const char *bytes) const;
+
+    /**
+     * @param value  returned by reference: what the condition always comes to, if it does
+     * @returns      true if the condition is the same for every row
+     */
+    bool is_constant(bool &value) const;
+
+    /**
+     * @returns  how many instructions the program has
+     */
+    size_t size() const { return this->program.size(); }
+
+protected:
+    enum Opcode {
+        CONSTANT,        // result = n
+        BOOLEAN_COLUMN,  // result = column
+        INT_LITERAL,     // result = column <comparison> n
+        TEXT_LITERAL,    // result = column <comparison> s
+        INT_COLUMNS,     // result = column <comparison> column2
+        TEXT_COLUMNS,
+        NOT,             // result = !result
+        JUMP_IF_FALSE,   // skip the next skip instructions if result is false
+        JUMP_IF_TRUE
+    };
+
+    enum Comparison {
+        EQ, NE, LT, LE, GT, GE
+    };
+
+    class Instruction {
+    public:
+        Instruction(Opcode opcode) : opcode(opcode), comparison(EQ), column(0), column2(0), n(0), s(), skip(0) {}
+
+        Opcode opcode;
+        Comparison comparison;
+        uint column;
+        uint column2;
+        int32_t n;
+        std::string s;
+        uint skip;
+    };
+
+    typedef std::vector<Instruction> Program;
+
+    Program program;
+
+    // compile a condition onto the end of a program; returns what it always comes to (0 or 1) or -1 if it depends
+    // on the row (and so was compiled)
+    static int compile(const hsql::Expr *expr, const ColumnAttributes &column_attributes,
+                       const ColumnResolver &resolver, Program &program, const char *not_condition);
+
+    // whether a three-way comparison's result (negative, zero or positive) satisfies a comparison
+    static bool holds(Comparison comparison, int order);
+
+    template<class Row>
+    bool run(const Row &row) const;
+};
+
+bool test_predicate();
@@ -0,0 +1,1380 @@
+/**
+ * @file QueryPlan.cpp - implementation of the query operators
+ * @see "Seattle University, CPSC5300"
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <dirent.h>
+#include <signal.h>
+#include <unistd.h>
+#include "QueryPlan.h"
+#include "CostModel.h"
+#include "HeapTable.h"
+#include "ParseTreeToString.h"
+
+using namespace std;
+using namespace hsql;
+
+/**
+ * Names of the columns at the given positions.
+ */
+static ColumnNames pick(const ColumnNames &column_names, const ColumnNumbers &column_numbers) {
+    ColumnNames picked;
+    for (auto const &col_num: column_numbers)
+        picked.push_back(column_names.at(col_num));
+    return picked;
+}
+
+/**
+ * Attributes of the columns at the given positions.
+ */
+static ColumnAttributes pick(const ColumnAttributes &column_attributes, const ColumnNumbers &column_numbers) {
+    ColumnAttributes picked;
+    for (auto const &col_num: column_numbers)
+        picked.push_back(column_attributes.at(col_num));
+    return picked;
+}
+
+/**
+ * A value as it would be written in SQL.
+ */
+static string value_text(const Value &value) {
+    return value.data_type == ColumnAttribute::TEXT ? "'" + value.s + "'" : to_string(value.n);
+}
+
+/**
+ * Column = value predicates as they would be written in a where clause.
+ */
+static string where_text(const ValueDict &where) {
+    string text;
+    for (auto const &column: where)
+        text += string(text.empty() ? "" : " AND ") + column.first + " = " + value_text(column.second);
+    return text;
+}
+
+/**
+ * Column names separated by commas.
+ */
+static string names_text(const ColumnNames &column_names) {
+    string text;
+    for (auto const &column_name: column_names)
+        text += (text.empty() ? "" : ", ") + column_name;
+    return text;
+}
+
+
+string OperatorProfile::describe() const {
+    char text[200];
+    snprintf(text, sizeof(text), "time=%.3f ms reads=%lu writes=%lu marshaled=%lu unmarshaled=%lu", this->seconds * 1000,
+             this->storage.block_reads, this->storage.block_writes, this->storage.bytes_marshaled,
+             this->storage.bytes_unmarshaled);
+    return text;
+}
+
+int QueryOperator::find_column(const Expr *column_ref) const {
+    string name = column_ref->name;
+    int found = -1;
+    for (uint i = 0; i < this->column_names.size(); i++) {
+        const Identifier &column_name = this->column_names[i];
+        size_t dot = column_name.find('.');
+        bool matches;
+        if (dot == string::npos)
+            matches = column_name == name;
+        else if (column_ref->table != nullptr)
+            matches = column_name == string(column_ref->table) + "." + name;
+        else
+            matches = column_name.compare(dot + 1, string::npos, name) == 0;
+        if (matches) {
+            if (found >= 0)
+                throw DbRelationError("column '" + name + "' is ambiguous");
+            found = (int) i;
+        }
+    }
+    return found;
+}
+
+void QueryOperator::qualify(const Identifier &table_name) {
+    for (auto &column_name: this->column_names)
+        if (column_name.find('.') == string::npos)
+            column_name = table_name + "." + column_name;
+}
+
+/**
+ * When profiling, the counters are read before and after each call, so what the operators under this one do while
+ * it pulls from them is included (explain() takes it back out).
+ */
+bool QueryOperator::next(RowBatch &batch) {
+    if (!this->profiling)
+        return produce(batch);
+    StorageCounters storage = _STORAGE_COUNTERS;
+    auto start = chrono::steady_clock::now();
+    bool more = produce(batch);
+    this->profile.seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    this->profile.storage += _STORAGE_COUNTERS;
+    this->profile.storage -= storage;
+    if (more)
+        this->profile.rows += batch.size();
+    return more;
+}
+
+void QueryOperator::start_profiling() {
+    this->profiling = true;
+    for (auto const &input: get_inputs())
+        input->start_profiling();
+}
+
+/**
+ * A profiled operator's line also has the rows it produced and pulled from its inputs, and the time and storage
+ * work of its own (the total, with its inputs', is in the line of the top operator).
+ */
+void QueryOperator::explain(ostream &out, uint depth) const {
+    out << string(2 * depth, ' ') << describe();
+    if (this->estimated_rows >= 0) {
+        char estimate[100];
+        snprintf(estimate, sizeof(estimate), "  (rows=%.0f cost=%.2f)", this->estimated_rows, this->estimated_cost);
+        out << estimate;
+    }
+    if (this->profiling) {
+        OperatorProfile own = this->profile;
+        u_long rows_in = 0;
+        for (auto const &input: get_inputs()) {
+            const OperatorProfile *input_profile = input->get_profile();
+            if (input_profile != nullptr) {
+                rows_in += input_profile->rows;
+                own -= *input_profile;
+            }
+        }
+        out << "  (actual rows=" << this->profile.rows << " in=" << rows_in << " " << own.describe() << ")";
+    }
+    out << endl;
+    for (auto const &input: get_inputs())
+        input->explain(out, depth + 1);
+}
+
+
+/**
+ * A condition compiled against all of a table's columns, by name, as the storage engine checks it on whole records.
+ */
+static Predicate *compile(const DbRelation &table, const Expr *predicate) {
+    if (predicate == nullptr)
+        return nullptr;
+    const ColumnNames &column_names = table.get_column_names();
+    return new Predicate(predicate, table.get_column_attributes(), [&column_names](const Expr *column_ref) {
+        auto found = find(column_names.begin(), column_names.end(), column_ref->name);
+        return found == column_names.end() ? -1 : (int) (found - column_names.begin());
+    });
+}
+
+// a scan's description with its conditions added
+static string describe_conditions(string text, const ValueDict &where, const Expr *predicate) {
+    if (!where.empty())
+        text += " where " + where_text(where);
+    if (predicate != nullptr)
+        text += (where.empty() ? " where " : " AND ") + ParseTreeToString::expression(predicate);
+    return text;
+}
+
+
+TableScan::TableScan(DbRelation &table, const ColumnNumbers &column_numbers, const ValueDict *where,
+                     const Expr *predicate)
+        : QueryOperator(pick(table.get_column_names(), column_numbers),
+                        pick(table.get_column_attributes(), column_numbers)), table(table),
+          column_numbers(column_numbers), where(), predicate(predicate), program(compile(table, predicate)),
+          rows(nullptr) {
+    if (where != nullptr)
+        this->where = *where;
+}
+
+TableScan::~TableScan() {
+    delete this->rows;
+    delete this->program;
+}
+
+bool TableScan::produce(RowBatch &batch) {
+    if (this->rows == nullptr)
+        this->rows = this->table.batch_cursor(&this->column_numbers, this->where.empty() ? nullptr : &this->where,
+                                              nullptr, this->program);
+    return this->rows->next(batch);
+}
+
+string TableScan::describe() const {
+    return describe_conditions("TableScan " + this->table.get_table_name(), this->where, this->predicate);
+}
+
+
+IndexScan::IndexScan(DbRelation &table, DbIndex &index, const Identifier &index_name,
+                     const ColumnNumbers &column_numbers, const ValueDict &where, const Expr *predicate)
+        : QueryOperator(pick(table.get_column_names(), column_numbers),
+                        pick(table.get_column_attributes(), column_numbers)), table(table), index(index),
+          index_name(index_name), column_numbers(column_numbers), is_range(false), where(where), min_key(),
+          max_key(), predicate(predicate), program(compile(table, predicate)), rows(nullptr) {
+}
+
+IndexScan::IndexScan(DbRelation &table, DbIndex &index, const Identifier &index_name,
+                     const ColumnNumbers &column_numbers, const ValueDict *min_key, const ValueDict *max_key,
+                     const Expr *predicate)
+        : QueryOperator(pick(table.get_column_names(), column_numbers),
+                        pick(table.get_column_attributes(), column_numbers)), table(table), index(index),
+          index_name(index_name), column_numbers(column_numbers), is_range(true), where(), min_key(), max_key(),
+          predicate(predicate), program(compile(table, predicate)), rows(nullptr) {
+    if (min_key != nullptr)
+        this->min_key = *min_key;
+    if (max_key != nullptr)
+        this->max_key = *max_key;
+}
+
+IndexScan::~IndexScan() {
+    delete this->rows;
+    delete this->program;
+}
+
+bool IndexScan::produce(RowBatch &batch) {
+    if (this->rows == nullptr) {
+        Handles *handles;
+        if (this->is_range)
+            handles = this->index.range(this->min_key.empty() ? nullptr : &this->min_key,
+                                        this->max_key.empty() ? nullptr : &this->max_key);
+        else {
+            ValueDict key;
+            for (auto const &column_name: this->index.get_key_columns())
+                key[column_name] = this->where.at(column_name);
+            handles = this->index.lookup(&key);
+        }
+        sort(handles->begin(), handles->end());
+        this->rows = this->table.batch_cursor(&this->column_numbers, this->where.empty() ? nullptr : &this->where,
+                                              handles, this->program);
+    }
+    return this->rows->next(batch);
+}
+
+string IndexScan::describe() const {
+    string text = "IndexScan " + this->table.get_table_name() + " using " + this->index_name;
+    if (!this->is_range)
+        return describe_conditions(text, this->where, this->predicate);
+    const Identifier &column_name = this->index.get_key_columns().at(0);
+    text += " where ";
+    if (!this->min_key.empty())
+        text += value_text(this->min_key.at(column_name)) + " <= ";
+    text += column_name;
+    if (!this->max_key.empty())
+        text += " <= " + value_text(this->max_key.at(column_name));
+    if (this->predicate != nullptr)
+        text += " AND " + ParseTreeToString::expression(this->predicate);
+    return text;
+}
+
+
+Filter::Filter(QueryOperator *input, const Expr *predicate) : QueryOperator(input->get_column_names(),
+                                                                            input->get_column_attributes()),
+                                                              input(input), predicate(predicate), program(nullptr) {
+    try {
+        this->program = new Predicate(predicate, this->column_attributes,
+                                      [this](const Expr *column_ref) { return find_column(column_ref); });
+    } catch (...) {
+        delete input;
+        throw;
+    }
+}
+
+Filter::~Filter() {
+    delete this->program;
+    delete this->input;
+}
+
+string Filter::describe() const {
+    return "Filter " + ParseTreeToString::expression(this->predicate);
+}
+
+/**
+ * Rows that don't pass are squeezed out of the input's batch in place, so the rows that do are never copied.
+ */
+bool Filter::produce(RowBatch &batch) {
+    while (this->input->next(batch)) {
+        uint kept = 0;
+        for (uint i = 0; i < batch.size(); i++)
+            if (this->program->test(batch[i]))
+                batch.move(i, kept++);
+        batch.truncate(kept);
+        if (kept > 0)
+            return true;
+    }
+    return false;
+}
+
+
+Projection::Projection(QueryOperator *input, const ColumnNumbers &positions)
+        : QueryOperator(pick(input->get_column_names(), positions), pick(input->get_column_attributes(), positions)),
+          input(input), positions(positions), input_batch() {
+    double rows = input->get_estimated_rows();
+    if (rows >= 0)
+        set_estimate(rows, input->get_estimated_cost() + CostModel::projection_cost(rows));
+}
+
+Projection::~Projection() {
+    delete this->input;
+}
+
+string Projection::describe() const {
+    return "Projection " + names_text(this->column_names);
+}
+
+bool Projection::produce(RowBatch &batch) {
+    batch.clear();
+    if (!this->input->next(this->input_batch))
+        return false;
+    uint n = (uint) this->positions.size();
+    for (uint i = 0; i < this->input_batch.size(); i++) {
+        const ValueRow &input_row = this->input_batch[i];
+        ValueRow &row = batch.add(this->input_batch.get_handle(i));
+        row.resize(n);
+        for (uint j = 0; j < n; j++)
+            row[j] = input_row[this->positions[j]];
+    }
+    return true;
+}
+
+
+Limit::Limit(QueryOperator *input, uint64_t limit, uint64_t offset)
+        : QueryOperator(input->get_column_names(), input->get_column_attributes()), input(input), limit(limit),
+          offset(offset), remaining(limit), to_skip(offset) {
+    double rows = input->get_estimated_rows();
+    if (rows >= 0)
+        set_estimate(max(0.0, min(rows - (double) offset, (double) limit)), input->get_estimated_cost());
+}
+
+string Limit::describe() const {
+    return "Limit " + to_string(this->limit) + (this->offset > 0 ? " offset " + to_string(this->offset) : "");
+}
+
+Limit::~Limit() {
+    delete this->input;
+}
+
+/**
+ * Stops pulling from the input as soon as the limit is reached, so the rest of the input is never read.
+ */
+bool Limit::produce(RowBatch &batch) {
+    while (this->remaining > 0 && this->input->next(batch)) {
+        uint start = 0;
+        if (this->to_skip > 0) {
+            start = (uint) min((uint64_t) batch.size(), this->to_skip);
+            this->to_skip -= start;
+        }
+        uint kept = (uint) min((uint64_t) (batch.size() - start), this->remaining);
+        for (uint i = 0; i < kept; i++)
+            batch.move(start + i, i);
+        batch.truncate(kept);
+        this->remaining -= kept;
+        if (kept > 0)
+            return true;
+    }
+    batch.clear();
+    return false;
+}
+
+
+Sort::Sort(QueryOperator *input, const ColumnNumbers &keys, const vector<bool> &descending, uint64_t limit,
+           size_t memory) : QueryOperator(input->get_column_names(), input->get_column_attributes()), input(input),
+                            keys(keys), descending(descending), limit(limit),
+                            sorter(input->get_column_attributes(), keys, descending, limit, memory), rows(nullptr) {
+    double rows = input->get_estimated_rows();
+    if (rows >= 0)
+        set_estimate(limit > 0 ? min(rows, (double) limit) : rows,
+                     input->get_estimated_cost() + CostModel::sort_cost(rows, (double) limit));
+}
+
+string Sort::describe() const {
+    string text = "Sort by ";
+    for (uint i = 0; i < this->keys.size(); i++)
+        text += string(i == 0 ? "" : ", ") + this->column_names[this->keys[i]] + (this->descending[i] ? " DESC" : "");
+    if (this->limit > 0)
+        text += " keeping " + to_string(this->limit);
+    return text;
+}
+
+Sort::~Sort() {
+    delete this->rows;
+    delete this->input;
+}
+
+bool Sort::produce(RowBatch &batch) {
+    if (this->rows == nullptr) {
+        while (this->input->next(batch))
+            for (uint i = 0; i < batch.size(); i++)
+                this->sorter.add(batch[i]);
+        this->rows = this->sorter.sorted();
+    }
+    return this->rows->next(batch);
+}
+
+
+/**
+ * FNV-1a, like hash_index_key(), continuing from hash.
+ */
+static uint32_t fnv1a(uint32_t hash, const void *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= ((const uint8_t *) data)[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+/**
+ * MurmurHash3's final mix. The top bits of our hashes pick a row's partition and the bottom bits its bucket or
+ * slot, so all of them need to be well mixed.
+ */
+static uint32_t finish_hash(uint32_t hash) {
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bU;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35U;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/**
+ * Hash of a row's join key.
+ */
+static uint32_t hash_key(const ValueRow &row, const ColumnNumbers &keys) {
+    uint32_t hash = 2166136261U;
+    for (auto const &key: keys) {
+        const Value &value = row[key];
+        if (value.data_type == ColumnAttribute::TEXT) {
+            uint32_t length = (uint32_t) value.s.length();
+            hash = fnv1a(hash, &length, sizeof(length));
+            hash = fnv1a(hash, value.s.data(), length);
+        } else {
+            hash = fnv1a(hash, &value.n, sizeof(value.n));
+        }
+    }
+    return finish_hash(hash);
+}
+
+/**
+ * Roughly how much memory a row takes up while it's held in a hash join (including its hash table links).
+ */
+static size_t row_footprint(const ValueRow &row) {
+    size_t size = sizeof(ValueRow) + row.size() * sizeof(Value) + sizeof(uint32_t) + sizeof(uint);
+    for (auto const &value: row)
+        size += value.s.length();
+    return size;
+}
+
+const string SpillPartitions::TABLE_PREFIX = "_spill_";
+uint SpillPartitions::spills = 0;
+
+void SpillPartitions::drop_leftovers() {
+    const char *home = nullptr;
+    _DB_ENV->get_home(&home);
+    DIR *dir = opendir(home == nullptr ? "." : home);
+    if (dir == nullptr)
+        return;
+    vector<string> leftovers;
+    for (struct dirent *entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+        string file_name = entry->d_name;
+        if (file_name.compare(0, TABLE_PREFIX.length(), TABLE_PREFIX) != 0 || file_name.length() < 3 ||
+            file_name.compare(file_name.length() - 3, 3, ".db") != 0)
+            continue;
+        pid_t pid = (pid_t) strtol(file_name.c_str() + TABLE_PREFIX.length(), nullptr, 10);
+        if (pid == getpid() ? SpillPartitions::spills == 0 : (kill(pid, 0) != 0 && errno == ESRCH))
+            leftovers.push_back(file_name);  // (both a table's own file and its free space map's)
+    }
+    closedir(dir);
+    for (auto const &file_name: leftovers) {
+        Db db(_DB_ENV, 0);
+        try {
+            db.remove(file_name.c_str(), nullptr, 0);
+        } catch (DbException &e) {
+            // gone already, or not ours to remove after all
+        }
+    }
+}
+
+SpillPartitions::SpillPartitions(const ColumnAttributes &column_attributes, uint count) : tables(), sizes(count, 0),
+                                                                                         buffers(count), all() {
+    string spill_name = TABLE_PREFIX + to_string(getpid()) + "_" + to_string(SpillPartitions::spills++) + "_";
+    ColumnNames column_names;
+    for (uint i = 0; i < column_attributes.size(); i++) {
+        column_names.push_back("c" + to_string(i));
+        this->all.push_back(i);
+    }
+    for (uint p = 0; p < count; p++) {
+        HeapTable *table = new HeapTable(spill_name + to_string(p), column_names, column_attributes);
+        try {
+            table->create();
+        } catch (...) {
+            delete table;
+            for (auto const &created: this->tables) {
+                created->drop();
+                delete created;
+            }
+            throw;
+        }
+        this->tables.push_back(table);
+    }
+}
+
+/**
+ * Destructor - drops whatever tables are left
+ */
+SpillPartitions::~SpillPartitions() {
+    for (auto const &table: this->tables)
+        if (table != nullptr) {
+            table->drop();
+            delete table;
+        }
+}
+
+void SpillPartitions::add(uint32_t hash, ValueRow &row) {
+    uint partition = (uint) (((uint64_t) hash * this->sizes.size()) >> 32);
+    RowBatch &buffer = this->buffers[partition];
+    buffer.add().swap(row);
+    if (buffer.full())
+        write(partition);
+}
+
+void SpillPartitions::flush() {
+    for (uint p = 0; p < this->buffers.size(); p++)
+        if (!this->buffers[p].empty())
+            write(p);
+}
+
+RowBatchCursor *SpillPartitions::rows(uint partition) {
+    return this->tables[partition]->batch_cursor(&this->all);
+}
+
+void SpillPartitions::drop(uint partition) {
+    this->tables[partition]->drop();
+    delete this->tables[partition];
+    this->tables[partition] = nullptr;
+}
+
+/**
+ * Write a partition's buffered rows to its table.
+ */
+void SpillPartitions::write(uint partition) {
+    RowBatch &buffer = this->buffers[partition];
+    this->tables[partition]->insert_batch(buffer);
+    this->sizes[partition] += buffer.size();
+    buffer.clear();
+}
+
+
+HashJoin::HashJoin(QueryOperator *left, QueryOperator *right, const ColumnNumbers &left_keys,
+                   const ColumnNumbers &right_keys, size_t memory)
+        : QueryOperator(left->get_column_names(), left->get_column_attributes()), memory(memory), started(false),
+          build(0), buffered_pos(0), build_rows(), hashes(), heads(), chain(), probe_rows(nullptr), partition(-1),
+          probe_batch(), probe_pos(0), probe_hash(0), match(END) {
+    this->inputs[0] = left;
+    this->inputs[1] = right;
+    this->partitions[0] = this->partitions[1] = nullptr;
+    this->keys[0] = left_keys;
+    this->keys[1] = right_keys;
+    const ColumnAttributes &left_attributes = left->get_column_attributes();
+    const ColumnAttributes &right_attributes = right->get_column_attributes();
+    bool ok = !left_keys.empty() && left_keys.size() == right_keys.size();
+    for (uint i = 0; ok && i < left_keys.size(); i++)
+        ok = left_keys[i] < left_attributes.size() && right_keys[i] < right_attributes.size() &&
+             left_attributes[left_keys[i]].get_data_type() == right_attributes[right_keys[i]].get_data_type();
+    if (!ok) {
+        delete left;
+        delete right;
+        throw DbRelationError("join keys do not correspond");
+    }
+    this->column_names.insert(this->column_names.end(), right->get_column_names().begin(),
+                              right->get_column_names().end());
+    this->column_attributes.insert(this->column_attributes.end(), right_attributes.begin(), right_attributes.end());
+}
+
+string HashJoin::describe() const {
+    string text = "HashJoin on ";
+    const ColumnNames &left_names = this->inputs[0]->get_column_names();
+    const ColumnNames &right_names = this->inputs[1]->get_column_names();
+    for (uint i = 0; i < this->keys[0].size(); i++)
+        text += string(i == 0 ? "" : " AND ") + left_names[this->keys[0][i]] + " = " + right_names[this->keys[1][i]];
+    return text;
+}
+
+/**
+ * Destructor - drops whatever temporary tables are left
+ */
+HashJoin::~HashJoin() {
+    if (this->partitions[0] != nullptr)
+        delete this->probe_rows;  // a cursor on a partition (otherwise it's one of the inputs)
+    delete this->inputs[0];
+    delete this->inputs[1];
+    delete this->partitions[0];
+    delete this->partitions[1];
+}
+
+/**
+ * A probe row can match more build rows than fit in the batch, so where we are in its bucket is kept between
+ * calls.
+ */
+bool HashJoin::produce(RowBatch &batch) {
+    batch.clear();
+    if (!this->started)
+        start();
+    while (!batch.full()) {
+        if (this->match != END) {
+            const ValueRow &probe_row = this->probe_batch[this->probe_pos - 1];
+            do {
+                uint m = this->match;
+                this->match = this->chain[m];
+                if (this->hashes[m] != this->probe_hash || !keys_equal(this->build_rows[m], probe_row))
+                    continue;
+                const ValueRow &left = this->build == 0 ? this->build_rows[m] : probe_row;
+                const ValueRow &right = this->build == 0 ? probe_row : this->build_rows[m];
+                ValueRow &row = batch.add();
+                row.resize(left.size() + right.size());
+                copy(left.begin(), left.end(), row.begin());
+                copy(right.begin(), right.end(), row.begin() + left.size());
+            } while (this->match != END && !batch.full());
+            continue;
+        }
+        if (this->probe_pos == this->probe_batch.size()) {
+            if (!next_probe_batch())
+                break;
+            continue;
+        }
+        const ValueRow &probe_row = this->probe_batch[this->probe_pos++];
+        this->probe_hash = hash_key(probe_row, this->keys[1 - this->build]);
+        this->match = this->heads[this->probe_hash & (this->heads.size() - 1)];
+    }
+    return !batch.empty();
+}
+
+/**
+ * Read from each input in turn to find out which is smaller, and build the hash table on it (or partition both
+ * inputs if we run out of memory first). The rows are swapped out of the batches rather than copied.
+ */
+void HashJoin::start() {
+    this->started = true;
+    RowBatch batch;
+    size_t used = 0;
+    for (uint side = 0;; side = 1 - side) {
+        if (!this->inputs[side]->next(batch)) {
+            this->build = side;
+            break;
+        }
+        for (uint i = 0; i < batch.size(); i++) {
+            this->buffered[side].emplace_back();
+            this->buffered[side].back().swap(batch[i]);
+            used += row_footprint(this->buffered[side].back());
+        }
+        if (used > this->memory) {
+            partition_inputs();
+            return;
+        }
+    }
+    this->build_rows.swap(this->buffered[this->build]);
+    build_table();
+    this->probe_rows = this->inputs[1 - this->build];
+}
+
+/**
+ * Write both inputs (what's been read of them and then the rest) into partitions by the hash of their keys, so
+ * that matching rows end up in the same pair of partitions.
+ */
+void HashJoin::partition_inputs() {
+    for (uint side = 0; side < 2; side++)
+        this->partitions[side] = new SpillPartitions(this->inputs[side]->get_column_attributes(), PARTITIONS);
+    RowBatch batch;
+    for (uint side = 0; side < 2; side++) {
+        SpillPartitions *partitions = this->partitions[side];
+        for (auto &row: this->buffered[side])
+            partitions->add(hash_key(row, this->keys[side]), row);
+        vector<ValueRow>().swap(this->buffered[side]);
+        while (this->inputs[side]->next(batch))
+            for (uint i = 0; i < batch.size(); i++)
+                partitions->add(hash_key(batch[i], this->keys[side]), batch[i]);
+        partitions->flush();
+    }
+}
+
+/**
+ * Move on to the next pair of partitions in which both have rows (dropping the pair we're done with), building
+ * the hash table on the smaller one and opening a cursor on the other.
+ * @returns  false if there are no more (or the inputs weren't partitioned)
+ */
+bool HashJoin::next_partition() {
+    int count = (int) get_partition_count();
+    while (this->partition < count) {
+        if (this->partition >= 0) {
+            delete this->probe_rows;
+            this->probe_rows = nullptr;
+            this->partitions[0]->drop((uint) this->partition);
+            this->partitions[1]->drop((uint) this->partition);
+        }
+        if (++this->partition == count)
+            break;
+        uint p = (uint) this->partition;
+        u_long left_size = this->partitions[0]->get_size(p), right_size = this->partitions[1]->get_size(p);
+        if (left_size == 0 || right_size == 0)
+            continue;
+
+        this->build = left_size <= right_size ? 0 : 1;
+        RowBatchCursor *rows = this->partitions[this->build]->rows(p);
+        this->build_rows.clear();
+        RowBatch batch;
+        try {
+            while (rows->next(batch))
+                for (uint i = 0; i < batch.size(); i++) {
+                    this->build_rows.emplace_back();
+                    this->build_rows.back().swap(batch[i]);
+                }
+        } catch (...) {
+            delete rows;
+            throw;
+        }
+        delete rows;
+        build_table();
+        this->probe_rows = this->partitions[1 - this->build]->rows(p);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Refill probe_batch: first with the probe input's rows that were read before the hash table was built, then from
+ * the probe input (or partition), then from the next pair of partitions.
+ * @returns  false once there's nothing left to probe
+ */
+bool HashJoin::next_probe_batch() {
+    this->probe_pos = 0;
+    vector<ValueRow> &buffered = this->buffered[1 - this->build];
+    if (this->buffered_pos < buffered.size()) {
+        this->probe_batch.clear();
+        while (!this->probe_batch.full() && this->buffered_pos < buffered.size())
+            this->probe_batch.add().swap(buffered[this->buffered_pos++]);
+        if (this->buffered_pos == buffered.size()) {
+            vector<ValueRow>().swap(buffered);
+            this->buffered_pos = 0;
+        }
+        return true;
+    }
+    while (true) {
+        if (this->probe_rows != nullptr) {
+            if (this->probe_rows->next(this->probe_batch))
+                return true;
+            if (this->partitions[0] == nullptr)
+                this->probe_rows = nullptr;  // the probe input, which is used up
+        }
+        if (!next_partition()) {
+            this->probe_batch.clear();
+            return false;
+        }
+    }
+}
+
+/**
+ * Hash the build rows into chained buckets (a power of two of them, at least as many as there are rows).
+ */
+void HashJoin::build_table() {
+    uint n = (uint) this->build_rows.size();
+    size_t buckets = 1;
+    while (buckets < n)
+        buckets <<= 1;
+    this->heads.assign(buckets, (uint) END);
+    this->chain.resize(n);
+    this->hashes.resize(n);
+    const ColumnNumbers &build_keys = this->keys[this->build];
+    for (uint i = 0; i < n; i++) {
+        uint32_t hash = hash_key(this->build_rows[i], build_keys);
+        this->hashes[i] = hash;
+        uint &head = this->heads[hash & (buckets - 1)];
+        this->chain[i] = head;
+        head = i;
+    }
+}
+
+bool HashJoin::keys_equal(const ValueRow &build_row, const ValueRow &probe_row) const {
+    const ColumnNumbers &build_keys = this->keys[this->build];
+    const ColumnNumbers &probe_keys = this->keys[1 - this->build];
+    for (uint i = 0; i < build_keys.size(); i++) {
+        const Value &a = build_row[build_keys[i]];
+        const Value &b = probe_row[probe_keys[i]];
+        if (a.data_type == ColumnAttribute::TEXT ? a.s != b.s : a.n != b.n)
+            return false;
+    }
+    return true;
+}
+
+
+HashAggregate::HashAggregate(QueryOperator *input, const ColumnNumbers &group_by, const Aggregates &aggregates,
+                             size_t memory)
+        : QueryOperator(pick(input->get_column_names(), group_by), pick(input->get_column_attributes(), group_by)),
+          input(input), group_by(group_by), aggregates(aggregates), memory(memory), used(0), started(false),
+          slots(INITIAL_SLOTS, 0), hashes(), keys(), groups(), states(), texts(), key(), partitions(nullptr),
+          partition(-1), output_pos(0) {
+    const ColumnNames &input_names = input->get_column_names();
+    const ColumnAttributes &input_attributes = input->get_column_attributes();
+    for (auto const &aggregate: aggregates) {
+        int column = aggregate.second;
+        bool ok = column < (int) input_attributes.size() && (column >= 0 || aggregate.first == COUNT);
+        if (ok && aggregate.first == SUM)
+            ok = input_attributes[column].get_data_type() == ColumnAttribute::INT;
+        if (!ok) {
+            delete input;
+            throw DbRelationError(aggregate.first == SUM ? "can only SUM an INT column" : "unknown aggregate column");
+        }
+        this->column_names.push_back(aggregate_name(aggregate.first, column < 0 ? "*" : input_names[column]));
+        if (aggregate.first == COUNT || aggregate.first == SUM)
+            this->column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+        else
+            this->column_attributes.push_back(input_attributes[column]);
+    }
+}
+
+HashAggregate::~HashAggregate() {
+    delete this->partitions;
+    delete this->input;
+}
+
+string HashAggregate::describe() const {
+    ColumnNames group_names(this->column_names.begin(), this->column_names.begin() + this->group_by.size());
+    ColumnNames aggregate_names(this->column_names.begin() + this->group_by.size(), this->column_names.end());
+    string text = "HashAggregate " + names_text(aggregate_names);
+    if (!group_names.empty())
+        text += " group by " + names_text(group_names);
+    return text;
+}
+
+Identifier HashAggregate::aggregate_name(Function function, const Identifier &column_name) {
+    static const char *const NAMES[] = {"COUNT", "SUM", "MIN", "MAX"};
+    return string(NAMES[function]) + "(" + column_name + ")";
+}
+
+/**
+ * All of the input is aggregated on the first call. Then the groups in memory are produced, and then those of
+ * each partition in turn.
+ */
+bool HashAggregate::produce(RowBatch &batch) {
+    batch.clear();
+    if (!this->started) {
+        this->started = true;
+        while (this->input->next(batch))
+            for (uint i = 0; i < batch.size(); i++)
+                add(batch[i], true);
+        batch.clear();
+        if (this->partitions != nullptr)
+            this->partitions->flush();
+        if (this->group_by.empty() && this->groups.empty()) {
+            this->key.clear();
+            new_group(finish_hash(2166136261U), nullptr);
+        }
+    }
+    while (!batch.full()) {
+        if (this->output_pos < this->groups.size()) {
+            produce(this->output_pos++, batch.add());
+            continue;
+        }
+        if (!next_partition())
+            break;
+    }
+    return !batch.empty();
+}
+
+/**
+ * Aggregate a row into its group, making the group if it's new (or, once we're out of memory, spilling the row).
+ * @param row        the row (its values are taken if it's spilled)
+ * @param may_spill  false when aggregating a partition, which has to be done in memory
+ */
+void HashAggregate::add(ValueRow &row, bool may_spill) {
+    this->key.clear();
+    for (uint i = 0; i < this->group_by.size(); i++)
+        normalize_value(row[this->group_by[i]], this->column_attributes[i].get_data_type(), false, this->key);
+    uint32_t hash = finish_hash(fnv1a(2166136261U, this->key.data(), this->key.length()));
+    uint32_t mask = (uint32_t) this->slots.size() - 1;
+    uint group = UINT_MAX;
+    for (uint32_t i = hash & mask; this->slots[i] != 0; i = (i + 1) & mask) {
+        uint g = this->slots[i] - 1;
+        if (this->hashes[g] == hash && this->keys[g] == this->key) {
+            group = g;
+            break;
+        }
+    }
+    if (group == UINT_MAX) {
+        if (may_spill && this->partitions != nullptr) {
+            this->partitions->add(hash, row);
+            return;
+        }
+        group = new_group(hash, &row);
+        if (may_spill && this->used >= this->memory)
+            this->partitions = new SpillPartitions(this->input->get_column_attributes(), PARTITIONS);
+    }
+
+    uint n = (uint) this->group_by.size();
+    int64_t *state = this->states.data() + (size_t) group * this->aggregates.size();
+    for (uint a = 0; a < this->aggregates.size(); a++) {
+        Function function = this->aggregates[a].first;
+        if (function == COUNT) {
+            state[a]++;
+            continue;
+        }
+        const Value &value = row[this->aggregates[a].second];
+        if (function == SUM) {
+            state[a] += value.n;
+        } else if (this->column_attributes[n + a].get_data_type() == ColumnAttribute::TEXT) {
+            string &text = this->texts[state[a]];
+            if (function == MIN ? value.s < text : value.s > text)
+                text = value.s;
+        } else if (function == MIN ? value.n < state[a] : value.n > state[a]) {
+            state[a] = value.n;
+        }
+    }
+}
+
+/**
+ * Add a group for the key in this->key, with its MINs and MAXes starting at the row's values.
+ * @param hash  hash of the key
+ * @param row   the group's first row (nullptr for the one group of no rows)
+ * @returns     the group's number
+ */
+uint HashAggregate::new_group(uint32_t hash, const ValueRow *row) {
+    uint group = (uint) this->groups.size();
+    this->hashes.push_back(hash);
+    this->keys.push_back(this->key);
+    this->groups.emplace_back();
+    ValueRow &values = this->groups.back();
+    size_t footprint = 3 * sizeof(uint32_t) + sizeof(string) + this->key.capacity() + sizeof(ValueRow) +
+                       this->aggregates.size() * sizeof(int64_t);
+    for (auto const &column: this->group_by) {
+        values.push_back((*row)[column]);
+        footprint += sizeof(Value) + values.back().s.length();
+    }
+    uint n = (uint) this->group_by.size();
+    for (uint a = 0; a < this->aggregates.size(); a++) {
+        int64_t state = 0;
+        Function function = this->aggregates[a].first;
+        if (function == MIN || function == MAX) {
+            if (this->column_attributes[n + a].get_data_type() == ColumnAttribute::TEXT) {
+                state = (int64_t) this->texts.size();
+                this->texts.push_back(row == nullptr ? string() : (*row)[this->aggregates[a].second].s);
+                footprint += sizeof(string) + this->texts.back().length();
+            } else if (row != nullptr) {
+                state = (*row)[this->aggregates[a].second].n;
+            }
+        }
+        this->states.push_back(state);
+    }
+    this->used += footprint;
+
+    if (this->groups.size() * 2 > this->slots.size()) {
+        grow();  // keeps the table no more than half full
+    } else {
+        uint32_t mask = (uint32_t) this->slots.size() - 1, i = hash & mask;
+        while (this->slots[i] != 0)
+            i = (i + 1) & mask;
+        this->slots[i] = group + 1;
+    }
+    return group;
+}
+
+/**
+ * Double the hash table and put all the groups back in it.
+ */
+void HashAggregate::grow() {
+    this->slots.assign(this->slots.size() * 2, 0);
+    uint32_t mask = (uint32_t) this->slots.size() - 1;
+    for (uint g = 0; g < this->groups.size(); g++) {
+        uint32_t i = this->hashes[g] & mask;
+        while (this->slots[i] != 0)
+            i = (i + 1) & mask;
+        this->slots[i] = g + 1;
+    }
+}
+
+/**
+ * Fill in a group's output row.
+ * @throws DbRelationError if a SUM doesn't fit in an INT
+ */
+void HashAggregate::produce(uint group, ValueRow &row) const {
+    uint n = (uint) this->group_by.size();
+    row.resize(n + this->aggregates.size());
+    copy(this->groups[group].begin(), this->groups[group].end(), row.begin());
+    const int64_t *state = this->states.data() + (size_t) group * this->aggregates.size();
+    for (uint a = 0; a < this->aggregates.size(); a++) {
+        Value &value = row[n + a];
+        ColumnAttribute::DataType data_type = this->column_attributes[n + a].get_data_type();
+        if (data_type == ColumnAttribute::TEXT) {
+            value = Value(this->texts[state[a]]);
+            continue;
+        }
+        if (state[a] < INT32_MIN || state[a] > INT32_MAX)
+            throw DbRelationError(this->column_names[n + a] + " is too big for an INT");
+        value = Value((int32_t) state[a]);
+        value.data_type = data_type;
+    }
+}
+
+/**
+ * Throw away the groups produced so far and aggregate the next partition with any rows (dropping the one we're
+ * done with).
+ * @returns  false if there are no more (or nothing was spilled)
+ */
+bool HashAggregate::next_partition() {
+    int count = (int) get_partition_count();
+    while (this->partition < count) {
+        if (this->partition >= 0)
+            this->partitions->drop((uint) this->partition);
+        if (++this->partition == count)
+            break;
+        uint p = (uint) this->partition;
+        if (this->partitions->get_size(p) == 0)
+            continue;
+
+        this->slots.assign(INITIAL_SLOTS, 0);
+        this->hashes.clear();
+        this->keys.clear();
+        this->groups.clear();
+        this->states.clear();
+        this->texts.clear();
+        this->used = 0;
+        this->output_pos = 0;
+        RowBatchCursor *rows = this->partitions->rows(p);
+        RowBatch batch;
+        try {
+            while (rows->next(batch))
+                for (uint i = 0; i < batch.size(); i++)
+                    add(batch[i], false);
+        } catch (...) {
+            delete rows;
+            throw;
+        }
+        delete rows;
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * Test helper. Count the rows a plan produces (and free it).
+ */
+static uint test_count(QueryOperator *plan) {
+    RowBatch batch;
+    uint count = 0;
+    while (plan->next(batch))
+        count += batch.size();
+    delete plan;
+    return count;
+}
+
+/**
+ * Test helper. Load a table with columns a INT (0..rows-1), b TEXT ("row " + a % 10) and c INT (a % 7).
+ */
+static void test_load(HeapTable &table, uint rows) {
+    table.create();
+    ValueDict row;
+    for (uint i = 0; i < rows; i++) {
+        row["a"] = Value((int32_t) i);
+        row["b"] = Value("row " + to_string(i % 10));
+        row["c"] = Value((int32_t) (i % 7));
+        table.insert(&row);
+    }
+}
+
+/**
+ * Test helper. The columns for test_load().
+ */
+static ColumnNames test_column_names() {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    column_names.push_back("c");
+    return column_names;
+}
+
+/**
+ * Test helper. The column attributes for test_load().
+ */
+static ColumnAttributes test_column_attributes() {
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    return column_attributes;
+}
+
+/**
+ * Test the operators on their own and stacked, including a predicate that can't be resolved.
+ * @return true if the tests all succeeded
+ */
+bool test_query_plan() {
+    const uint N = 5000;
+    HeapTable table("_test_query_plan_cpp", test_column_names(), test_column_attributes());
+    test_load(table, N);
+    ColumnNumbers all;
+    for (uint i = 0; i < 3; i++)
+        all.push_back(i);
+
+    // SELECT * FROM t: full batches, then what's left
+    TableScan *scan = new TableScan(table, all);
+    RowBatch batch;
+    uint count = 0, batches = 0;
+    int64_t sum = 0;
+    while (scan->next(batch)) {
+        if (batch.size() != RowBatch::CAPACITY && count + batch.size() != N)
+            return assertion_failure("scan batch size", batch.size());
+        for (uint i = 0; i < batch.size(); i++)
+            sum += batch[i][0].n;
+        count += batch.size();
+        batches++;
+    }
+    delete scan;
+    if (count != N || sum != (int64_t) N * (N - 1) / 2)
+        return assertion_failure("scan", count, sum);
+    if (batches != (N + RowBatch::CAPACITY - 1) / RowBatch::CAPACITY)
+        return assertion_failure("scan batches", batches);
+
+    // SELECT * FROM t WHERE c = 3 (handed down to the table)
+    ValueDict equals;
+    equals["c"] = Value(3);
+    count = test_count(new TableScan(table, all, &equals));
+    if (count != (N + 3) / 7)
+        return assertion_failure("scan where", count);
+
+    // SELECT * FROM t WHERE a >= 100 AND a < 200 AND NOT b = 'row 5'
+    Expr *where = Expr::makeOpBinary(
+            Expr::makeOpBinary(
+                    Expr::makeOpBinary(Expr::makeColumnRef(strdup("a")), Expr::GREATER_EQ, Expr::makeLiteral((int64_t) 100)),
+                    Expr::AND,
+                    Expr::makeOpBinary(Expr::makeColumnRef(strdup("a")), '<', Expr::makeLiteral((int64_t) 200))),
+            Expr::AND,
+            Expr::makeOpUnary(Expr::NOT,
+                              Expr::makeOpBinary(Expr::makeColumnRef(strdup("b")), '=', Expr::makeLiteral(strdup("row 5")))));
+    count = test_count(new Filter(new TableScan(table, all), where));
+    delete where;
+    if (count != 90)
+        return assertion_failure("filter", count);
+
+    // SELECT c, a FROM t LIMIT 10 OFFSET 1500, profiled
+    ColumnNumbers positions;
+    positions.push_back(2);
+    positions.push_back(0);
+    QueryOperator *plan = new Limit(new Projection(new TableScan(table, all), positions), 10, 1500);
+    if (plan->get_column_names()[0] != "c")
+        return assertion_failure("projection column names");
+    plan->start_profiling();
+    count = 0;
+    while (plan->next(batch)) {
+        for (uint i = 0; i < batch.size(); i++) {
+            int32_t a = (int32_t) (1500 + count++);
+            if (batch[i].size() != 2 || batch[i][1].n != a || batch[i][0].n != a % 7)
+                return assertion_failure("projection", a, batch[i][1].n);
+        }
+    }
+    if (count != 10)
+        return assertion_failure("limit", count);
+    const OperatorProfile *profile = plan->get_profile();
+    const OperatorProfile *scan_profile = plan->get_inputs()[0]->get_inputs()[0]->get_profile();
+    if (profile == nullptr || profile->rows != 10 || scan_profile == nullptr || scan_profile->rows < 1510)
+        return assertion_failure("profile rows");
+    if (scan_profile->storage.bytes_unmarshaled == 0
+        || profile->storage.bytes_unmarshaled < scan_profile->storage.bytes_unmarshaled)
+        return assertion_failure("profile storage");
+    delete plan;
+
+    // SELECT * FROM t WHERE a = 'x' is rejected when the plan is built
+    where = Expr::makeOpBinary(Expr::makeColumnRef(strdup("a")), '=', Expr::makeLiteral(strdup("x")));
+    try {
+        delete new Filter(new TableScan(table, all), where);
+        return assertion_failure("filter type check");
+    } catch (DbRelationError &e) {
+        // expected
+    }
+    delete where;
+
+    // SELECT * FROM t JOIN u ON t.c = u.c AND t.b = u.b, with u (70 rows) on either side: each row of t matches
+    // exactly one of u's
+    HeapTable small("_test_query_plan_cpp_u", test_column_names(), test_column_attributes());
+    test_load(small, 70);
+    ColumnNumbers keys;
+    keys.push_back(2);
+    keys.push_back(1);
+    for (uint small_side = 0; small_side < 2; small_side++) {
+        QueryOperator *left = new TableScan(table, all), *right = new TableScan(small, all);
+        if (small_side == 0)
+            swap(left, right);
+        HashJoin *join = new HashJoin(left, right, keys, keys);
+        count = 0;
+        while (join->next(batch)) {
+            for (uint i = 0; i < batch.size(); i++) {
+                const ValueRow &row = batch[i];
+                if (row.size() != 6 || row[2].n != row[5].n || row[1].s != row[4].s || row[small_side * 3].n >= 70)
+                    return assertion_failure("join row", small_side, count);
+                count++;
+            }
+        }
+        if (join->get_column_names().size() != 6 || join->get_partition_count() != 0)
+            return assertion_failure("join columns", join->get_column_names().size(), join->get_partition_count());
+        delete join;
+        if (count != N)
+            return assertion_failure("join", small_side, count);
+    }
+
+    // SELECT * FROM t AS x JOIN t AS y ON x.a = y.c with a budget small enough that both sides get partitioned
+    TableScan *x = new TableScan(table, all), *y = new TableScan(table, all);
+    x->qualify("x");
+    y->qualify("y");
+    HashJoin *join = new HashJoin(x, y, ColumnNumbers(1, 0), ColumnNumbers(1, 2), 50000);
+    Expr *y_a = Expr::makeColumnRef(strdup("y"), strdup("a")), *a = Expr::makeColumnRef(strdup("a"));
+    if (join->find_column(y_a) != 3)
+        return assertion_failure("join qualified column", join->find_column(y_a));
+    try {
+        join->find_column(a);
+        return assertion_failure("join ambiguous column");
+    } catch (DbRelationError &e) {
+        // expected
+    }
+    delete y_a;
+    delete a;
+    count = 0;
+    sum = 0;
+    while (join->next(batch)) {
+        for (uint i = 0; i < batch.size(); i++) {
+            if (batch[i][0].n != batch[i][5].n)
+                return assertion_failure("spilled join row", count);
+            sum += batch[i][3].n;
+            count++;
+        }
+    }
+    if (join->get_partition_count() != HashJoin::PARTITIONS)
+        return assertion_failure("spilled join partitions", join->get_partition_count());
+    delete join;
+    if (count != N || sum != (int64_t) N * (N - 1) / 2)
+        return assertion_failure("spilled join", count, sum);
+
+    // SELECT * FROM t ORDER BY c DESC, a, both spilled and as a top 25 (the rows come out of the sort without
+    // their handles)
+    ColumnNumbers sort_keys;
+    sort_keys.push_back(2);
+    sort_keys.push_back(0);
+    vector<bool> descending;
+    descending.push_back(true);
+    descending.push_back(false);
+    for (uint64_t limit: {(uint64_t) 0, (uint64_t) 25}) {
+        Sort *sort = new Sort(new TableScan(table, all), sort_keys, descending, limit, limit > 0 ? 100000 : 50000);
+        count = 0;
+        int32_t c = 6, a = -1;
+        while (sort->next(batch)) {
+            for (uint i = 0; i < batch.size(); i++) {
+                const ValueRow &row = batch[i];
+                if (row[2].n != c) {
+                    c--;
+                    a = -1;
+                }
+                if (row[2].n != c || row[0].n <= a || row[0].n % 7 != c)
+                    return assertion_failure("sort order", limit, count);
+                a = row[0].n;
+                count++;
+            }
+        }
+        if (count != (limit > 0 ? limit : N) || (limit > 0) != (sort->get_run_count() == 0))
+            return assertion_failure("sort", limit, count);
+        delete sort;
+    }
+
+    // SELECT c, COUNT(*), SUM(a), MIN(b), MAX(a) FROM t GROUP BY c
+    HashAggregate::Aggregates aggregates;
+    aggregates.push_back(HashAggregate::Aggregate(HashAggregate::COUNT, -1));
+    aggregates.push_back(HashAggregate::Aggregate(HashAggregate::SUM, 0));
+    aggregates.push_back(HashAggregate::Aggregate(HashAggregate::MIN, 1));
+    aggregates.push_back(HashAggregate::Aggregate(HashAggregate::MAX, 0));
+    HashAggregate *aggregate = new HashAggregate(new TableScan(table, all), ColumnNumbers(1, 2), aggregates);
+    if (aggregate->get_column_names()[2] != "SUM(a)" ||
+        aggregate->get_column_attributes()[3].get_data_type() != ColumnAttribute::TEXT)
+        return assertion_failure("aggregate columns " + aggregate->get_column_names()[2]);
+    count = 0;
+    while (aggregate->next(batch)) {
+        for (uint i = 0; i < batch.size(); i++) {
+            const ValueRow &row = batch[i];
+            int32_t c = row[0].n, rows = 0, total = 0, max = 0;
+            for (int32_t a = c; a < (int32_t) N; a += 7, rows++)
+                total += max = a;
+            if (row.size() != 5 || row[1].n != rows || row[2].n != total || row[3].s != "row 0" || row[4].n != max)
+                return assertion_failure("aggregate row", c, row[1].n);
+            count++;
+        }
+    }
+    delete aggregate;
+    if (count != 7)
+        return assertion_failure("aggregate groups", count);
+
+    // SELECT a, COUNT(*), MAX(b) FROM t GROUP BY a with a budget too small for all the groups
+    aggregates.clear();
+    aggregates.push_back(HashAggregate::Aggregate(HashAggregate::COUNT, -1));
+    aggregates.push_back(HashAggregate::Aggregate(HashAggregate::MAX, 1));
+    aggregate = new HashAggregate(new TableScan(table, all), ColumnNumbers(1, 0), aggregates, 20000);
+    count = 0;
+    sum = 0;
+    while (aggregate->next(batch)) {
+        for (uint i = 0; i < batch.size(); i++) {
+            if (batch[i][1].n != 1 || batch[i][2].s != "row " + to_string(batch[i][0].n % 10))
+                return assertion_failure("spilled aggregate row", batch[i][0].n);
+            sum += batch[i][0].n;
+            count++;
+        }
+    }
+    if (aggregate->get_partition_count() != HashAggregate::PARTITIONS)
+        return assertion_failure("spilled aggregate partitions", aggregate->get_partition_count());
+    delete aggregate;
+    if (count != N || sum != (int64_t) N * (N - 1) / 2)
+        return assertion_failure("spilled aggregate", count, sum);
+
+    // SELECT COUNT(*) FROM t WHERE a < 0 is one row
+    where = Expr::makeOpBinary(Expr::makeColumnRef(strdup("a")), '<', Expr::makeLiteral((int64_t) 0));
+    aggregates.clear();
+    aggregates.push_back(HashAggregate::Aggregate(HashAggregate::COUNT, -1));
+    aggregate = new HashAggregate(new Filter(new TableScan(table, all), where), ColumnNumbers(), aggregates);
+    if (!aggregate->next(batch) || batch.size() != 1 || batch[0][0].n != 0 || aggregate->next(batch))
+        return assertion_failure("aggregate of nothing");
+    delete aggregate;
+    delete where;
+
+    small.drop();
+    table.drop();
+    return true;
+}
+
+/**
+ * Benchmark of a filtered scan done the old way (select() and then project() of every row, checking the
+ * condition on the ValueDict) against the same scan as a TableScan + Filter pipeline.
+ * @param rows  how many rows to load
+ */
+void benchmark_query_plan(uint rows) {
+    HeapTable table("_benchmark_query_plan_cpp", test_column_names(), test_column_attributes());
+    test_load(table, rows);
+    ColumnNames column_names = table.get_column_names();
+    ColumnNumbers all;
+    for (uint i = 0; i < column_names.size(); i++)
+        all.push_back(i);
+    int32_t cutoff = (int32_t) rows / 2;
+
+    auto start = chrono::steady_clock::now();
+    uint old_count = 0;
+    Handles *handles = table.select();
+    for (auto const &handle: *handles) {
+        ValueDict *result = table.project(handle, &column_names);
+        if ((*result)["a"].n < cutoff)
+            old_count++;
+        delete result;
+    }
+    delete handles;
+    double old_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    start = chrono::steady_clock::now();
+    Expr *where = Expr::makeOpBinary(Expr::makeColumnRef(strdup("a")), '<', Expr::makeLiteral((int64_t) cutoff));
+    uint new_count = test_count(new Filter(new TableScan(table, all), where));
+    double new_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    delete where;
+
+    cout << "filtered scan of " << rows << " rows: select+project " << old_ms << " ms, batched pipeline " << new_ms
+         << " ms" << (old_count == new_count ? "" : " (mismatch!)") << endl;
+    table.drop();
+}
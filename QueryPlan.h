@@ -0,0 +1,662 @@
+/**
+ * @file QueryPlan.h - Operators that evaluate a query by pulling batches of rows through a pipeline.
+ * QueryOperator
+ * TableScan: QueryOperator
+ * IndexScan: QueryOperator
+ * Filter: QueryOperator
+ * Projection: QueryOperator
+ * Limit: QueryOperator
+ * Sort: QueryOperator
+ * SpillPartitions
+ * HashJoin: QueryOperator
+ * HashAggregate: QueryOperator
+ *
+ * @see "Seattle University, CPSC5300, Spring 2021"
+ */
+#pragma once
+
+#include <climits>
+#include <map>
+#include <ostream>
+#include "SQLParser.h"
+#include "ExternalSort.h"
+#include "Predicate.h"
+#include "storage_engine.h"
+
+/**
+ * @class OperatorProfile - what running an operator took, counting the operators under it (EXPLAIN ANALYZE)
+ */
+class OperatorProfile {
+public:
+    OperatorProfile() : rows(0), seconds(0.0), storage() {}
+
+    u_long rows;              // rows produced
+    double seconds;           // wall time spent in next()
+    StorageCounters storage;  // storage work done in next()
+
+    OperatorProfile &operator-=(const OperatorProfile &other) {
+        this->rows -= other.rows;
+        this->seconds -= other.seconds;
+        this->storage -= other.storage;
+        return *this;
+    }
+
+    /**
+     * The time and storage work, e.g., "time=1.250 ms reads=12 writes=0 marshaled=0 unmarshaled=4096".
+     */
+    std::string describe() const;
+};
+
+/**
+ * @class QueryOperator - one step of a query plan: a cursor over the batches of rows it produces
+ *
+ *      A plan is a tree of operators with a TableScan at each leaf. Each operator pulls batches from the
+ *      operator(s) under it as it needs them, so rows stream through the whole plan a batch at a time and
+ *      nothing is collected unless some operator has to (e.g., to sort). Nothing is read until the first
+ *      call to next().
+ *
+ *      The planner records its estimate of how many rows each operator produces and what the plan up to and
+ *      including it costs (see CostModel), and explain() prints the tree with them. Once start_profiling() has
+ *      been called, next() also keeps an OperatorProfile, and explain() shows what actually happened, too.
+ *
+ * Usage:
+ *      RowBatch batch;
+ *      while (plan->next(batch))
+ *          for (uint i = 0; i < batch.size(); i++)
+ *              ... batch[i] positionally matches plan->get_column_names() ...
+ *      delete plan;
+ */
+class QueryOperator : public RowBatchCursor {
+public:
+    QueryOperator(ColumnNames column_names, ColumnAttributes column_attributes) : column_names(column_names),
+                                                                                 column_attributes(
+                                                                                         column_attributes),
+                                                                                 estimated_rows(-1),
+                                                                                 estimated_cost(-1), profiling(false),
+                                                                                 profile() {}
+
+    virtual ~QueryOperator() {}
+
+    QueryOperator(const QueryOperator &other) = delete;
+
+    QueryOperator(QueryOperator &&temp) = delete;
+
+    QueryOperator &operator=(const QueryOperator &other) = delete;
+
+    QueryOperator &operator=(QueryOperator &&temp) = delete;
+
+    /**
+     * Refill the batch with this operator's next rows.
+     * @param batch  returned by reference: at least one row (unless there are no more)
+     * @returns      false once all the rows have been produced
+     */
+    virtual bool next(RowBatch &batch);
+
+    /**
+     * Names of the columns of the rows this operator produces, in order.
+     */
+    const ColumnNames &get_column_names() const { return column_names; }
+
+    const ColumnAttributes &get_column_attributes() const { return column_attributes; }
+
+    /**
+     * Find the column an AST column reference is to. A column named "t.c" (see qualify()) matches references to
+     * t.c and to plain c; any other column matches references to it with or without a table name.
+     * @param column_ref  AST column reference
+     * @returns           its position in this operator's rows, or -1 if there's no such column
+     * @throws DbRelationError if the reference is ambiguous
+     */
+    virtual int find_column(const hsql::Expr *column_ref) const;
+
+    /**
+     * Prefix each column name with a table name (or alias) and a dot, so that the columns can be told apart from
+     * another table's once the two are joined.
+     * @param table_name  the prefix
+     */
+    virtual void qualify(const Identifier &table_name);
+
+    /**
+     * What this operator does, in a line, e.g., "Filter a > 3".
+     */
+    virtual std::string describe() const = 0;
+
+    /**
+     * The operators this one pulls rows from (none for a scan).
+     */
+    virtual std::vector<QueryOperator *> get_inputs() const { return std::vector<QueryOperator *>(); }
+
+    /**
+     * Record the planner's estimates for this operator.
+     * @param rows  how many rows it will produce
+     * @param cost  cost of the plan up to and including this operator
+     */
+    void set_estimate(double rows, double cost) {
+        this->estimated_rows = rows;
+        this->estimated_cost = cost;
+    }
+
+    /**
+     * @returns  the estimated row count, or a negative number if there isn't one
+     */
+    double get_estimated_rows() const { return estimated_rows; }
+
+    /**
+     * @returns  the estimated cost, or a negative number if there isn't one
+     */
+    double get_estimated_cost() const { return estimated_cost; }
+
+    /**
+     * Print the plan from this operator down, one operator a line with its inputs indented under it (EXPLAIN).
+     * @param out    where to print it
+     * @param depth  how far to indent this operator
+     */
+    void explain(std::ostream &out, uint depth = 0) const;
+
+    /**
+     * Have next() keep a profile of this operator and of the ones under it from now on.
+     */
+    void start_profiling();
+
+    /**
+     * @returns  what next() has taken so far, counting the operators under this one (nullptr unless profiling)
+     */
+    const OperatorProfile *get_profile() const { return profiling ? &profile : nullptr; }
+
+protected:
+    ColumnNames column_names;
+    ColumnAttributes column_attributes;
+    double estimated_rows;
+    double estimated_cost;
+    bool profiling;
+    OperatorProfile profile;
+
+    /**
+     * What next() does, apart from profiling.
+     */
+    virtual bool produce(RowBatch &batch) = 0;
+};
+
+/**
+ * @class TableScan - the rows of a relation, or the ones matching some equality predicates or a where-clause
+ *                    condition, found by reading every block (the planner uses an IndexScan when it expects that
+ *                    to be cheaper)
+ *
+ *      The condition is compiled into a Predicate over the table's columns and checked by the storage engine on
+ *      each marshaled row, so it needn't be one of the columns produced and rows that fail aren't unmarshaled.
+ */
+class TableScan : public QueryOperator {
+public:
+    /**
+     * @param table           relation to read
+     * @param column_numbers  which of its columns to produce (only these are unmarshaled)
+     * @param where           column = value predicates the rows must match (nullptr for all rows)
+     * @param predicate       AST condition the rows must also satisfy (must outlive this operator), or nullptr
+     * @throws DbRelationError if the condition isn't supported or refers to a column the table doesn't have
+     */
+    TableScan(DbRelation &table, const ColumnNumbers &column_numbers, const ValueDict *where = nullptr,
+              const hsql::Expr *predicate = nullptr);
+
+    virtual ~TableScan();
+
+    virtual std::string describe() const;
+
+protected:
+    virtual bool produce(RowBatch &batch);
+
+    DbRelation &table;
+    ColumnNumbers column_numbers;
+    ValueDict where;
+    const hsql::Expr *predicate;
+    Predicate *program;    // predicate compiled (nullptr if there's none)
+    RowBatchCursor *rows;  // opened by the first next()
+};
+
+/**
+ * @class IndexScan - the rows of a relation that an index finds, either those with a given search key or, with a
+ *                    B+ tree on one column, those whose key is in a range
+ *
+ *      The index's handles are put in block order before any rows are read, so each block is read once. As with
+ *      a TableScan, a where-clause condition can be checked on the marshaled rows.
+ */
+class IndexScan : public QueryOperator {
+public:
+    /**
+     * Look up a search key.
+     * @param table           relation to read
+     * @param index           one of its indices
+     * @param index_name      the index's name (for describe())
+     * @param column_numbers  which of the table's columns to produce
+     * @param where           column = value predicates the rows must match, including the whole search key
+     * @param predicate       AST condition the rows must also satisfy (must outlive this operator), or nullptr
+     * @throws DbRelationError if the condition isn't supported or refers to a column the table doesn't have
+     */
+    IndexScan(DbRelation &table, DbIndex &index, const Identifier &index_name, const ColumnNumbers &column_numbers,
+              const ValueDict &where, const hsql::Expr *predicate = nullptr);
+
+    /**
+     * Scan a range of search keys.
+     * @param table           relation to read
+     * @param index           one of its indices, a B+ tree
+     * @param index_name      the index's name (for describe())
+     * @param column_numbers  which of the table's columns to produce
+     * @param min_key         smallest key wanted (inclusive), or nullptr for no lower bound
+     * @param max_key         largest key wanted (inclusive), or nullptr for no upper bound
+     * @param predicate       AST condition the rows must also satisfy (must outlive this operator), or nullptr
+     * @throws DbRelationError if the condition isn't supported or refers to a column the table doesn't have
+     */
+    IndexScan(DbRelation &table, DbIndex &index, const Identifier &index_name, const ColumnNumbers &column_numbers,
+              const ValueDict *min_key, const ValueDict *max_key, const hsql::Expr *predicate = nullptr);
+
+    virtual ~IndexScan();
+
+    virtual std::string describe() const;
+
+protected:
+    virtual bool produce(RowBatch &batch);
+
+    DbRelation &table;
+    DbIndex &index;
+    Identifier index_name;
+    ColumnNumbers column_numbers;
+    bool is_range;
+    ValueDict where;       // for a lookup
+    ValueDict min_key;     // for a range (empty if unbounded)
+    ValueDict max_key;
+    const hsql::Expr *predicate;
+    Predicate *program;    // predicate compiled (nullptr if there's none)
+    RowBatchCursor *rows;  // opened by the first next()
+};
+
+/**
+ * @class Filter - the rows of its input for which a where-clause expression is true
+ *
+ *      The expression is compiled into a Predicate (checked, and its column references resolved to positions in
+ *      the input's rows) when the operator is built, so evaluating it can't fail. Conditions on a single table
+ *      are usually pushed down into its scan instead; a Filter is for the ones that aren't, e.g., over a join.
+ */
+class Filter : public QueryOperator {
+public:
+    /**
+     * @param input      operator to filter (freed by this operator)
+     * @param predicate  the where-clause (must outlive this operator, as the statement it's part of does)
+     * @throws DbRelationError if the expression isn't supported or refers to a column input doesn't have
+     */
+    Filter(QueryOperator *input, const hsql::Expr *predicate);
+
+    virtual ~Filter();
+
+    virtual std::string describe() const;
+
+    virtual std::vector<QueryOperator *> get_inputs() const {
+        return std::vector<QueryOperator *>(1, input);
+    }
+
+protected:
+    virtual bool produce(RowBatch &batch);
+
+    QueryOperator *input;
+    const hsql::Expr *predicate;
+    Predicate *program;
+};
+
+/**
+ * @class Projection - picks out and reorders columns of its input's rows
+ */
+class Projection : public QueryOperator {
+public:
+    /**
+     * @param input      operator to project (freed by this operator)
+     * @param positions  for each output column, its position in input's rows
+     */
+    Projection(QueryOperator *input, const ColumnNumbers &positions);
+
+    virtual ~Projection();
+
+    virtual std::string describe() const;
+
+    virtual std::vector<QueryOperator *> get_inputs() const {
+        return std::vector<QueryOperator *>(1, input);
+    }
+
+protected:
+    virtual bool produce(RowBatch &batch);
+
+    QueryOperator *input;
+    ColumnNumbers positions;
+    RowBatch input_batch;
+};
+
+/**
+ * @class Limit - at most so many rows of its input, optionally skipping some first (LIMIT ... OFFSET ...)
+ */
+class Limit : public QueryOperator {
+public:
+    /**
+     * @param input   operator to limit (freed by this operator)
+     * @param limit   most rows to produce
+     * @param offset  how many of input's rows to skip first
+     */
+    Limit(QueryOperator *input, uint64_t limit, uint64_t offset = 0);
+
+    virtual ~Limit();
+
+    virtual std::string describe() const;
+
+    virtual std::vector<QueryOperator *> get_inputs() const {
+        return std::vector<QueryOperator *>(1, input);
+    }
+
+protected:
+    virtual bool produce(RowBatch &batch);
+
+    QueryOperator *input;
+    uint64_t limit;
+    uint64_t offset;
+    uint64_t remaining;  // rows still to produce
+    uint64_t to_skip;    // rows still to skip
+};
+
+/**
+ * @class Sort - its input's rows in order of some of their columns (ORDER BY), sorted with a RowSorter
+ *
+ *      Nothing comes out until all of the input has been read, of course, and that happens on the first next().
+ */
+class Sort : public QueryOperator {
+public:
+    /**
+     * @param input       operator to sort (freed by this operator)
+     * @param keys        positions of the sort key's columns in input's rows, most significant first
+     * @param descending  for each key column, whether it sorts from high to low
+     * @param limit       if not 0, only the first this many rows are produced (ORDER BY ... LIMIT)
+     * @param memory      about how many bytes of rows to hold before spilling a run
+     */
+    Sort(QueryOperator *input, const ColumnNumbers &keys, const std::vector<bool> &descending, uint64_t limit = 0,
+         size_t memory = RowSorter::DEFAULT_MEMORY);
+
+    virtual ~Sort();
+
+    virtual std::string describe() const;
+
+    virtual std::vector<QueryOperator *> get_inputs() const {
+        return std::vector<QueryOperator *>(1, input);
+    }
+
+    /**
+     * How many runs the rows were spilled in (0 if they fit in memory).
+     */
+    uint get_run_count() const { return sorter.get_run_count(); }
+
+protected:
+    virtual bool produce(RowBatch &batch);
+
+    QueryOperator *input;
+    ColumnNumbers keys;
+    std::vector<bool> descending;
+    uint64_t limit;
+    RowSorter sorter;
+    RowBatchCursor *rows;  // opened by the first next()
+};
+
+/**
+ * @class SpillPartitions - rows split by hash into partitions kept in temporary tables, for the operators that
+ *                          spill to disk when their rows don't fit in memory
+ *
+ *      Each partition's rows are buffered a batch at a time and written with insert_batch(). A partition's table
+ *      is dropped when the operator is done with it, and any that are left when this is destroyed. The tables are
+ *      named _spill_<pid>_<spill>_<partition>, so they can't clash with another process's, and any a crashed
+ *      process left behind are dropped by drop_leftovers().
+ */
+class SpillPartitions {
+public:
+    /**
+     * Drop the spill tables of processes that are gone (and this one's, if it hasn't spilled yet): only a crash
+     * leaves them behind.
+     */
+    static void drop_leftovers();
+
+    /**
+     * @param column_attributes  the rows' column types
+     * @param count              how many partitions
+     * @throws DbRelationError if the tables can't be created
+     */
+    SpillPartitions(const ColumnAttributes &column_attributes, uint count);
+
+    virtual ~SpillPartitions();
+
+    SpillPartitions(const SpillPartitions &other) = delete;
+
+    SpillPartitions(SpillPartitions &&temp) = delete;
+
+    SpillPartitions &operator=(const SpillPartitions &other) = delete;
+
+    SpillPartitions &operator=(SpillPartitions &&temp) = delete;
+
+    /**
+     * Add a row to the partition picked by the top bits of its hash (so that the bottom bits are still good for
+     * a hash table of the partition's rows).
+     * @param hash  hash of the row's key
+     * @param row   the row (its values are taken, leaving it with whatever a buffered row had)
+     */
+    virtual void add(uint32_t hash, ValueRow &row);
+
+    /**
+     * Write out the rows still buffered. Call it after the last add().
+     */
+    virtual void flush();
+
+    /**
+     * Read back a partition's rows.
+     * @param partition  which one
+     * @returns          cursor over its rows, all columns (freed by caller, before drop())
+     */
+    virtual RowBatchCursor *rows(uint partition);
+
+    /**
+     * Drop a partition's table once its rows are no longer needed.
+     */
+    virtual void drop(uint partition);
+
+    uint get_count() const { return (uint) sizes.size(); }
+
+    u_long get_size(uint partition) const { return sizes[partition]; }
+
+protected:
+    std::vector<DbRelation *> tables;  // nullptr once dropped
+    std::vector<u_long> sizes;         // rows in each partition
+    std::vector<RowBatch> buffers;     // rows not yet written to each partition
+    ColumnNumbers all;                 // all the columns' positions
+
+    static const std::string TABLE_PREFIX;
+    static uint spills;                // for naming the tables
+
+    virtual void write(uint partition);
+};
+
+/**
+ * @class HashJoin - pairs of rows from two inputs whose join keys are equal (an inner equi-join), each made of
+ *                   the left input's columns followed by the right input's
+ *
+ *      The inputs are read a batch from each in turn until one of them runs out, and that one (the smaller, as
+ *      far as we can tell without statistics) is built into a hash table. The rows already read from the other
+ *      input are probed against it, then the rest of that input as it's pulled.
+ *
+ *      If the rows read reach the memory budget before either input runs out, both inputs are instead split on
+ *      the hash of their keys into PARTITIONS pairs of temporary tables (a grace hash join), and then each pair is
+ *      joined in turn, building on whichever side of it has fewer rows. Partitioning is only done once, so a
+ *      partition that is still over budget is built in memory anyway.
+ */
+class HashJoin : public QueryOperator {
+public:
+    /**
+     * Default memory budget for the rows held at once
+     */
+    static const size_t DEFAULT_MEMORY = 16 * 1024 * 1024;
+
+    /**
+     * How many partitions the inputs are split into when they don't fit in memory
+     */
+    static const uint PARTITIONS = 16;
+
+    /**
+     * @param left        left input (freed by this operator)
+     * @param right       right input (freed by this operator)
+     * @param left_keys   positions of the join key's columns in left's rows
+     * @param right_keys  positions of the corresponding columns in right's rows (of the same types)
+     * @param memory      about how many bytes of rows to hold before spilling to disk
+     * @throws DbRelationError if the keys don't correspond
+     */
+    HashJoin(QueryOperator *left, QueryOperator *right, const ColumnNumbers &left_keys,
+             const ColumnNumbers &right_keys, size_t memory = DEFAULT_MEMORY);
+
+    virtual ~HashJoin();
+
+    virtual std::string describe() const;
+
+    virtual std::vector<QueryOperator *> get_inputs() const {
+        return std::vector<QueryOperator *>(this->inputs, this->inputs + 2);
+    }
+
+    /**
+     * How many pairs of partitions the inputs were split into (0 if the join fit in memory).
+     */
+    uint get_partition_count() const { return partitions[0] == nullptr ? 0 : partitions[0]->get_count(); }
+
+protected:
+    virtual bool produce(RowBatch &batch);
+
+    static const uint END = UINT_MAX;  // end of a bucket's chain
+
+    QueryOperator *inputs[2];                // left and right
+    ColumnNumbers keys[2];                   // join key positions in each input's rows
+    size_t memory;
+    bool started;
+    uint build;                              // which input the hash table holds rows of
+    std::vector<ValueRow> buffered[2];       // rows read while deciding which input to build on
+    size_t buffered_pos;                     // next buffered row of the probe input
+    std::vector<ValueRow> build_rows;
+    std::vector<uint32_t> hashes;            // of each build row's key
+    std::vector<uint> heads;                 // bucket -> first build row in it
+    std::vector<uint> chain;                 // build row -> next build row in its bucket
+    RowBatchCursor *probe_rows;              // the rest of the probe input
+    SpillPartitions *partitions[2];          // each input's partitions, if they had to be partitioned
+    int partition;                           // the pair of partitions being joined
+    RowBatch probe_batch;
+    uint probe_pos;                          // next row of probe_batch to probe
+    uint32_t probe_hash;                     // hash of the row being probed
+    uint match;                              // next build row to check against it
+
+    virtual void start();
+
+    virtual void partition_inputs();
+
+    virtual bool next_partition();
+
+    virtual bool next_probe_batch();
+
+    virtual void build_table();
+
+    virtual bool keys_equal(const ValueRow &build_row, const ValueRow &probe_row) const;
+};
+
+/**
+ * @class HashAggregate - one row per group of its input's rows (GROUP BY), with COUNT, SUM, MIN and MAX aggregates
+ *
+ *      Output rows are the group's values followed by the aggregates. Groups live in an open-addressing hash table
+ *      (linear probing) keyed on the normalized bytes of their group values (see normalize_value()), and each
+ *      group's aggregates are a fixed-size array of 8-byte states: COUNTs and SUMs are 64-bit totals, MIN and MAX
+ *      the value so far (for TEXT, the index of the string so far, which is kept on the side).
+ *
+ *      Once the groups reach the memory budget, rows of groups that are already in the table keep being aggregated
+ *      in memory, but rows of new groups are spilled by hash into PARTITIONS temporary tables. After the groups
+ *      in memory are produced, each partition is aggregated in turn. Partitioning is only done once, so a
+ *      partition with too many groups is aggregated in memory anyway.
+ *
+ *      With no GROUP BY columns, there is exactly one group, even for no rows. (There are no NULLs, so then the
+ *      aggregates are 0 or the empty string.) A SUM that doesn't fit in an INT is an error when it's produced.
+ */
+class HashAggregate : public QueryOperator {
+public:
+    enum Function {
+        COUNT, SUM, MIN, MAX
+    };
+
+    /**
+     * An aggregate to compute: the function and the position of the column it's over in the input's rows
+     * (-1 for COUNT(*))
+     */
+    typedef std::pair<Function, int> Aggregate;
+    typedef std::vector<Aggregate> Aggregates;
+
+    /**
+     * Default memory budget for the groups
+     */
+    static const size_t DEFAULT_MEMORY = 16 * 1024 * 1024;
+
+    /**
+     * How many partitions the rows of groups that don't fit in memory are split into
+     */
+    static const uint PARTITIONS = 16;
+
+    /**
+     * @param input       operator to aggregate (freed by this operator)
+     * @param group_by    positions of the grouping columns in input's rows
+     * @param aggregates  what to compute for each group
+     * @param memory      about how many bytes of groups to hold before spilling rows to disk
+     * @throws DbRelationError if an aggregate can't be computed on its column
+     */
+    HashAggregate(QueryOperator *input, const ColumnNumbers &group_by, const Aggregates &aggregates,
+                  size_t memory = DEFAULT_MEMORY);
+
+    virtual ~HashAggregate();
+
+    virtual std::string describe() const;
+
+    virtual std::vector<QueryOperator *> get_inputs() const {
+        return std::vector<QueryOperator *>(1, input);
+    }
+
+    /**
+     * How many partitions rows were spilled to (0 if all the groups fit in memory).
+     */
+    uint get_partition_count() const { return partitions == nullptr ? 0 : partitions->get_count(); }
+
+    /**
+     * Name of an aggregate's output column, e.g., "SUM(v)".
+     */
+    static Identifier aggregate_name(Function function, const Identifier &column_name);
+
+protected:
+    virtual bool produce(RowBatch &batch);
+
+    static const uint INITIAL_SLOTS = 1024;  // hash table size to start with (always a power of two)
+
+    QueryOperator *input;
+    ColumnNumbers group_by;
+    Aggregates aggregates;
+    size_t memory;
+    size_t used;                      // estimated bytes taken by the groups
+    bool started;
+    std::vector<uint32_t> slots;      // the hash table: each slot is a group number + 1, or 0 if empty
+    std::vector<uint32_t> hashes;     // group -> hash of its key
+    std::vector<std::string> keys;    // group -> normalized key
+    std::vector<ValueRow> groups;     // group -> its group by values
+    std::vector<int64_t> states;      // group -> its aggregates' states, one after another
+    std::vector<std::string> texts;   // TEXT MIN and MAX values so far (their states are indices into this)
+    std::string key;                  // scratch space for normalizing a row's key
+    SpillPartitions *partitions;      // rows of groups that didn't fit, if there were any
+    int partition;                    // the partition being aggregated
+    uint output_pos;                  // next group to produce
+
+    virtual void add(ValueRow &row, bool may_spill);
+
+    virtual uint new_group(uint32_t hash, const ValueRow *row);
+
+    virtual void grow();
+
+    virtual void produce(uint group, ValueRow &row) const;
+
+    virtual bool next_partition();
+};
+
+bool test_query_plan();
+void benchmark_query_plan(uint rows);
@@ -0,0 +1,315 @@
+/**
+ * @file RecordCodec.cpp - implementation of RecordCodec
+ * @see "Seattle University, CPSC5300"
+ */
+#include <cstring>
+#include <strings.h>
+#include "RecordCodec.h"
+#include "SlottedPage.h"
+
+using namespace std;
+typedef uint16_t u16;
+
+/**
+ * Lay out the record format for the given columns.
+ * @param column_attributes  the table's columns, in order
+ * @throws DbRelationError for an unknown data type
+ */
+RecordCodec::RecordCodec(const ColumnAttributes &column_attributes) : table_start(0), text_start(0) {
+    uint fixed_size = 0, text_columns = 0;
+    for (auto const &ca: column_attributes) {
+        ColumnAttribute::DataType data_type = ca.get_data_type();
+        this->data_types.push_back(data_type);
+        if (data_type == ColumnAttribute::DataType::INT)
+            fixed_size += sizeof(int32_t);
+        else if (data_type == ColumnAttribute::DataType::BOOLEAN)
+            fixed_size += sizeof(uint8_t);
+        else if (data_type == ColumnAttribute::DataType::TEXT)
+            text_columns++;
+        else
+            throw DbRelationError("Only know how to marshal INT, TEXT, and BOOLEAN");
+    }
+    u16 fixed_offset = 0, table_offset = (u16) fixed_size;
+    for (auto const &data_type: this->data_types) {
+        if (data_type == ColumnAttribute::DataType::TEXT) {
+            this->offsets.push_back(table_offset);
+            table_offset += sizeof(u16);
+        } else {
+            this->offsets.push_back(fixed_offset);
+            fixed_offset += data_type == ColumnAttribute::DataType::INT ? sizeof(int32_t) : sizeof(uint8_t);
+        }
+    }
+    this->table_start = (u16) fixed_size;
+    this->text_start = (u16) (fixed_size + text_columns * sizeof(u16));
+}
+
+uint RecordCodec::size(const ValueRow *row) const {
+    uint size = this->text_start;
+    for (uint col_num = 0; col_num < this->data_types.size(); col_num++) {
+        if (this->data_types[col_num] == ColumnAttribute::DataType::TEXT) {
+            u_long length = (*row)[col_num].s.length();
+            if (length > UINT16_MAX)
+                throw DbRelationError("text field too long to marshal");
+            size += length;
+        }
+    }
+    if (size > SlottedPage::MAX_RECORD_SZ)
+        throw DbRelationError("row too big to marshal");  // it wouldn't fit in any block
+    return size;
+}
+
+void RecordCodec::encode(const ValueRow *row, char *bytes) const {
+    u16 end = this->text_start;
+    for (uint col_num = 0; col_num < this->data_types.size(); col_num++) {
+        const Value &value = (*row)[col_num];
+        u16 offset = this->offsets[col_num];
+        switch (this->data_types[col_num]) {
+            case ColumnAttribute::DataType::INT:
+                *(int32_t *) (bytes + offset) = value.n;
+                break;
+            case ColumnAttribute::DataType::BOOLEAN:
+                *(uint8_t *) (bytes + offset) = (uint8_t) value.n;
+                break;
+            default:
+                memcpy(bytes + end, value.s.data(), value.s.length()); // assume ascii for now
+                end += (u16) value.s.length();
+                *(u16 *) (bytes + offset) = end;
+        }
+    }
+    _STORAGE_COUNTERS.bytes_marshaled += end;
+}
+
+/**
+ * Read an INT field.
+ * @param field  the text
+ * @param n      returned by reference: its value
+ * @return       false if it isn't a 32-bit integer
+ */
+static bool parse_int(const RawField &field, int32_t &n) {
+    uint i = 0;
+    bool negative = false;
+    if (field.length > 0 && (field.text[0] == '-' || field.text[0] == '+'))
+        negative = field.text[i++] == '-';
+    if (i == field.length)
+        return false;
+    int64_t value = 0;
+    for (; i < field.length; i++) {
+        if (field.text[i] < '0' || field.text[i] > '9')
+            return false;
+        value = value * 10 + (field.text[i] - '0');
+        if (value > (int64_t) INT32_MAX + 1)
+            return false;
+    }
+    if (negative)
+        value = -value;
+    if (value > INT32_MAX)
+        return false;
+    n = (int32_t) value;
+    return true;
+}
+
+/**
+ * Read a BOOLEAN field.
+ * @param field  the text
+ * @param b      returned by reference: its value
+ * @return       false if it isn't true, false, t, f, 1 or 0
+ */
+static bool parse_boolean(const RawField &field, bool &b) {
+    if (field.length == 1 && strchr("tT1", field.text[0]) != nullptr)
+        b = true;
+    else if (field.length == 1 && strchr("fF0", field.text[0]) != nullptr)
+        b = false;
+    else if (field.length == 4 && strncasecmp(field.text, "true", 4) == 0)
+        b = true;
+    else if (field.length == 5 && strncasecmp(field.text, "false", 5) == 0)
+        b = false;
+    else
+        return false;
+    return true;
+}
+
+uint RecordCodec::size(const RawFields &fields) const {
+    if (fields.size() != this->data_types.size())
+        throw DbRelationError("expected " + to_string(this->data_types.size()) + " fields, not " +
+                              to_string(fields.size()));
+    uint size = this->text_start;
+    for (uint col_num = 0; col_num < this->data_types.size(); col_num++) {
+        const RawField &field = fields[col_num];
+        int32_t n;
+        bool b;
+        switch (this->data_types[col_num]) {
+            case ColumnAttribute::DataType::INT:
+                if (!parse_int(field, n))
+                    throw DbRelationError("not an INT: '" + string(field.text, field.length) + "'");
+                break;
+            case ColumnAttribute::DataType::BOOLEAN:
+                if (!parse_boolean(field, b))
+                    throw DbRelationError("not a BOOLEAN: '" + string(field.text, field.length) + "'");
+                break;
+            default:
+                size += field.length;
+        }
+    }
+    if (size > SlottedPage::MAX_RECORD_SZ)
+        throw DbRelationError("row too big to marshal");  // it wouldn't fit in any block
+    return size;
+}
+
+void RecordCodec::encode(const RawFields &fields, char *bytes) const {
+    u16 end = this->text_start;
+    for (uint col_num = 0; col_num < this->data_types.size(); col_num++) {
+        const RawField &field = fields[col_num];
+        u16 offset = this->offsets[col_num];
+        int32_t n = 0;
+        bool b = false;
+        switch (this->data_types[col_num]) {
+            case ColumnAttribute::DataType::INT:
+                parse_int(field, n);
+                *(int32_t *) (bytes + offset) = n;
+                break;
+            case ColumnAttribute::DataType::BOOLEAN:
+                parse_boolean(field, b);
+                *(uint8_t *) (bytes + offset) = (uint8_t) b;
+                break;
+            default:
+                memcpy(bytes + end, field.text, field.length);
+                end += (u16) field.length;
+                *(u16 *) (bytes + offset) = end;
+        }
+    }
+    _STORAGE_COUNTERS.bytes_marshaled += end;
+}
+
+ValueRow *RecordCodec::decode(const char *bytes) const {
+    ValueRow *row = new ValueRow(this->data_types.size());
+    for (uint col_num = 0; col_num < this->data_types.size(); col_num++)
+        decode(bytes, col_num, (*row)[col_num]);
+    return row;
+}
+
+void RecordCodec::decode(const char *bytes, uint col_num, Value &value) const {
+    value.data_type = this->data_types[col_num];
+    u16 offset = this->offsets[col_num];
+    switch (value.data_type) {
+        case ColumnAttribute::DataType::INT:
+            value.n = *(int32_t *) (bytes + offset);
+            _STORAGE_COUNTERS.bytes_unmarshaled += sizeof(int32_t);
+            break;
+        case ColumnAttribute::DataType::BOOLEAN:
+            value.n = *(uint8_t *) (bytes + offset);
+            _STORAGE_COUNTERS.bytes_unmarshaled += sizeof(uint8_t);
+            break;
+        default:
+            const char *text;
+            u16 length;
+            get_text(bytes, col_num, text, length);
+            value.s.assign(text, length);
+            _STORAGE_COUNTERS.bytes_unmarshaled += length;
+    }
+}
+
+bool RecordCodec::equals(const char *bytes, uint col_num, const Value &value) const {
+    ColumnAttribute::DataType data_type = this->data_types[col_num];
+    if (value.data_type != data_type)
+        return false;
+    u16 offset = this->offsets[col_num];
+    switch (data_type) {
+        case ColumnAttribute::DataType::INT:
+            return *(int32_t *) (bytes + offset) == value.n;
+        case ColumnAttribute::DataType::BOOLEAN:
+            return *(uint8_t *) (bytes + offset) == (uint8_t) value.n;
+        default:
+            const char *text;
+            u16 length;
+            get_text(bytes, col_num, text, length);
+            return length == value.s.length() && memcmp(text, value.s.data(), length) == 0;
+    }
+}
+
+void RecordCodec::get_text(const char *bytes, uint col_num, const char *&text, u16 &length) const {
+    u16 entry = this->offsets[col_num];
+    u16 end = *(u16 *) (bytes + entry);
+    u16 begin = entry == this->table_start ? this->text_start : *(u16 *) (bytes + entry - sizeof(u16));
+    text = bytes + begin;
+    length = end - begin;
+}
+
+/**
+ * Test RecordCodec on a schema that mixes fixed-width and (empty and non-empty) TEXT columns.
+ * @return true if the tests all succeeded
+ */
+bool test_record_codec() {
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::BOOLEAN));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    RecordCodec codec(column_attributes);
+
+    ValueRow row;
+    row.push_back(Value("hello"));
+    row.push_back(Value(-12345));
+    row.push_back(Value(""));
+    row.push_back(Value(1));
+    row.push_back(Value("world!"));
+    uint size = codec.size(&row);
+    if (size != 4 + 1 + 3 * 2 + 5 + 0 + 6)
+        return false;
+    char bytes[DbBlock::BLOCK_SZ];
+    codec.encode(&row, bytes);
+
+    ValueRow *decoded = codec.decode(bytes);
+    bool ok = (*decoded)[0].s == "hello" && (*decoded)[1].n == -12345 && (*decoded)[2].s.empty() &&
+              (*decoded)[3].n == 1 && (*decoded)[3].data_type == ColumnAttribute::BOOLEAN &&
+              (*decoded)[4].s == "world!";
+    delete decoded;
+    if (!ok)
+        return false;
+    Value value;
+    codec.decode(bytes, 4, value);
+    if (value.s != "world!")
+        return false;
+    if (!codec.equals(bytes, 2, Value("")) || codec.equals(bytes, 0, Value("hell")) ||
+        !codec.equals(bytes, 1, Value(-12345)) || codec.equals(bytes, 1, Value("-12345")))
+        return false;
+
+    // the same row from text encodes to the same bytes
+    RawFields fields;
+    for (const char *text: {"hello", "-12345", "", "T", "world!"})
+        fields.push_back(RawField{text, (uint) strlen(text)});
+    char text_bytes[DbBlock::BLOCK_SZ];
+    if (codec.size(fields) != size)
+        return false;
+    codec.encode(fields, text_bytes);
+    if (memcmp(bytes, text_bytes, size) != 0)
+        return false;
+    for (const char *bad: {"12x", "", "-", "2147483648"}) {
+        fields[1] = RawField{bad, (uint) strlen(bad)};
+        try {
+            codec.size(fields);
+            return false;
+        } catch (DbRelationError &e) {
+            // expected
+        }
+    }
+    fields[1] = RawField{"-2147483648", 11};
+    codec.encode(fields, text_bytes);
+    codec.decode(text_bytes, 1, value);
+    if (value.n != INT32_MIN)
+        return false;
+
+    // the biggest row that fits in an empty block, and one byte more
+    row[4] = Value(std::string());
+    row[4] = Value(std::string(SlottedPage::MAX_RECORD_SZ - codec.size(&row), 'x'));
+    if (codec.size(&row) != SlottedPage::MAX_RECORD_SZ)
+        return false;
+    row[4].s += 'x';
+    try {
+        codec.size(&row);
+        return false;
+    } catch (DbRelationError &e) {
+        // expected
+    }
+    return true;
+}
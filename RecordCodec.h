@@ -0,0 +1,123 @@
+/**
+ * @file RecordCodec.h - Conversion between rows and the bytes stored for them in a heap file.
+ * RecordCodec
+ *
+ * @see "Seattle University, CPSC5300, Spring 2021"
+ */
+#pragma once
+
+#include <vector>
+#include "storage_engine.h"
+
+/**
+ * @class RawField - the text of one field of a row, as found in some buffer (e.g., a line of a CSV file)
+ */
+class RawField {
+public:
+    const char *text;
+    uint length;
+};
+
+typedef std::vector<RawField> RawFields;
+
+/**
+ * @class RecordCodec - marshals and unmarshals the rows of one schema, worked out once when the table is built
+ *
+ *      Record layout:
+ *          fixed-width columns (INT: 4 bytes, BOOLEAN: 1 byte), in column order
+ *          offset table: for each TEXT column, in column order, 2 bytes giving the offset (from the start of
+ *                        the record) just past the end of its text
+ *          text of each TEXT column, in column order, back to back with no length prefixes
+ *      So every column can be found without looking at any other: a fixed-width column is at a known offset
+ *      and a TEXT column runs from the end of the previous TEXT column (or the end of the offset table, for
+ *      the first one) to its own end.
+ */
+class RecordCodec {
+public:
+    RecordCodec(const ColumnAttributes &column_attributes);
+
+    virtual ~RecordCodec() {}
+
+    /**
+     * How many bytes the given row marshals into.
+     * @param row  values in column order
+     * @returns    size of the record
+     * @throws DbRelationError if the row is too big to store
+     */
+    virtual uint size(const ValueRow *row) const;
+
+    /**
+     * Marshal a row.
+     * @param row    values in column order
+     * @param bytes  where to put the record (must have room for size(row) bytes)
+     */
+    virtual void encode(const ValueRow *row, char *bytes) const;
+
+    /**
+     * How many bytes a row given as text marshals into. Also checks that each field is good for its column:
+     * INTs are an optional sign and digits, BOOLEANs are true/false, t/f or 1/0 (in any case).
+     * @param fields  text of each column, in column order
+     * @returns       size of the record
+     * @throws DbRelationError if a field isn't good for its column or the row is too big to store
+     */
+    virtual uint size(const RawFields &fields) const;
+
+    /**
+     * Marshal a row given as text, converting each field to its column's type along the way.
+     * @param fields  text of each column, in column order (must have passed size(fields))
+     * @param bytes   where to put the record (must have room for size(fields) bytes)
+     */
+    virtual void encode(const RawFields &fields, char *bytes) const;
+
+    /**
+     * Unmarshal a whole record.
+     * @param bytes  the record
+     * @returns      values in column order (freed by caller)
+     */
+    virtual ValueRow *decode(const char *bytes) const;
+
+    /**
+     * Unmarshal one column of a record.
+     * @param bytes    the record
+     * @param col_num  which column
+     * @param value    returned by reference
+     */
+    virtual void decode(const char *bytes, uint col_num, Value &value) const;
+
+    /**
+     * Compare one column of a record to a value without unmarshaling it.
+     * @param bytes    the record
+     * @param col_num  which column
+     * @param value    value to compare against (a different data type never matches, as with Value::operator==)
+     * @returns        true if they're the same
+     */
+    virtual bool equals(const char *bytes, uint col_num, const Value &value) const;
+
+    /**
+     * Read an INT or BOOLEAN column of a record in place.
+     * @param bytes    the record
+     * @param col_num  which column (must be INT or BOOLEAN)
+     * @returns        its value
+     */
+    int32_t get_int(const char *bytes, uint col_num) const {
+        const char *field = bytes + this->offsets[col_num];
+        return this->data_types[col_num] == ColumnAttribute::BOOLEAN ? *(uint8_t *) field : *(int32_t *) field;
+    }
+
+    /**
+     * Find a TEXT column within a record, without copying it out.
+     * @param bytes    the record
+     * @param col_num  which column (must be TEXT)
+     * @param text     returned by reference, start of the column's text
+     * @param length   returned by reference, number of bytes of text
+     */
+    void get_text(const char *bytes, uint col_num, const char *&text, uint16_t &length) const;
+
+protected:
+    std::vector<ColumnAttribute::DataType> data_types;
+    std::vector<uint16_t> offsets;  // fixed-width column: its offset; TEXT column: offset of its offset table entry
+    uint16_t table_start;           // offset of the offset table (just past the fixed-width columns)
+    uint16_t text_start;            // offset of the first TEXT column's text (just past the offset table)
+};
+
+bool test_record_codec();
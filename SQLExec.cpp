@@ -3,7 +3,16 @@
  * @author Kevin Lundeen
  * @see "Seattle University, CPSC5300, Spring 2021"
  */
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
 #include "SQLExec.h"
+#include "CsvReader.h"
 
 using namespace std;
 using namespace hsql;
@@ -11,36 +20,57 @@ using namespace hsql;
 // define static data
 Tables *SQLExec::tables = nullptr;
 Indices* SQLExec::indices = nullptr;
+Statistics *SQLExec::statistics = nullptr;
+PlanCache *SQLExec::plan_cache = nullptr;
+
+// print a row's values
+static void print_row(ostream &out, const ValueRow &row) {
+    for (auto const &value: row) {
+        switch (value.data_type) {
+            case ColumnAttribute::INT:
+                out << value.n;
+                break;
+            case ColumnAttribute::TEXT:
+                out << "\"" << value.s << "\"";
+                break;
+            case ColumnAttribute::BOOLEAN:
+                out << (value.n == 0 ? "false" : "true");
+                break;
+            default:
+                out << "???";
+        }
+        out << " ";
+    }
+    out << endl;
+}
+
+// print the column names and the line under them
+static void print_header(ostream &out, const ColumnNames &column_names) {
+    for (auto const &column_name: column_names)
+        out << column_name << " ";
+    out << endl << "+";
+    for (unsigned int i = 0; i < column_names.size(); i++)
+        out << "----------+";
+    out << endl;
+}
 
 // make query result be printable
 ostream &operator<<(ostream &out, const QueryResult &qres) {
     if (qres.column_names != nullptr) {
-        for (auto const &column_name: *qres.column_names)
-            out << column_name << " ";
-        out << endl << "+";
-        for (unsigned int i = 0; i < qres.column_names->size(); i++)
-            out << "----------+";
-        out << endl;
-        for (auto const &row: *qres.rows) {
-            for (auto const &column_name: *qres.column_names) {
-                Value value = row->at(column_name);
-                switch (value.data_type) {
-                    case ColumnAttribute::INT:
-                        out << value.n;
-                        break;
-                    case ColumnAttribute::TEXT:
-                        out << "\"" << value.s << "\"";
-                        break;
-                    case ColumnAttribute::BOOLEAN:
-                        out << (value.n == 0 ? "false" : "true");
-                        break;
-                    default:
-                        out << "???";
-                }
-                out << " ";
-            }
-            out << endl;
+        print_header(out, *qres.column_names);
+        for (auto const &row: *qres.rows)
+            print_row(out, *row);
+    }
+    if (qres.plan != nullptr) {
+        print_header(out, qres.plan->get_column_names());
+        RowBatch batch;
+        u_long n = 0;
+        while (qres.plan->next(batch)) {
+            for (uint i = 0; i < batch.size(); i++)
+                print_row(out, batch[i]);
+            n += batch.size();
         }
+        out << "successfully returned " << n << " rows";
     }
     out << qres.message;
     return out;
@@ -56,33 +86,207 @@ QueryResult::~QueryResult() {
             delete row;
         delete rows;
     }
+    delete plan;
+}
+
+// whether a table is one of the schema tables, which only DDL (and ANALYZE) changes
+static bool is_schema_table(const Identifier &table_name) {
+    return table_name == Tables::TABLE_NAME || table_name == Columns::TABLE_NAME ||
+           table_name == Indices::TABLE_NAME || table_name == Statistics::TABLE_NAME;
 }
 
 
-QueryResult *SQLExec::execute(const SQLStatement *statement) {
-    // initialize _tables table, if not yet present
-    if (SQLExec::tables == nullptr)
+void SQLExec::initialize() {
+    // initialize _tables table, if not yet present (and, the first time through, clean up after a crash)
+    if (SQLExec::tables == nullptr) {
+        SpillPartitions::drop_leftovers();
         SQLExec::tables = new Tables();
+    }
 
     //initialize _indices indice if not yet present
     if (SQLExec::indices == nullptr) {
         SQLExec::indices = new Indices();
     }
-    
+
+    if (SQLExec::statistics == nullptr)
+        SQLExec::statistics = new Statistics();
+
+    if (SQLExec::plan_cache == nullptr)
+        SQLExec::plan_cache = new PlanCache();
+}
+
+QueryResult *SQLExec::execute(const SQLStatement *statement, const Identifier &storage) {
+    initialize();
+    if (storage != Tables::BERKELEY_DB && !(statement->type() == kStmtCreate &&
+                                            ((const CreateStatement *) statement)->type == CreateStatement::kTable))
+        throw SQLExecError("USING " + storage + " is only for CREATE TABLE");
     try {
+        QueryResult *result;
         switch (statement->type()) {
-            case kStmtCreate:
-                return create((const CreateStatement *) statement);
-            case kStmtDrop:
-                return drop((const DropStatement *) statement);
             case kStmtShow:
                 return show((const ShowStatement *) statement);
+            case kStmtSelect:
+                return select((const SelectStatement *) statement);
+            case kStmtCreate:
+                result = create((const CreateStatement *) statement, storage);
+                break;
+            case kStmtDrop:
+                result = drop((const DropStatement *) statement);
+                break;
+            case kStmtInsert:
+                result = insert((const InsertStatement *) statement);
+                break;
+            case kStmtImport:
+                result = import((const ImportStatement *) statement);
+                break;
+            case kStmtDelete:
+                result = del((const DeleteStatement *) statement);
+                break;
+            case kStmtUpdate:
+                result = update((const UpdateStatement *) statement);
+                break;
             default:
                 return new QueryResult("not implemented");
         }
+        _BUFFER_POOL->flush_all();  // a statement that changed anything is on disk once it returns
+        if (statement->type() == kStmtCreate || statement->type() == kStmtDrop)
+            Catalog::save_snapshot();  // so the next startup doesn't have to read the schema tables
+        return result;
+    } catch (DbRelationError &e) {
+        throw SQLExecError(string("DbRelationError: ") + e.what());
+    }
+}
+
+/**
+ * ANALYZE <table>
+ * Reads up to CostModel::SAMPLE_BLOCKS of the table's blocks, picked at random, and replaces whatever statistics
+ * the table had. Planning then goes by them, so cached plans are stale (the catalog's version changes).
+ */
+QueryResult *SQLExec::analyze(const Identifier &table_name) {
+    initialize();
+    if (is_schema_table(table_name))
+        throw SQLExecError("cannot analyze a schema table");
+    if (!Catalog::has_table(table_name))
+        throw SQLExecError("unknown table " + table_name);
+    TableStatistics statistics;
+    try {
+        CostModel::analyze(SQLExec::tables->get_table(table_name), statistics);
+        SQLExec::statistics->put(table_name, statistics);
+        _BUFFER_POOL->flush_all();
     } catch (DbRelationError &e) {
         throw SQLExecError(string("DbRelationError: ") + e.what());
     }
+    return new QueryResult("analyzed " + table_name + ": about " + to_string(statistics.row_count) + " rows in " +
+                           to_string(statistics.block_count) + " blocks");
+}
+
+/**
+ * EXPLAIN <select>
+ * The plan is built just as for running it (operators don't read anything until they're pulled from), printed,
+ * and thrown away.
+ */
+QueryResult *SQLExec::explain(const SQLStatement *statement, bool analyze) {
+    initialize();
+    if (statement->type() != kStmtSelect && !analyze)
+        throw SQLExecError("can only EXPLAIN a SELECT");
+    ostringstream out;
+    OperatorProfile total;
+    StorageCounters storage = _STORAGE_COUNTERS;
+    auto start = chrono::steady_clock::now();
+    if (statement->type() == kStmtSelect) {
+        try {
+            QueryResult *result = select((const SelectStatement *) statement);
+            try {
+                QueryOperator *plan = result->get_plan();
+                if (analyze) {
+                    plan->start_profiling();
+                    RowBatch batch;
+                    while (plan->next(batch))
+                        total.rows += batch.size();
+                }
+                plan->explain(out);
+            } catch (...) {
+                delete result;
+                throw;
+            }
+            delete result;
+        } catch (DbRelationError &e) {
+            throw SQLExecError(string("DbRelationError: ") + e.what());
+        }
+    } else {
+        QueryResult *result = execute(statement);
+        try {
+            out << *result << endl;
+        } catch (...) {
+            delete result;
+            throw;
+        }
+        delete result;
+    }
+    if (analyze) {
+        total.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        total.storage = _STORAGE_COUNTERS;
+        total.storage -= storage;
+        out << "total (";
+        if (statement->type() == kStmtSelect)
+            out << "rows=" << total.rows << " ";
+        out << total.describe() << ")" << endl;
+    }
+    string plan = out.str();
+    return new QueryResult(plan.substr(0, plan.length() - 1));  // without the last newline
+}
+
+/**
+ * PREPARE <name> AS <statement>
+ */
+QueryResult *SQLExec::prepare(const Identifier &name, const string &sql) {
+    initialize();
+    if (SQLExec::plan_cache->find(name) != nullptr)
+        throw SQLExecError("prepared statement " + name + " already exists");
+    SQLParserResult *parse = SQLParser::parseSQLString(sql);
+    if (!parse->isValid()) {
+        string message = parse->errorMsg();
+        delete parse;
+        throw SQLExecError("invalid SQL: " + message);
+    }
+    if (!PreparedStatement::preparable(parse)) {
+        delete parse;
+        throw SQLExecError("can only PREPARE a single SELECT, INSERT, UPDATE or DELETE");
+    }
+    PreparedStatement *prepared = new PreparedStatement(parse);
+    SQLExec::plan_cache->put(name, prepared);
+    return new QueryResult("prepared " + name + " with " + to_string(prepared->get_parameter_count()) +
+                           " parameters");
+}
+
+/**
+ * EXECUTE <name>(<value>, ...)
+ */
+QueryResult *SQLExec::execute_prepared(const Identifier &name, const ValueRow &parameters) {
+    initialize();
+    PreparedStatement *prepared = SQLExec::plan_cache->find(name);
+    if (prepared == nullptr)
+        throw SQLExecError("unknown prepared statement " + name);
+    if (parameters.size() != prepared->get_parameter_count())
+        throw SQLExecError(name + " takes " + to_string(prepared->get_parameter_count()) + " parameters, not " +
+                           to_string(parameters.size()));
+    prepared->bind(parameters);
+    return execute(prepared->get_statement());
+}
+
+/**
+ * DEALLOCATE <name>
+ */
+QueryResult *SQLExec::deallocate(const Identifier &name) {
+    initialize();
+    if (!SQLExec::plan_cache->remove(name))
+        throw SQLExecError("unknown prepared statement " + name);
+    return new QueryResult("deallocated " + name);
+}
+
+const SQLStatement *SQLExec::cached(const string &sql) {
+    initialize();
+    return SQLExec::plan_cache->get(sql);
 }
 
 void
@@ -101,10 +305,10 @@ SQLExec::column_definition(const ColumnDefinition *col, Identifier &column_name,
     }
 }
 
-QueryResult *SQLExec::create(const CreateStatement *statement) {
+QueryResult *SQLExec::create(const CreateStatement *statement, const Identifier &storage) {
     switch (statement->type) {
         case CreateStatement::kTable:
-            return create_table(statement);
+            return create_table(statement, storage);
         case CreateStatement::kIndex:
             return create_index(statement);
         default:
@@ -112,7 +316,7 @@ QueryResult *SQLExec::create(const CreateStatement *statement) {
     }
 }
 
-QueryResult *SQLExec::create_table(const CreateStatement *statement) {
+QueryResult *SQLExec::create_table(const CreateStatement *statement, const Identifier &storage) {
     Identifier table_name = statement->tableName;
     ColumnNames column_names;
     ColumnAttributes column_attributes;
@@ -127,7 +331,8 @@ QueryResult *SQLExec::create_table(const CreateStatement *statement) {
     // Add to schema: _tables and _columns
     ValueDict row;
     row["table_name"] = table_name;
-    Handle t_handle = SQLExec::tables->insert(&row);  // Insert into _tables
+    row["storage"] = storage;
+    Handle t_handle = SQLExec::tables->insert(&row);  // Insert into _tables (unknown storage is rejected there)
     try {
         Handles c_handles;
         DbRelation &columns = SQLExec::tables->get_table(Columns::TABLE_NAME);
@@ -225,46 +430,44 @@ QueryResult *SQLExec::drop(const DropStatement *statement) {
 
 QueryResult *SQLExec::drop_table(const DropStatement *statement) {
     Identifier table_name = statement->name;
-    if (table_name == Tables::TABLE_NAME || table_name == Columns::TABLE_NAME)
+    if (is_schema_table(table_name))
         throw SQLExecError("cannot drop a schema table");
 
-    ValueDict where;
-    where["table_name"] = Value(table_name);
-
     // get the table
     DbRelation &table = SQLExec::tables->get_table(table_name);
 
-    //get indices
-    DbRelation& indices = SQLExec::tables->get_table(Indices::TABLE_NAME);
-    Handles* indices_handles = indices.select(&where);
     //Get name of indices
     IndexNames index_id = SQLExec::indices->get_index_names(table_name);
 
-    //Deleting indices from relation
-    for (auto const& handle : *indices_handles)
-        indices.del(handle);
-
-    //getting index name and dropping them
+    //getting index name and dropping them (while their _indices rows are still there to find them by)
     for (auto const& id : index_id) {
         DbIndex& index = SQLExec::indices->get_index(table_name, id);
         index.drop();
     }
-    delete indices_handles;
-    
+
+    //Deleting indices from relation (the catalog has their rows' handles, so no need to search _indices)
+    for (auto const& id : index_id) {
+        Handles handles = Catalog::get_index(table_name, id)->handles;
+        for (auto const &handle : handles)
+            SQLExec::indices->del(handle);
+    }
+
+    // remove from _statistics
+    SQLExec::statistics->remove(table_name);
+
     // remove from _columns schema
     DbRelation &columns = SQLExec::tables->get_table(Columns::TABLE_NAME);
-    Handles *handles = columns.select(&where);
-    for (auto const &handle: *handles)
+    Handles handles = Catalog::get_columns(table_name).handles;
+    for (auto const &handle : handles)
         columns.del(handle);
-    delete handles;
 
     // remove table
     table.drop();
 
     // finally, remove from _tables schema
-    handles = SQLExec::tables->select(&where);
-    SQLExec::tables->del(*handles->begin()); // expect only one row from select
-    delete handles;
+    Handle handle;
+    if (Catalog::has_table(table_name, &handle))
+        SQLExec::tables->del(handle);
 
     return new QueryResult(string("dropped ") + table_name);
 }
@@ -273,19 +476,890 @@ QueryResult *SQLExec::drop_index(const DropStatement *statement) {
     Identifier table_name = statement->name;
     Identifier index_name = statement->indexName;
     DbIndex& index = SQLExec::indices->get_index(table_name, index_name);
+    index.drop();
+
+    Handles handles = Catalog::get_index(table_name, index_name)->handles;
+    for (auto const &handle : handles)
+        SQLExec::indices->del(handle);
+    return new QueryResult("dropped index " + index_name);
+}
+
+// statistics of the column an AST column reference is to, in whichever table of a FROM clause has it
+static const ColumnStatistics *column_statistics(const TableRef *table_ref, const Expr *column_ref) {
+    if (table_ref->type == kTableJoin) {
+        const ColumnStatistics *found = column_statistics(table_ref->join->left, column_ref);
+        return found != nullptr ? found : column_statistics(table_ref->join->right, column_ref);
+    }
+    if (table_ref->type != kTableName)
+        return nullptr;
+    const char *alias = table_ref->alias != nullptr ? table_ref->alias : table_ref->name;
+    if (column_ref->table != nullptr && strcmp(column_ref->table, alias) != 0)
+        return nullptr;
+    return Catalog::get_statistics(table_ref->name).get_column(column_ref->name);
+}
+
+// a Filter on the plan, with its estimates
+static QueryOperator *add_filter(QueryOperator *plan, const Expr *predicate, const CostModel::ColumnLookup &lookup) {
+    double rows = plan->get_estimated_rows(), cost = plan->get_estimated_cost();
+    QueryOperator *filtered = new Filter(plan, predicate);
+    if (rows >= 0)
+        filtered->set_estimate(CostModel::clamp_rows(rows * CostModel::selectivity(predicate, lookup)),
+                               cost + CostModel::filter_cost(rows));
+    return filtered;
+}
+
+// fraction of a table's rows that have the given column values
+static double equal_selectivity(const TableStatistics &statistics, const ValueDict &where) {
+    double fraction = 1.0;
+    for (auto const &column: where) {
+        const ColumnStatistics *column_statistics = statistics.get_column(column.first);
+        fraction *= column_statistics == nullptr ? CostModel::DEFAULT_EQUAL_SELECTIVITY
+                                                 : column_statistics->equal_fraction(column.second);
+    }
+    return fraction;
+}
+
+// fraction of a table's rows whose value in the column is within the (inclusive) bounds
+static double range_selectivity(const TableStatistics &statistics, const Identifier &column_name,
+                                const ValueDict &min_key, const ValueDict &max_key) {
+    const ColumnStatistics *column = statistics.get_column(column_name);
+    if (column == nullptr)
+        return CostModel::DEFAULT_RANGE_SELECTIVITY;
+    double fraction = max_key.empty() ? 1.0 : column->less_fraction(max_key.at(column_name), true);
+    if (!min_key.empty())
+        fraction -= column->less_fraction(min_key.at(column_name), false);
+    return max(fraction, 0.0);
+}
+
+// whether an expression is an INT literal, counting a negated one (the parser gives -5 as UMINUS applied to 5)
+static bool is_int_literal(const Expr *expr) {
+    if (expr->type == kExprOperator)
+        return expr->opType == Expr::UMINUS && expr->expr->type == kExprLiteralInt;
+    return expr->type == kExprLiteralInt;
+}
+
+// the value of an INT literal (see is_int_literal), which has to fit in 32 bits
+static int32_t int_literal(const Expr *expr) {
+    int64_t n = expr->type == kExprLiteralInt ? expr->ival : -expr->expr->ival;
+    if (n < INT32_MIN || n > INT32_MAX)
+        throw SQLExecError("integer literal " + to_string(n) + " is out of range");
+    return (int32_t) n;
+}
+
+// the range the top-level conjunction of a where clause puts a column's values in: the tightest of its
+// comparisons of the column with literals, all taken as inclusive; returns false if there aren't any
+static bool column_bounds(const Expr *expr, const DbRelation &table, const Identifier &column_name,
+                          ColumnAttribute::DataType data_type, ValueDict &min_key, ValueDict &max_key) {
+    if (expr->type == kExprOperator && expr->opType == Expr::AND) {
+        bool left = column_bounds(expr->expr, table, column_name, data_type, min_key, max_key);
+        bool right = column_bounds(expr->expr2, table, column_name, data_type, min_key, max_key);
+        return left || right;
+    }
+    if (expr->type != kExprOperator || expr->expr == nullptr || expr->expr2 == nullptr)
+        return false;
+    const Expr *column = expr->expr, *literal = expr->expr2;
+    bool flipped = column->type != kExprColumnRef;
+    if (flipped)
+        swap(column, literal);
+    if (column->type != kExprColumnRef || column_name != column->name ||
+        (column->table != nullptr && table.get_table_name() != column->table))
+        return false;
+    Value value;
+    if (data_type == ColumnAttribute::INT && is_int_literal(literal))
+        value = Value(int_literal(literal));
+    else if (data_type == ColumnAttribute::TEXT && literal->type == kExprLiteralString)
+        value = Value(string(literal->name));
+    else
+        return false;
+    bool less = expr->opType == Expr::LESS_EQ || (expr->opType == Expr::SIMPLE_OP && expr->opChar == '<');
+    bool greater = expr->opType == Expr::GREATER_EQ || (expr->opType == Expr::SIMPLE_OP && expr->opChar == '>');
+    bool equal = expr->opType == Expr::SIMPLE_OP && expr->opChar == '=';
+    if (!less && !greater && !equal)
+        return false;
+    if (equal || (greater != flipped))
+        if (min_key.empty() || min_key[column_name] < value)
+            min_key[column_name] = value;
+    if (equal || (less != flipped))
+        if (max_key.empty() || value < max_key[column_name])
+            max_key[column_name] = value;
+    return true;
+}
+
+/**
+ * The scan matches the column = literal predicates of the where clause, or, if there's more to it than those, the
+ * whole where clause, compiled and checked on the marshaled rows; either way, only the columns asked for are
+ * unmarshaled, and each of them only once, however many times it's asked for.
+ *
+ * The rows are found with whichever is cheapest by the table's statistics: reading the whole table, looking up
+ * the equalities in an index on their columns, or scanning a B+ tree on one column for the range the where
+ * clause puts it in. A table that hasn't been analyzed gets the same plan as before there were statistics: an
+ * index if the equalities cover one, otherwise a scan.
+ */
+QueryOperator *SQLExec::scan(DbRelation &table, const Expr *where_clause, ColumnNames &column_names) {
     ValueDict where;
-    where["table_name"] = table_name;
-    where["index_name"] = index_name;
+    bool filter = false;
+    if (where_clause != nullptr)
+        filter = !get_where_conjunction(where_clause, table, where);
+    ColumnNames scan_names = column_names;
+    column_names.clear();
+    for (auto const &column_name: scan_names)
+        if (find(column_names.begin(), column_names.end(), column_name) == column_names.end())
+            column_names.push_back(column_name);
+    ColumnNumbers scan_columns;
+    table.get_column_numbers(&column_names, scan_columns);
 
-    Handles* index_handles = SQLExec::indices->select(&where);
-    index.drop();
+    const Identifier &table_name = table.get_table_name();
+    const TableStatistics &statistics = Catalog::get_statistics(table_name);
+    double rows = CostModel::clamp_rows(statistics.row_count * equal_selectivity(statistics, where));
+    double cost = CostModel::scan_cost(statistics);
+    const Identifier *best_index = nullptr;
+    ValueDict min_key, max_key;
+    const CatalogIndices &indices = Catalog::get_indices(table_name);
+    for (auto const &index_name: indices.index_names) {
+        const CatalogIndex &index = indices.indices.at(index_name);
+        bool covered = true;
+        for (auto const &column_name: index.column_names)
+            covered = covered && where.find(column_name) != where.end();
+        double index_rows;
+        ValueDict index_min, index_max;
+        if (covered) {
+            index_rows = index.is_unique ? 1.0 : rows;
+        } else if (!index.is_hash && index.column_names.size() == 1 && where_clause != nullptr) {
+            const Identifier &column_name = index.column_names[0];
+            ColumnNames names(1, column_name);
+            ColumnNumbers numbers;
+            table.get_column_numbers(&names, numbers);
+            if (!column_bounds(where_clause, table, column_name,
+                               table.get_column_attributes()[numbers[0]].get_data_type(), index_min, index_max))
+                continue;
+            index_rows = CostModel::clamp_rows(
+                    statistics.row_count * range_selectivity(statistics, column_name, index_min, index_max));
+        } else {
+            continue;
+        }
+        double index_cost = CostModel::index_cost(statistics, index_rows, index.is_hash);
+        if (statistics.analyzed ? index_cost < cost : covered && best_index == nullptr) {
+            best_index = &index_name;
+            cost = index_cost;
+            rows = covered ? min(rows, index_rows) : index_rows;
+            min_key = index_min;
+            max_key = index_max;
+        }
+    }
 
-    for (unsigned int i = 0; i < index_handles->size(); i++) {
-        SQLExec::indices->del(index_handles->at(i));
+    const Expr *predicate = filter ? where_clause : nullptr;
+    QueryOperator *plan;
+    if (best_index == nullptr) {
+        plan = new TableScan(table, scan_columns, filter ? nullptr : &where, predicate);
+    } else {
+        DbIndex &index = SQLExec::indices->get_index(table_name, *best_index);
+        if (min_key.empty() && max_key.empty())
+            plan = new IndexScan(table, index, *best_index, scan_columns, where, predicate);
+        else
+            plan = new IndexScan(table, index, *best_index, scan_columns, min_key.empty() ? nullptr : &min_key,
+                                 max_key.empty() ? nullptr : &max_key, predicate);
+    }
+    if (filter) {
+        // the predicate checks the whole where clause again, so the rows are a fraction of the table's
+        CostModel::ColumnLookup lookup = [&statistics](const Expr *column_ref) {
+            return statistics.get_column(column_ref->name);
+        };
+        cost += CostModel::filter_cost(rows);
+        rows = CostModel::clamp_rows(statistics.row_count * CostModel::selectivity(where_clause, lookup));
     }
+    plan->set_estimate(rows, cost);
+    return plan;
+}
 
-    delete index_handles;
-    return new QueryResult("dropped index " + index_name);
+/**
+ * Plan a SELECT as a pipeline: a TableScan of just the columns needed, which checks the where clause itself, a
+ * Projection if the scan's columns aren't already the ones asked for, and a Limit. The rows aren't read until the
+ * result is printed.
+ */
+QueryResult *SQLExec::select(const SelectStatement *statement) {
+    if (statement->selectDistinct || statement->unionSelect != nullptr)
+        throw SQLExecError("only SELECT ... FROM ... WHERE ... GROUP BY ... ORDER BY ... LIMIT is implemented");
+    bool aggregate = statement->groupBy != nullptr;
+    for (Expr *expr : *statement->selectList)
+        aggregate = aggregate || expr->type == kExprFunctionRef;
+    QueryOperator *plan;
+    if (aggregate) {
+        plan = select_aggregate(statement);
+    } else if (statement->fromTable->type == kTableJoin) {
+        plan = select_join(statement);
+    } else {
+        if (statement->fromTable->type != kTableName)
+            throw SQLExecError("only SELECT from a single table or a join of tables is implemented");
+        Identifier table_name = statement->fromTable->name;
+        if (!Catalog::has_table(table_name))
+            throw SQLExecError("unknown table " + table_name);
+        DbRelation &table = SQLExec::tables->get_table(table_name);
+
+        // the columns asked for
+        ColumnNames column_names;
+        for (Expr *expr : *statement->selectList) {
+            if (expr->type == kExprStar) {
+                for (auto const &column_name: table.get_column_names())
+                    column_names.push_back(column_name);
+            } else if (expr->type == kExprColumnRef) {
+                column_names.push_back(column_reference(expr, table));
+            } else {
+                throw SQLExecError("only columns can be selected");
+            }
+        }
+
+        ColumnNames unique_names = column_names;
+        if (statement->order != nullptr)
+            for (auto const &order: *statement->order)
+                if (order->expr->type == kExprColumnRef)
+                    unique_names.push_back(column_reference(order->expr, table));
+        plan = scan(table, statement->whereClause, unique_names);
+        if (statement->order != nullptr)
+            plan = order_by(plan, statement);
+        if (unique_names != column_names) {
+            ColumnNumbers positions;
+            for (auto const &column_name: column_names)
+                positions.push_back((uint) (find(unique_names.begin(), unique_names.end(), column_name) -
+                                            unique_names.begin()));
+            plan = new Projection(plan, positions);
+        }
+    }
+    if (statement->limit != nullptr && statement->limit->limit >= 0)
+        plan = new Limit(plan, (uint64_t) statement->limit->limit,
+                         statement->limit->offset > 0 ? (uint64_t) statement->limit->offset : 0);
+    return new QueryResult(plan);
+}
+
+// position of the column an AST column reference is to in a plan's rows
+static uint column_position(const QueryOperator &plan, const Expr *column_ref) {
+    int position = plan.find_column(column_ref);
+    if (position < 0)
+        throw SQLExecError(string("unknown column ") + column_ref->name);
+    return (uint) position;
+}
+
+// a Projection of the plan's columns at the given positions, unless that's all of them in order already
+static QueryOperator *project(QueryOperator *plan, const ColumnNumbers &positions) {
+    bool all = positions.size() == plan->get_column_names().size();
+    for (uint i = 0; all && i < positions.size(); i++)
+        all = positions[i] == i;
+    return all ? plan : new Projection(plan, positions);
+}
+
+/**
+ * The joined rows' columns are named table.column (or alias.column), so the select list and where clause can
+ * refer to them either way, as long as a plain column name isn't ambiguous.
+ */
+QueryOperator *SQLExec::select_join(const SelectStatement *statement) {
+    QueryOperator *plan = join(statement->fromTable);
+    ColumnNumbers positions;
+    try {
+        for (Expr *expr : *statement->selectList) {
+            if (expr->type == kExprStar) {
+                for (uint i = 0; i < plan->get_column_names().size(); i++)
+                    positions.push_back(i);
+            } else if (expr->type == kExprColumnRef) {
+                positions.push_back(column_position(*plan, expr));
+            } else {
+                throw SQLExecError("only columns can be selected");
+            }
+        }
+    } catch (...) {
+        delete plan;
+        throw;
+    }
+    if (statement->whereClause != nullptr)
+        plan = add_filter(plan, statement->whereClause, [statement](const Expr *column_ref) {
+            return column_statistics(statement->fromTable, column_ref);
+        });
+    if (statement->order != nullptr)
+        plan = order_by(plan, statement);
+    return project(plan, positions);
+}
+
+// name of an AST function call in upper case
+static string function_name(const Expr *expr) {
+    string name = expr->name;
+    transform(name.begin(), name.end(), name.begin(), ::toupper);
+    return name;
+}
+
+// the aggregate an AST function call asks for, over a plan's columns
+static HashAggregate::Aggregate aggregate_function(const QueryOperator &plan, const Expr *expr) {
+    static const map<string, HashAggregate::Function> FUNCTIONS = {{"COUNT", HashAggregate::COUNT},
+                                                                   {"SUM",   HashAggregate::SUM},
+                                                                   {"MIN",   HashAggregate::MIN},
+                                                                   {"MAX",   HashAggregate::MAX}};
+    string name = function_name(expr);
+    auto found = FUNCTIONS.find(name);
+    if (found == FUNCTIONS.end())
+        throw SQLExecError("unknown aggregate function " + name);
+    if (expr->distinct)
+        throw SQLExecError(name + "(DISTINCT ...) is not implemented");
+    const Expr *argument = expr->expr;
+    if (argument != nullptr && argument->type == kExprStar && found->second == HashAggregate::COUNT)
+        return HashAggregate::Aggregate(HashAggregate::COUNT, -1);
+    if (argument == nullptr || argument->type != kExprColumnRef)
+        throw SQLExecError(name + " can only be of a column");
+    return HashAggregate::Aggregate(found->second, (int) column_position(plan, argument));
+}
+
+/**
+ * Only the columns that the grouping and the aggregates need are read (or, for a join, the joined rows are
+ * filtered), and a HashAggregate does the rest. Then comes the ORDER BY, which can be on the grouping columns or
+ * the aggregates, and a Projection into the order of the select list.
+ */
+QueryOperator *SQLExec::select_aggregate(const SelectStatement *statement) {
+    if (statement->groupBy != nullptr && statement->groupBy->having != nullptr)
+        throw SQLExecError("HAVING is not implemented");
+    CostModel::ColumnLookup lookup = [statement](const Expr *column_ref) {
+        return column_statistics(statement->fromTable, column_ref);
+    };
+    QueryOperator *plan;
+    if (statement->fromTable->type == kTableJoin) {
+        plan = join(statement->fromTable);
+        if (statement->whereClause != nullptr)
+            plan = add_filter(plan, statement->whereClause, lookup);
+    } else {
+        if (statement->fromTable->type != kTableName)
+            throw SQLExecError("only SELECT from a single table or a join of tables is implemented");
+        Identifier table_name = statement->fromTable->name;
+        if (!Catalog::has_table(table_name))
+            throw SQLExecError("unknown table " + table_name);
+        DbRelation &table = SQLExec::tables->get_table(table_name);
+        ColumnNames column_names;
+        if (statement->groupBy != nullptr)
+            for (Expr *expr : *statement->groupBy->columns)
+                if (expr->type == kExprColumnRef)
+                    column_names.push_back(column_reference(expr, table));
+        for (Expr *expr : *statement->selectList)
+            if (expr->type == kExprFunctionRef && expr->expr != nullptr && expr->expr->type == kExprColumnRef)
+                column_names.push_back(column_reference(expr->expr, table));
+        plan = scan(table, statement->whereClause, column_names);
+    }
+
+    ColumnNumbers group_by, positions;
+    HashAggregate::Aggregates aggregates;
+    try {
+        if (statement->groupBy != nullptr)
+            for (Expr *expr : *statement->groupBy->columns) {
+                if (expr->type != kExprColumnRef)
+                    throw SQLExecError("can only GROUP BY columns");
+                group_by.push_back(column_position(*plan, expr));
+            }
+        for (Expr *expr : *statement->selectList) {
+            if (expr->type == kExprColumnRef) {
+                auto found = find(group_by.begin(), group_by.end(), column_position(*plan, expr));
+                if (found == group_by.end())
+                    throw SQLExecError(string("column ") + expr->name + " must be in the GROUP BY");
+                positions.push_back((uint) (found - group_by.begin()));
+            } else if (expr->type == kExprFunctionRef) {
+                aggregates.push_back(aggregate_function(*plan, expr));
+                positions.push_back((uint) (group_by.size() + aggregates.size() - 1));
+            } else {
+                throw SQLExecError("only columns and aggregates can be selected with GROUP BY");
+            }
+        }
+    } catch (...) {
+        delete plan;
+        throw;
+    }
+    double rows = plan->get_estimated_rows(), cost = plan->get_estimated_cost();
+    plan = new HashAggregate(plan, group_by, aggregates);
+    if (rows >= 0) {
+        // as many groups as there are combinations of the grouping columns' values, but no more than rows
+        double groups = 1.0;
+        if (statement->groupBy != nullptr)
+            for (Expr *expr : *statement->groupBy->columns) {
+                const ColumnStatistics *column = lookup(expr);
+                groups *= column == nullptr || column->distinct_count == 0 ? rows : (double) column->distinct_count;
+            }
+        groups = CostModel::clamp_rows(min(groups, rows));
+        plan->set_estimate(groups, cost + CostModel::hash_aggregate_cost(rows, groups));
+    }
+    if (statement->order != nullptr)
+        plan = order_by(plan, statement);
+    return project(plan, positions);
+}
+
+// position of an aggregate's column in a plan's rows, found by the name HashAggregate gave it
+static uint aggregate_position(const QueryOperator &plan, const Expr *expr) {
+    const Expr *argument = expr->expr;
+    ColumnNames names;
+    if (argument->type == kExprStar) {
+        names.push_back("*");
+    } else if (argument->type == kExprColumnRef) {
+        names.push_back(argument->name);
+        if (argument->table != nullptr)
+            names.push_back(string(argument->table) + "." + argument->name);
+    }
+    const ColumnNames &column_names = plan.get_column_names();
+    for (auto const &name: names) {
+        Identifier column_name = function_name(expr) + "(" + name + ")";
+        auto found = find(column_names.begin(), column_names.end(), column_name);
+        if (found != column_names.end())
+            return (uint) (found - column_names.begin());
+    }
+    throw SQLExecError("can only ORDER BY aggregates that are selected");
+}
+
+/**
+ * With a LIMIT, the sort only has to keep the first LIMIT + OFFSET rows.
+ */
+QueryOperator *SQLExec::order_by(QueryOperator *plan, const SelectStatement *statement) {
+    ColumnNumbers keys;
+    vector<bool> descending;
+    try {
+        for (auto const &order: *statement->order) {
+            const Expr *expr = order->expr;
+            if (expr->type == kExprColumnRef)
+                keys.push_back(column_position(*plan, expr));
+            else if (expr->type == kExprFunctionRef && expr->expr != nullptr)
+                keys.push_back(aggregate_position(*plan, expr));
+            else
+                throw SQLExecError("can only ORDER BY columns and aggregates");
+            descending.push_back(order->type == kOrderDesc);
+        }
+    } catch (...) {
+        delete plan;
+        throw;
+    }
+    uint64_t limit = 0;
+    if (statement->limit != nullptr && statement->limit->limit >= 0)
+        limit = (uint64_t) statement->limit->limit + (statement->limit->offset > 0 ? statement->limit->offset : 0);
+    return new Sort(plan, keys, descending, limit);
+}
+
+// the column = column equalities between left and right in the top-level conjunction of a join condition;
+// returns true if that's all the condition says
+static bool join_keys(const Expr *expr, const QueryOperator &left, const QueryOperator &right,
+                      ColumnNumbers &left_keys, ColumnNumbers &right_keys) {
+    if (expr->type == kExprOperator && expr->opType == Expr::AND) {
+        bool first = join_keys(expr->expr, left, right, left_keys, right_keys);
+        bool second = join_keys(expr->expr2, left, right, left_keys, right_keys);
+        return first && second;
+    }
+    if (expr->type != kExprOperator || expr->opType != Expr::SIMPLE_OP || expr->opChar != '=' ||
+        expr->expr->type != kExprColumnRef || expr->expr2->type != kExprColumnRef)
+        return false;
+    int left_key = left.find_column(expr->expr), right_key = right.find_column(expr->expr2);
+    if (left_key < 0 || right_key < 0) {
+        left_key = left.find_column(expr->expr2);
+        right_key = right.find_column(expr->expr);
+    }
+    if (left_key < 0 || right_key < 0 || left.get_column_attributes()[left_key].get_data_type() !=
+                                         right.get_column_attributes()[right_key].get_data_type())
+        return false;
+    left_keys.push_back((uint) left_key);
+    right_keys.push_back((uint) right_key);
+    return true;
+}
+
+// the conjuncts of the top-level conjunction of a condition
+static void conjuncts(const Expr *expr, vector<const Expr *> &conditions) {
+    if (expr->type == kExprOperator && expr->opType == Expr::AND) {
+        conjuncts(expr->expr, conditions);
+        conjuncts(expr->expr2, conditions);
+    } else {
+        conditions.push_back(expr);
+    }
+}
+
+// the tables of a FROM clause, in order, and the conjuncts of the ON conditions joining them
+static void join_parts(const TableRef *table_ref, vector<const TableRef *> &leaves,
+                       vector<const Expr *> &conditions) {
+    if (table_ref->type == kTableName) {
+        leaves.push_back(table_ref);
+        return;
+    }
+    if (table_ref->type != kTableJoin)
+        throw SQLExecError("can only join tables");
+    const JoinDefinition *definition = table_ref->join;
+    if (definition->type != kJoinInner || definition->condition == nullptr)
+        throw SQLExecError("only inner joins with an ON condition are implemented");
+    join_parts(definition->left, leaves, conditions);
+    join_parts(definition->right, leaves, conditions);
+    conjuncts(definition->condition, conditions);
+}
+
+// whether some of the conditions are column = column equalities between left and right, and if so, how many rows
+// joining them on those is estimated to produce
+static bool join_rows(const QueryOperator &left, const QueryOperator &right, const vector<const Expr *> &conditions,
+                      const CostModel::ColumnLookup &lookup, double &rows) {
+    bool connected = false;
+    rows = left.get_estimated_rows() * right.get_estimated_rows();
+    for (auto const &condition: conditions) {
+        ColumnNumbers left_keys, right_keys;
+        if (join_keys(condition, left, right, left_keys, right_keys)) {
+            connected = true;
+            rows *= CostModel::selectivity(condition, lookup);
+        }
+    }
+    rows = CostModel::clamp_rows(rows);
+    return connected;
+}
+
+// whether all the columns an expression refers to are in a plan's rows
+static bool resolves(const Expr *expr, const QueryOperator &plan) {
+    if (expr == nullptr)
+        return true;
+    if (expr->type == kExprColumnRef)
+        return plan.find_column(expr) >= 0;
+    return resolves(expr->expr, plan) && resolves(expr->expr2, plan);
+}
+
+/**
+ * Each table is scanned whole. The join starts with the two tables whose join is estimated to produce the fewest
+ * rows, and then keeps adding whichever table joins onto what it has so far for the fewest rows (ties go to the
+ * table named first), each with a HashJoin on the equalities of the ON conditions between them. The rest of the
+ * ON conditions are checked by a Filter as soon as the tables they refer to have been joined.
+ */
+QueryOperator *SQLExec::join(const TableRef *table_ref) {
+    vector<const TableRef *> leaves;
+    vector<const Expr *> conditions;
+    join_parts(table_ref, leaves, conditions);
+    for (auto const &leaf: leaves)
+        if (!Catalog::has_table(leaf->name))
+            throw SQLExecError(string("unknown table ") + leaf->name);
+    vector<QueryOperator *> scans;
+    for (auto const &leaf: leaves) {
+        DbRelation &table = SQLExec::tables->get_table(leaf->name);
+        ColumnNumbers all;
+        for (uint i = 0; i < table.get_column_names().size(); i++)
+            all.push_back(i);
+        const TableStatistics &statistics = Catalog::get_statistics(leaf->name);
+        QueryOperator *scan = new TableScan(table, all);
+        scan->set_estimate(statistics.row_count, CostModel::scan_cost(statistics));
+        scan->qualify(leaf->alias != nullptr ? leaf->alias : leaf->name);
+        scans.push_back(scan);
+    }
+    if (scans.size() == 1)
+        return scans[0];
+
+    CostModel::ColumnLookup lookup = [table_ref](const Expr *column_ref) {
+        return column_statistics(table_ref, column_ref);
+    };
+    QueryOperator *plan = nullptr;
+    vector<bool> joined(scans.size(), false);
+    ColumnNumbers offsets(scans.size(), 0);  // where each table's columns start in the plan's rows
+    try {
+        uint first = 0, next = 0;
+        double best = -1, rows;
+        for (uint i = 0; i < scans.size(); i++)
+            for (uint j = i + 1; j < scans.size(); j++)
+                if (join_rows(*scans[i], *scans[j], conditions, lookup, rows) && (best < 0 || rows < best)) {
+                    best = rows;
+                    first = i;
+                    next = j;
+                }
+        if (best < 0)
+            throw SQLExecError("only joins on column = column (of the same type) are implemented");
+        plan = scans[first];
+        joined[first] = true;
+
+        while (best >= 0) {
+            QueryOperator *left = plan, *right = scans[next];
+            ColumnNumbers left_keys, right_keys;
+            for (auto condition = conditions.begin(); condition != conditions.end();)
+                if (join_keys(*condition, *left, *right, left_keys, right_keys))
+                    condition = conditions.erase(condition);
+                else
+                    condition++;
+            offsets[next] = (uint) left->get_column_names().size();
+            double cost = left->get_estimated_cost() + right->get_estimated_cost() +
+                          CostModel::hash_join_cost(left->get_estimated_rows(), right->get_estimated_rows(), best);
+            plan = nullptr;
+            joined[next] = true;
+            plan = new HashJoin(left, right, left_keys, right_keys);
+            plan->set_estimate(best, cost);
+
+            for (auto condition = conditions.begin(); condition != conditions.end();)
+                if (resolves(*condition, *plan)) {
+                    QueryOperator *input = plan;
+                    plan = nullptr;
+                    plan = add_filter(input, *condition, lookup);
+                    condition = conditions.erase(condition);
+                } else {
+                    condition++;
+                }
+
+            best = -1;
+            for (uint k = 0; k < scans.size(); k++)
+                if (!joined[k] && join_rows(*plan, *scans[k], conditions, lookup, rows) && (best < 0 || rows < best)) {
+                    best = rows;
+                    next = k;
+                }
+        }
+        if (find(joined.begin(), joined.end(), false) != joined.end())
+            throw SQLExecError("only joins on column = column (of the same type) are implemented");
+        for (auto const &condition: conditions) {  // let the Filter complain about what it refers to
+            QueryOperator *input = plan;
+            plan = nullptr;
+            plan = new Filter(input, condition);
+        }
+    } catch (...) {
+        delete plan;
+        for (uint i = 0; i < scans.size(); i++)
+            if (!joined[i])
+                delete scans[i];
+        throw;
+    }
+
+    // the columns in the order of the FROM clause
+    ColumnNumbers positions;
+    for (uint i = 0; i < scans.size(); i++)
+        for (uint c = 0; c < scans[i]->get_column_names().size(); c++)
+            positions.push_back(offsets[i] + c);
+    return project(plan, positions);
+}
+
+// the value of an AST literal to store in a column of the given type
+static Value literal_value(const Expr *expr, ColumnAttribute::DataType data_type) {
+    if (data_type == ColumnAttribute::INT && is_int_literal(expr))
+        return Value(int_literal(expr));
+    if (expr->type == kExprLiteralString && data_type == ColumnAttribute::TEXT)
+        return Value(string(expr->name));
+    throw SQLExecError("can only store INT and TEXT literals of the column's type");
+}
+
+// whether a FROM clause reads the given table anywhere: directly, on either side of a join, or in a subquery
+static bool reads_table(const TableRef *table_ref, const Identifier &table_name) {
+    if (table_ref == nullptr)
+        return false;
+    switch (table_ref->type) {
+        case kTableName:
+            return table_name == table_ref->name;
+        case kTableJoin:
+            return reads_table(table_ref->join->left, table_name) || reads_table(table_ref->join->right, table_name);
+        case kTableCrossProduct:
+            for (auto const &each: *table_ref->list)
+                if (reads_table(each, table_name))
+                    return true;
+            return false;
+        case kTableSelect:
+            return reads_table(table_ref->select->fromTable, table_name);
+        default:
+            return false;
+    }
+}
+
+/**
+ * INSERT ... VALUES adds its row with insert_batch(). INSERT ... SELECT runs the select's plan and hands each
+ * batch it produces straight to insert_batch(), so rows go into the table a block at a time. Each batch goes in
+ * entirely or not at all, but if a later batch fails the earlier ones stay.
+ */
+QueryResult *SQLExec::insert(const InsertStatement *statement) {
+    Identifier table_name = statement->tableName;
+    if (is_schema_table(table_name))
+        throw SQLExecError("cannot insert into a schema table");
+    if (!Catalog::has_table(table_name))
+        throw SQLExecError("unknown table " + table_name);
+    DbRelation &table = SQLExec::tables->get_table(table_name);
+    uint n_columns = (uint) table.get_column_names().size();
+    ColumnAttributes column_attributes = table.get_column_attributes();
+
+    // where each value given goes in the table's rows
+    ColumnNames column_names;
+    if (statement->columns != nullptr) {
+        for (auto const &column_name: *statement->columns)
+            column_names.push_back(column_name);
+    } else {
+        column_names = table.get_column_names();
+    }
+    ColumnNumbers column_numbers;
+    table.get_column_numbers(&column_names, column_numbers);
+    vector<bool> given(n_columns, false);
+    for (auto const &col_num: column_numbers) {
+        if (given[col_num])
+            throw SQLExecError("column " + table.get_column_names()[col_num] + " given twice");
+        given[col_num] = true;
+    }
+    if (column_numbers.size() != n_columns)
+        throw SQLExecError("don't know how to handle NULLs, defaults, etc. yet");
+
+    RowBatch batch;
+    u_long n = 0;
+    if (statement->type == InsertStatement::kInsertValues) {
+        if (statement->values->size() != n_columns)
+            throw SQLExecError("need a value for each column");
+        ValueRow &row = batch.add();
+        row.resize(n_columns);
+        for (uint i = 0; i < n_columns; i++)
+            row[column_numbers[i]] = literal_value((*statement->values)[i],
+                                                   column_attributes[column_numbers[i]].get_data_type());
+        table.insert_batch(batch);
+        n = 1;
+    } else {
+        if (reads_table(statement->select->fromTable, table_name))
+            throw SQLExecError("cannot insert into a table being selected from");
+        QueryResult *source = select(statement->select);
+        QueryOperator *plan = source->get_plan();
+        bool in_order = plan->get_column_names().size() == n_columns;
+        for (uint i = 0; in_order && i < n_columns; i++)
+            in_order = column_numbers[i] == i;
+        try {
+            if (plan->get_column_names().size() != n_columns)
+                throw SQLExecError("need a value for each column");
+            for (uint i = 0; i < n_columns; i++)
+                if (plan->get_column_attributes()[i].get_data_type() !=
+                    column_attributes[column_numbers[i]].get_data_type())
+                    throw SQLExecError("selected column " + plan->get_column_names()[i] + " is the wrong type");
+            RowBatch selected;
+            while (plan->next(selected)) {
+                if (in_order) {
+                    table.insert_batch(selected);
+                } else {
+                    batch.clear();
+                    for (uint r = 0; r < selected.size(); r++) {
+                        ValueRow &row = batch.add();
+                        row.resize(n_columns);
+                        for (uint i = 0; i < n_columns; i++)
+                            row[column_numbers[i]] = selected[r][i];
+                    }
+                    table.insert_batch(batch);
+                }
+                n += selected.size();
+            }
+        } catch (...) {
+            delete source;
+            throw;
+        }
+        delete source;
+    }
+    return new QueryResult("successfully inserted " + to_string(n) + " row" + (n == 1 ? "" : "s") + " into " +
+                           table_name);
+}
+
+/**
+ * IMPORT FROM CSV FILE '<file>' INTO <table> (also what the shell's COPY <table> FROM '<file>' runs)
+ * The file's lines go straight into the table's blocks with load_csv() rather than each being parsed as an INSERT.
+ * Progress goes to cout on long loads.
+ */
+QueryResult *SQLExec::import(const ImportStatement *statement) {
+    Identifier table_name = statement->tableName;
+    if (statement->type != ImportStatement::kImportCSV)
+        throw SQLExecError("can only import CSV files");
+    if (is_schema_table(table_name))
+        throw SQLExecError("cannot import into a schema table");
+    if (!Catalog::has_table(table_name))
+        throw SQLExecError("unknown table " + table_name);
+    DbRelation &table = SQLExec::tables->get_table(table_name);
+
+    CsvReader reader(statement->filePath);
+    auto start = chrono::steady_clock::now();
+    u_long n = table.load_csv(reader, &cout);
+    double seconds = max(chrono::duration<double>(chrono::steady_clock::now() - start).count(), 1e-6);
+    char rates[100];
+    snprintf(rates, sizeof(rates), " in %.2f s (%.0f rows/s, %.1f MB/s)", seconds, n / seconds,
+             reader.get_bytes_read() / (1024.0 * 1024.0) / seconds);
+    return new QueryResult("successfully loaded " + to_string(n) + " row" + (n == 1 ? "" : "s") + " into " +
+                           table_name + rates);
+}
+
+void SQLExec::matching_rows(DbRelation &table, const Expr *where_clause, Handles &handles) {
+    ColumnNames column_names;
+    QueryOperator *plan = scan(table, where_clause, column_names);
+    try {
+        RowBatch batch;
+        while (plan->next(batch))
+            for (uint i = 0; i < batch.size(); i++)
+                handles.push_back(batch.get_handle(i));
+    } catch (...) {
+        delete plan;
+        throw;
+    }
+    delete plan;
+}
+
+/**
+ * DELETE FROM <table> [WHERE ...]
+ * The rows to delete are found first, only reading the columns the where clause needs, and then all deleted at
+ * once with del_batch().
+ */
+QueryResult *SQLExec::del(const DeleteStatement *statement) {
+    Identifier table_name = statement->tableName;
+    if (is_schema_table(table_name))
+        throw SQLExecError("cannot delete from a schema table");
+    if (!Catalog::has_table(table_name))
+        throw SQLExecError("unknown table " + table_name);
+    DbRelation &table = SQLExec::tables->get_table(table_name);
+
+    Handles handles;
+    matching_rows(table, statement->expr, handles);
+    table.del_batch(handles);
+    u_long n = handles.size();
+    return new QueryResult("successfully deleted " + to_string(n) + " row" + (n == 1 ? "" : "s") + " from " +
+                           table_name);
+}
+
+/**
+ * UPDATE <table> SET <column> = <literal>, ... [WHERE ...]
+ * The rows to change are found first, then each is updated where it is (see HeapTable::update()).
+ */
+QueryResult *SQLExec::update(const UpdateStatement *statement) {
+    if (statement->table->type != kTableName)
+        throw SQLExecError("can only update a single table");
+    Identifier table_name = statement->table->name;
+    if (is_schema_table(table_name))
+        throw SQLExecError("cannot update a schema table");
+    if (!Catalog::has_table(table_name))
+        throw SQLExecError("unknown table " + table_name);
+    DbRelation &table = SQLExec::tables->get_table(table_name);
+
+    ValueDict new_values;
+    for (auto const &clause: *statement->updates) {
+        Identifier column_name = clause->column;
+        const ColumnNames &column_names = table.get_column_names();
+        uint col_num = (uint) (find(column_names.begin(), column_names.end(), column_name) - column_names.begin());
+        if (col_num == column_names.size())
+            throw SQLExecError("unknown column " + column_name);
+        ColumnAttribute::DataType data_type = table.get_column_attributes()[col_num].get_data_type();
+        new_values[column_name] = literal_value(clause->value, data_type);
+    }
+    Handles handles;
+    matching_rows(table, statement->where, handles);
+    for (auto const &handle: handles)
+        table.update(handle, &new_values);
+    u_long n = handles.size();
+    return new QueryResult("successfully updated " + to_string(n) + " row" + (n == 1 ? "" : "s") + " in " +
+                           table_name);
+}
+
+Identifier SQLExec::column_reference(const Expr *expr, const DbRelation &table) {
+    if (expr->table != nullptr && table.get_table_name() != expr->table)
+        throw SQLExecError(string("unknown table ") + expr->table);
+    return expr->name;
+}
+
+bool SQLExec::get_where_conjunction(const Expr *expr, const DbRelation &table, ValueDict &where) {
+    if (expr->type == kExprOperator && expr->opType == Expr::AND) {
+        bool left = get_where_conjunction(expr->expr, table, where);
+        bool right = get_where_conjunction(expr->expr2, table, where);
+        return left && right;
+    }
+    if (expr->type != kExprOperator || expr->opType != Expr::SIMPLE_OP || expr->opChar != '=')
+        return false;
+    const Expr *column = expr->expr, *literal = expr->expr2;
+    if (column->type != kExprColumnRef)
+        swap(column, literal);
+    if (column->type != kExprColumnRef || !(literal->isLiteral() || is_int_literal(literal)))
+        return false;
+    Identifier column_name = column_reference(column, table);
+    ColumnNames names(1, column_name);
+    ColumnNumbers numbers;
+    table.get_column_numbers(&names, numbers);
+    Value value;
+    ColumnAttribute::DataType data_type = table.get_column_attributes()[numbers[0]].get_data_type();
+    if (data_type == ColumnAttribute::INT && is_int_literal(literal))
+        value = Value(int_literal(literal));
+    else if (data_type == ColumnAttribute::TEXT && literal->type == kExprLiteralString)
+        value = Value(string(literal->name));
+    else
+        return false;  // let the scan's predicate complain about it
+    if (where.find(column_name) != where.end() && where[column_name] != value)
+        return false;  // a = 1 AND a = 2: the predicate will find no rows
+    where[column_name] = value;
+    return true;
 }
 
 QueryResult *SQLExec::show(const ShowStatement *statement) {
@@ -312,19 +1386,11 @@ QueryResult *SQLExec::show_tables() {
     ColumnAttributes *column_attributes = new ColumnAttributes;
     column_attributes->push_back(ColumnAttribute(ColumnAttribute::TEXT));
 
-    Handles *handles = SQLExec::tables->select();
-    u_long n = handles->size() - 3;
-
-    ValueDicts *rows = new ValueDicts;
-    for (auto const &handle: *handles) {
-        ValueDict *row = SQLExec::tables->project(handle, column_names);
-        Identifier table_name = row->at("table_name").s;
-        if (table_name != Tables::TABLE_NAME && table_name != Columns::TABLE_NAME && table_name != Indices::TABLE_NAME)
-            rows->push_back(row);
-        else
-            delete row;
-    }
-    delete handles;
+    ValueRows *rows = new ValueRows;
+    for (auto const &table_name : Catalog::get_table_names())
+        if (!is_schema_table(table_name))
+            rows->push_back(new ValueRow(1, Value(table_name)));
+    u_long n = rows->size();
     return new QueryResult(column_names, column_attributes, rows, "successfully returned " + to_string(n) + " rows");
 }
 
@@ -339,16 +1405,11 @@ QueryResult *SQLExec::show_columns(const ShowStatement *statement) {
     ColumnAttributes *column_attributes = new ColumnAttributes;
     column_attributes->push_back(ColumnAttribute(ColumnAttribute::TEXT));
 
-    ValueDict where;
-    where["table_name"] = Value(statement->tableName);
-    Handles *handles = columns.select(&where);
-    u_long n = handles->size();
-
-    ValueDicts *rows = new ValueDicts;
-    for (auto const &handle: *handles) {
-        ValueDict *row = columns.project(handle, column_names);
-        rows->push_back(row);
-    }
-    delete handles;
+    ColumnNumbers column_numbers;
+    columns.get_column_numbers(column_names, column_numbers);
+    ValueRows *rows = new ValueRows;
+    for (auto const &handle : Catalog::get_columns(statement->tableName).handles)
+        rows->push_back(columns.project_row(handle, &column_numbers));
+    u_long n = rows->size();
     return new QueryResult(column_names, column_attributes, rows, "successfully returned " + to_string(n) + " rows");
 }
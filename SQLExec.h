@@ -9,6 +9,8 @@
 #include <string>
 #include "SQLParser.h"
 #include "schema_tables.h"
+#include "PlanCache.h"
+#include "QueryPlan.h"
 
 /**
  * @class SQLExecError - exception for SQLExec methods
@@ -21,16 +23,28 @@ public:
 
 /**
  * @class QueryResult - data structure to hold all the returned data for a query execution
+ *                      (each row's values are in the order of column_names)
+ *
+ *      The rows of a SELECT aren't collected here; the result holds the query's plan instead, and the rows
+ *      stream out of it a batch at a time as the result is printed (or as the caller pulls them from get_plan()).
  */
 class QueryResult {
 public:
-    QueryResult() : column_names(nullptr), column_attributes(nullptr), rows(nullptr), message("") {}
+    QueryResult() : column_names(nullptr), column_attributes(nullptr), rows(nullptr), plan(nullptr), message("") {}
 
     QueryResult(std::string message) : column_names(nullptr), column_attributes(nullptr), rows(nullptr),
-                                       message(message) {}
+                                       plan(nullptr), message(message) {}
 
-    QueryResult(ColumnNames *column_names, ColumnAttributes *column_attributes, ValueDicts *rows, std::string message)
-            : column_names(column_names), column_attributes(column_attributes), rows(rows), message(message) {}
+    QueryResult(ColumnNames *column_names, ColumnAttributes *column_attributes, ValueRows *rows, std::string message)
+            : column_names(column_names), column_attributes(column_attributes), rows(rows), plan(nullptr),
+              message(message) {}
+
+    /**
+     * A result whose rows come from running a plan.
+     * @param plan  the plan, not yet run (freed by this result)
+     */
+    QueryResult(QueryOperator *plan) : column_names(nullptr), column_attributes(nullptr), rows(nullptr), plan(plan),
+                                       message("") {}
 
     virtual ~QueryResult();
 
@@ -38,7 +52,9 @@ public:
 
     ColumnAttributes *get_column_attributes() const { return column_attributes; }
 
-    ValueDicts *get_rows() const { return rows; }
+    ValueRows *get_rows() const { return rows; }
+
+    QueryOperator *get_plan() const { return plan; }
 
     const std::string &get_message() const { return message; }
 
@@ -47,7 +63,8 @@ public:
 protected:
     ColumnNames *column_names;
     ColumnAttributes *column_attributes;
-    ValueDicts *rows;
+    ValueRows *rows;
+    QueryOperator *plan;
     std::string message;
 };
 
@@ -60,19 +77,76 @@ public:
     /**
      * Execute the given SQL statement.
      * @param statement   the Hyrise AST of the SQL statement to execute
+     * @param storage     for a CREATE TABLE, how to store the table: Tables::BERKELEY_DB or Tables::MMAP (the
+     *                    parser has no syntax for it; the shell takes it from a trailing USING <storage>)
+     * @returns           the query result (freed by caller)
+     */
+    static QueryResult *execute(const hsql::SQLStatement *statement, const Identifier &storage = Tables::BERKELEY_DB);
+
+    /**
+     * Gather a table's statistics from a sample of its blocks and keep them in _statistics (ANALYZE).
+     * @param table_name  the table
+     * @returns           the query result (freed by caller)
+     */
+    static QueryResult *analyze(const Identifier &table_name);
+
+    /**
+     * Plan the given SQL statement without running it, and return the plan with its estimates (EXPLAIN). Or, with
+     * analyze, run it, too, and add what each operator actually took and the totals (EXPLAIN ANALYZE). Statements
+     * other than SELECT have no plan, so for them EXPLAIN ANALYZE gives their usual result and the totals.
+     * @param statement  the Hyrise AST of a SELECT (or of any statement, with analyze)
+     * @param analyze    whether to run the statement
+     * @returns          the query result, with the plan as its message (freed by caller)
+     */
+    static QueryResult *explain(const hsql::SQLStatement *statement, bool analyze = false);
+
+    /**
+     * Parse a statement with placeholders (?) and keep it to be run by name (PREPARE).
+     * @param name  name for the statement
+     * @param sql   text of a SELECT, INSERT, UPDATE or DELETE
+     * @returns     the query result (freed by caller)
+     */
+    static QueryResult *prepare(const Identifier &name, const std::string &sql);
+
+    /**
+     * Run a prepared statement (EXECUTE).
+     * @param name        its name
+     * @param parameters  a value for each of its placeholders
      * @returns           the query result (freed by caller)
      */
-    static QueryResult *execute(const hsql::SQLStatement *statement);
+    static QueryResult *execute_prepared(const Identifier &name, const ValueRow &parameters);
+
+    /**
+     * Forget a prepared statement (DEALLOCATE).
+     * @param name  its name
+     * @returns     the query result (freed by caller)
+     */
+    static QueryResult *deallocate(const Identifier &name);
+
+    /**
+     * Look a statement up in the plan cache, so that it needn't be parsed again.
+     * @param sql  text of the statement
+     * @returns    the statement with its literals, good until the next lookup (nullptr if it can't be cached;
+     *             parse it the usual way then)
+     */
+    static const hsql::SQLStatement *cached(const std::string &sql);
 
 protected:
-    // the one place in the system that holds the _tables table and _indices table
+    // the one place in the system that holds the _tables, _indices and _statistics tables
     static Tables *tables;
     static Indices *indices;
+    static Statistics *statistics;
+
+    // parsed statements, and prepared ones by name
+    static PlanCache *plan_cache;
+
+    // open the schema tables the first time through
+    static void initialize();
 
     // recursive decent into the AST
-    static QueryResult *create(const hsql::CreateStatement *statement);
+    static QueryResult *create(const hsql::CreateStatement *statement, const Identifier &storage);
 
-    static QueryResult *create_table(const hsql::CreateStatement *statement);
+    static QueryResult *create_table(const hsql::CreateStatement *statement, const Identifier &storage);
 
     static QueryResult *create_index(const hsql::CreateStatement *statement);
 
@@ -82,6 +156,16 @@ protected:
 
     static QueryResult *drop_index(const hsql::DropStatement *statement);
 
+    static QueryResult *select(const hsql::SelectStatement *statement);
+
+    static QueryResult *insert(const hsql::InsertStatement *statement);
+
+    static QueryResult *import(const hsql::ImportStatement *statement);
+
+    static QueryResult *del(const hsql::DeleteStatement *statement);
+
+    static QueryResult *update(const hsql::UpdateStatement *statement);
+
     static QueryResult *show(const hsql::ShowStatement *statement);
 
     static QueryResult *show_tables();
@@ -98,4 +182,74 @@ protected:
      */
     static void
     column_definition(const hsql::ColumnDefinition *col, Identifier &column_name, ColumnAttribute &column_attribute);
+
+    /**
+     * Pull out the column = literal predicates from the top-level conjunction of a where clause.
+     * @param expr   AST where clause
+     * @param table  table the where clause is on
+     * @param where  returned by reference: a value for each column that the clause says it must equal
+     * @returns      true if that's all the where clause says (so it needs no more checking)
+     */
+    static bool get_where_conjunction(const hsql::Expr *expr, const DbRelation &table, ValueDict &where);
+
+    /**
+     * Name of the column an AST column reference is to.
+     * @param expr   AST column reference
+     * @param table  table it has to be a column of
+     * @returns      the column name
+     * @throws SQLExecError if it is for some other table
+     */
+    static Identifier column_reference(const hsql::Expr *expr, const DbRelation &table);
+
+    /**
+     * Plan the part of a query that reads a table: a TableScan or an IndexScan, whichever the table's statistics
+     * say is cheaper, checking the where clause itself.
+     * @param table         table to read
+     * @param where_clause  AST where clause (nullptr for all rows)
+     * @param column_names  the columns wanted; returned by reference: the plan's columns (the same, without
+     *                      duplicates)
+     * @returns             the plan (freed by caller)
+     */
+    static QueryOperator *scan(DbRelation &table, const hsql::Expr *where_clause, ColumnNames &column_names);
+
+    /**
+     * Plan a SELECT whose FROM clause is a join.
+     * @param statement  AST select statement
+     * @returns          the plan, without its limit (freed by caller)
+     */
+    static QueryOperator *select_join(const hsql::SelectStatement *statement);
+
+    /**
+     * Plan a SELECT with a GROUP BY or aggregates.
+     * @param statement  AST select statement
+     * @returns          the plan, without its limit (freed by caller)
+     */
+    static QueryOperator *select_aggregate(const hsql::SelectStatement *statement);
+
+    /**
+     * Add a Sort for a SELECT's ORDER BY to its plan.
+     * @param plan       the plan so far, which has to have all the columns the ORDER BY refers to (freed by the
+     *                   returned plan, or if this throws)
+     * @param statement  AST select statement (with an ORDER BY)
+     * @returns          the plan (freed by caller)
+     */
+    static QueryOperator *order_by(QueryOperator *plan, const hsql::SelectStatement *statement);
+
+    /**
+     * Plan the reading of a table, or of tables joined together, qualifying the column names with the tables'
+     * names (or aliases). The tables are joined in the order the cost model likes best, but the plan's columns are
+     * in the order of the FROM clause.
+     * @param table_ref  AST table reference (a table name or a join)
+     * @returns          the plan (freed by caller)
+     * @throws SQLExecError if the join isn't an inner equi-join
+     */
+    static QueryOperator *join(const hsql::TableRef *table_ref);
+
+    /**
+     * Find the rows of a table that a where clause picks out, the same way a SELECT would.
+     * @param table         table to look in
+     * @param where_clause  AST where clause (nullptr for all rows)
+     * @param handles       returned by reference: the rows' handles are added to it
+     */
+    static void matching_rows(DbRelation &table, const hsql::Expr *where_clause, Handles &handles);
 };
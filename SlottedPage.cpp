@@ -3,6 +3,8 @@
  * @author K Lundeen
  * @see Seattle University, CPSC5300
  */
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include "SlottedPage.h"
 
@@ -16,13 +18,8 @@ typedef uint16_t u16;
  * @param is_new
  */
 SlottedPage::SlottedPage(Dbt &block, BlockID block_id, bool is_new) : DbBlock(block, block_id, is_new) {
-    if (is_new) {
-        this->num_records = 0;
-        this->end_free = DbBlock::BLOCK_SZ - 1;
-        put_header();
-    } else {
-        get_header(this->num_records, this->end_free);
-    }
+    if (is_new)
+        put_header(0, 0, DbBlock::BLOCK_SZ - 1);
 }
 
 /**
@@ -31,15 +28,30 @@ SlottedPage::SlottedPage(Dbt &block, BlockID block_id, bool is_new) : DbBlock(bl
  * @return the new block's id
  */
 RecordID SlottedPage::add(const Dbt *data) {
-    if (!has_room((u16) data->get_size()))
+    void *bytes;
+    RecordID id = reserve((u16) data->get_size(), bytes);
+    memcpy(bytes, data->get_data(), data->get_size());
+    return id;
+}
+
+/**
+ * Add a new record of the given size to the block without filling it in, so that the caller can build the
+ * record right where it will live.
+ * @param size   how many bytes the record needs
+ * @param bytes  returned by reference, where to put the record's contents
+ *               (only good until the next change to this block)
+ * @return the new record's id
+ * @throws DbBlockNoRoomError if insufficient room in the block
+ */
+RecordID SlottedPage::reserve(u16 size, void *&bytes) {
+    if (!make_room(size + 4U))
         throw DbBlockNoRoomError("not enough room for new record");
-    u16 id = ++this->num_records;
-    u16 size = (u16) data->get_size();
-    this->end_free -= size;
-    u16 loc = this->end_free + 1U;
-    put_header();
+    RecordID id = get_num_records() + 1U;
+    u16 end_free = get_end_free() - size;
+    put_header(0, id, end_free);
+    u16 loc = end_free + 1U;
     put_header(id, size, loc);
-    memcpy(this->address(loc), data->get_data(), size);
+    bytes = this->address(loc);
     return id;
 }
 
@@ -56,8 +68,21 @@ Dbt *SlottedPage::get(RecordID record_id) const {
     return new Dbt(this->address(loc), size);
 }
 
+const char *SlottedPage::get_bytes(RecordID record_id, u16 &size) const {
+    u16 loc;
+    get_header(size, loc, record_id);
+    if (loc == 0)
+        return nullptr;
+    return (const char *) this->address(loc);
+}
+
 /**
  * Replace the record with the given data.
+ *
+ * A shrinking record is rewritten in place against its right edge. A growing record is rewritten into the
+ * contiguous free space and its old bytes are left behind as a hole. Either way the holes are only squeezed
+ * out by compact() when some later add/put can't otherwise find contiguous room.
+ *
  * @param record_id   record to replace
  * @param data        new contents of record_id
  * @throws DbBlockNoRoomError if it won't fit
@@ -65,51 +90,103 @@ Dbt *SlottedPage::get(RecordID record_id) const {
 void SlottedPage::put(RecordID record_id, const Dbt &data) {
     u16 size, loc;
     get_header(size, loc, record_id);
+    u16 tag = get_tag(record_id);
     u16 new_size = (u16) data.get_size();
-    if (new_size > size) {
-        u16 extra = new_size - size;
-        if (!has_room(extra))
-            throw DbBlockNoRoomError("not enough room for enlarged record");
-        slide(loc, loc - extra);
-        memcpy(this->address(loc - extra), data.get_data(), new_size);
-    } else {
-        memcpy(this->address(loc), data.get_data(), new_size);
-        slide(loc + new_size, loc + size);
+    if (new_size <= size) {
+        u16 new_loc = loc + size - new_size;
+        memmove(this->address(new_loc), data.get_data(), new_size);
+        put_header(record_id, new_size | tag, new_loc);
+        release(loc, size - new_size);
+        return;
     }
-    get_header(size, loc, record_id);
-    put_header(record_id, new_size, loc);
+    // the record already has its header and its old bytes are counted as used, so it only needs the growth
+    if (new_size - size > free_space())
+        throw DbBlockNoRoomError("not enough room for enlarged record");
+    put_header(record_id, 0, 0);
+    release(loc, size);  // (right at the free space, its old bytes join it)
+    if (!has_room(new_size))
+        compact();
+    u16 end_free = get_end_free() - new_size;
+    put_header(0, get_num_records(), end_free);
+    u16 new_loc = end_free + 1U;
+    put_header(record_id, new_size | tag, new_loc);
+    memcpy(this->address(new_loc), data.get_data(), new_size);
 }
 
 /**
  * Delete a record from the page.
  *
- * Mark the given id as deleted by changing its size to zero and its location to 0.
- * Compact the rest of the data in the block. But keep the record ids the same for everyone.
+ * Mark the given id as deleted by changing its size to zero and its location to 0. The record's bytes
+ * become a hole that is reclaimed lazily (see compact()). Record ids stay the same for everyone, and the
+ * deleted one is never handed out again, so a handle to it goes on finding nothing rather than some other row.
  *
  * @param record_id  record to delete
  */
 void SlottedPage::del(RecordID record_id) {
     u16 size, loc;
     get_header(size, loc, record_id);
+    if (loc == 0)
+        return;  // already a tombstone
     put_header(record_id, 0, 0);  // 0 is the tombstone sentinel
-    slide(loc, loc + size);
+    release(loc, size);
+}
+
+u16 SlottedPage::get_tag(RecordID record_id) const {
+    return get_n((u16) 4 * record_id) & TAGS;
+}
+
+void SlottedPage::set_tag(RecordID record_id, u16 tag) {
+    put_n((u16) 4 * record_id, (get_n((u16) 4 * record_id) & ~TAGS) | tag);
 }
 
 /**
- * Sequence of all non-deleted record IDs.
+ * Sequence of all non-deleted record IDs (other than MOVED ones).
  * @return  sequence of IDs (freed by caller)
  */
 RecordIDs *SlottedPage::ids(void) const {
     RecordIDs *vec = new RecordIDs();
     u16 size, loc;
-    for (RecordID record_id = 1; record_id <= this->num_records; record_id++) {
+    u16 num_records = get_num_records();
+    for (RecordID record_id = 1; record_id <= num_records; record_id++) {
         get_header(size, loc, record_id);
-        if (loc != 0)
+        if (loc != 0 && (get_tag(record_id) & MOVED) == 0)
             vec->push_back(record_id);
     }
     return vec;
 }
 
+/**
+ * @class SlottedPageCursor - walks the record headers of a SlottedPage, skipping tombstones and MOVED records
+ */
+class SlottedPageCursor : public RecordIDCursor {
+public:
+    SlottedPageCursor(const SlottedPage &page) : page(page), record_id(0) {}
+
+    virtual bool next(RecordID &next_id) {
+        u16 size, loc;
+        while (this->record_id < this->page.get_num_records()) {
+            this->page.get_header(size, loc, ++this->record_id);
+            if (loc != 0 && (this->page.get_tag(this->record_id) & SlottedPage::MOVED) == 0) {
+                next_id = this->record_id;
+                return true;
+            }
+        }
+        return false;
+    }
+
+protected:
+    const SlottedPage &page;
+    RecordID record_id;
+};
+
+/**
+ * Stream of all non-deleted record IDs (other than MOVED ones).
+ * @return  cursor (freed by caller; only valid as long as this page is)
+ */
+RecordIDCursor *SlottedPage::id_cursor(void) const {
+    return new SlottedPageCursor(*this);
+}
+
 /**
  * Get the size and offset for given id. For id of zero, it is the block header.
  * @param size  set to the size from given header
@@ -117,71 +194,101 @@ RecordIDs *SlottedPage::ids(void) const {
  * @param id    the id of the header to fetch
  */
 void SlottedPage::get_header(u_int16_t &size, u_int16_t &loc, RecordID id) const {
-    size = get_n((u16) 4 * id);
+    size = get_n((u16) 4 * id) & ~TAGS;
     loc = get_n((u16) (4 * id + 2));
 }
 
 /**
- * Store the size and offset for given id. For id of zero, store the block header.
+ * Store the size and offset for given id. For id of zero, store the block header (the number of records and
+ * the offset to the end of free space).
  * @param id
  * @param size
  * @param loc
  */
 void SlottedPage::put_header(RecordID id, u16 size, u16 loc) {
-    if (id == 0) { // called the put_header() version and using the default params
-        size = this->num_records;
-        loc = this->end_free;
-    }
     put_n((u16) 4 * id, size);
     put_n((u16) (4 * id + 2), loc);
 }
 
 /**
- * Calculate if we have room to store a record with given size. The size should include the 4 bytes
+ * Calculate if we have contiguous room to store a record with given size. The size should include the 4 bytes
  * for the header, too, if this is an add.
  * @param size   size of the new record (not including the header space needed)
  * @return       true if there is enough room, false otherwise
  */
 bool SlottedPage::has_room(u16 size) const {
-    return 4 * (this->num_records + 1) + size <= this->end_free;
+    return 4U * (get_num_records() + 1U) + size <= get_end_free() + 1U;
 }
 
 /**
- * Slide the contents to compensate for a smaller/larger record.
- *
- * If start < end, then remove data from offset start up to but not including offset end by sliding data
- * that is to the left of start to the right. If start > end, then make room for extra data from end to start
- * by sliding data that is to the left of start to the left.
- * Also fix up any record headers whose data has slid. Assumes there is enough room if it is a left
- * shift (end < start).
- *
- * @param start  beginning of slide
- * @param end    end of slide
+ * Make sure there is contiguous room for size bytes, compacting the block if the holes left by earlier
+ * del/put calls would make the difference.
+ * @param size  bytes needed (including the 4 header bytes if this is an add)
+ * @return      true if there is now room, false if even a compacted block would be too full
  */
-void SlottedPage::slide(u_int16_t start, u_int16_t end) {
-    int shift = end - start;
-    if (shift == 0)
-        return;
+bool SlottedPage::make_room(u16 size) {
+    if (has_room(size))
+        return true;
+    if (size > free_space())
+        return false;
+    compact();
+    return true;
+}
+
+/**
+ * Total bytes we could hand out after a compaction: the contiguous free space plus all the holes, i.e.,
+ * whatever the headers and the live records don't take up. Worked out from the headers every time, since
+ * another SlottedPage on the same block (the same buffer pool frame) may have changed them.
+ * @return  free bytes in the block
+ */
+u16 SlottedPage::free_space() const {
+    u16 size, loc;
+    u16 num_records = get_num_records();
+    uint used = 4U * (num_records + 1U);
+    for (RecordID record_id = 1; record_id <= num_records; record_id++) {
+        get_header(size, loc, record_id);
+        if (loc != 0)
+            used += size;
+    }
+    return (u16) (DbBlock::BLOCK_SZ - used);
+}
 
-    // slide data
-    void *to = this->address((u16) (this->end_free + 1 + shift));
-    void *from = this->address((u16) (this->end_free + 1));
-    int bytes = start - (this->end_free + 1U);
-    memmove(to, from, bytes);
+/**
+ * Give back the bytes from offset loc for size bytes. If they border the contiguous free space, we just grow
+ * that; otherwise they become a hole to be reclaimed by the next compact().
+ * @param loc   offset of the first byte no longer in use
+ * @param size  number of bytes no longer in use
+ */
+void SlottedPage::release(u16 loc, u16 size) {
+    if (size == 0)
+        return;
+    u16 end_free = get_end_free();
+    if (loc == end_free + 1U)
+        put_header(0, get_num_records(), end_free + size);
+}
 
-    // fix up headers to the right
-    RecordIDs *record_ids = ids();
-    for (auto const &record_id : *record_ids) {
-        u16 size, loc;
+/**
+ * Squeeze all the holes out of the block so that the free space is contiguous again.
+ *
+ * Live records are packed against the end of the block in record id order via a stack copy of the record
+ * area and each header is fixed up as its record is placed, so there is one pass over the headers and no
+ * heap allocation.
+ */
+void SlottedPage::compact() {
+    char scratch[DbBlock::BLOCK_SZ];
+    uint end = DbBlock::BLOCK_SZ;
+    u16 size, loc;
+    u16 num_records = get_num_records();
+    for (RecordID record_id = 1; record_id <= num_records; record_id++) {
         get_header(size, loc, record_id);
-        if (loc <= start) {
-            loc += shift;
-            put_header(record_id, size, loc);
-        }
+        if (loc == 0)
+            continue;
+        end -= size;
+        memcpy(scratch + end, this->address(loc), size);
+        put_header(record_id, size | get_tag(record_id), (u16) end);
     }
-    delete record_ids;
-    this->end_free += shift;
-    put_header();
+    memcpy(this->address((u16) end), scratch + end, DbBlock::BLOCK_SZ - end);
+    put_header(0, num_records, (u16) (end - 1));
 }
 
 /**
@@ -325,6 +432,88 @@ bool test_slotted_page() {
         return assertion_failure("wrong type thrown when add too big");
     }
 
+    // holes left by del/put are only reclaimed once an add or put needs the room
+    char filler[100];
+    memset(filler, 'f', sizeof(filler));
+    Dbt filler_dbt(filler, sizeof(filler));
+    RecordIDs filled;
+    try {
+        while (true)
+            filled.push_back(slot.add(&filler_dbt));
+    } catch (const DbBlockNoRoomError &exc) {
+        // expected once the block is full
+    }
+    for (uint i = 0; i < filled.size(); i += 2)
+        slot.del(filled[i]);
+    slot.set_tag(filled[1], SlottedPage::FORWARD);
+    slot.set_tag(filled[3], SlottedPage::MOVED);
+    char big[300];
+    memset(big, 'b', sizeof(big));
+    Dbt big_dbt(big, 250);
+    RecordID big_id = slot.add(&big_dbt);
+    big_dbt = Dbt(big, sizeof(big));
+    slot.put(filled[1], big_dbt);
+    get_dbt = slot.get(2);
+    expected = string(rec2, sizeof(rec2));
+    actual = string((char *) get_dbt->get_data(), get_dbt->get_size());
+    delete get_dbt;
+    if (expected != actual)
+        return assertion_failure("get 2 back after compaction " + actual);
+    for (uint i = 3; i < filled.size(); i += 2) {
+        get_dbt = slot.get(filled[i]);
+        bool ok = get_dbt->get_size() == sizeof(filler) && memcmp(get_dbt->get_data(), filler, sizeof(filler)) == 0;
+        delete get_dbt;
+        if (!ok)
+            return assertion_failure("filler record wrong after compaction", filled[i]);
+    }
+    get_dbt = slot.get(big_id);
+    if (get_dbt->get_size() != 250 || memcmp(get_dbt->get_data(), big, 250) != 0)
+        return assertion_failure("add into reclaimed holes");
+    delete get_dbt;
+    get_dbt = slot.get(filled[1]);
+    if (get_dbt->get_size() != sizeof(big) || memcmp(get_dbt->get_data(), big, sizeof(big)) != 0)
+        return assertion_failure("put into reclaimed holes");
+    delete get_dbt;
+
+    // tags stay with their records through puts and compaction, and MOVED records aren't listed
+    if (slot.get_tag(filled[1]) != SlottedPage::FORWARD || slot.get_tag(filled[3]) != SlottedPage::MOVED ||
+        slot.get_tag(2) != 0)
+        return assertion_failure("tags after compaction");
+    id_list = slot.ids();
+    bool listed = find(id_list->begin(), id_list->end(), filled[3]) != id_list->end();
+    delete id_list;
+    if (listed)
+        return assertion_failure("MOVED record in ids()", filled[3]);
+
+    // two objects on the same bytes (as with two gets of a block in one buffer pool frame) see each other's changes
+    char shared_space[DbBlock::BLOCK_SZ];
+    Dbt shared_dbt(shared_space, sizeof(shared_space));
+    SlottedPage writer(shared_dbt, 1, true);
+    SlottedPage reader(shared_dbt, 1);
+    RecordID first = writer.add(&filler_dbt);
+    RecordID second = reader.add(&filler_dbt);
+    writer.del(first);
+    uint16_t size;
+    get_dbt = writer.get(second);
+    bool seen = get_dbt != nullptr;
+    delete get_dbt;
+    if (first != 1 || second != 2 || !seen || reader.get_bytes(first, size) != nullptr ||
+        reader.free_space() != writer.free_space())
+        return assertion_failure("two pages on one block", second);
+
+    // a record next to the free space grows into it without a compaction (which would move the others)
+    char grow_space[DbBlock::BLOCK_SZ], grown[2080];
+    memset(grown, 'g', sizeof(grown));
+    Dbt grow_dbt(grow_space, sizeof(grow_space)), thousand(grown, 1000), grown_dbt(grown, sizeof(grown));
+    SlottedPage growing(grow_dbt, 1, true);
+    RecordID hole = growing.add(&thousand), kept = growing.add(&thousand), last = growing.add(&thousand);
+    growing.del(hole);
+    const char *kept_bytes = growing.get_bytes(kept, size);
+    growing.put(last, grown_dbt);
+    if (growing.get_bytes(kept, size) != kept_bytes || growing.get_bytes(last, size) == nullptr ||
+        size != sizeof(grown))
+        return assertion_failure("grow record into the free space");
+
     // more volume
     string gettysburg = "Four score and seven years ago our fathers brought forth on this continent, a new nation, conceived in Liberty, and dedicated to the proposition that all men are created equal.";
     int32_t n = -1;
@@ -367,3 +556,62 @@ bool test_slotted_page() {
     delete[] data;
     return true;
 }
+
+/**
+ * Microbenchmark for SlottedPage: mixed add/put/del churn on full 4 KB blocks.
+ * Each round fills a fresh block with 20-60 byte records, then resizes, deletes and re-adds
+ * records at random until an add no longer fits.
+ */
+void benchmark_slotted_page() {
+    const uint ROUNDS = 20000;
+    char blank_space[DbBlock::BLOCK_SZ];
+    char payload[64];
+    memset(payload, 'x', sizeof(payload));
+    uint32_t seed = 5300;
+    auto next = [&seed](uint32_t n) {
+        seed = seed * 1103515245U + 12345U;
+        return (seed >> 16) % n;
+    };
+    RecordID live[DbBlock::BLOCK_SZ / 4];
+    u_long ops = 0;
+    auto start = chrono::steady_clock::now();
+    for (uint round = 0; round < ROUNDS; round++) {
+        Dbt block_dbt(blank_space, sizeof(blank_space));
+        SlottedPage page(block_dbt, 1, true);
+        uint n_live = 0;
+        try {
+            while (true) {
+                Dbt rec(payload, 20 + next(41));
+                RecordID id = page.add(&rec);
+                live[n_live++] = id;
+                ops++;
+            }
+        } catch (DbBlockNoRoomError &e) {}
+        try {
+            while (n_live > 0) {
+                uint which = next(n_live);
+                switch (next(3)) {
+                    case 0: {
+                        Dbt rec(payload, 20 + next(41));
+                        try {
+                            page.put(live[which], rec);
+                        } catch (DbBlockNoRoomError &e) {}
+                        break;
+                    }
+                    case 1:
+                        page.del(live[which]);
+                        live[which] = live[--n_live];
+                        break;
+                    default: {
+                        Dbt rec(payload, 20 + next(41));
+                        RecordID id = page.add(&rec);
+                        live[n_live++] = id;
+                    }
+                }
+                ops++;
+            }
+        } catch (DbBlockNoRoomError &e) {}
+    }
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    cout << "slotted page churn: " << ops << " ops, " << ns / ops << " ns/op" << endl;
+}
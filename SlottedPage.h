@@ -1,7 +1,8 @@
 /**
  * @file heap_storage.h - Implementation of storage_engine with a heap file structure.
  * SlottedPage: DbBlock
- * HeapFile: DbFile
+ * SlottedPageFile: DbFile
+ * HeapFile: SlottedPageFile
  * HeapTable: DbRelation
  *
  * @author Kevin Lundeen
@@ -23,10 +24,35 @@
             Bytes 0x04 - 0x05: size of record 1
             Bytes 0x06 - 0x07: offset to record 1
             etc.
+        Deletes and resizing puts leave holes in the record area rather than sliding everything over; the
+        holes are squeezed out all at once by compact() when an add or put needs more contiguous room.
+        Record ids are never reused: a deleted record leaves its header behind as a tombstone.
+        Nothing about the block is kept in the SlottedPage object itself; it all comes from the block's bytes,
+        so several objects on the same bytes (e.g., the same buffer pool frame) see each other's changes.
+        The top two bits of a record's size are tags the block's owner can set (see FORWARD and MOVED); sizes
+        are always reported without them.
  *
  */
 class SlottedPage : public DbBlock {
 public:
+    /**
+     * Tag for a record that is just a stub saying where the real record went (when it outgrew this block)
+     */
+    static const uint16_t FORWARD = 0x8000;
+
+    /**
+     * Tag for a record that a FORWARD stub elsewhere points to; ids() and id_cursor() leave these out, since
+     * the record belongs to the stub's block
+     */
+    static const uint16_t MOVED = 0x4000;
+
+    static const uint16_t TAGS = FORWARD | MOVED;
+
+    /**
+     * Biggest record an empty block can hold: all of it but the block's header and the record's own
+     */
+    static const uint16_t MAX_RECORD_SZ = DbBlock::BLOCK_SZ - 8;
+
     SlottedPage(Dbt &block, BlockID block_id, bool is_new = false);
 
     // Big 5 - use the defaults
@@ -34,25 +60,56 @@ public:
 
     virtual RecordID add(const Dbt *data);
 
+    virtual RecordID reserve(uint16_t size, void *&bytes);
+
     virtual Dbt *get(RecordID record_id) const;
 
+    /**
+     * Like get(), but without allocating anything: points straight at the record's bytes in the block.
+     * @param record_id  which record
+     * @param size       returned by reference: size of the record
+     * @returns          the record's bytes (only good until the block changes), or nullptr if it has been deleted
+     */
+    const char *get_bytes(RecordID record_id, uint16_t &size) const;
+
     virtual void put(RecordID record_id, const Dbt &data);
 
     virtual void del(RecordID record_id);
 
+    /**
+     * The tags of a record (FORWARD, MOVED, or 0). A record's tags stay with it through put() and are cleared by
+     * del().
+     */
+    uint16_t get_tag(RecordID record_id) const;
+
+    void set_tag(RecordID record_id, uint16_t tag);
+
     virtual RecordIDs *ids(void) const;
 
+    virtual RecordIDCursor *id_cursor(void) const;
+
+    /**
+     * Total bytes available for new records once any holes are compacted away (including header space).
+     * @returns  free bytes in the block
+     */
+    uint16_t free_space() const;
+
 protected:
-    uint16_t num_records;
-    uint16_t end_free;
+    uint16_t get_num_records() const { return get_n(0); }
+
+    uint16_t get_end_free() const { return get_n(2); }
 
     void get_header(uint16_t &size, uint16_t &loc, RecordID id = 0) const;
 
-    void put_header(RecordID id = 0, uint16_t size = 0, uint16_t loc = 0);
+    void put_header(RecordID id, uint16_t size, uint16_t loc);
 
     bool has_room(uint16_t size) const;
 
-    virtual void slide(uint16_t start, uint16_t end);
+    bool make_room(uint16_t size);
+
+    void release(uint16_t loc, uint16_t size);
+
+    virtual void compact();
 
     uint16_t get_n(uint16_t offset) const;
 
@@ -61,7 +118,10 @@ protected:
     void *address(uint16_t offset) const;
 
     friend bool test_slotted_page();
+
+    friend class SlottedPageCursor;
 };
 
 bool assertion_failure(std::string message, double x = -1, double y = -1);
 bool test_slotted_page();
+void benchmark_slotted_page();
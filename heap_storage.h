@@ -1,8 +1,11 @@
 /**
  * @file heap_storage.h - Implementation of storage_engine with a heap file structure.
  * SlottedPage: DbBlock
- * HeapFile: DbFile
+ * SlottedPageFile: DbFile
+ * HeapFile: SlottedPageFile
+ * MmapHeapFile: SlottedPageFile
  * HeapTable: DbRelation
+ * CsvReader
  *
  * @author Kevin Lundeen
  * @see "Seattle University, CPSC5300, Spring 2021"
@@ -10,4 +13,6 @@
 #pragma once
 #include "SlottedPage.h"
 #include "HeapFile.h"
+#include "MmapHeapFile.h"
 #include "HeapTable.h"
+#include "CsvReader.h"
@@ -3,6 +3,12 @@
  * @author Kevin Lundeen
  * @see "Seattle University, CPSC5300, Spring 2021"
  */
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "schema_tables.h"
 #include "ParseTreeToString.h"
 
@@ -10,14 +16,18 @@
 void initialize_schema_tables() {
     Tables tables;
     tables.create_if_not_exists();
-    tables.close();
     Columns columns;
     columns.create_if_not_exists();
-    columns.close();
     Indices indices;
     indices.create_if_not_exists();
+    Catalog::open(tables, columns, indices);
+    Statistics statistics;
+    statistics.create_if_not_exists();
+    Catalog::save_snapshot();  // in case _statistics was just added to the schema
+    tables.close();
+    columns.close();
     indices.close();
-
+    statistics.close();
 }
 
 // Not terribly useful since the parser weeds most of these out
@@ -41,20 +51,594 @@ bool is_acceptable_data_type(std::string dt) {
 }
 
 
+/*
+ * ****************************
+ * Catalog class implementation
+ * ****************************
+ */
+const char *const Catalog::SNAPSHOT_NAME = "_catalog.snapshot";
+const char *const Catalog::STAMP_NAME = "_schema.stamp";
+uint64_t Catalog::version = 0;
+bool Catalog::snapshot_on_disk = true;  // until we know better, assume there's one that changes would make stale
+bool Catalog::tables_loaded = false;
+bool Catalog::columns_loaded = false;
+bool Catalog::indices_loaded = false;
+bool Catalog::statistics_loaded = false;
+std::unordered_map<Identifier, Handle> Catalog::tables;
+std::unordered_set<Identifier> Catalog::memory_mapped_tables;
+std::unordered_map<Identifier, CatalogColumns> Catalog::columns;
+std::unordered_map<Identifier, CatalogIndices> Catalog::indices;
+std::unordered_map<Identifier, CatalogStatistics> Catalog::statistics;
+
+void Catalog::reset() {
+    Catalog::tables.clear();
+    Catalog::memory_mapped_tables.clear();
+    Catalog::columns.clear();
+    Catalog::indices.clear();
+    Catalog::statistics.clear();
+    Catalog::tables_loaded = Catalog::columns_loaded = Catalog::indices_loaded = Catalog::statistics_loaded = false;
+    Catalog::version++;
+}
+
+bool Catalog::has_table(Identifier table_name, Handle *handle) {
+    if (!Catalog::tables_loaded)
+        load_tables();
+    auto found = Catalog::tables.find(table_name);
+    if (found == Catalog::tables.end())
+        return false;
+    if (handle != nullptr)
+        *handle = found->second;
+    return true;
+}
+
+bool Catalog::is_memory_mapped(Identifier table_name) {
+    if (!Catalog::tables_loaded)
+        load_tables();
+    return Catalog::memory_mapped_tables.find(table_name) != Catalog::memory_mapped_tables.end();
+}
+
+IndexNames Catalog::get_table_names() {
+    if (!Catalog::tables_loaded)
+        load_tables();
+    IndexNames table_names;
+    for (auto const &table: Catalog::tables)
+        table_names.push_back(table.first);
+    std::sort(table_names.begin(), table_names.end());
+    return table_names;
+}
+
+const CatalogColumns &Catalog::get_columns(Identifier table_name) {
+    static const CatalogColumns none;
+    if (!Catalog::columns_loaded)
+        load_columns();
+    auto found = Catalog::columns.find(table_name);
+    return found == Catalog::columns.end() ? none : found->second;
+}
+
+const CatalogIndices &Catalog::get_indices(Identifier table_name) {
+    static const CatalogIndices none;
+    if (!Catalog::indices_loaded)
+        load_indices();
+    auto found = Catalog::indices.find(table_name);
+    return found == Catalog::indices.end() ? none : found->second;
+}
+
+const CatalogIndex *Catalog::get_index(Identifier table_name, Identifier index_name) {
+    const CatalogIndices &table_indices = get_indices(table_name);
+    auto found = table_indices.indices.find(index_name);
+    return found == table_indices.indices.end() ? nullptr : &found->second;
+}
+
+const TableStatistics &Catalog::get_statistics(Identifier table_name) {
+    static const TableStatistics none;
+    if (!Catalog::statistics_loaded)
+        load_statistics();
+    auto found = Catalog::statistics.find(table_name);
+    return found == Catalog::statistics.end() ? none : found->second.statistics;
+}
+
+// Read all of _tables
+void Catalog::load_tables(DbRelation *tables) {
+    if (tables == nullptr) {
+        auto found = Tables::table_cache.find(Tables::TABLE_NAME);
+        if (found == Tables::table_cache.end())
+            throw DbRelationError("schema tables are not open");
+        tables = found->second;
+    }
+    Catalog::tables.clear();
+    Catalog::memory_mapped_tables.clear();
+    Catalog::tables_loaded = true;
+    HandleCursor *cursor = tables->select_cursor();
+    Handle handle;
+    while (cursor->next(handle)) {
+        ValueDict *row = tables->project(handle);
+        cache_table(row, handle);
+        delete row;
+    }
+    delete cursor;
+}
+
+// Read all of _columns
+void Catalog::load_columns(DbRelation *columns) {
+    if (columns == nullptr)
+        columns = Tables::columns_table;
+    if (columns == nullptr)
+        throw DbRelationError("schema tables are not open");
+    Catalog::columns.clear();
+    Catalog::columns_loaded = true;
+    HandleCursor *cursor = columns->select_cursor();
+    Handle handle;
+    while (cursor->next(handle)) {
+        ValueDict *row = columns->project(handle);
+        cache_column(row, handle);
+        delete row;
+    }
+    delete cursor;
+}
+
+// Read all of _indices (if there's no Indices object open yet, there's nobody who could want them)
+void Catalog::load_indices(DbRelation *indices) {
+    if (indices == nullptr) {
+        auto found = Tables::table_cache.find(Indices::TABLE_NAME);
+        if (found == Tables::table_cache.end())
+            return;
+        indices = found->second;
+    }
+    Catalog::indices.clear();
+    Catalog::indices_loaded = true;
+    HandleCursor *cursor = indices->select_cursor();
+    Handle handle;
+    while (cursor->next(handle)) {
+        ValueDict *row = indices->project(handle);
+        cache_index_column(row, handle);
+        delete row;
+    }
+    delete cursor;
+}
+
+// Read all of _statistics (if there's no Statistics object open, there's nothing to read it through yet)
+void Catalog::load_statistics(DbRelation *statistics) {
+    if (statistics == nullptr) {
+        auto found = Tables::table_cache.find(Statistics::TABLE_NAME);
+        if (found == Tables::table_cache.end())
+            return;
+        statistics = found->second;
+    }
+    Catalog::statistics.clear();
+    Catalog::statistics_loaded = true;
+    HandleCursor *cursor = statistics->select_cursor();
+    Handle handle;
+    while (cursor->next(handle)) {
+        ValueDict *row = statistics->project(handle);
+        cache_column_statistics(row, handle);
+        delete row;
+    }
+    delete cursor;
+}
+
+// Get rid of the snapshot, which is about to stop matching the schema tables
+void Catalog::invalidate_snapshot() {
+    if (Catalog::snapshot_on_disk) {
+        unlink(snapshot_path().c_str());
+        Catalog::snapshot_on_disk = false;
+    }
+}
+
+// Note a change to the schema
+void Catalog::changed() {
+    invalidate_snapshot();
+    Catalog::version++;
+}
+
+void Catalog::add_table(const ValueDict *row, Handle handle) {
+    if (!Catalog::tables_loaded)
+        load_tables();
+    cache_table(row, handle);
+    changed();
+}
+
+void Catalog::remove_table(const ValueDict *row) {
+    if (!Catalog::tables_loaded)
+        load_tables();
+    Catalog::tables.erase(row->at("table_name").s);
+    Catalog::memory_mapped_tables.erase(row->at("table_name").s);
+    changed();
+}
+
+void Catalog::add_column(const ValueDict *row, Handle handle) {
+    if (!Catalog::columns_loaded)
+        load_columns();
+    cache_column(row, handle);
+    changed();
+}
+
+void Catalog::remove_column(const ValueDict *row, Handle handle) {
+    if (!Catalog::columns_loaded)
+        load_columns();
+    auto found = Catalog::columns.find(row->at("table_name").s);
+    if (found == Catalog::columns.end())
+        return;
+    CatalogColumns &table_columns = found->second;
+    for (uint i = 0; i < table_columns.handles.size(); i++) {
+        if (table_columns.handles[i] == handle) {
+            table_columns.column_names.erase(table_columns.column_names.begin() + i);
+            table_columns.column_attributes.erase(table_columns.column_attributes.begin() + i);
+            table_columns.handles.erase(table_columns.handles.begin() + i);
+            break;
+        }
+    }
+    if (table_columns.handles.empty())
+        Catalog::columns.erase(found);
+    changed();
+}
+
+void Catalog::add_index_column(const ValueDict *row, Handle handle) {
+    if (!Catalog::indices_loaded)
+        load_indices();
+    cache_index_column(row, handle);
+    changed();
+}
+
+// An index's rows are only ever deleted all together, so it goes from the catalog once the last one does
+void Catalog::remove_index_column(const ValueDict *row, Handle handle) {
+    if (!Catalog::indices_loaded)
+        load_indices();
+    auto found = Catalog::indices.find(row->at("table_name").s);
+    if (found == Catalog::indices.end())
+        return;
+    CatalogIndices &table_indices = found->second;
+    Identifier index_name = row->at("index_name").s;
+    auto index = table_indices.indices.find(index_name);
+    if (index == table_indices.indices.end())
+        return;
+    Handles &handles = index->second.handles;
+    handles.erase(std::remove(handles.begin(), handles.end(), handle), handles.end());
+    if (handles.empty()) {
+        table_indices.indices.erase(index);
+        table_indices.index_names.erase(
+                std::find(table_indices.index_names.begin(), table_indices.index_names.end(), index_name));
+        if (table_indices.index_names.empty())
+            Catalog::indices.erase(found);
+    }
+    changed();
+}
+
+void Catalog::cache_table(const ValueDict *row, Handle handle) {
+    Catalog::tables[row->at("table_name").s] = handle;
+    if (row->at("storage").s == Tables::MMAP)
+        Catalog::memory_mapped_tables.insert(row->at("table_name").s);
+}
+
+void Catalog::cache_column(const ValueDict *row, Handle handle) {
+    ColumnAttribute::DataType data_type;
+    const std::string &type_name = row->at("data_type").s;
+    if (type_name == "INT")
+        data_type = ColumnAttribute::INT;
+    else if (type_name == "TEXT")
+        data_type = ColumnAttribute::TEXT;
+    else if (type_name == "BOOLEAN")
+        data_type = ColumnAttribute::BOOLEAN;
+    else
+        throw DbRelationError("Unknown data type");
+    CatalogColumns &table_columns = Catalog::columns[row->at("table_name").s];
+    table_columns.column_names.push_back(row->at("column_name").s);
+    table_columns.column_attributes.push_back(ColumnAttribute(data_type));
+    table_columns.handles.push_back(handle);
+}
+
+void Catalog::cache_index_column(const ValueDict *row, Handle handle) {
+    CatalogIndices &table_indices = Catalog::indices[row->at("table_name").s];
+    Identifier index_name = row->at("index_name").s;
+    if (table_indices.indices.find(index_name) == table_indices.indices.end())
+        table_indices.index_names.push_back(index_name);
+    CatalogIndex &index = table_indices.indices[index_name];
+    uint seq = (uint) row->at("seq_in_index").n;  // 1-based
+    if (index.column_names.size() < seq)
+        index.column_names.resize(seq);
+    index.column_names[seq - 1] = row->at("column_name").s;
+    index.is_hash = row->at("index_type").s == "HASH";
+    index.is_unique = row->at("is_unique").n != 0;
+    index.handles.push_back(handle);
+}
+
+// The values are decoded as the column's type, so a row for a column the table doesn't have (any more) is ignored.
+void Catalog::cache_column_statistics(const ValueDict *row, Handle handle) {
+    const Identifier &table_name = row->at("table_name").s, &column_name = row->at("column_name").s;
+    const CatalogColumns &table_columns = get_columns(table_name);
+    auto found = std::find(table_columns.column_names.begin(), table_columns.column_names.end(), column_name);
+    if (found == table_columns.column_names.end())
+        return;
+    ColumnAttribute::DataType data_type =
+            table_columns.column_attributes[found - table_columns.column_names.begin()].get_data_type();
+    CatalogStatistics &table_statistics = Catalog::statistics[table_name];
+    TableStatistics &statistics = table_statistics.statistics;
+    statistics.analyzed = true;
+    statistics.row_count = (u_long) row->at("row_count").n;
+    statistics.block_count = (u_long) row->at("block_count").n;
+    ColumnStatistics &column = statistics.columns[column_name];
+    column.data_type = data_type;
+    column.distinct_count = (u_long) row->at("distinct_count").n;
+    column.histogram = Statistics::histogram_from_text(row->at("histogram").s, data_type);
+    if (!column.histogram.empty()) {
+        column.min = Statistics::from_text(row->at("min_value").s, data_type);
+        column.max = Statistics::from_text(row->at("max_value").s, data_type);
+    }
+    table_statistics.handles.push_back(handle);
+}
+
+std::string Catalog::snapshot_path() {
+    const char *home;
+    _DB_ENV->get_home(&home);
+    return std::string(home) + "/" + SNAPSHOT_NAME;
+}
+
+std::string Catalog::stamp_path() {
+    const char *home;
+    _DB_ENV->get_home(&home);
+    return std::string(home) + "/" + STAMP_NAME;
+}
+
+// Write a whole file via a temporary file and a rename, so a crash part way through leaves the old one (or none)
+bool Catalog::write_file(const std::string &path, const std::string &bytes) {
+    std::string temp_path = path + ".tmp";
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    bool ok = write(fd, bytes.data(), bytes.size()) == (ssize_t) bytes.size();
+    ok = fsync(fd) == 0 && ok;
+    ::close(fd);
+    if (!ok || rename(temp_path.c_str(), path.c_str()) != 0) {
+        unlink(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Catalog::stamp_schema() {
+    return write_file(stamp_path(), std::string((const char *) &Catalog::version, sizeof(Catalog::version)));
+}
+
+// The version the schema tables were last stamped with; false if they never were
+bool Catalog::read_stamp(uint64_t &stamp) {
+    int fd = ::open(stamp_path().c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    bool ok = read(fd, &stamp, sizeof(stamp)) == (ssize_t) sizeof(stamp);
+    ::close(fd);
+    return ok;
+}
+
+/**
+ * @class SnapshotWriter - appends the fields of a catalog snapshot to a buffer
+ */
+class SnapshotWriter {
+public:
+    std::string bytes;
+
+    void put_u8(uint8_t n) { this->bytes.push_back((char) n); }
+
+    void put_u32(uint32_t n) { this->bytes.append((const char *) &n, sizeof(n)); }
+
+    void put_u64(uint64_t n) { this->bytes.append((const char *) &n, sizeof(n)); }
+
+    void put_string(const std::string &s) {
+        put_u32((uint32_t) s.length());
+        this->bytes.append(s);
+    }
+
+    void put_handle(Handle handle) {
+        put_u32(handle.first);
+        put_u32(handle.second);
+    }
+};
+
+/**
+ * @class SnapshotReader - takes the fields of a catalog snapshot back out of a buffer
+ * @throws std::out_of_range if the snapshot is cut short
+ */
+class SnapshotReader {
+public:
+    SnapshotReader(const char *bytes, size_t size) : bytes(bytes), size(size), offset(0) {}
+
+    uint8_t get_u8() { return (uint8_t) *take(1); }
+
+    uint32_t get_u32() { return *(const uint32_t *) take(sizeof(uint32_t)); }
+
+    uint64_t get_u64() { return *(const uint64_t *) take(sizeof(uint64_t)); }
+
+    std::string get_string() {
+        uint32_t length = get_u32();
+        return std::string(take(length), length);
+    }
+
+    Handle get_handle() {
+        BlockID block_id = get_u32();
+        RecordID record_id = (RecordID) get_u32();
+        return Handle(block_id, record_id);
+    }
+
+    bool at_end() const { return this->offset == this->size; }
+
+protected:
+    const char *bytes;
+    size_t size;
+    size_t offset;
+
+    const char *take(size_t n) {
+        if (n > this->size - this->offset)
+            throw std::out_of_range("catalog snapshot is cut short");
+        const char *at = this->bytes + this->offset;
+        this->offset += n;
+        return at;
+    }
+};
+
+/**
+ * Write the whole catalog to the snapshot file (via a temporary file and a rename, so a crash part way through
+ * leaves no snapshot rather than a broken one). The schema tables are flushed and stamped with the version first:
+ * a crash before the snapshot is written leaves the stamp ahead of any older snapshot, which then isn't used.
+ * Layout: magic, format, version, then the tables (with whether each is memory-mapped), the columns of each table,
+ * and the indices of each table, each as a count followed by that many entries.
+ * @returns  false if the schema tables aren't open or the stamp or the snapshot couldn't be written
+ */
+bool Catalog::save_snapshot() {
+    if (Catalog::snapshot_on_disk)
+        return true;
+    if (!Catalog::tables_loaded)
+        load_tables();
+    if (!Catalog::columns_loaded)
+        load_columns();
+    if (!Catalog::indices_loaded)
+        load_indices();
+    if (!Catalog::indices_loaded)
+        return false;  // no Indices open to read _indices through
+    _BUFFER_POOL->flush_all();
+    if (!stamp_schema())
+        return false;
+    SnapshotWriter out;
+    out.put_u32(SNAPSHOT_MAGIC);
+    out.put_u32(SNAPSHOT_FORMAT);
+    out.put_u64(Catalog::version);
+    out.put_u32((uint32_t) Catalog::tables.size());
+    for (auto const &table: Catalog::tables) {
+        out.put_string(table.first);
+        out.put_handle(table.second);
+        out.put_u8(Catalog::memory_mapped_tables.find(table.first) != Catalog::memory_mapped_tables.end());
+    }
+    out.put_u32((uint32_t) Catalog::columns.size());
+    for (auto const &table: Catalog::columns) {
+        out.put_string(table.first);
+        out.put_u32((uint32_t) table.second.column_names.size());
+        for (uint i = 0; i < table.second.column_names.size(); i++) {
+            out.put_string(table.second.column_names[i]);
+            out.put_u8((uint8_t) table.second.column_attributes[i].get_data_type());
+            out.put_handle(table.second.handles[i]);
+        }
+    }
+    out.put_u32((uint32_t) Catalog::indices.size());
+    for (auto const &table: Catalog::indices) {
+        out.put_string(table.first);
+        out.put_u32((uint32_t) table.second.index_names.size());
+        for (auto const &index_name: table.second.index_names) {
+            const CatalogIndex &index = table.second.indices.at(index_name);
+            out.put_string(index_name);
+            out.put_u8(index.is_hash);
+            out.put_u8(index.is_unique);
+            out.put_u32((uint32_t) index.column_names.size());
+            for (auto const &column_name: index.column_names)
+                out.put_string(column_name);
+            out.put_u32((uint32_t) index.handles.size());
+            for (auto const &handle: index.handles)
+                out.put_handle(handle);
+        }
+    }
+
+    if (!write_file(snapshot_path(), out.bytes))
+        return false;
+    Catalog::snapshot_on_disk = true;
+    return true;
+}
+
+/**
+ * Replace the catalog with the contents of the snapshot file, read in one go.
+ * @returns  false (leaving the catalog empty) if there's no snapshot, it isn't one we can use, or it isn't of the
+ *           version the schema tables are stamped with
+ */
+bool Catalog::load_snapshot() {
+    std::string path = snapshot_path();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat file_stat;
+    std::vector<char> bytes;
+    bool ok = fstat(fd, &file_stat) == 0;
+    if (ok) {
+        bytes.resize((size_t) file_stat.st_size);
+        ok = read(fd, bytes.data(), bytes.size()) == (ssize_t) bytes.size();
+    }
+    ::close(fd);
+
+    reset();
+    try {
+        SnapshotReader in(bytes.data(), bytes.size());
+        if (!ok || in.get_u32() != SNAPSHOT_MAGIC || in.get_u32() != SNAPSHOT_FORMAT)
+            return false;
+        uint64_t snapshot_version = in.get_u64(), stamp;
+        if (!read_stamp(stamp) || stamp != snapshot_version)
+            return false;  // the schema tables have moved on (or back) since the snapshot was taken
+        for (uint32_t n = in.get_u32(); n > 0; n--) {
+            Identifier table_name = in.get_string();
+            Catalog::tables[table_name] = in.get_handle();
+            if (in.get_u8() != 0)
+                Catalog::memory_mapped_tables.insert(table_name);
+        }
+        for (uint32_t n = in.get_u32(); n > 0; n--) {
+            CatalogColumns &table_columns = Catalog::columns[in.get_string()];
+            for (uint32_t c = in.get_u32(); c > 0; c--) {
+                table_columns.column_names.push_back(in.get_string());
+                table_columns.column_attributes.push_back(ColumnAttribute((ColumnAttribute::DataType) in.get_u8()));
+                table_columns.handles.push_back(in.get_handle());
+            }
+        }
+        for (uint32_t n = in.get_u32(); n > 0; n--) {
+            CatalogIndices &table_indices = Catalog::indices[in.get_string()];
+            for (uint32_t i = in.get_u32(); i > 0; i--) {
+                Identifier index_name = in.get_string();
+                table_indices.index_names.push_back(index_name);
+                CatalogIndex &index = table_indices.indices[index_name];
+                index.is_hash = in.get_u8() != 0;
+                index.is_unique = in.get_u8() != 0;
+                for (uint32_t c = in.get_u32(); c > 0; c--)
+                    index.column_names.push_back(in.get_string());
+                for (uint32_t h = in.get_u32(); h > 0; h--)
+                    index.handles.push_back(in.get_handle());
+            }
+        }
+        if (!in.at_end()) {
+            reset();
+            return false;
+        }
+        Catalog::version = snapshot_version;
+    } catch (std::out_of_range &e) {
+        reset();
+        return false;
+    }
+    Catalog::tables_loaded = Catalog::columns_loaded = Catalog::indices_loaded = true;
+    Catalog::snapshot_on_disk = true;
+    return true;
+}
+
+void Catalog::open(DbRelation &tables, DbRelation &columns, DbRelation &indices) {
+    if (load_snapshot())
+        return;
+    uint64_t stamp;
+    if (read_stamp(stamp) && Catalog::version <= stamp)
+        Catalog::version = stamp + 1;  // never reuse a version a leftover snapshot could have
+    load_tables(&tables);
+    load_columns(&columns);
+    load_indices(&indices);
+    save_snapshot();
+}
+
+
 /*
  * ***************************
  * Tables class implementation
  * ***************************
  */
 const Identifier Tables::TABLE_NAME = "_tables";
+const Identifier Tables::BERKELEY_DB = "BERKELEY_DB";
+const Identifier Tables::MMAP = "MMAP";
 Columns *Tables::columns_table = nullptr;
 std::map<Identifier, DbRelation *> Tables::table_cache;
 
 // get the column name for _tables column
 ColumnNames &Tables::COLUMN_NAMES() {
     static ColumnNames cn;
-    if (cn.empty())
+    if (cn.empty()) {
         cn.push_back("table_name");
+        cn.push_back("storage");
+    }
     return cn;
 }
 
@@ -64,22 +648,32 @@ ColumnAttributes &Tables::COLUMN_ATTRIBUTES() {
     if (cas.empty()) {
         ColumnAttribute ca(ColumnAttribute::TEXT);
         cas.push_back(ca);
+        cas.push_back(ca);
     }
     return cas;
 }
 
-// ctor - we have a fixed table structure of just one column: table_name
+// ctor - we have a fixed table structure of two columns: table_name and storage
+// (the first one constructed is the one get_table() hands out until it goes away)
 Tables::Tables() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES()) {
-    Tables::table_cache[TABLE_NAME] = this;
+    if (Tables::table_cache.find(TABLE_NAME) == Tables::table_cache.end())
+        Tables::table_cache[TABLE_NAME] = this;
     if (Tables::columns_table == nullptr)
         columns_table = new Columns();
     Tables::table_cache[columns_table->TABLE_NAME] = columns_table;
 }
 
+// dtor - don't leave ourselves behind in the table cache
+Tables::~Tables() {
+    if (Tables::table_cache.find(TABLE_NAME) != Tables::table_cache.end() && Tables::table_cache[TABLE_NAME] == this)
+        Tables::table_cache.erase(TABLE_NAME);
+}
+
 // Create the file and also, manually add schema tables.
 void Tables::create() {
     HeapTable::create();
     ValueDict row;
+    row["storage"] = Value(BERKELEY_DB);  // the schema tables are all in Berkeley DB
     row["table_name"] = Value("_tables");
     insert(&row);
     row["table_name"] = Value("_columns");
@@ -88,15 +682,21 @@ void Tables::create() {
     insert(&row);
 }
 
-// Manually check that table_name is unique.
+// Manually check that table_name is unique, and that storage (BERKELEY_DB if not given) is one we have.
 Handle Tables::insert(const ValueDict *row) {
-    // Try SELECT * FROM _tables WHERE table_name = row["table_name"] and it should return nothing
-    Handles *handles = select(row);
-    bool unique = handles->empty();
-    delete handles;
-    if (!unique)
+    if (!Catalog::tables_loaded)
+        Catalog::load_tables(this);
+    if (Catalog::has_table(row->at("table_name").s))
         throw DbRelationError(row->at("table_name").s + " already exists");
-    return HeapTable::insert(row);
+    ValueDict full_row = *row;
+    if (full_row.find("storage") == full_row.end())
+        full_row["storage"] = Value(BERKELEY_DB);
+    if (full_row["storage"].s != BERKELEY_DB && full_row["storage"].s != MMAP)
+        throw DbRelationError("unknown storage " + full_row["storage"].s);
+    Catalog::invalidate_snapshot();  // before the schema table changes, so a crash can't leave a stale one
+    Handle handle = HeapTable::insert(&full_row);
+    Catalog::add_table(&full_row, handle);
+    return handle;
 }
 
 // Remove a row, but first remove from table cache if there
@@ -105,6 +705,9 @@ void Tables::del(Handle handle) {
     // remove from cache, if there
     ValueDict *row = project(handle);
     Identifier table_name = row->at("table_name").s;
+    if (!Catalog::tables_loaded)
+        Catalog::load_tables(this);
+    Catalog::remove_table(row);
     delete row;
     if (Tables::table_cache.find(table_name) != Tables::table_cache.end()) {
         DbRelation *table = Tables::table_cache.at(table_name);
@@ -117,35 +720,10 @@ void Tables::del(Handle handle) {
 
 // Return a list of column names and column attributes for given table.
 void Tables::get_columns(Identifier table_name, ColumnNames &column_names, ColumnAttributes &column_attributes) {
-    // SELECT * FROM _columns WHERE table_name = <table_name>
-    ValueDict where;
-    where["table_name"] = table_name;
-    Handles *handles = Tables::columns_table->select(&where);
-
-    ColumnAttribute column_attribute;
-    for (auto const &handle: *handles) {
-        ValueDict *row = Tables::columns_table->project(
-                handle);  // get the row's values: {'column_name': <name>, 'data_type': <type>}
-
-        Identifier column_name = (*row)["column_name"].s;
-        column_names.push_back(column_name);
-
-        ColumnAttribute::DataType data_type;
-        if ((*row)["data_type"].s == "INT")
-            data_type = ColumnAttribute::INT;
-        else if ((*row)["data_type"].s == "TEXT")
-            data_type = ColumnAttribute::TEXT;
-        else if ((*row)["data_type"].s == "BOOLEAN")
-            data_type = ColumnAttribute::BOOLEAN;
-        else
-            throw DbRelationError("Unknown data type");
-        column_attribute.set_data_type(data_type);
-
-        column_attributes.push_back(column_attribute);
-
-        delete row;
-    }
-    delete handles;
+    const CatalogColumns &table_columns = Catalog::get_columns(table_name);
+    column_names.insert(column_names.end(), table_columns.column_names.begin(), table_columns.column_names.end());
+    column_attributes.insert(column_attributes.end(), table_columns.column_attributes.begin(),
+                             table_columns.column_attributes.end());
 }
 
 // Return a table for given table_name.
@@ -154,12 +732,20 @@ DbRelation &Tables::get_table(Identifier table_name) {
     if (Tables::table_cache.find(table_name) != Tables::table_cache.end())
         return *Tables::table_cache[table_name];
 
-    // otherwise assume it is a HeapTable (for now)
+    // otherwise assume it is a HeapTable (for now), in the storage its _tables row asks for
     ColumnNames column_names;
     ColumnAttributes column_attributes;
     get_columns(table_name, column_names, column_attributes);
-    DbRelation *table = new HeapTable(table_name, column_names, column_attributes);
+    DbRelation *table = new HeapTable(table_name, column_names, column_attributes,
+                                      Catalog::is_memory_mapped(table_name));
     Tables::table_cache[table_name] = table;
+
+    // bring in its indices, too, so they are kept up to date from the start
+    if (Tables::table_cache.find(Indices::TABLE_NAME) != Tables::table_cache.end()) {
+        Indices *indices = (Indices *) Tables::table_cache[Indices::TABLE_NAME];
+        for (auto const &index_name: indices->get_index_names(table_name))
+            indices->get_index(table_name, index_name);
+    }
     return *table;
 }
 
@@ -206,6 +792,8 @@ void Columns::create() {
     row["table_name"] = Value("_tables");
     row["column_name"] = Value("table_name");
     insert(&row);
+    row["column_name"] = Value("storage");
+    insert(&row);
     row["table_name"] = Value("_columns");
     row["column_name"] = Value("table_name");
     insert(&row);
@@ -241,18 +829,26 @@ Handle Columns::insert(const ValueDict *row) {
     if (!is_acceptable_data_type(row->at("data_type").s))
         throw DbRelationError("unacceptable data type '" + row->at("data_type").s + "'");
 
-    // Try SELECT * FROM _columns WHERE table_name = row["table_name"] AND column_name = column_name["column_name"]
-    // and it should return nothing
-    ValueDict where;
-    where["table_name"] = row->at("table_name");
-    where["column_name"] = row->at("column_name");
-    Handles *handles = select(&where);
-    bool unique = handles->empty();
-    delete handles;
-    if (!unique)
+    if (!Catalog::columns_loaded)
+        Catalog::load_columns(this);
+    const ColumnNames &column_names = Catalog::get_columns(row->at("table_name").s).column_names;
+    if (std::find(column_names.begin(), column_names.end(), row->at("column_name").s) != column_names.end())
         throw DbRelationError("duplicate column " + row->at("table_name").s + "." + row->at("column_name").s);
 
-    return HeapTable::insert(row);
+    Catalog::invalidate_snapshot();
+    Handle handle = HeapTable::insert(row);
+    Catalog::add_column(row, handle);
+    return handle;
+}
+
+// Remove a row, keeping the catalog in step.
+void Columns::del(Handle handle) {
+    ValueDict *row = project(handle);
+    if (!Catalog::columns_loaded)
+        Catalog::load_columns(this);
+    Catalog::remove_column(row, handle);
+    delete row;
+    HeapTable::del(handle);
 }
 
 
@@ -296,8 +892,16 @@ ColumnAttributes &Indices::COLUMN_ATTRIBUTES() {
     return cas;
 }
 
-// ctor - we have a fixed table structure
+// ctor - we have a fixed table structure (the first one constructed is the one get_table() hands out)
 Indices::Indices() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES()) {
+    if (Tables::table_cache.find(TABLE_NAME) == Tables::table_cache.end())
+        Tables::table_cache[TABLE_NAME] = this;
+}
+
+// dtor - don't leave ourselves behind in the table cache
+Indices::~Indices() {
+    if (Tables::table_cache.find(TABLE_NAME) != Tables::table_cache.end() && Tables::table_cache[TABLE_NAME] == this)
+        Tables::table_cache.erase(TABLE_NAME);
 }
 
 // Manually check constraints -- unique on (table, index, column)
@@ -306,20 +910,20 @@ Handle Indices::insert(const ValueDict *row) {
     if (!is_acceptable_identifier(row->at("index_name").s))
         throw DbRelationError("unacceptable index name '" + row->at("index_name").s + "'");
 
-    // Try SELECT * FROM _indices WHERE table_name = row["table_name"] AND index_name = row["index_name"]
-    //     AND column_name = column_name["column_name"]
-    // and it should return nothing
-    ValueDict where;
-    where["table_name"] = row->at("table_name");
-    where["index_name"] = row->at("index_name");
-    if (row->at("seq_in_index").n > 1)
-        where["column_name"] = row->at("column_name");  // check for duplicate columns on the same index
-    Handles *handles = select(&where);
-    bool unique = handles->empty();
-    delete handles;
+    // the first column of an index must be for a new index; later ones must not repeat a column of the index
+    if (!Catalog::indices_loaded)
+        Catalog::load_indices(this);
+    const CatalogIndex *index = Catalog::get_index(row->at("table_name").s, row->at("index_name").s);
+    bool unique = index == nullptr;
+    if (index != nullptr && row->at("seq_in_index").n > 1)
+        unique = std::find(index->column_names.begin(), index->column_names.end(), row->at("column_name").s) ==
+                 index->column_names.end();
     if (!unique)
         throw DbRelationError("duplicate index " + row->at("table_name").s + " " + row->at("index_name").s);
-    return HeapTable::insert(row);
+    Catalog::invalidate_snapshot();
+    Handle handle = HeapTable::insert(row);
+    Catalog::add_index_column(row, handle);
+    return handle;
 }
 
 // Remove a row, but first remove from index cache if there
@@ -333,60 +937,29 @@ void Indices::del(Handle handle) {
     if (Indices::index_cache.find(cache_key) != Indices::index_cache.end()) {
         DbIndex *index = Indices::index_cache.at(cache_key);
         Indices::index_cache.erase(cache_key);
+        Tables::get_table(table_name).detach_index(index);
         delete index;
     }
+    if (!Catalog::indices_loaded)
+        Catalog::load_indices(this);
+    Catalog::remove_index_column(row, handle);
+    delete row;
     HeapTable::del(handle);
 }
 
 // Return a list of column names and column attributes for given table.
 void Indices::get_columns(Identifier table_name, Identifier index_name, ColumnNames &column_names, bool &is_hash,
                           bool &is_unique) {
-    // SELECT * FROM _indices WHERE table_name = <table_name> AND index_name = <index_name>
-    ValueDict where;
-    where["table_name"] = table_name;
-    where["index_name"] = index_name;
-    Handles *handles = select(&where);
-
-    Identifier colnames[DbIndex::MAX_COMPOSITE];
-    uint size = 0;
-    for (auto const &handle: *handles) {
-        ValueDict *row = project(handle);
-
-        Identifier column_name = (*row)["column_name"].s;
-        uint which = (uint) (*row)["seq_in_index"].n;
-        colnames[which - 1] = column_name;  // seq_in_index is 1-based
-        if (which > size)
-            size = which;
-        is_unique = (*row)["is_unique"].n != 0;
-        is_hash = (*row)["index_type"].s == "HASH";
-        delete row;
-    }
-    for (uint i = 0; i < size; i++)
-        column_names.push_back(colnames[i]);
-    delete handles;
+    if (!Catalog::indices_loaded)
+        Catalog::load_indices(this);
+    const CatalogIndex *index = Catalog::get_index(table_name, index_name);
+    if (index == nullptr)
+        return;
+    column_names.insert(column_names.end(), index->column_names.begin(), index->column_names.end());
+    is_hash = index->is_hash;
+    is_unique = index->is_unique;
 }
 
-// FIXME - use this for now until we have BTreeIndex and HashIndex
-class DummyIndex : public DbIndex {
-public:
-    DummyIndex(DbRelation &rel, Identifier idx, ColumnNames key, bool unq) : DbIndex(rel, idx, key, unq) {}
-
-    void create() {}
-
-    void drop() {}
-
-    void open() {}
-
-    void close() {}
-
-    Handles *lookup(ValueDict *key_values) const { return nullptr; }
-
-    void insert(Handle handle) {}
-
-    void del(Handle handle) {}
-};
-
-
 // Return a table for given table_name.
 DbIndex &Indices::get_index(Identifier table_name, Identifier index_name) {
     // if they are asking about an index we've once constructed, then just return that one
@@ -394,32 +967,374 @@ DbIndex &Indices::get_index(Identifier table_name, Identifier index_name) {
     if (Indices::index_cache.find(cache_key) != Indices::index_cache.end())
         return *Indices::index_cache[cache_key];
 
-    // otherwise assume it is a DummyIndex (for now)
+    // getting the table may have brought in its indices (including this one)
+    DbRelation &table = Tables::get_table(table_name);
+    if (Indices::index_cache.find(cache_key) != Indices::index_cache.end())
+        return *Indices::index_cache[cache_key];
+
     ColumnNames column_names;
-    bool is_hash, is_unique;
+    bool is_hash = false, is_unique = false;
     get_columns(table_name, index_name, column_names, is_hash, is_unique);
-    DbRelation &table = Tables::get_table(table_name);
+    if (column_names.empty())
+        throw DbRelationError("no index " + index_name + " on " + table_name);
     DbIndex *index;
     if (is_hash) {
-        index = new DummyIndex(table, index_name, column_names, is_unique);  // FIXME - change to HashIndex
+        index = new HashIndex(table, index_name, column_names, is_unique);
     } else {
-        index = new DummyIndex(table, index_name, column_names, is_unique);  // FIXME - change to BTreeIndex
+        index = new BTreeIndex(table, index_name, column_names, is_unique);
+    }
+    try {
+        index->open();
+    } catch (DbException &e) {
+        // not created yet (we must be in the middle of CREATE INDEX)
     }
     Indices::index_cache[cache_key] = index;
+    table.attach_index(index);
     return *index;
 }
 
 IndexNames Indices::get_index_names(Identifier table_name) {
-    IndexNames ret;
-    ValueDict where;
-    where["table_name"] = Value(table_name);
-    where["seq_in_index"] = Value(1);  // only get the row for the first column if composite index
-    Handles *handles = select(&where);
-    for (auto const &handle: *handles) {
-        ValueDict *row = project(handle);
-        ret.push_back((*row)["index_name"].s);
-        delete row;
+    if (!Catalog::indices_loaded)
+        Catalog::load_indices(this);
+    return Catalog::get_indices(table_name).index_names;
+}
+
+
+/*
+ * *******************************
+ * Statistics class implementation
+ * *******************************
+ */
+const Identifier Statistics::TABLE_NAME = "_statistics";
+
+// get the column names for _statistics columns
+ColumnNames &Statistics::COLUMN_NAMES() {
+    static ColumnNames cn;
+    if (cn.empty()) {
+        cn.push_back("table_name");
+        cn.push_back("column_name");
+        cn.push_back("row_count");
+        cn.push_back("block_count");
+        cn.push_back("distinct_count");
+        cn.push_back("min_value");
+        cn.push_back("max_value");
+        cn.push_back("histogram");
+    }
+    return cn;
+}
+
+// get the column attributes for _statistics columns
+ColumnAttributes &Statistics::COLUMN_ATTRIBUTES() {
+    static ColumnAttributes cas;
+    if (cas.empty()) {
+        ColumnAttribute ca(ColumnAttribute::TEXT);
+        cas.push_back(ca);  // table_name
+        cas.push_back(ca);  // column_name
+        ca.set_data_type(ColumnAttribute::INT);
+        cas.push_back(ca);  // row_count
+        cas.push_back(ca);  // block_count
+        cas.push_back(ca);  // distinct_count
+        ca.set_data_type(ColumnAttribute::TEXT);
+        cas.push_back(ca);  // min_value
+        cas.push_back(ca);  // max_value
+        cas.push_back(ca);  // histogram
     }
+    return cas;
+}
+
+// ctor - we have a fixed table structure (the first one constructed is the one get_table() hands out)
+Statistics::Statistics() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES()) {
+    if (Tables::table_cache.find(TABLE_NAME) == Tables::table_cache.end())
+        Tables::table_cache[TABLE_NAME] = this;
+}
+
+// dtor - don't leave ourselves behind in the table cache
+Statistics::~Statistics() {
+    if (Tables::table_cache.find(TABLE_NAME) != Tables::table_cache.end() &&
+        Tables::table_cache[TABLE_NAME] == this)
+        Tables::table_cache.erase(TABLE_NAME);
+}
+
+void Statistics::create() {
+    HeapTable::create();
+    if (Catalog::has_table(TABLE_NAME))
+        return;
+    DbRelation &tables = Tables::get_table(Tables::TABLE_NAME);
+    DbRelation &columns = Tables::get_table(Columns::TABLE_NAME);
+    ValueDict row;
+    row["table_name"] = Value(TABLE_NAME);
+    tables.insert(&row);
+    for (uint i = 0; i < COLUMN_NAMES().size(); i++) {
+        row["column_name"] = Value(COLUMN_NAMES()[i]);
+        row["data_type"] = Value(COLUMN_ATTRIBUTES()[i].get_data_type() == ColumnAttribute::INT ? "INT" : "TEXT");
+        columns.insert(&row);
+    }
+}
+
+// One row per column, in the table's column order.
+void Statistics::put(Identifier table_name, const TableStatistics &statistics) {
+    remove(table_name);
+    CatalogStatistics &table_statistics = Catalog::statistics[table_name];
+    table_statistics.statistics = statistics;
+    ValueDict row;
+    row["table_name"] = Value(table_name);
+    row["row_count"] = Value((int32_t) std::min(statistics.row_count, (u_long) INT32_MAX));
+    row["block_count"] = Value((int32_t) std::min(statistics.block_count, (u_long) INT32_MAX));
+    for (auto const &column_name: Catalog::get_columns(table_name).column_names) {
+        const ColumnStatistics *column = statistics.get_column(column_name);
+        if (column == nullptr)
+            continue;
+        bool empty = column->histogram.empty();
+        row["column_name"] = Value(column_name);
+        row["distinct_count"] = Value((int32_t) std::min(column->distinct_count, (u_long) INT32_MAX));
+        row["min_value"] = Value(empty ? "" : to_text(column->min));
+        row["max_value"] = Value(empty ? "" : to_text(column->max));
+        row["histogram"] = Value(histogram_to_text(column->histogram));
+        table_statistics.handles.push_back(HeapTable::insert(&row));
+    }
+    Catalog::version++;
+}
+
+void Statistics::remove(Identifier table_name) {
+    if (!Catalog::statistics_loaded)
+        Catalog::load_statistics(this);
+    auto found = Catalog::statistics.find(table_name);
+    if (found == Catalog::statistics.end())
+        return;
+    HeapTable::del_batch(found->second.handles);
+    Catalog::statistics.erase(found);
+    Catalog::version++;
+}
+
+std::string Statistics::to_text(const Value &value) {
+    return value.data_type == ColumnAttribute::TEXT ? value.s : std::to_string(value.n);
+}
+
+Value Statistics::from_text(const std::string &text, ColumnAttribute::DataType data_type) {
+    if (data_type == ColumnAttribute::TEXT)
+        return Value(text);
+    Value value((int32_t) std::stol(text));
+    value.data_type = data_type;
+    return value;
+}
+
+std::string Statistics::histogram_to_text(const ValueRow &histogram) {
+    std::string text;
+    for (auto const &bound: histogram) {
+        std::string bound_text = to_text(bound);
+        if (!text.empty())
+            text += " ";
+        text += std::to_string(bound_text.length()) + ":" + bound_text;
+    }
+    return text;
+}
+
+ValueRow Statistics::histogram_from_text(const std::string &text, ColumnAttribute::DataType data_type) {
+    ValueRow histogram;
+    size_t at = 0;
+    while (at < text.length()) {
+        size_t colon = text.find(':', at);
+        if (colon == std::string::npos)
+            throw DbRelationError("bad histogram in " + TABLE_NAME);
+        size_t length = std::stoul(text.substr(at, colon - at));
+        histogram.push_back(from_text(text.substr(colon + 1, length), data_type));
+        at = colon + 1 + length + 1;  // past the space
+    }
+    return histogram;
+}
+
+
+/**
+ * Test the Catalog: lookups, uniqueness checks, and staying in step with inserts and deletes of schema rows.
+ * Assumes initialize_schema_tables() has been called.
+ * @return true if the tests all succeeded
+ */
+bool test_catalog() {
+    Tables tables;
+    Indices indices;
+    DbRelation &columns = Tables::get_table(Columns::TABLE_NAME);
+    const Identifier table_name = "_test_catalog_cpp";
+
+    ValueDict row;
+    row["table_name"] = Value(table_name);
+    row["storage"] = Value("TAPE");
+    try {
+        tables.insert(&row);
+        return assertion_failure("catalog unknown storage");
+    } catch (DbRelationError &e) {
+        // expected
+    }
+    row["storage"] = Value(Tables::MMAP);
+    uint64_t version = Catalog::get_version();
+    Handle table_handle = tables.insert(&row);
+    if (!Catalog::has_table(table_name) || Catalog::get_version() == version)
+        return assertion_failure("catalog add table");
+    try {
+        tables.insert(&row);
+        return assertion_failure("catalog duplicate table");
+    } catch (DbRelationError &e) {
+        // expected
+    }
+    row.erase("storage");
+    row["column_name"] = Value("a");
+    row["data_type"] = Value("INT");
+    columns.insert(&row);
+    row["column_name"] = Value("b");
+    row["data_type"] = Value("TEXT");
+    columns.insert(&row);
+    try {
+        columns.insert(&row);
+        return assertion_failure("catalog duplicate column");
+    } catch (DbRelationError &e) {
+        // expected
+    }
+    row.clear();
+    row["table_name"] = Value(table_name);
+    row["index_name"] = Value("ab");
+    row["index_type"] = Value("BTREE");
+    row["is_unique"] = Value(true);
+    row["seq_in_index"] = Value(1);
+    row["column_name"] = Value("b");
+    indices.insert(&row);
+    row["seq_in_index"] = Value(2);
+    row["column_name"] = Value("a");
+    indices.insert(&row);
+    try {
+        indices.insert(&row);
+        return assertion_failure("catalog duplicate index column");
+    } catch (DbRelationError &e) {
+        // expected
+    }
+
+    // the same whether served from what we've kept in step, read in afresh, or loaded from the snapshot
+    for (uint pass = 0; pass < 3; pass++) {
+        ColumnNames column_names;
+        ColumnAttributes column_attributes;
+        Tables::get_columns(table_name, column_names, column_attributes);
+        if (column_names.size() != 2 || column_names[1] != "b" ||
+            column_attributes[0].get_data_type() != ColumnAttribute::INT)
+            return assertion_failure("catalog get_columns", pass);
+        IndexNames index_names = indices.get_index_names(table_name);
+        ColumnNames key_columns;
+        bool is_hash = true, is_unique = false;
+        indices.get_columns(table_name, "ab", key_columns, is_hash, is_unique);
+        if (index_names.size() != 1 || key_columns.size() != 2 || key_columns[0] != "b" || is_hash || !is_unique)
+            return assertion_failure("catalog index", pass);
+        if (!Catalog::is_memory_mapped(table_name) || Catalog::is_memory_mapped(Columns::TABLE_NAME))
+            return assertion_failure("catalog storage", pass);
+        if (pass == 1 && !Catalog::save_snapshot())
+            return assertion_failure("catalog save snapshot");
+        Catalog::reset();
+        if (pass == 1 && !Catalog::load_snapshot())
+            return assertion_failure("catalog load snapshot");
+    }
+
+    // not if the schema tables have been stamped with another version since
+    Catalog::reset();
+    if (!Catalog::stamp_schema() || Catalog::load_snapshot())
+        return assertion_failure("catalog snapshot of another version");
+    if (Catalog::get_columns(table_name).column_names.size() != 2)
+        return assertion_failure("catalog read back after stale snapshot");
+
+    // get_table builds the table in the storage its _tables row asks for
+    const char *home;
+    _DB_ENV->get_home(&home);
+    struct stat file_stat;
+    DbRelation &table = Tables::get_table(table_name);
+    table.create();
+    row.clear();
+    row["a"] = Value(12);
+    row["b"] = Value("twelve");
+    table.insert(&row);
+    bool mapped = stat((std::string(home) + "/" + table_name + ".mmap").c_str(), &file_stat) == 0;
+    Handles *handles = table.select();
+    u_long n = handles->size();
     delete handles;
-    return ret;
+    table.drop();
+    if (!mapped || n != 1)
+        return assertion_failure("catalog memory-mapped table");
+
+    for (auto const &handle: Handles(Catalog::get_index(table_name, "ab")->handles))
+        indices.del(handle);
+    for (auto const &handle: Handles(Catalog::get_columns(table_name).handles))
+        columns.del(handle);
+    tables.del(table_handle);
+    if (Catalog::has_table(table_name) || !Catalog::get_columns(table_name).column_names.empty() ||
+        !indices.get_index_names(table_name).empty())
+        return assertion_failure("catalog del");
+    return true;
+}
+
+/**
+ * Benchmark schema lookups, DDL and startup against a big catalog: add rows to _tables and _columns for n_tables
+ * tables (without making the tables themselves), then time getting the catalog ready as at startup, both by reading
+ * the schema tables and from the snapshot, and look up each table's columns. For comparison, also time the lookup
+ * the catalog replaces, a select on _columns for the table's rows.
+ * Assumes initialize_schema_tables() has been called.
+ * @param n_tables  how many tables to add
+ */
+void benchmark_catalog(uint n_tables) {
+    Tables tables;
+    Indices indices;
+    DbRelation &columns = Tables::get_table(Columns::TABLE_NAME);
+    const uint COLUMNS_PER_TABLE = 5;
+    Handles table_handles;
+
+    auto start = std::chrono::steady_clock::now();
+    ValueDict row;
+    row["data_type"] = Value("INT");
+    for (uint i = 0; i < n_tables; i++) {
+        row["table_name"] = Value("_benchmark_catalog_" + std::to_string(i));
+        table_handles.push_back(tables.insert(&row));
+        for (uint c = 0; c < COLUMNS_PER_TABLE; c++) {
+            row["column_name"] = Value("c" + std::to_string(c));
+            columns.insert(&row);
+        }
+    }
+    double ddl_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // the DDL left no snapshot, so this reads the schema tables (and writes a snapshot)
+    Catalog::reset();
+    start = std::chrono::steady_clock::now();
+    Catalog::open(tables, columns, indices);
+    double scan_open_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    Catalog::reset();
+    start = std::chrono::steady_clock::now();
+    Catalog::open(tables, columns, indices);
+    double snapshot_open_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    uint found = 0;
+    for (uint i = 0; i < n_tables; i++) {
+        ColumnNames column_names;
+        ColumnAttributes column_attributes;
+        Tables::get_columns("_benchmark_catalog_" + std::to_string(i), column_names, column_attributes);
+        found += column_names.size();
+    }
+    double lookup_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    const uint SCANS = 20;
+    start = std::chrono::steady_clock::now();
+    ValueDict where;
+    for (uint i = 0; i < SCANS; i++) {
+        where["table_name"] = Value("_benchmark_catalog_" + std::to_string(i * n_tables / SCANS));
+        Handles *handles = columns.select(&where);
+        found += handles->size();
+        delete handles;
+    }
+    double scan_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "catalog with " << n_tables << " extra tables: DDL " << ddl_ms * 1000 / n_tables
+              << " us per table; startup from schema tables " << scan_open_ms << " ms, from snapshot "
+              << snapshot_open_ms << " ms; get_columns " << lookup_ms * 1000 / n_tables
+              << " us each, select on _columns " << scan_ms * 1000 / SCANS << " us each (" << found << " found)"
+              << std::endl;
+
+    for (uint i = 0; i < n_tables; i++) {
+        for (auto const &handle: Handles(Catalog::get_columns("_benchmark_catalog_" + std::to_string(i)).handles))
+            columns.del(handle);
+        tables.del(table_handles[i]);
+    }
+    Catalog::save_snapshot();
 }
@@ -2,12 +2,19 @@
  * @file schema_tables.h - schema table classes:
  * 		Columns
  * 		Tables
+ * 		Indices
+ * 		Statistics
  * @author Kevin Lundeen
  * @see "Seattle University, CPSC5300, Spring 2021"
  */
 #pragma once
 
+#include <unordered_map>
+#include <unordered_set>
 #include "heap_storage.h"
+#include "BTreeIndex.h"
+#include "HashIndex.h"
+#include "CostModel.h"
 
 /**
  * Initialize access to the schema tables.
@@ -19,10 +26,232 @@ void initialize_schema_tables();
 
 class Columns; // forward declare
 
+typedef ColumnNames IndexNames;
+
+/**
+ * @class CatalogColumns - a table's columns as recorded in _columns
+ */
+class CatalogColumns {
+public:
+    ColumnNames column_names;
+    ColumnAttributes column_attributes;
+    Handles handles;  // the _columns rows, in column order
+};
+
+/**
+ * @class CatalogIndex - an index as recorded in _indices
+ */
+class CatalogIndex {
+public:
+    CatalogIndex() : column_names(), is_hash(false), is_unique(false), handles() {}
+
+    ColumnNames column_names;  // in seq_in_index order
+    bool is_hash;
+    bool is_unique;
+    Handles handles;           // the _indices rows, one per column
+};
+
+/**
+ * @class CatalogIndices - the indices on one table as recorded in _indices
+ */
+class CatalogIndices {
+public:
+    IndexNames index_names;  // in the order they were created
+    std::unordered_map<Identifier, CatalogIndex> indices;
+};
+
+/**
+ * @class CatalogStatistics - a table's statistics as recorded in _statistics
+ */
+class CatalogStatistics {
+public:
+    TableStatistics statistics;
+    Handles handles;  // the _statistics rows, one per column
+};
+
+/**
+ * @class Catalog - in-memory copy of the schema tables, so that finding a table's columns or indices, or checking
+ * a new schema row for uniqueness, is a hash lookup rather than a scan of _tables, _columns or _indices.
+ *
+ * Each schema table is read in full the first time it's needed. After that every insert or delete of a schema
+ * row goes through Tables, Columns, Indices or Statistics, which keep the catalog in step, and each change bumps
+ * the version.
+ *
+ * At startup the whole catalog comes from a snapshot file in the database environment, with a single read,
+ * rather than from the schema tables. The snapshot is deleted by the first change to the schema after it is
+ * written, and written again after each DDL statement and at shutdown, once the schema tables have been flushed.
+ * Both the snapshot and a stamp file kept beside the schema tables hold the catalog version as of that flush, and
+ * a snapshot whose version doesn't match the stamp isn't used, so a snapshot that is used always matches the
+ * schema tables; the version also carries across runs. If there's no usable snapshot, the schema tables are read
+ * instead and a new snapshot is written. Statistics aren't in the snapshot; they are
+ * read from _statistics when the planner first asks for them.
+ */
+class Catalog {
+public:
+    /**
+     * Name of the snapshot file
+     */
+    static const char *const SNAPSHOT_NAME;
+
+    /**
+     * Name of the schema tables' version stamp file
+     */
+    static const char *const STAMP_NAME;
+
+    /**
+     * Get the catalog ready at startup, from the snapshot if there's a good one and otherwise from the schema tables.
+     * @param tables   _tables
+     * @param columns  _columns
+     * @param indices  _indices
+     */
+    static void open(DbRelation &tables, DbRelation &columns, DbRelation &indices);
+
+    /**
+     * Write the snapshot if there isn't a current one already, flushing the schema tables and stamping them with
+     * the version first.
+     * @returns  true if there's a current snapshot now
+     */
+    static bool save_snapshot();
+
+    /**
+     * Record the current version in the stamp file. Only call this once the schema tables are on disk.
+     * @returns  false if the stamp couldn't be written
+     */
+    static bool stamp_schema();
+
+    /**
+     * Replace the catalog with the contents of the snapshot.
+     * @returns  false if there is no usable snapshot, or its version isn't the schema tables' stamp (and the catalog
+     *           is left empty, to be read from the schema tables)
+     */
+    static bool load_snapshot();
+
+    /**
+     * Counts changes to the schema; anything derived from the catalog can compare versions to see if it's stale.
+     */
+    static uint64_t get_version() { return Catalog::version; }
+
+    /**
+     * Forget everything (it will all be read in again when next needed).
+     */
+    static void reset();
+
+    /**
+     * Is there a row for table_name in _tables?
+     * @param table_name  table to look for
+     * @param handle      if not nullptr, returned by reference: its _tables row
+     * @returns           true if there is
+     */
+    static bool has_table(Identifier table_name, Handle *handle = nullptr);
+
+    /**
+     * Is the table stored in an MmapHeapFile (its _tables row has storage MMAP)?
+     * @param table_name  table to look for
+     * @returns           true if it is
+     */
+    static bool is_memory_mapped(Identifier table_name);
+
+    /**
+     * Names of all the tables in _tables.
+     * @returns  table names, sorted
+     */
+    static IndexNames get_table_names();
+
+    /**
+     * A table's columns.
+     * @param table_name  table to look for
+     * @returns           its columns (empty if none)
+     */
+    static const CatalogColumns &get_columns(Identifier table_name);
+
+    /**
+     * The indices on a table.
+     * @param table_name  table to look for
+     * @returns           its indices (empty if none)
+     */
+    static const CatalogIndices &get_indices(Identifier table_name);
+
+    /**
+     * One index on a table.
+     * @param table_name  table it is on
+     * @param index_name  name of the index
+     * @returns           the index, or nullptr if there's no such index
+     */
+    static const CatalogIndex *get_index(Identifier table_name, Identifier index_name);
+
+    /**
+     * What the last ANALYZE of a table found.
+     * @param table_name  table to look for
+     * @returns           its statistics (the defaults, with analyzed false, if it hasn't been analyzed)
+     */
+    static const TableStatistics &get_statistics(Identifier table_name);
+
+private:
+    friend class Tables;
+    friend class Columns;
+    friend class Indices;
+    friend class Statistics;
+
+    static const uint32_t SNAPSHOT_MAGIC = 0x54414353;  // "SCAT"
+    static const uint32_t SNAPSHOT_FORMAT = 2;
+
+    static uint64_t version;
+    static bool snapshot_on_disk;
+    static bool tables_loaded;
+    static bool columns_loaded;
+    static bool indices_loaded;
+    static bool statistics_loaded;
+    static std::unordered_map<Identifier, Handle> tables;
+    static std::unordered_set<Identifier> memory_mapped_tables;
+    static std::unordered_map<Identifier, CatalogColumns> columns;
+    static std::unordered_map<Identifier, CatalogIndices> indices;
+    static std::unordered_map<Identifier, CatalogStatistics> statistics;
+
+    // read a schema table in full, through the given object or else the one that is open
+    static void load_tables(DbRelation *tables = nullptr);
+
+    static void load_columns(DbRelation *columns = nullptr);
+
+    static void load_indices(DbRelation *indices = nullptr);
+
+    static void load_statistics(DbRelation *statistics = nullptr);
+
+    static std::string snapshot_path();
+
+    static std::string stamp_path();
+
+    static bool read_stamp(uint64_t &stamp);
+
+    static bool write_file(const std::string &path, const std::string &bytes);
+
+    static void invalidate_snapshot();
+
+    static void changed();
+
+    static void cache_table(const ValueDict *row, Handle handle);
+
+    static void cache_column(const ValueDict *row, Handle handle);
+
+    static void cache_index_column(const ValueDict *row, Handle handle);
+
+    static void add_table(const ValueDict *row, Handle handle);
+
+    static void remove_table(const ValueDict *row);
+
+    static void add_column(const ValueDict *row, Handle handle);
+
+    static void remove_column(const ValueDict *row, Handle handle);
+
+    static void add_index_column(const ValueDict *row, Handle handle);
+
+    static void remove_index_column(const ValueDict *row, Handle handle);
+
+    static void cache_column_statistics(const ValueDict *row, Handle handle);
+};
+
 /**
  * @class Tables - The singleton table that stores the metadata for all other tables.
- * For now, we are not indexing anything, so a query requires sequential scan
- * of the table.
+ * Lookups are served by the Catalog rather than by scanning the schema tables.
  */
 class Tables : public HeapTable {
 public:
@@ -31,18 +260,32 @@ public:
      */
     static const Identifier TABLE_NAME;
 
+    /**
+     * Values of the storage column: the table is kept in a Berkeley DB HeapFile (the default) or an MmapHeapFile
+     */
+    static const Identifier BERKELEY_DB;
+    static const Identifier MMAP;
+
     // ctor/dtor
     Tables();
 
-    virtual ~Tables() {}
+    virtual ~Tables();
 
     // HeapTable overrides
     virtual void create();
 
     virtual Handle insert(const ValueDict *row);
 
+    virtual void insert_batch(const RowBatch &rows, Handles *handles = nullptr) {
+        DbRelation::insert_batch(rows, handles);  // one row at a time, so each goes through insert()
+    }
+
     virtual void del(Handle handle);
 
+    virtual void del_batch(const Handles &handles) {
+        DbRelation::del_batch(handles);  // one row at a time, so each goes through del()
+    }
+
     /**
      * Get the columns and their attributes for a given table.
      * @param table_name         table to get column info for
@@ -72,6 +315,10 @@ protected:
 private:
     // keep a cache of all the tables we've instantiated so far
     static std::map<Identifier, DbRelation *> table_cache;
+
+    friend class Indices;     // registers itself in table_cache
+    friend class Statistics;  // likewise
+    friend class Catalog;     // reads _tables and _columns through us
 };
 
 
@@ -95,6 +342,16 @@ public:
 
     virtual Handle insert(const ValueDict *row);
 
+    virtual void insert_batch(const RowBatch &rows, Handles *handles = nullptr) {
+        DbRelation::insert_batch(rows, handles);
+    }
+
+    virtual void del(Handle handle);
+
+    virtual void del_batch(const Handles &handles) {
+        DbRelation::del_batch(handles);
+    }
+
 protected:
     // hard-coded columns for the _columns table
     static ColumnNames &COLUMN_NAMES();
@@ -102,8 +359,10 @@ protected:
     static ColumnAttributes &COLUMN_ATTRIBUTES();
 };
 
-typedef ColumnNames IndexNames;
-
+/**
+ * @class Indices - The singleton table that stores the metadata for all indices.
+ * Each index is instantiated (and attached to its table, so it is kept up to date) when its table is.
+ */
 class Indices : public HeapTable {
 public:
     /**
@@ -114,7 +373,7 @@ public:
     // ctor/dtor
     Indices();
 
-    virtual ~Indices() {}
+    virtual ~Indices();
 
     /**
      * Get the search key for the given index.
@@ -147,8 +406,16 @@ public:
     // overrides
     virtual Handle insert(const ValueDict *row);
 
+    virtual void insert_batch(const RowBatch &rows, Handles *handles = nullptr) {
+        DbRelation::insert_batch(rows, handles);
+    }
+
     virtual void del(Handle handle);
 
+    virtual void del_batch(const Handles &handles) {
+        DbRelation::del_batch(handles);
+    }
+
 protected:
     static ColumnNames &COLUMN_NAMES();
 
@@ -157,3 +424,65 @@ protected:
 private:
     static std::map<std::pair<Identifier, Identifier>, DbIndex *> index_cache;
 };
+
+/**
+ * @class Statistics - The singleton table that stores what ANALYZE found out about each table: a row per column
+ * with its table's row and block counts, its distinct count, min, max and histogram. Values are stored as text
+ * (see to_text() and from_text()), since they may be of any of the column types.
+ */
+class Statistics : public HeapTable {
+public:
+    /**
+     * Name of the statistics table ("_statistics")
+     */
+    static const Identifier TABLE_NAME;
+
+    // ctor/dtor
+    Statistics();
+
+    virtual ~Statistics();
+
+    /**
+     * Create the file and, if this is a database from before there was a _statistics table, add its rows to
+     * _tables and _columns.
+     */
+    virtual void create();
+
+    /**
+     * Record a table's statistics, replacing any it already has.
+     * @param table_name  the table
+     * @param statistics  what ANALYZE found
+     */
+    virtual void put(Identifier table_name, const TableStatistics &statistics);
+
+    /**
+     * Forget a table's statistics (e.g., because it is being dropped).
+     * @param table_name  the table
+     */
+    virtual void remove(Identifier table_name);
+
+    /**
+     * A value as _statistics stores it.
+     */
+    static std::string to_text(const Value &value);
+
+    /**
+     * A value stored by to_text().
+     */
+    static Value from_text(const std::string &text, ColumnAttribute::DataType data_type);
+
+    /**
+     * A histogram as _statistics stores it: each bound as its length, a colon, and the bound's text.
+     */
+    static std::string histogram_to_text(const ValueRow &histogram);
+
+    static ValueRow histogram_from_text(const std::string &text, ColumnAttribute::DataType data_type);
+
+protected:
+    static ColumnNames &COLUMN_NAMES();
+
+    static ColumnAttributes &COLUMN_ATTRIBUTES();
+};
+
+bool test_catalog();
+void benchmark_catalog(uint n_tables);
@@ -3,9 +3,12 @@
  * @author Kevin Lundeen
  * @see "Seattle University, CPSC5300, Spring 2021"
  */
+#include <cctype>
 #include <cstdlib>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <strings.h>
 #include "db_cxx.h"
 #include "SQLParser.h"
 #include "ParseTreeToString.h"
@@ -15,23 +18,267 @@ using namespace std;
 using namespace hsql;
 
 /*
- * we allocate and initialize the _DB_ENV global
+ * we allocate and initialize the _DB_ENV and _BUFFER_POOL globals
  */
 void initialize_environment(char *envHome);
 
+/**
+ * Print a result and free it, also when streaming its rows fails part way (its plan may have spill tables to drop).
+ * @param result  the result (freed here)
+ */
+void print_result(QueryResult *result) {
+    try {
+        cout << *result << endl;
+    } catch (...) {
+        delete result;
+        throw;
+    }
+    delete result;
+}
+
+/**
+ * Execute a statement, printing it and its result.
+ * @param statement  the statement
+ * @param explain    just print its plan instead of running it
+ * @param analyze    with explain, run it and print what its plan actually took
+ * @param storage    for a CREATE TABLE, how to store the table
+ */
+void run(const SQLStatement *statement, bool explain = false, bool analyze = false,
+         const string &storage = Tables::BERKELEY_DB) {
+    try {
+        cout << (explain ? (analyze ? "EXPLAIN ANALYZE " : "EXPLAIN ") : "")
+             << ParseTreeToString::statement(statement) << (storage != Tables::BERKELEY_DB ? " USING " + storage : "")
+             << endl;
+        print_result(explain ? SQLExec::explain(statement, analyze) : SQLExec::execute(statement, storage));
+    } catch (SQLExecError &e) {
+        cout << "Error: " << e.what() << endl;
+    } catch (DbRelationError &e) {
+        cout << "Error: DbRelationError: " << e.what() << endl;  // while a query's rows were streaming
+    }
+}
+
+/**
+ * Parse and execute the statements of a query, printing each and its result. A query that is just one statement
+ * the plan cache has seen before (with any literals) isn't parsed again.
+ * @param query    the statements
+ * @param explain  just print each statement's plan instead of running it
+ * @param analyze  with explain, run each statement and print what its plan actually took
+ * @param storage  for a CREATE TABLE, how to store the table
+ */
+void run(const string &query, bool explain = false, bool analyze = false, const string &storage = Tables::BERKELEY_DB) {
+    const SQLStatement *cached = SQLExec::cached(query);
+    if (cached != nullptr) {
+        run(cached, explain, analyze, storage);
+        return;
+    }
+    SQLParserResult *parse = SQLParser::parseSQLString(query);
+    if (!parse->isValid()) {
+        cout << "invalid SQL: " << query << endl;
+        cout << parse->errorMsg() << endl;
+    } else {
+        for (uint i = 0; i < parse->size(); ++i)
+            run(parse->getStatement(i), explain, analyze, storage);
+    }
+    delete parse;
+}
+
+/**
+ * The parser has no COPY statement, so the shell turns COPY <table> FROM '<file>' into the equivalent IMPORT.
+ * @param query   what was typed
+ * @param import  returned by reference: the IMPORT statement
+ * @return        false if query isn't a COPY
+ */
+bool copy_as_import(const string &query, string &import) {
+    istringstream words(query);
+    string copy, table_name, from, path;
+    words >> copy >> table_name >> from;
+    getline(words >> ws, path);
+    if (strcasecmp(copy.c_str(), "copy") != 0 || strcasecmp(from.c_str(), "from") != 0 || path.length() < 2 ||
+        path.front() != '\'' || path.back() != '\'')
+        return false;
+    import = "IMPORT FROM CSV FILE " + path + " INTO " + table_name;
+    return true;
+}
+
+/**
+ * The parser has no ANALYZE or EXPLAIN either (nor PREPARE, EXECUTE and DEALLOCATE as the shell takes them), so
+ * the shell picks those words off the front of the query.
+ * @param query    what was typed
+ * @param keyword  the word to look for (in any case)
+ * @param rest     returned by reference: the rest of the query
+ * @return         false if query doesn't start with keyword
+ */
+bool leading_keyword(const string &query, const char *keyword, string &rest) {
+    istringstream words(query);
+    string word;
+    words >> word;
+    if (strcasecmp(word.c_str(), keyword) != 0)
+        return false;
+    getline(words >> ws, rest);
+    return true;
+}
+
+/**
+ * Take a trailing semicolon and white space off the end of a query.
+ */
+string trim(string query) {
+    while (!query.empty() && (query.back() == ';' || isspace(query.back())))
+        query.pop_back();
+    return query;
+}
+
+/**
+ * Nor does the parser take a storage clause on CREATE TABLE, so the shell takes a trailing USING <storage> off
+ * one (as in CREATE TABLE t (a INT) USING MMAP) and passes the storage along separately.
+ * @param query    what was typed
+ * @param sql      returned by reference: the CREATE TABLE without the clause
+ * @param storage  returned by reference: the storage (in upper case)
+ * @return         false if query isn't a CREATE TABLE ending in USING <storage>
+ */
+bool create_table_using(const string &query, string &sql, string &storage) {
+    istringstream words(query);
+    string create, table;
+    words >> create >> table;
+    if (strcasecmp(create.c_str(), "create") != 0 || strcasecmp(table.c_str(), "table") != 0)
+        return false;
+    string trimmed = trim(query);
+    size_t storage_start = trimmed.find_last_of(" \t") + 1;  // (0 if there's no space at all)
+    size_t using_end = trimmed.find_last_not_of(" \t", storage_start - 1);
+    size_t using_start = trimmed.find_last_of(" \t", using_end) + 1;
+    if (storage_start == 0 || using_end == string::npos || using_start == 0 ||
+        strcasecmp(trimmed.substr(using_start, using_end + 1 - using_start).c_str(), "using") != 0)
+        return false;
+    sql = trimmed.substr(0, using_start);
+    storage = trimmed.substr(storage_start);
+    for (char &c: storage)
+        c = (char) toupper(c);
+    return true;
+}
+
+/**
+ * ANALYZE <table>: gather the table's statistics and print the result.
+ */
+void analyze(string table_name) {
+    table_name = trim(table_name);
+    cout << "ANALYZE " << table_name << endl;
+    try {
+        print_result(SQLExec::analyze(table_name));
+    } catch (SQLExecError &e) {
+        cout << "Error: " << e.what() << endl;
+    }
+}
+
+/**
+ * PREPARE <name> AS <statement>: parse the statement, with ? for each value to be given when it is executed.
+ */
+void prepare(const string &rest) {
+    istringstream words(rest);
+    string name, as, sql;
+    words >> name >> as;
+    getline(words >> ws, sql);
+    sql = trim(sql);
+    cout << "PREPARE " << name << " AS " << sql << endl;
+    if (strcasecmp(as.c_str(), "as") != 0 || sql.empty()) {
+        cout << "Error: expected PREPARE <name> AS <statement>" << endl;
+        return;
+    }
+    try {
+        print_result(SQLExec::prepare(name, sql));
+    } catch (SQLExecError &e) {
+        cout << "Error: " << e.what() << endl;
+    }
+}
+
+/**
+ * Read the values of an EXECUTE: "(<value>, ...)", or nothing at all if there are none.
+ * @param text        what follows the statement's name
+ * @param parameters  returned by reference: the values (INT or TEXT literals)
+ * @returns           false if text isn't that
+ */
+bool parameter_list(const string &text, ValueRow &parameters) {
+    size_t pos = 0;
+    auto skip_space = [&text, &pos]() {
+        while (pos < text.length() && isspace(text[pos]))
+            pos++;
+    };
+    skip_space();
+    if (pos == text.length())
+        return true;
+    if (text[pos++] != '(')
+        return false;
+    skip_space();
+    if (pos < text.length() && text[pos] == ')')
+        return pos + 1 == text.length();
+    while (true) {
+        Value value;
+        if (!PlanCache::scan_literal(text, pos, value))
+            return false;
+        parameters.push_back(value);
+        skip_space();
+        if (pos < text.length() && text[pos] == ')')
+            return pos + 1 == text.length();
+        if (pos == text.length() || text[pos++] != ',')
+            return false;
+        skip_space();
+    }
+}
+
+/**
+ * EXECUTE <name>(<value>, ...): run a prepared statement, the values taking the places of its placeholders in
+ * order.
+ */
+void execute(string rest) {
+    rest = trim(rest);
+    cout << "EXECUTE " << rest << endl;
+    size_t length = 0;
+    while (length < rest.length() && (isalnum(rest[length]) || rest[length] == '_'))
+        length++;
+    Identifier name = rest.substr(0, length);
+    ValueRow parameters;
+    if (name.empty() || !parameter_list(rest.substr(length), parameters)) {
+        cout << "Error: expected EXECUTE <name>(<value>, ...)" << endl;
+        return;
+    }
+    try {
+        print_result(SQLExec::execute_prepared(name, parameters));
+    } catch (SQLExecError &e) {
+        cout << "Error: " << e.what() << endl;
+    } catch (DbRelationError &e) {
+        cout << "Error: DbRelationError: " << e.what() << endl;
+    }
+}
+
+/**
+ * DEALLOCATE <name>: forget a prepared statement.
+ */
+void deallocate(string name) {
+    name = trim(name);
+    cout << "DEALLOCATE " << name << endl;
+    try {
+        print_result(SQLExec::deallocate(name));
+    } catch (SQLExecError &e) {
+        cout << "Error: " << e.what() << endl;
+    }
+}
 
 /**
  * Main entry point of the sql5300 program
  * @args dbenvpath  the path to the BerkeleyDB database environment
+ * @args --load table file.csv  (optional) just bulk load the file into the table and exit
  */
 int main(int argc, char *argv[]) {
 
     // Open/create the db environment
-    if (argc != 2) {
-        cerr << "Usage: cpsc5300: dbenvpath" << endl;
+    if (argc != 2 && !(argc == 5 && string(argv[2]) == "--load")) {
+        cerr << "Usage: cpsc5300: dbenvpath [--load table file.csv]" << endl;
         return EXIT_FAILURE;
     }
     initialize_environment(argv[1]);
+    if (argc == 5) {
+        run(string("IMPORT FROM CSV FILE '") + argv[4] + "' INTO " + argv[3]);
+        _BUFFER_POOL->flush_all();
+        return EXIT_SUCCESS;
+    }
 
     // Enter the SQL shell loop
     while (true) {
@@ -40,37 +287,69 @@ int main(int argc, char *argv[]) {
         getline(cin, query);
         if (query.length() == 0)
             continue;  // blank line -- just skip
-        if (query == "quit")
+        if (query == "quit") {
+            _BUFFER_POOL->flush_all();
+            Catalog::save_snapshot();  // after the flush, so it never describes schema tables still in memory
             break;  // only way to get out
+        }
         if (query == "test") {
             cout << "test_heap_storage: " << (test_heap_storage() ? "ok" : "failed") << endl;
+            cout << "test_csv_reader: " << (test_csv_reader() ? "ok" : "failed") << endl;
+            cout << "test_predicate: " << (test_predicate() ? "ok" : "failed") << endl;
+            cout << "test_external_sort: " << (test_external_sort() ? "ok" : "failed") << endl;
+            cout << "test_btree: " << (test_btree() ? "ok" : "failed") << endl;
+            cout << "test_hash_index: " << (test_hash_index() ? "ok" : "failed") << endl;
+            cout << "test_catalog: " << (test_catalog() ? "ok" : "failed") << endl;
+            cout << "test_query_plan: " << (test_query_plan() ? "ok" : "failed") << endl;
+            cout << "test_cost_model: " << (test_cost_model() ? "ok" : "failed") << endl;
+            cout << "test_plan_cache: " << (test_plan_cache() ? "ok" : "failed") << endl;
+            continue;
+        }
+        if (query == "benchmark") {
+            benchmark_slotted_page();
+            benchmark_heap_storage(100000, 1000000);
+            benchmark_heap_scan(200000);
+            benchmark_project(200000);
+            benchmark_insert(1000000);
+            benchmark_delete(1000000);
+            benchmark_load_csv(1000000);
+            benchmark_btree(200000);
+            benchmark_hash_index(200000);
+            benchmark_catalog(10000);
+            benchmark_query_plan(200000);
+            benchmark_plan_cache(100000);
+            continue;
+        }
+        if (query == "stats") {
+            cout << *_BUFFER_POOL << endl;
             continue;
         }
 
         // parse and execute
-        SQLParserResult *parse = SQLParser::parseSQLString(query);
-        if (!parse->isValid()) {
-            cout << "invalid SQL: " << query << endl;
-            cout << parse->errorMsg() << endl;
-        } else {
-            for (uint i = 0; i < parse->size(); ++i) {
-                const SQLStatement *statement = parse->getStatement(i);
-                try {
-                    cout << ParseTreeToString::statement(statement) << endl;
-                    QueryResult *result = SQLExec::execute(statement);
-                    cout << *result << endl;
-                    delete result;
-                } catch (SQLExecError &e) {
-                    cout << "Error: " << e.what() << endl;
-                }
-            }
-        }
-        delete parse;
+        string import, rest, statement, storage;
+        if (create_table_using(query, statement, storage))
+            run(statement, false, false, storage);
+        else if (leading_keyword(query, "analyze", rest))
+            analyze(rest);
+        else if (leading_keyword(query, "prepare", rest))
+            prepare(rest);
+        else if (leading_keyword(query, "execute", rest))
+            execute(rest);
+        else if (leading_keyword(query, "deallocate", rest))
+            deallocate(rest);
+        else if (leading_keyword(query, "explain", rest))
+            if (leading_keyword(rest, "analyze", statement))
+                run(statement, true, true);
+            else
+                run(rest, true);
+        else
+            run(copy_as_import(query, import) ? import : query);
     }
     return EXIT_SUCCESS;
 }
 
 DbEnv *_DB_ENV;
+BufferPool *_BUFFER_POOL;
 
 void initialize_environment(char *envHome) {
     cout << "(sql5300: running with database environment at " << envHome << ")" << endl;
@@ -85,5 +364,6 @@ void initialize_environment(char *envHome) {
         exit(1);
     }
     _DB_ENV = env;
+    _BUFFER_POOL = new BufferPool();
     initialize_schema_tables();
 }
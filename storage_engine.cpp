@@ -5,6 +5,8 @@
  */
 #include "storage_engine.h"
 
+StorageCounters _STORAGE_COUNTERS;
+
 bool Value::operator==(const Value &other) const {
     if (this->data_type != other.data_type)
         return false;
@@ -17,6 +19,15 @@ bool Value::operator!=(const Value &other) const {
     return !(*this == other);
 }
 
+// Orders INTs and BOOLEANs by number and TEXTs by string; values of different types are ordered by type.
+bool Value::operator<(const Value &other) const {
+    if (this->data_type != other.data_type)
+        return this->data_type < other.data_type;
+    if (this->data_type == ColumnAttribute::TEXT)
+        return this->s < other.s;
+    return this->n < other.n;
+}
+
 // Just pulls out the column names from a ValueDict and passes that to the usual form of project().
 ValueDict *DbRelation::project(Handle handle, const ValueDict *where) {
     ColumnNames t;
@@ -24,3 +35,44 @@ ValueDict *DbRelation::project(Handle handle, const ValueDict *where) {
         t.push_back(column.first);
     return this->project(handle, &t);
 }
+
+// One insert() per row, taking back the ones already done if one fails.
+void DbRelation::insert_batch(const RowBatch &rows, Handles *handles) {
+    Handles added;
+    ValueDict row;
+    try {
+        for (uint i = 0; i < rows.size(); i++) {
+            if (rows[i].size() != this->column_names.size())
+                throw DbRelationError("don't know how to handle NULLs, defaults, etc. yet");
+            for (uint col_num = 0; col_num < this->column_names.size(); col_num++)
+                row[this->column_names[col_num]] = rows[i][col_num];
+            added.push_back(this->insert(&row));
+        }
+    } catch (DbRelationError &e) {
+        for (auto const &handle: added)
+            this->del(handle);
+        throw;
+    }
+    if (handles != nullptr)
+        handles->insert(handles->end(), added.begin(), added.end());
+}
+
+// One del() per row.
+void DbRelation::del_batch(const Handles &handles) {
+    for (auto const &handle: handles)
+        this->del(handle);
+}
+
+// Positions of the given columns within column_names.
+void DbRelation::get_column_numbers(const ColumnNames *column_names, ColumnNumbers &column_numbers) const {
+    column_numbers.clear();
+    column_numbers.reserve(column_names->size());
+    for (auto const &column_name: *column_names) {
+        uint col_num = 0;
+        while (col_num < this->column_names.size() && this->column_names[col_num] != column_name)
+            col_num++;
+        if (col_num == this->column_names.size())
+            throw DbRelationError("table does not have column named '" + column_name + "'");
+        column_numbers.push_back(col_num);
+    }
+}
@@ -10,6 +10,7 @@
 #pragma once
 
 #include <exception>
+#include <iosfwd>
 #include <map>
 #include <utility>
 #include <vector>
@@ -28,6 +29,30 @@ typedef u_int32_t BlockID;
 typedef std::vector<RecordID> RecordIDs;
 typedef std::length_error DbBlockNoRoomError;
 
+/**
+ * @class DbCursor - forward-only stream of items (block ids, record ids, handles) produced one at a time
+ * so that a scan never has to hold a list of everything it will visit.
+ *
+ * Usage:
+ *      T item;
+ *      while (cursor->next(item))
+ *          ...
+ */
+template<typename T>
+class DbCursor {
+public:
+    virtual ~DbCursor() {}
+
+    /**
+     * Advance to the next item.
+     * @param item  set to the next item (only if there is one)
+     * @returns     false once the cursor is exhausted
+     */
+    virtual bool next(T &item) = 0;
+};
+
+typedef DbCursor<RecordID> RecordIDCursor;
+
 /**
  * @class DbBlock - abstract base class for blocks in our database files 
  * (DbBlock's belong to DbFile's.)
@@ -38,6 +63,7 @@ typedef std::length_error DbBlockNoRoomError;
  * 	put(record_id, data)
  * 	del(record_id)
  * 	ids()
+ * 	id_cursor()
  * Accessors:
  * 	get_block()
  * 	get_data()
@@ -93,6 +119,13 @@ public:
      */
     virtual RecordIDs *ids() const = 0;
 
+    /**
+     * Stream all the record ids in this block (excluding deleted ones).
+     * The cursor is only good while this block object exists.
+     * @returns  cursor over the record ids (freed by caller)
+     */
+    virtual RecordIDCursor *id_cursor() const = 0;
+
     /**
      * Access the whole block's memory as a BerkeleyDB Dbt pointer.
      * @returns  Dbt used by this block
@@ -116,8 +149,9 @@ protected:
     BlockID block_id;
 };
 
-// convenience type alias
-typedef std::vector<BlockID> BlockIDs;  // FIXME: will need to turn this into an iterator at some point
+// convenience type aliases
+typedef std::vector<BlockID> BlockIDs;
+typedef DbCursor<BlockID> BlockIDCursor;
 
 /**
  * @class DbFile - abstract base class which represents a disk-based collection of DbBlocks
@@ -129,6 +163,7 @@ typedef std::vector<BlockID> BlockIDs;  // FIXME: will need to turn this into an
  *	get(block_id)
  *	put(block)
  *	block_ids()
+ *	block_cursor()
  */
 class DbFile {
 public:
@@ -178,11 +213,17 @@ public:
 
     /**
      * Get a list of all the valid BlockID's in the file
-     * FIXME - not a good long-term approach, but we'll do this until we put in iterators
+     * (prefer block_cursor() for scans, which doesn't materialize the list)
      * @returns  a pointer to vector of BlockIDs (freed by caller)
      */
     virtual BlockIDs *block_ids() const = 0;
 
+    /**
+     * Stream all the valid BlockID's in the file.
+     * @returns  cursor over the block ids (freed by caller)
+     */
+    virtual BlockIDCursor *block_cursor() const = 0;
+
 protected:
     std::string name;  // filename (or part of it)
 };
@@ -203,7 +244,7 @@ public:
 
     virtual ~ColumnAttribute() {}
 
-    virtual DataType get_data_type() { return data_type; }
+    virtual DataType get_data_type() const { return data_type; }
 
     virtual void set_data_type(DataType data_type) { this->data_type = data_type; }
 
@@ -230,6 +271,8 @@ public:
     bool operator==(const Value &other) const;
 
     bool operator!=(const Value &other) const;
+
+    bool operator<(const Value &other) const;
 };
 
 // More type aliases
@@ -237,10 +280,143 @@ typedef std::string Identifier;
 typedef std::vector<Identifier> ColumnNames;
 typedef std::vector<ColumnAttribute> ColumnAttributes;
 typedef std::pair<BlockID, RecordID> Handle;
-typedef std::vector<Handle> Handles;  // FIXME: will need to turn this into an iterator at some point
+typedef std::vector<Handle> Handles;
+typedef DbCursor<Handle> HandleCursor;
 typedef std::map<Identifier, Value> ValueDict;
 typedef std::vector<ValueDict *> ValueDicts;
+typedef std::vector<Value> ValueRow;          // values in the order of some list of column names
+typedef std::vector<ValueRow *> ValueRows;
+typedef std::vector<uint> ColumnNumbers;      // positions within a relation's column_names
+
+/**
+ * @class RowBatch - a batch of rows (each with its handle) handed along in one go, so that streaming rows from
+ * a relation, or from one query operator to the next, costs one call per batch rather than one per row
+ *
+ *      The rows are kept when the batch is cleared, so refilling it reuses their vectors and strings instead of
+ *      allocating new ones.
+ *
+ * Usage:
+ *      batch.clear();
+ *      while (!batch.full() && ...) {
+ *          ValueRow &row = batch.add(handle);
+ *          ... set row's values ...
+ *      }
+ *      for (uint i = 0; i < batch.size(); i++)
+ *          ... batch[i] ...
+ */
+class RowBatch {
+public:
+    /**
+     * Most rows in a batch
+     */
+    static const uint CAPACITY = 1024;
+
+    RowBatch() : rows(CAPACITY), handles(CAPACITY), count(0) {}
+
+    virtual ~RowBatch() {}
+
+    RowBatch(const RowBatch &other) = delete;
+
+    RowBatch(RowBatch &&temp) = delete;
+
+    RowBatch &operator=(const RowBatch &other) = delete;
+
+    RowBatch &operator=(RowBatch &&temp) = delete;
 
+    /**
+     * Add a row to the end of the batch (must not be full).
+     * @param handle  where the row came from (if anywhere)
+     * @returns       the new row, holding whatever the last row in its position held
+     */
+    ValueRow &add(Handle handle = Handle(0, 0)) {
+        this->handles[this->count] = handle;
+        return this->rows[this->count++];
+    }
+
+    /**
+     * Move row from to position to (to <= from), for dropping rows while walking the batch.
+     */
+    void move(uint from, uint to) {
+        if (from != to) {
+            this->rows[to].swap(this->rows[from]);
+            this->handles[to] = this->handles[from];
+        }
+    }
+
+    /**
+     * Keep only the first size rows.
+     */
+    void truncate(uint size) {
+        if (size < this->count)
+            this->count = size;
+    }
+
+    void clear() { this->count = 0; }
+
+    uint size() const { return count; }
+
+    bool empty() const { return count == 0; }
+
+    bool full() const { return count == CAPACITY; }
+
+    ValueRow &operator[](uint i) { return rows[i]; }
+
+    const ValueRow &operator[](uint i) const { return rows[i]; }
+
+    Handle get_handle(uint i) const { return handles[i]; }
+
+protected:
+    std::vector<ValueRow> rows;
+    std::vector<Handle> handles;
+    uint count;
+};
+
+/**
+ * Cursor over batches of rows. next(batch) refills the batch with at least one row, or returns false.
+ */
+typedef DbCursor<RowBatch> RowBatchCursor;
+
+
+class DbIndex; // forward declare
+class CsvReader; // forward declare
+class Predicate; // forward declare
+
+/**
+ * @class StorageCounters - running totals of the storage work done since the program started: blocks gotten from
+ *                          and put back into heap files (including those of indices and temporary tables), and
+ *                          bytes of records marshaled and unmarshaled. EXPLAIN ANALYZE charges each query operator
+ *                          with how much they go up while it runs.
+ */
+class StorageCounters {
+public:
+    StorageCounters() : block_reads(0), block_writes(0), bytes_marshaled(0), bytes_unmarshaled(0) {}
+
+    u_long block_reads;
+    u_long block_writes;
+    u_long bytes_marshaled;
+    u_long bytes_unmarshaled;
+
+    StorageCounters &operator+=(const StorageCounters &other) {
+        this->block_reads += other.block_reads;
+        this->block_writes += other.block_writes;
+        this->bytes_marshaled += other.bytes_marshaled;
+        this->bytes_unmarshaled += other.bytes_unmarshaled;
+        return *this;
+    }
+
+    StorageCounters &operator-=(const StorageCounters &other) {
+        this->block_reads -= other.block_reads;
+        this->block_writes -= other.block_writes;
+        this->bytes_marshaled -= other.bytes_marshaled;
+        this->bytes_unmarshaled -= other.bytes_unmarshaled;
+        return *this;
+    }
+};
+
+/**
+ * Global variable holding the storage engine's counters.
+ */
+extern StorageCounters _STORAGE_COUNTERS;
 
 /**
  * @class DbRelationError - generic exception class for DbRelation
@@ -263,12 +439,24 @@ public:
  * 	close()
  * 	
  *	insert(row)
+ *	insert_batch(rows)
+ *	load_csv(reader, progress)
  *	update(handle, new_values)
  *	del(handle)
+ *	del_batch(handles)
  *	select()
  *	select(where)
+ *	select_cursor(where)
+ *	batch_cursor(column_numbers, where)
+ *	batch_cursor(column_numbers, where, handles, predicate)
+ *	sample_cursor(column_numbers, n_blocks, block_count)
  *	project(handle)
  *	project(handle, column_names)
+ *	project_row(handle)
+ *	project_row(handle, column_numbers)
+ *
+ *	attach_index(index)
+ *	detach_index(index)
  */
 class DbRelation {
 public:
@@ -314,6 +502,26 @@ public:
      */
     virtual Handle insert(const ValueDict *row) = 0;
 
+    /**
+     * Execute: INSERT INTO <table_name> VALUES ( <row_values> ), ( <row_values> ), ...
+     * If any row can't be inserted, none of them are. This default just calls insert() for each row.
+     * @param rows     full rows, positionally matching get_column_names()
+     * @param handles  if not nullptr, the new rows' handles are added to it, in order
+     */
+    virtual void insert_batch(const RowBatch &rows, Handles *handles = nullptr);
+
+    /**
+     * Execute: COPY <table_name> FROM '<file>'
+     * Appends a row for each line of a CSV file, its fields positionally matching get_column_names(). If any line
+     * can't be loaded, none of them are.
+     * @param reader    the file
+     * @param progress  if not nullptr, where to report progress on long loads
+     * @returns         how many rows were loaded
+     */
+    virtual u_long load_csv(CsvReader &reader, std::ostream *progress = nullptr) {
+        throw DbRelationError("bulk load not supported");
+    }
+
     /**
      * Conceptually, execute: UPDATE INTO <table_name> SET <new_values> WHERE <handle>
      * where handle is sufficient to identify one specific record (e.g., returned
@@ -331,6 +539,13 @@ public:
      */
     virtual void del(const Handle handle) = 0;
 
+    /**
+     * Execute: DELETE FROM <table_name> WHERE <handle> OR <handle> OR ...
+     * This default just calls del() for each row.
+     * @param handles  the rows to delete
+     */
+    virtual void del_batch(const Handles &handles);
+
     /**
      * Conceptually, execute: SELECT <handle> FROM <table_name> WHERE 1
      * @returns  a pointer to a list of handles for qualifying rows (caller frees)
@@ -344,6 +559,47 @@ public:
      */
     virtual Handles *select(const ValueDict *where) = 0;
 
+    /**
+     * Like select(where), but streams the handles of qualifying rows rather than collecting them all first.
+     * Deleting rows already returned while the cursor is still open is fine; inserting is not.
+     * @param where  where-clause predicates (nullptr for all rows)
+     * @returns      cursor over the handles (freed by caller)
+     */
+    virtual HandleCursor *select_cursor(const ValueDict *where = nullptr) = 0;
+
+    /**
+     * Like select_cursor(where) followed by project_row() of each handle, but a batch of rows at a time.
+     * @param column_numbers  which columns to project, as from get_column_numbers()
+     * @param where           where-clause predicates (nullptr for all rows)
+     * @returns               cursor over batches of the rows' values, positionally matching column_numbers
+     *                        (freed by caller)
+     */
+    virtual RowBatchCursor *batch_cursor(const ColumnNumbers *column_numbers, const ValueDict *where = nullptr) = 0;
+
+    /**
+     * Like batch_cursor(column_numbers, where), but the planner has already decided how to find the rows: either
+     * they are the given candidates (e.g., from an index lookup), which are checked against where, or, if there
+     * are none given, the whole relation is scanned without consulting any index.
+     * @param column_numbers  which columns to project, as from get_column_numbers()
+     * @param where           where-clause predicates (nullptr for all rows)
+     * @param handles         the candidate rows, in the order to read them (freed by the cursor), or nullptr
+     * @param predicate       a further condition, compiled against the relation's column numbers and checked on
+     *                        each row before any of it is unmarshaled (must outlive the cursor), or nullptr
+     * @returns               cursor over batches of the rows' values (freed by caller)
+     */
+    virtual RowBatchCursor *batch_cursor(const ColumnNumbers *column_numbers, const ValueDict *where,
+                                         Handles *handles, const Predicate *predicate = nullptr) = 0;
+
+    /**
+     * Stream the rows in a random sample of the relation's blocks, for gathering statistics (see ANALYZE).
+     * @param column_numbers  which columns to project, as from get_column_numbers()
+     * @param n_blocks        how many blocks to read (all of them if the relation has no more than that)
+     * @param block_count     returned by reference: how many blocks the relation has in all
+     * @returns               cursor over batches of the sampled rows' values (freed by caller)
+     */
+    virtual RowBatchCursor *sample_cursor(const ColumnNumbers *column_numbers, uint n_blocks,
+                                          BlockID &block_count) = 0;
+
     /**
      * Return a sequence of all values for handle (SELECT *).
      * @param handle  row to get values from
@@ -360,6 +616,22 @@ public:
      */
     virtual ValueDict *project(Handle handle, const ColumnNames *column_names) = 0;
 
+    /**
+     * Return all the values for handle in column order (SELECT *). Unlike project(), this doesn't build
+     * a dictionary, so it is the one to use for anything that touches a lot of rows.
+     * @param handle  row to get values from
+     * @returns       values from row, positionally matching get_column_names() (freed by caller)
+     */
+    virtual ValueRow *project_row(Handle handle) = 0;
+
+    /**
+     * Return the values for handle of the given columns (SELECT <column_names>).
+     * @param handle          row to get values from
+     * @param column_numbers  which columns to project, as from get_column_numbers()
+     * @returns               values from row, positionally matching column_numbers (freed by caller)
+     */
+    virtual ValueRow *project_row(Handle handle, const ColumnNumbers *column_numbers) = 0;
+
     /**
      * Return a sequence of values for handle given by column_names (from dictionary)
      * (SELECT <column_names>).
@@ -369,6 +641,14 @@ public:
      */
     virtual ValueDict *project(Handle handle, const ValueDict *column_names);
 
+    /**
+     * Accessor for table_name.
+     * @returns table_name   name of this relation
+     */
+    virtual const Identifier &get_table_name() const {
+        return table_name;
+    }
+
     /**
      * Accessor for column_names.
      * @returns column_names   list of column names for this relation, in order
@@ -377,6 +657,27 @@ public:
         return column_names;
     }
 
+    /**
+     * Keep the given index up to date from now on as rows are inserted into and deleted from this relation.
+     * Selects may also use it to find their rows.
+     * @param index  an open index on this relation (still owned by the caller)
+     */
+    virtual void attach_index(DbIndex *index) = 0;
+
+    /**
+     * Stop maintaining the given index (e.g., because it is being dropped).
+     * @param index  an index previously given to attach_index()
+     */
+    virtual void detach_index(DbIndex *index) = 0;
+
+    /**
+     * Look up the positions of the given columns.
+     * @param column_names    columns to look for
+     * @param column_numbers  returned by reference, positionally matching column_names
+     * @throws DbRelationError if we don't have one of the columns
+     */
+    virtual void get_column_numbers(const ColumnNames *column_names, ColumnNumbers &column_numbers) const;
+
     /**
      * Accessor for column_attributes.
      * @returns column_attributes dictionary of column attributes keyed by column names
@@ -458,6 +759,32 @@ public:
      */
     virtual void del(Handle record) = 0;
 
+    /**
+     * Delete the index entries for the given records. This default just calls del() for each.
+     * @param records  handles (into relation) to the records to remove
+     *                 (must still be in the relation at time of removal)
+     */
+    virtual void del_batch(const Handles &records) {
+        for (auto const &record: records)
+            del(record);
+    }
+
+    /**
+     * Accessor for key_columns.
+     * @returns  the columns of the search key, in order
+     */
+    virtual const ColumnNames &get_key_columns() const {
+        return key_columns;
+    }
+
+    /**
+     * Accessor for unique.
+     * @returns  true if no two rows may have the same search key
+     */
+    virtual bool is_unique() const {
+        return unique;
+    }
+
 protected:
     DbRelation &relation;
     Identifier name;